@@ -0,0 +1,211 @@
+//
+// Copyright (c) 2020 Carl Chen. All rights reserved.
+//
+
+#include "Arena.h"
+#include "Assert.h"
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+namespace ss {
+
+namespace {
+
+thread_local Arena* gCurrentArena = nullptr;
+
+inline uint8_t* AlignUp(uint8_t* p, size_t alignment)
+{
+    return reinterpret_cast<uint8_t*>((reinterpret_cast<uintptr_t>(p) + alignment - 1) & ~uintptr_t(alignment - 1));
+}
+
+} // namespace
+
+Arena::Scope::Scope(Arena& arena)
+    : Scope(&arena)
+{
+}
+
+Arena::Scope::Scope(Arena* arena)
+    : previous_(gCurrentArena)
+{
+    gCurrentArena = arena;
+}
+
+Arena::Scope::~Scope()
+{
+    gCurrentArena = previous_;
+}
+
+Arena::Arena(size_t blockSize)
+    : head_(nullptr)
+    , block_(nullptr)
+    , blockBegin_(nullptr)
+    , ptr_(nullptr)
+    , end_(nullptr)
+    , last_(nullptr)
+    , allocated_(0)
+    , capacity_(0)
+    , blockSize_(blockSize > sizeof(Block) ? blockSize : kDefaultBlockSize)
+{
+}
+
+Arena::Arena(void* buffer, size_t size, size_t blockSize)
+    : Arena(blockSize)
+{
+    uint8_t* begin = AlignUp(static_cast<uint8_t*>(buffer), alignof(Block));
+    if (begin + sizeof(Block) < static_cast<uint8_t*>(buffer) + size) {
+        auto* block = reinterpret_cast<Block*>(begin);
+        block->next = nullptr;
+        block->size = size_t(static_cast<uint8_t*>(buffer) + size - block->Begin());
+        block->owned = false;
+        head_ = block;
+        capacity_ = block->size;
+        Enter(block);
+    }
+}
+
+Arena::~Arena()
+{
+    Release();
+}
+
+void* Arena::Allocate(size_t size, size_t alignment)
+{
+    SSASSERT(alignment > 0 && (alignment & (alignment - 1)) == 0);
+    uint8_t* p = AlignUp(ptr_, alignment);
+    if (ptr_ == nullptr || p > end_ || size_t(end_ - p) < size) {
+        NextBlock(size, alignment);
+        p = AlignUp(ptr_, alignment);
+    }
+    ptr_ = p + size;
+    last_ = p;
+    return p;
+}
+
+void* Arena::Reallocate(void* p, size_t oldSize, size_t newSize, size_t alignment)
+{
+    if (p == nullptr) {
+        return Allocate(newSize, alignment);
+    }
+    if (p == last_ && size_t(end_ - last_) >= newSize) {
+        ptr_ = last_ + newSize;
+        return p;
+    }
+    if (newSize <= oldSize) {
+        return p;
+    }
+    void* q = Allocate(newSize, alignment);
+    memcpy(q, p, oldSize);
+    return q;
+}
+
+void Arena::Reset()
+{
+    allocated_ = 0;
+    last_ = nullptr;
+    if (head_ != nullptr) {
+        Enter(head_);
+    }
+}
+
+void Arena::Release()
+{
+    Block* block = head_;
+    head_ = nullptr;
+    capacity_ = 0;
+    while (block != nullptr) {
+        Block* next = block->next;
+        if (block->owned) {
+            free(block);
+        } else {
+            // The user buffer stays the first block
+            block->next = nullptr;
+            head_ = block;
+            capacity_ = block->size;
+        }
+        block = next;
+    }
+    allocated_ = 0;
+    last_ = nullptr;
+    block_ = nullptr;
+    blockBegin_ = ptr_ = end_ = nullptr;
+    if (head_ != nullptr) {
+        Enter(head_);
+    }
+}
+
+void Arena::NextBlock(size_t size, size_t alignment)
+{
+    size_t needed = size + alignment;
+    if (block_ != nullptr) {
+        allocated_ += size_t(ptr_ - blockBegin_);
+        // Blocks kept by `Reset`, which are too small for this allocation are skipped
+        while (block_->next != nullptr) {
+            Block* next = block_->next;
+            block_ = next;
+            if (next->size >= needed) {
+                Enter(next);
+                return;
+            }
+        }
+    }
+    size_t blockSize = blockSize_ > needed ? blockSize_ : needed;
+    auto* block = static_cast<Block*>(malloc(sizeof(Block) + blockSize));
+    if (block == nullptr) {
+        throw std::bad_alloc();
+    }
+    block->next = nullptr;
+    block->size = blockSize;
+    block->owned = true;
+    if (block_ == nullptr) {
+        head_ = block;
+    } else {
+        block_->next = block;
+    }
+    capacity_ += blockSize;
+    if (blockSize_ < kMaxBlockSize) {
+        blockSize_ *= 2;
+    }
+    Enter(block);
+}
+
+void Arena::Enter(Block* block)
+{
+    block_ = block;
+    blockBegin_ = block->Begin();
+    ptr_ = blockBegin_;
+    end_ = blockBegin_ + block->size;
+}
+
+Arena* Arena::Current()
+{
+    return gCurrentArena;
+}
+
+void* Arena::AllocateFrom(Arena* arena, size_t size)
+{
+    if (arena != nullptr) {
+        return arena->Allocate(size);
+    }
+    return malloc(size);
+}
+
+void* Arena::ReallocateFrom(Arena* arena, void* p, size_t oldSize, size_t newSize)
+{
+    if (arena != nullptr) {
+        return arena->Reallocate(p, oldSize, newSize);
+    }
+    return realloc(p, newSize);
+}
+
+void Arena::DeallocateFrom(Arena* arena, void* p, size_t size)
+{
+    if (arena != nullptr) {
+        arena->Deallocate(p, size);
+    } else {
+        free(p);
+    }
+}
+
+} // namespace ss
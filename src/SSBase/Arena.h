@@ -0,0 +1,123 @@
+//
+// Copyright (c) 2020 Carl Chen. All rights reserved.
+//
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace ss {
+
+/// Monotonic memory resource: allocations bump a pointer in a block, and nothing is freed until `Reset`, which gives
+/// all the memory back at once and keeps the blocks for the next round, e.g. the next request.
+///
+/// The storage of a `String` or a `DynamicBuffer` comes from the arena whose `Scope` is active on the thread when it is
+/// constructed (or which is passed explicitly), as do the objects of an `ObjectPool` given the arena. They keep
+/// allocating from that arena as they grow, so such objects must be gone before the arena is reset or destroyed: a
+/// `String` copied outside of the scope gets its own storage, so copy what is to be kept, or construct it in a
+/// `Scope(nullptr)`, as the library does for the strings it keeps, e.g. the interned ones.
+///
+/// NOTE: An arena is not thread safe, only the thread of its scope may allocate from it. Since deallocation does not
+/// touch the arena (see `Deallocate`), objects may still be released on other threads.
+class Arena {
+public:
+    enum : size_t {
+        kDefaultBlockSize = 4096,
+        kMaxBlockSize = 1024 * 1024,
+        kAlignment = alignof(std::max_align_t)
+    };
+
+    /// Makes `arena` the arena of the allocations of this thread, until the scope ends
+    class Scope {
+    public:
+        explicit Scope(Arena& arena);
+
+        /// nullptr suspends the arena of this thread, so objects which outlive it are allocated from the heap
+        explicit Scope(Arena* arena);
+
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+        ~Scope();
+
+    private:
+        Arena* previous_;
+    };
+
+    explicit Arena(size_t blockSize = kDefaultBlockSize);
+
+    /// Allocations are served from `buffer` first, e.g. a buffer on the stack, which the arena does not free
+    Arena(void* buffer, size_t size, size_t blockSize = kDefaultBlockSize);
+
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+
+    ~Arena();
+
+    void* Allocate(size_t size, size_t alignment = kAlignment);
+
+    /// Grows `p` in place if it is the last allocation and the block has room, otherwise copies it to a new allocation
+    void* Reallocate(void* p, size_t oldSize, size_t newSize, size_t alignment = kAlignment);
+
+    /// Nothing is given back before `Reset`, so this only exists for symmetry
+    void Deallocate(void* p, size_t size)
+    {
+        (void)p;
+        (void)size;
+    }
+
+    /// Free all the allocations in O(1), the blocks are kept for reuse
+    void Reset();
+
+    /// Free all the allocations and the blocks
+    void Release();
+
+    /// Bytes allocated since the last reset, including the alignment paddings
+    size_t Allocated() const
+    {
+        return allocated_ + size_t(ptr_ - blockBegin_);
+    }
+
+    /// Bytes of all the blocks held
+    size_t Capacity() const
+    {
+        return capacity_;
+    }
+
+    /// The arena of the allocations of this thread, nullptr if they come from the heap
+    static Arena* Current();
+
+    /// Allocate from `arena`, or from the heap with malloc if it is nullptr
+    static void* AllocateFrom(Arena* arena, size_t size);
+    static void* ReallocateFrom(Arena* arena, void* p, size_t oldSize, size_t newSize);
+    static void DeallocateFrom(Arena* arena, void* p, size_t size);
+
+private:
+    struct Block {
+        Block* next;
+        size_t size; // Of the data following this header
+        bool owned; // The user buffer is not freed
+
+        uint8_t* Begin()
+        {
+            return reinterpret_cast<uint8_t*>(this + 1);
+        }
+    };
+
+    /// Move to the next block which holds `size` bytes, allocating one if there is none
+    void NextBlock(size_t size, size_t alignment);
+
+    void Enter(Block* block);
+
+    Block* head_; // All the blocks, in the order of use
+    Block* block_; // The current block
+    uint8_t* blockBegin_;
+    uint8_t* ptr_;
+    uint8_t* end_;
+    uint8_t* last_; // The last allocation, which may grow in place
+    size_t allocated_; // By the blocks before the current one
+    size_t capacity_;
+    size_t blockSize_; // Of the next block to allocate
+};
+
+} // namespace ss
@@ -0,0 +1,223 @@
+//
+// Copyright (c) 2020 Carl Chen. All rights reserved.
+//
+
+#include "AtomicSharedPtr.h"
+#include "internal/Simd.h"
+#include <algorithm>
+#include <mutex>
+#include <new>
+#include <vector>
+
+namespace ss {
+namespace internal {
+
+namespace {
+
+constexpr uint32_t kSlotsPerRecord = 4;
+constexpr uintptr_t kCacheLineSize = 64;
+
+/// The slots of a thread, alone on a cache line, so announcing an object writes to no line shared with other threads
+struct HazardRecord {
+    HazardPointers::Slot slots[kSlotsPerRecord]; // First, the record is found from a slot by aligning its address
+    std::atomic<bool> owned;
+    HazardRecord* next; // Set before the record is published, the records are never freed
+    uint32_t used; // Bits of the slots in use, only accessed by the owner
+};
+
+static_assert(sizeof(HazardRecord) <= kCacheLineSize, "HazardRecord must fit in a cache line");
+
+struct Retired {
+    void* object;
+    void (*release)(void*);
+};
+
+struct Domain {
+    std::atomic<HazardRecord*> records { nullptr };
+    std::mutex mutex; // Of the orphans
+    std::vector<Retired> orphans; // Still announced when their thread exited
+    std::atomic<size_t> orphansCount { 0 }; // So the mutex is only locked when there are orphans, which is rare
+};
+
+/// Never destroyed, as objects may be retired until the process exits
+Domain& GetDomain()
+{
+    static auto* domain = new Domain();
+    return *domain;
+}
+
+HazardRecord* AcquireRecord()
+{
+    Domain& domain = GetDomain();
+    for (HazardRecord* r = domain.records.load(std::memory_order_acquire); r != nullptr; r = r->next) {
+        bool owned = false;
+        if (!r->owned.load(std::memory_order_relaxed) && r->owned.compare_exchange_strong(owned, true, std::memory_order_acquire)) {
+            return r;
+        }
+    }
+    // Aligned by hand, as C++14 new does not align beyond std::max_align_t
+    void* memory = ::operator new(sizeof(HazardRecord) + kCacheLineSize);
+    auto aligned = (reinterpret_cast<uintptr_t>(memory) + kCacheLineSize - 1) & ~(kCacheLineSize - 1);
+    auto* record = new (reinterpret_cast<void*>(aligned)) HazardRecord();
+    for (auto& slot : record->slots) {
+        slot.store(nullptr, std::memory_order_relaxed);
+    }
+    record->owned.store(true, std::memory_order_relaxed);
+    record->used = 0;
+    HazardRecord* head = domain.records.load(std::memory_order_relaxed);
+    do {
+        record->next = head;
+    } while (!domain.records.compare_exchange_weak(head, record, std::memory_order_release, std::memory_order_relaxed));
+    return record;
+}
+
+/// For another thread to reclaim, as this thread is exiting
+void AddOrphans(const std::vector<Retired>& retired)
+{
+    if (retired.empty()) {
+        return;
+    }
+    Domain& domain = GetDomain();
+    std::lock_guard<std::mutex> lock(domain.mutex);
+    domain.orphans.insert(domain.orphans.end(), retired.begin(), retired.end());
+    domain.orphansCount.store(domain.orphans.size(), std::memory_order_release);
+}
+
+/// Releases the objects of `retired` which no slot announces, and keeps the others
+void Reclaim(std::vector<Retired>& retired)
+{
+    Domain& domain = GetDomain();
+    if (domain.orphansCount.load(std::memory_order_acquire) != 0) {
+        std::lock_guard<std::mutex> lock(domain.mutex);
+        retired.insert(retired.end(), domain.orphans.begin(), domain.orphans.end());
+        domain.orphans.clear();
+        domain.orphansCount.store(0, std::memory_order_relaxed);
+    }
+    if (retired.empty()) {
+        return;
+    }
+    std::vector<const void*> hazards;
+    for (HazardRecord* r = domain.records.load(std::memory_order_acquire); r != nullptr; r = r->next) {
+        for (auto& slot : r->slots) {
+            // Ordered after the exchange of the writer, see `AtomicSharedPtr::Protect`
+            const void* p = slot.load(std::memory_order_seq_cst);
+            if (p != nullptr) {
+                hazards.push_back(p);
+            }
+        }
+    }
+    std::sort(hazards.begin(), hazards.end());
+    std::vector<Retired> releasing;
+    auto kept = std::partition(retired.begin(), retired.end(), [&hazards](const Retired& r) {
+        return std::binary_search(hazards.begin(), hazards.end(), r.object);
+    });
+    releasing.assign(kept, retired.end());
+    retired.erase(kept, retired.end());
+    // Releasing may retire more objects into `retired`
+    for (auto& r : releasing) {
+        r.release(r.object);
+    }
+}
+
+struct ThreadState {
+    std::vector<HazardRecord*> records; // Another record is chained once the slots of the others are all used
+    std::vector<Retired> retired;
+};
+
+ThreadState* const kDestroyedState = reinterpret_cast<ThreadState*>(uintptr_t(1));
+
+// A plain pointer, which is still readable while the thread exits, after `gThreadStateOwner` is destroyed
+thread_local ThreadState* gThreadState = nullptr;
+
+struct ThreadStateOwner {
+    ThreadState* state = nullptr;
+
+    ~ThreadStateOwner()
+    {
+        if (state != nullptr) {
+            Reclaim(state->retired);
+            AddOrphans(state->retired);
+            for (HazardRecord* record : state->records) {
+                if (record->used == 0) {
+                    record->owned.store(false, std::memory_order_release);
+                }
+            }
+            delete state;
+        }
+        gThreadState = kDestroyedState;
+    }
+};
+
+thread_local ThreadStateOwner gThreadStateOwner;
+
+/// The state of this thread, nullptr once the thread is exiting
+ThreadState* GetThreadState()
+{
+    ThreadState* state = gThreadState;
+    if (state == nullptr) {
+        state = new ThreadState();
+        gThreadStateOwner.state = state;
+        gThreadState = state;
+    }
+    return state == kDestroyedState ? nullptr : state;
+}
+
+inline HazardRecord* RecordOf(HazardPointers::Slot* slot)
+{
+    return reinterpret_cast<HazardRecord*>(reinterpret_cast<uintptr_t>(slot) & ~(kCacheLineSize - 1));
+}
+
+} // namespace
+
+HazardPointers::Slot* HazardPointers::AcquireSlot()
+{
+    constexpr uint32_t kAllSlots = (1u << kSlotsPerRecord) - 1;
+    ThreadState* state = GetThreadState();
+    HazardRecord* record = nullptr;
+    if (state == nullptr) {
+        // The thread is exiting, the record is given back with its last slot
+        record = AcquireRecord();
+    } else {
+        for (HazardRecord* r : state->records) {
+            if (r->used != kAllSlots) {
+                record = r;
+                break;
+            }
+        }
+        if (record == nullptr) {
+            record = AcquireRecord();
+            state->records.push_back(record);
+        }
+    }
+    uint32_t free = ~record->used & kAllSlots;
+    uint32_t index = Simd::CountTrailingZeros(free);
+    record->used |= 1u << index;
+    return &record->slots[index];
+}
+
+void HazardPointers::ReleaseSlot(Slot* slot)
+{
+    slot->store(nullptr, std::memory_order_release);
+    HazardRecord* record = RecordOf(slot);
+    record->used &= ~(1u << uint32_t(slot - record->slots));
+    if (record->used == 0 && GetThreadState() == nullptr) {
+        record->owned.store(false, std::memory_order_release);
+    }
+}
+
+void HazardPointers::Retire(void* object, void (*release)(void*))
+{
+    ThreadState* state = GetThreadState();
+    if (state == nullptr) {
+        std::vector<Retired> retired { { object, release } };
+        Reclaim(retired);
+        AddOrphans(retired);
+        return;
+    }
+    // Stores of the read-mostly states are rare, so the objects are reclaimed right away instead of in batches
+    state->retired.push_back({ object, release });
+    Reclaim(state->retired);
+}
+
+} // namespace internal
+} // namespace ss
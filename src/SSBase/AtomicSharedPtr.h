@@ -0,0 +1,197 @@
+//
+// Copyright (c) 2020 Carl Chen. All rights reserved.
+//
+
+#pragma once
+
+#include "Ptr.h"
+#include <atomic>
+#include <cstdint>
+
+namespace ss {
+
+namespace internal {
+
+/// Hazard pointers of `AtomicSharedPtr`. A reader announces the object it is about to use in a slot of its thread,
+/// and the references dropped by the writers are retired: they are only released once no slot announces them.
+class HazardPointers {
+public:
+    using Slot = std::atomic<const void*>;
+
+    /// A free slot of this thread, the slots of a thread are on their own cache lines, one more is chained when they are
+    /// all used
+    static Slot* AcquireSlot();
+
+    static void ReleaseSlot(Slot* slot);
+
+    /// `release(object)` is invoked once no slot announces `object`, maybe by another thread
+    static void Retire(void* object, void (*release)(void*));
+};
+
+} // namespace internal
+
+/// A SharedPtr which threads load and store concurrently without a lock, e.g. a configuration or a routing table
+/// published by a writer to many readers. `Read` does not change the reference count, so the readers never write to
+/// a cache line shared with other threads, and never wait for the writers. The reference replaced by a writer is
+/// released once no reader uses the object any more. A thread may hold any number of guards at once, e.g. nested
+/// reads of several states.
+///
+/// NOTE: T should count with `MultiThreadPolicy`, as the references are released by any thread.
+template <class T>
+class AtomicSharedPtr {
+public:
+    /// Lock-free access to the object for a short scope, which keeps it alive without a reference
+    class Guard {
+    public:
+        Guard(Guard&& g) noexcept
+            : slot_(g.slot_)
+            , ptr_(g.ptr_)
+        {
+            g.slot_ = nullptr;
+            g.ptr_ = nullptr;
+        }
+
+        Guard(const Guard&) = delete;
+        Guard& operator=(const Guard&) = delete;
+        Guard& operator=(Guard&&) = delete;
+
+        ~Guard()
+        {
+            if (slot_ != nullptr) {
+                internal::HazardPointers::ReleaseSlot(slot_);
+            }
+        }
+
+        T* Get() const
+        {
+            return ptr_;
+        }
+
+        explicit operator bool() const
+        {
+            return ptr_ != nullptr;
+        }
+
+        T* operator->() const
+        {
+            return ptr_;
+        }
+
+        T& operator*() const
+        {
+            return *ptr_;
+        }
+
+    private:
+        Guard(internal::HazardPointers::Slot* slot, T* ptr)
+            : slot_(slot)
+            , ptr_(ptr)
+        {
+        }
+
+        internal::HazardPointers::Slot* slot_;
+        T* ptr_;
+
+        friend class AtomicSharedPtr;
+    };
+
+    AtomicSharedPtr()
+        : ptr_(nullptr)
+    {
+    }
+
+    explicit AtomicSharedPtr(SharedPtr<T> p)
+        : ptr_(Detach(p))
+    {
+    }
+
+    AtomicSharedPtr(const AtomicSharedPtr&) = delete;
+    AtomicSharedPtr& operator=(const AtomicSharedPtr&) = delete;
+
+    ~AtomicSharedPtr()
+    {
+        Retire(ptr_.load(std::memory_order_relaxed));
+    }
+
+    Guard Read() const
+    {
+        auto* slot = internal::HazardPointers::AcquireSlot();
+        return Guard(slot, Protect(slot));
+    }
+
+    SharedPtr<T> Load() const
+    {
+        auto guard = Read();
+        // The guard keeps the object alive until the reference is counted
+        return SharedPtr<T>(guard.Get());
+    }
+
+    void Store(SharedPtr<T> p)
+    {
+        Retire(ptr_.exchange(Detach(p), std::memory_order_seq_cst));
+    }
+
+    SharedPtr<T> Exchange(SharedPtr<T> p)
+    {
+        T* old = ptr_.exchange(Detach(p), std::memory_order_seq_cst);
+        // The readers may still use the object through the reference held by this
+        SharedPtr<T> result(old);
+        Retire(old);
+        return result;
+    }
+
+    /// Replaces `expected` by `desired` if it is the current object. Otherwise `expected` is set to the current object,
+    /// which is loaded again after the failed exchange (the object it saw may be released already), so it may be newer
+    /// than the one which failed the exchange.
+    bool CompareExchange(SharedPtr<T>& expected, SharedPtr<T> desired)
+    {
+        // `expected` holds its object, so its address can not be reused meanwhile
+        T* old = expected.Get();
+        if (ptr_.compare_exchange_strong(old, desired.Get(), std::memory_order_seq_cst)) {
+            Detach(desired);
+            Retire(old);
+            return true;
+        }
+        expected = Load();
+        return false;
+    }
+
+private:
+    T* Protect(internal::HazardPointers::Slot* slot) const
+    {
+        T* p = ptr_.load(std::memory_order_relaxed);
+        for (;;) {
+            slot->store(p, std::memory_order_seq_cst);
+            // Still current after announced, so the writer which replaces it sees the slot before releasing it
+            T* current = ptr_.load(std::memory_order_seq_cst);
+            if (current == p) {
+                return p;
+            }
+            p = current;
+        }
+    }
+
+    /// Takes the reference of `p`
+    static T* Detach(SharedPtr<T>& p)
+    {
+        T* ptr = p.ptr_;
+        p.ptr_ = nullptr;
+        return ptr;
+    }
+
+    static void Retire(T* p)
+    {
+        if (p != nullptr) {
+            internal::HazardPointers::Retire(p, &Release);
+        }
+    }
+
+    static void Release(void* p)
+    {
+        SharedPtr<T> adopted(static_cast<T*>(p), typename SharedPtr<T>::Adopted());
+    }
+
+    std::atomic<T*> ptr_; // Holds a reference
+};
+
+} // namespace ss
@@ -3,15 +3,45 @@
 //
 
 #include "Buffer.h"
+#include "BufferAllocator.h"
 #include "../SSBase/Misc.h"
+#include <algorithm>
 
 namespace ss {
 
+namespace {
+
+/// The storage comes from `arena`, or from the size classes of `BufferAllocator` if it is nullptr
+inline void* Reallocate(Arena* arena, void* p, uint32_t oldSize, uint32_t newSize, uint32_t usedSize)
+{
+    if (arena != nullptr) {
+        return arena->Reallocate(p, oldSize, newSize);
+    }
+    return BufferAllocator::Reallocate(p, oldSize, newSize, usedSize);
+}
+
+inline void Deallocate(Arena* arena, void* p, uint32_t size)
+{
+    if (arena != nullptr) {
+        arena->Deallocate(p, size);
+    } else {
+        BufferAllocator::Deallocate(p, size);
+    }
+}
+
+} // namespace
+
 DynamicBuffer::DynamicBuffer(uint32_t capacity)
+    : DynamicBuffer(capacity, Arena::Current())
+{
+}
+
+DynamicBuffer::DynamicBuffer(uint32_t capacity, Arena* arena)
     : offset_(0)
     , size_(0)
     , capacity_(0)
     , buf_(nullptr)
+    , arena_(arena)
 {
     if (capacity > 0) {
         ReAllocate(Misc::CeilToPowerOfTwo(capacity));
@@ -23,6 +53,7 @@ DynamicBuffer::DynamicBuffer(DynamicBuffer&& b) noexcept
     , size_(b.size_)
     , capacity_(b.capacity_)
     , buf_(b.buf_)
+    , arena_(b.arena_)
 {
     b.offset_ = 0;
     b.size_ = 0;
@@ -32,13 +63,13 @@ DynamicBuffer::DynamicBuffer(DynamicBuffer&& b) noexcept
 
 DynamicBuffer::~DynamicBuffer()
 {
-    offset_ = 0;
-    size_ = 0;
-    capacity_ = 0;
     if (buf_ != nullptr) {
-        free(buf_);
+        Deallocate(arena_, buf_, capacity_);
         buf_ = nullptr;
     }
+    offset_ = 0;
+    size_ = 0;
+    capacity_ = 0;
 }
 
 DynamicBuffer& DynamicBuffer::operator=(DynamicBuffer&& b) noexcept
@@ -47,6 +78,7 @@ DynamicBuffer& DynamicBuffer::operator=(DynamicBuffer&& b) noexcept
     std::swap(size_, b.size_);
     std::swap(capacity_, b.capacity_);
     std::swap(buf_, b.buf_);
+    std::swap(arena_, b.arena_);
     return *this;
 }
 
@@ -102,11 +134,154 @@ void DynamicBuffer::EnsureSpace(uint32_t size)
 
 void DynamicBuffer::ReAllocate(uint32_t length)
 {
-    if (buf_ == nullptr) {
-        buf_ = static_cast<uint8_t*>(malloc(length));
+    buf_ = static_cast<uint8_t*>(Reallocate(arena_, buf_, capacity_, length, offset_ + size_));
+    capacity_ = length;
+}
+
+RingBuffer::RingBuffer(uint32_t capacity)
+    : RingBuffer(capacity, Arena::Current())
+{
+}
+
+RingBuffer::RingBuffer(uint32_t capacity, Arena* arena)
+    : head_(0)
+    , size_(0)
+    , capacity_(0)
+    , buf_(nullptr)
+    , arena_(arena)
+{
+    if (capacity > 0) {
+        ReAllocate(Misc::CeilToPowerOfTwo(capacity));
+    }
+}
+
+RingBuffer::RingBuffer(RingBuffer&& b) noexcept
+    : head_(b.head_)
+    , size_(b.size_)
+    , capacity_(b.capacity_)
+    , buf_(b.buf_)
+    , arena_(b.arena_)
+{
+    b.head_ = 0;
+    b.size_ = 0;
+    b.capacity_ = 0;
+    b.buf_ = nullptr;
+}
+
+RingBuffer::~RingBuffer()
+{
+    if (buf_ != nullptr) {
+        Deallocate(arena_, buf_, capacity_);
+        buf_ = nullptr;
+    }
+    head_ = 0;
+    size_ = 0;
+    capacity_ = 0;
+}
+
+RingBuffer& RingBuffer::operator=(RingBuffer&& b) noexcept
+{
+    std::swap(head_, b.head_);
+    std::swap(size_, b.size_);
+    std::swap(capacity_, b.capacity_);
+    std::swap(buf_, b.buf_);
+    std::swap(arena_, b.arena_);
+    return *this;
+}
+
+uint32_t RingBuffer::ReadData(void* buffer, uint32_t size) const
+{
+    if (size > Size()) {
+        size = Size();
+    }
+    uint32_t first = std::min(size, Capacity() - head_);
+    memcpy(buffer, buf_ + head_, first);
+    memcpy(static_cast<uint8_t*>(buffer) + first, buf_, size - first);
+    return size;
+}
+
+void RingBuffer::PushData(const void* data, uint32_t length)
+{
+    if (length == 0) {
+        return;
+    }
+    EnsureSpace(length);
+    uint32_t tail = (head_ + size_) & Mask();
+    uint32_t first = std::min(length, Capacity() - tail);
+    memcpy(buf_ + tail, data, first);
+    memcpy(buf_, static_cast<const uint8_t*>(data) + first, length - first);
+    size_ += length;
+}
+
+void RingBuffer::EnsureSpace(uint32_t size)
+{
+    if (size <= FreeSpaceSize()) {
+        return;
+    }
+    uint32_t oldCapacity = Capacity();
+    uint32_t newCapacity = oldCapacity * 2;
+    if (newCapacity < Size() + size) {
+        newCapacity = Misc::CeilToPowerOfTwo(Size() + size);
+    }
+    ReAllocate(newCapacity);
+
+    if (head_ + size_ <= oldCapacity) {
+        return; // Not wrapped around, still contiguous in the larger storage
+    }
+    // The data wraps around the old end, copy the shorter span to keep it in order. Since the storage at least
+    // doubles, the copy never overlaps.
+    uint32_t headSpan = oldCapacity - head_;
+    uint32_t tailSpan = size_ - headSpan;
+    if (tailSpan <= headSpan) {
+        memcpy(buf_ + oldCapacity, buf_, tailSpan);
     } else {
-        buf_ = static_cast<uint8_t*>(realloc(buf_, length));
+        memcpy(buf_ + newCapacity - headSpan, buf_ + head_, headSpan);
+        head_ = newCapacity - headSpan;
+    }
+}
+
+uint32_t RingBuffer::GetReadableSpans(BufferSpan spans[2])
+{
+    if (Empty()) {
+        return 0;
+    }
+    uint32_t first = std::min(size_, Capacity() - head_);
+    spans[0] = { buf_ + head_, first };
+    if (first == size_) {
+        return 1;
     }
+    spans[1] = { buf_, size_ - first };
+    return 2;
+}
+
+uint32_t RingBuffer::GetWritableSpans(BufferSpan spans[2])
+{
+    uint32_t free = FreeSpaceSize();
+    if (free == 0) {
+        return 0;
+    }
+    uint32_t tail = (head_ + size_) & Mask();
+    uint32_t first = std::min(free, Capacity() - tail);
+    spans[0] = { buf_ + tail, first };
+    if (first == free) {
+        return 1;
+    }
+    spans[1] = { buf_, free - first };
+    return 2;
+}
+
+uint8_t* RingBuffer::Linearize()
+{
+    if (head_ + size_ > Capacity()) {
+        std::rotate(buf_, buf_ + head_, buf_ + Capacity());
+        head_ = 0;
+    }
+    return buf_ + head_;
+}
+
+void RingBuffer::ReAllocate(uint32_t length)
+{
+    buf_ = static_cast<uint8_t*>(Reallocate(arena_, buf_, capacity_, length, head_ + size_ > capacity_ ? capacity_ : head_ + size_));
     capacity_ = length;
 }
 
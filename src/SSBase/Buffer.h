@@ -4,7 +4,9 @@
 
 #pragma once
 
+#include "Arena.h"
 #include "Assert.h"
+#include "ByteSearch.h"
 #include <cstdint>
 #include <cstring>
 
@@ -13,6 +15,10 @@ namespace ss {
 template <uint32_t capacity>
 class Buffer {
 public:
+    enum : uint32_t {
+        kNPos = ByteSearch::kNPos
+    };
+
     void Reset(uint32_t offset = 0, uint32_t size = 0)
     {
         offset_ = offset;
@@ -106,10 +112,43 @@ public:
         return GetData<uint8_t>()[index];
     }
 
+    /// Offset of the first `byte` in the data not before `start`, or kNPos
+    uint32_t Find(uint8_t byte, uint32_t start = 0) const
+    {
+        SSASSERT(start <= Size());
+        return FoundAt(start, ByteSearch::Find(GetData<uint8_t>() + start, Size() - start, byte));
+    }
+
+    /// Offset of the first `length` bytes of `pattern` in the data not before `start`, or kNPos
+    uint32_t Find(const void* pattern, uint32_t length, uint32_t start = 0) const
+    {
+        SSASSERT(start <= Size());
+        return FoundAt(start, ByteSearch::Find(GetData<uint8_t>() + start, Size() - start, pattern, length));
+    }
+
+    /// Offset of the first byte of `set` in the data not before `start`, or kNPos
+    uint32_t FindAny(const ByteSet& set, uint32_t start = 0) const
+    {
+        SSASSERT(start <= Size());
+        return FoundAt(start, ByteSearch::FindAny(GetData<uint8_t>() + start, Size() - start, set));
+    }
+
+    /// Offset of the first "\r\n" in the data not before `start`, or kNPos
+    uint32_t FindCRLF(uint32_t start = 0) const
+    {
+        SSASSERT(start <= Size());
+        return FoundAt(start, ByteSearch::FindCRLF(GetData<uint8_t>() + start, Size() - start));
+    }
+
 private:
+    static uint32_t FoundAt(uint32_t start, uint32_t found)
+    {
+        return found == ByteSearch::kNPos ? found : start + found;
+    }
+
     void EnsureSpace(uint32_t length)
     {
-        if (offset_ + Size() + length <= Capacity()) {
+        if (offset_ + Size() + length > Capacity()) {
             memmove(GetBufferHead(), GetData<uint8_t>(), Size());
             offset_ = 0;
         }
@@ -123,8 +162,16 @@ private:
 
 class DynamicBuffer {
 public:
+    enum : uint32_t {
+        kNPos = ByteSearch::kNPos
+    };
+
+    /// The memory comes from the arena of the thread if there is one, see `Arena::Scope`
     explicit DynamicBuffer(uint32_t capacity = 0);
 
+    /// The memory comes from `arena`, or from the heap if it is nullptr
+    DynamicBuffer(uint32_t capacity, Arena* arena);
+
     DynamicBuffer(const DynamicBuffer&) = delete;
 
     DynamicBuffer(DynamicBuffer&& b) noexcept;
@@ -227,7 +274,40 @@ public:
         return Capacity() - offset_ - Size();
     }
 
+    /// Offset of the first `byte` in the data not before `start`, or kNPos
+    uint32_t Find(uint8_t byte, uint32_t start = 0) const
+    {
+        SSASSERT(start <= Size());
+        return FoundAt(start, ByteSearch::Find(GetData<uint8_t>() + start, Size() - start, byte));
+    }
+
+    /// Offset of the first `length` bytes of `pattern` in the data not before `start`, or kNPos
+    uint32_t Find(const void* pattern, uint32_t length, uint32_t start = 0) const
+    {
+        SSASSERT(start <= Size());
+        return FoundAt(start, ByteSearch::Find(GetData<uint8_t>() + start, Size() - start, pattern, length));
+    }
+
+    /// Offset of the first byte of `set` in the data not before `start`, or kNPos
+    uint32_t FindAny(const ByteSet& set, uint32_t start = 0) const
+    {
+        SSASSERT(start <= Size());
+        return FoundAt(start, ByteSearch::FindAny(GetData<uint8_t>() + start, Size() - start, set));
+    }
+
+    /// Offset of the first "\r\n" in the data not before `start`, or kNPos
+    uint32_t FindCRLF(uint32_t start = 0) const
+    {
+        SSASSERT(start <= Size());
+        return FoundAt(start, ByteSearch::FindCRLF(GetData<uint8_t>() + start, Size() - start));
+    }
+
 private:
+    static uint32_t FoundAt(uint32_t start, uint32_t found)
+    {
+        return found == ByteSearch::kNPos ? found : start + found;
+    }
+
     void ReAllocate(uint32_t length);
 
 private:
@@ -235,6 +315,129 @@ private:
     uint32_t size_;
     uint32_t capacity_;
     uint8_t* buf_;
+    Arena* arena_;
+};
+
+/// A contiguous part of the data or of the free space of a `RingBuffer`
+struct BufferSpan {
+    uint8_t* data;
+    uint32_t size;
+};
+
+/// Circular byte buffer: the data wraps around the end of the storage, so neither consuming nor appending ever moves
+/// it, unlike `DynamicBuffer` which moves the data back to the head when the tail runs out of space. This suits a
+/// socket receive buffer under steady traffic. The data and the free space are both at most two contiguous spans,
+/// which map to the iovec/uv_buf_t arrays of scatter/gather I/O. The capacity is always a power of two.
+class RingBuffer {
+public:
+    /// The memory comes from the arena of the thread if there is one, see `Arena::Scope`
+    explicit RingBuffer(uint32_t capacity = 0);
+
+    /// The memory comes from `arena`, or from the heap if it is nullptr
+    RingBuffer(uint32_t capacity, Arena* arena);
+
+    RingBuffer(const RingBuffer&) = delete;
+
+    RingBuffer(RingBuffer&& b) noexcept;
+
+    ~RingBuffer();
+
+    RingBuffer& operator=(const RingBuffer&) = delete;
+
+    RingBuffer& operator=(RingBuffer&& b) noexcept;
+
+    void Reset()
+    {
+        head_ = 0;
+        size_ = 0;
+    }
+
+    /// Do not pop data, invoke skip to pop data instead
+    uint32_t ReadData(void* buffer, uint32_t size) const;
+
+    void PushData(const void* data, uint32_t length);
+
+    void Skip(uint32_t n)
+    {
+        SSASSERT(Size() >= n);
+        size_ -= n;
+        // Once empty, start over at the head so that the free space is a single span
+        head_ = size_ == 0 ? 0 : (head_ + n) & Mask();
+    }
+
+    uint32_t Capacity() const
+    {
+        return capacity_;
+    }
+
+    uint32_t Size() const
+    {
+        return size_;
+    }
+
+    bool Empty() const
+    {
+        return Size() == 0;
+    }
+
+    bool Full() const
+    {
+        return Size() == Capacity();
+    }
+
+    uint32_t FreeSpaceSize() const
+    {
+        return Capacity() - Size();
+    }
+
+    uint8_t operator[](uint32_t index) const
+    {
+        SSASSERT(index < Size());
+        return buf_[(head_ + index) & Mask()];
+    }
+
+    uint8_t& operator[](uint32_t index)
+    {
+        SSASSERT(index < Size());
+        return buf_[(head_ + index) & Mask()];
+    }
+
+    /// Make sure `size` more bytes fit, growing the storage. The data is not compacted, at most the shorter of its
+    /// two spans is copied when the storage grows.
+    void EnsureSpace(uint32_t size);
+
+    /// Fill `spans` with the data in order, returns the number of spans used, 0 to 2
+    uint32_t GetReadableSpans(BufferSpan spans[2]);
+
+    /// Fill `spans` with the free space in order, returns the number of spans used, 0 to 2. Invoke `Commit` with the
+    /// number of bytes written to them.
+    uint32_t GetWritableSpans(BufferSpan spans[2]);
+
+    /// Append `n` bytes written to the spans of `GetWritableSpans`
+    void Commit(uint32_t n)
+    {
+        SSASSERT(n <= FreeSpaceSize());
+        size_ += n;
+    }
+
+    /// Make the data a single span starting at the returned pointer, by rotating the storage if the data wraps around.
+    /// For parsers which need contiguous bytes, prefer the spans otherwise.
+    uint8_t* Linearize();
+
+private:
+    uint32_t Mask() const
+    {
+        return capacity_ - 1;
+    }
+
+    void ReAllocate(uint32_t length);
+
+private:
+    uint32_t head_;
+    uint32_t size_;
+    uint32_t capacity_;
+    uint8_t* buf_;
+    Arena* arena_;
 };
 
 }
\ No newline at end of file
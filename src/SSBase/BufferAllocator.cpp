@@ -0,0 +1,348 @@
+//
+// Copyright (c) 2020 Carl Chen. All rights reserved.
+//
+
+#include "BufferAllocator.h"
+#include "internal/Simd.h"
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <new>
+#include <utility>
+
+namespace ss {
+
+namespace {
+
+constexpr uint32_t kMinShift = 12;
+constexpr uint32_t kClassesCount = 9; // 4 KB to 1 MB
+
+static_assert(BufferAllocator::kMinBlockSize == 1u << kMinShift, "");
+static_assert(BufferAllocator::kMaxBlockSize == 1u << (kMinShift + kClassesCount - 1), "");
+
+/// The size class of `size`, -1 if it is not cached
+inline int32_t ClassOf(uint32_t size)
+{
+    if (size < BufferAllocator::kMinBlockSize || size > BufferAllocator::kMaxBlockSize || (size & (size - 1)) != 0) {
+        return -1;
+    }
+    return int32_t(Simd::CountTrailingZeros(size) - kMinShift);
+}
+
+inline uint32_t SizeOf(uint32_t sizeClass)
+{
+    return 1u << (sizeClass + kMinShift);
+}
+
+/// Singly linked through the first bytes of the free blocks
+struct FreeList {
+    struct Node {
+        Node* next;
+    };
+
+    Node* head = nullptr;
+    uint32_t count = 0;
+
+    void Push(void* p)
+    {
+        auto* node = static_cast<Node*>(p);
+        node->next = head;
+        head = node;
+        ++count;
+    }
+
+    void* Pop()
+    {
+        Node* node = head;
+        if (node != nullptr) {
+            head = node->next;
+            --count;
+        }
+        return node;
+    }
+
+    /// Keep the first `n` blocks, returns the others
+    FreeList SplitAfter(uint32_t n)
+    {
+        FreeList rest;
+        if (n >= count) {
+            return rest;
+        }
+        if (n == 0) {
+            std::swap(rest, *this);
+            return rest;
+        }
+        Node* last = head;
+        for (uint32_t i = 1; i < n; ++i) {
+            last = last->next;
+        }
+        rest.head = last->next;
+        rest.count = count - n;
+        last->next = nullptr;
+        count = n;
+        return rest;
+    }
+};
+
+void* SystemAllocate(size_t size);
+void SystemFree(void* p);
+
+class Depot {
+public:
+    Depot()
+        : threadCacheBytes_(1024 * 1024)
+        , depotBytes_(8 * 1024 * 1024)
+        , systemAllocations_(0)
+        , systemFrees_(0)
+        , bytes_(0)
+    {
+    }
+
+    /// Move at most `n` blocks to `list`
+    void Take(uint32_t sizeClass, FreeList& list, uint32_t n)
+    {
+        Class& c = classes_[sizeClass];
+        std::lock_guard<std::mutex> lock(c.mutex);
+        uint32_t taken = 0;
+        for (; taken < n && c.list.count > 0; ++taken) {
+            list.Push(c.list.Pop());
+        }
+        bytes_.fetch_sub(size_t(taken) * SizeOf(sizeClass), std::memory_order_relaxed);
+    }
+
+    /// Move all the blocks of `list`, the ones beyond the limit are freed
+    void Put(uint32_t sizeClass, FreeList& list)
+    {
+        uint32_t size = SizeOf(sizeClass);
+        size_t limit = depotBytes_.load(std::memory_order_relaxed) / size;
+        FreeList overflow;
+        {
+            Class& c = classes_[sizeClass];
+            std::lock_guard<std::mutex> lock(c.mutex);
+            uint32_t put = 0;
+            while (list.count > 0) {
+                void* p = list.Pop();
+                if (c.list.count < limit) {
+                    c.list.Push(p);
+                    ++put;
+                } else {
+                    overflow.Push(p);
+                }
+            }
+            bytes_.fetch_add(size_t(put) * size, std::memory_order_relaxed);
+        }
+        FreeAll(overflow);
+    }
+
+    void Trim()
+    {
+        for (uint32_t i = 0; i < kClassesCount; ++i) {
+            FreeList list;
+            {
+                std::lock_guard<std::mutex> lock(classes_[i].mutex);
+                std::swap(list, classes_[i].list);
+            }
+            bytes_.fetch_sub(size_t(list.count) * SizeOf(i), std::memory_order_relaxed);
+            FreeAll(list);
+        }
+    }
+
+    void FreeAll(FreeList& list)
+    {
+        while (list.count > 0) {
+            SystemFree(list.Pop());
+        }
+    }
+
+    std::atomic<size_t> threadCacheBytes_;
+    std::atomic<size_t> depotBytes_;
+    std::atomic<uint64_t> systemAllocations_;
+    std::atomic<uint64_t> systemFrees_;
+    std::atomic<size_t> bytes_;
+
+private:
+    struct Class {
+        std::mutex mutex;
+        FreeList list;
+    };
+
+    Class classes_[kClassesCount];
+};
+
+Depot& GetDepot()
+{
+    // Never destroyed, so buffers held by static objects may be freed at any time
+    static auto* depot = new Depot();
+    return *depot;
+}
+
+void* SystemAllocate(size_t size)
+{
+    void* p = malloc(size);
+    if (p == nullptr) {
+        throw std::bad_alloc();
+    }
+    GetDepot().systemAllocations_.fetch_add(1, std::memory_order_relaxed);
+    return p;
+}
+
+void SystemFree(void* p)
+{
+    GetDepot().systemFrees_.fetch_add(1, std::memory_order_relaxed);
+    free(p);
+}
+
+struct ThreadCache {
+    FreeList lists[kClassesCount];
+
+    /// Give back all the blocks to the depot
+    void Flush()
+    {
+        for (uint32_t i = 0; i < kClassesCount; ++i) {
+            GetDepot().Put(i, lists[i]);
+        }
+    }
+};
+
+ThreadCache* const kDestroyedCache = reinterpret_cast<ThreadCache*>(uintptr_t(1));
+
+// A plain pointer, which is still readable while the thread exits, after `gThreadCacheOwner` is destroyed
+thread_local ThreadCache* gThreadCache = nullptr;
+
+struct ThreadCacheOwner {
+    ThreadCache* cache = nullptr;
+
+    ~ThreadCacheOwner()
+    {
+        if (cache != nullptr) {
+            cache->Flush();
+            delete cache;
+        }
+        gThreadCache = kDestroyedCache;
+    }
+};
+
+thread_local ThreadCacheOwner gThreadCacheOwner;
+
+/// The cache of this thread, nullptr once the thread is exiting
+inline ThreadCache* GetThreadCache()
+{
+    ThreadCache* cache = gThreadCache;
+    if (cache == nullptr) {
+        cache = new ThreadCache();
+        gThreadCacheOwner.cache = cache;
+        gThreadCache = cache;
+    }
+    return cache == kDestroyedCache ? nullptr : cache;
+}
+
+} // namespace
+
+void* BufferAllocator::Allocate(uint32_t size)
+{
+    int32_t sizeClass = ClassOf(size);
+    if (sizeClass < 0) {
+        return SystemAllocate(size);
+    }
+    Depot& depot = GetDepot();
+    ThreadCache* cache = GetThreadCache();
+    if (cache != nullptr) {
+        FreeList& list = cache->lists[sizeClass];
+        if (list.count == 0) {
+            // Refill half of the cache at once, so the depot lock is taken once per batch
+            size_t limit = depot.threadCacheBytes_.load(std::memory_order_relaxed) / size;
+            depot.Take(uint32_t(sizeClass), list, limit > 2 ? uint32_t(limit / 2) : 1);
+        }
+        if (void* p = list.Pop()) {
+            return p;
+        }
+    } else {
+        FreeList list;
+        depot.Take(uint32_t(sizeClass), list, 1);
+        if (void* p = list.Pop()) {
+            return p;
+        }
+    }
+    return SystemAllocate(size);
+}
+
+void* BufferAllocator::Reallocate(void* p, uint32_t oldSize, uint32_t newSize, uint32_t usedSize)
+{
+    if (p == nullptr) {
+        return Allocate(newSize);
+    }
+    if (ClassOf(oldSize) < 0 && ClassOf(newSize) < 0) {
+        void* q = realloc(p, newSize);
+        if (q == nullptr && newSize > 0) {
+            throw std::bad_alloc();
+        }
+        return q;
+    }
+    void* q = Allocate(newSize);
+    memcpy(q, p, usedSize < newSize ? usedSize : newSize);
+    Deallocate(p, oldSize);
+    return q;
+}
+
+void BufferAllocator::Deallocate(void* p, uint32_t size)
+{
+    if (p == nullptr) {
+        return;
+    }
+    int32_t sizeClass = ClassOf(size);
+    if (sizeClass < 0) {
+        SystemFree(p);
+        return;
+    }
+    Depot& depot = GetDepot();
+    ThreadCache* cache = GetThreadCache();
+    if (cache == nullptr) {
+        FreeList list;
+        list.Push(p);
+        depot.Put(uint32_t(sizeClass), list);
+        return;
+    }
+    FreeList& list = cache->lists[sizeClass];
+    list.Push(p);
+    size_t limit = depot.threadCacheBytes_.load(std::memory_order_relaxed) / size;
+    if (list.count > limit) {
+        // Keep half of the limit, so a thread which frees and allocates around the limit does not go to the depot
+        // every time. The blocks kept are the most recently freed ones, which are likely still in the CPU caches.
+        FreeList older = list.SplitAfter(uint32_t(limit / 2));
+        depot.Put(uint32_t(sizeClass), older);
+    }
+}
+
+void BufferAllocator::SetPolicy(const Policy& policy)
+{
+    Depot& depot = GetDepot();
+    depot.threadCacheBytes_.store(policy.threadCacheBytes, std::memory_order_relaxed);
+    depot.depotBytes_.store(policy.depotBytes, std::memory_order_relaxed);
+}
+
+BufferAllocator::Policy BufferAllocator::GetPolicy()
+{
+    Depot& depot = GetDepot();
+    return { depot.threadCacheBytes_.load(std::memory_order_relaxed), depot.depotBytes_.load(std::memory_order_relaxed) };
+}
+
+void BufferAllocator::Trim()
+{
+    if (ThreadCache* cache = GetThreadCache()) {
+        cache->Flush();
+    }
+    GetDepot().Trim();
+}
+
+BufferAllocator::Stats BufferAllocator::GetStats()
+{
+    Depot& depot = GetDepot();
+    return {
+        depot.systemAllocations_.load(std::memory_order_relaxed),
+        depot.systemFrees_.load(std::memory_order_relaxed),
+        depot.bytes_.load(std::memory_order_relaxed),
+    };
+}
+
+} // namespace ss
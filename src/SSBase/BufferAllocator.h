@@ -0,0 +1,56 @@
+//
+// Copyright (c) 2020 Carl Chen. All rights reserved.
+//
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace ss {
+
+/// Storage of `DynamicBuffer` and `RingBuffer` when they do not use an arena. Their capacities are powers of two, so
+/// the blocks from 4 KB to 1 MB are recycled by size class: a freed block goes to the cache of its thread, which
+/// overflows to a depot shared by all the threads, and only the depot overflow goes back to the system allocator. A
+/// buffer allocated by one thread may be freed by another. Other sizes go to malloc directly.
+class BufferAllocator {
+public:
+    enum : uint32_t {
+        kMinBlockSize = 4096,
+        kMaxBlockSize = 1024 * 1024
+    };
+
+    /// When the cached blocks are given back, both limits are per size class
+    struct Policy {
+        /// A thread cache holding more moves the older half to the depot. 0 disables the thread caches.
+        size_t threadCacheBytes;
+        /// Blocks beyond this are freed instead of being put into the depot. 0 disables the depot.
+        size_t depotBytes;
+    };
+
+    struct Stats {
+        uint64_t systemAllocations; // Blocks which had to be allocated by malloc
+        uint64_t systemFrees; // Blocks which were given back by free
+        size_t depotBytes; // Bytes held by the depot now, of all the size classes
+    };
+
+    static void* Allocate(uint32_t size);
+
+    /// Like realloc, `p` may be nullptr, but only the first `usedSize` bytes are kept
+    static void* Reallocate(void* p, uint32_t oldSize, uint32_t newSize, uint32_t usedSize);
+
+    /// `size` must be the size `p` was allocated with
+    static void Deallocate(void* p, uint32_t size);
+
+    /// Change the limits of the caches, the blocks already cached are given back as they overflow
+    static void SetPolicy(const Policy& policy);
+
+    static Policy GetPolicy();
+
+    /// Give back the blocks cached by this thread and by the depot to the system allocator, e.g. after a burst
+    static void Trim();
+
+    static Stats GetStats();
+};
+
+} // namespace ss
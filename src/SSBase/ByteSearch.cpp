@@ -0,0 +1,196 @@
+//
+// Copyright (c) 2020 Carl Chen. All rights reserved.
+//
+
+#include "ByteSearch.h"
+#include "internal/Search.h"
+#include "internal/Simd.h"
+
+namespace ss {
+
+ByteSet::ByteSet(const void* bytes, uint32_t count)
+    : bits_ {}
+    , low_ {}
+    , high_ {}
+    , nibbleLookup_(true)
+    , bytes_ {}
+    , count_(0)
+{
+    auto* p = static_cast<const uint8_t*>(bytes);
+    for (uint32_t i = 0; i < count; ++i) {
+        if (!Contains(p[i])) {
+            bits_[p[i] >> 6u] |= uint64_t(1) << (p[i] & 63u);
+            if (count_ < 8) {
+                bytes_[count_] = p[i];
+            }
+            ++count_;
+        }
+    }
+    uint32_t highs = 0; // Number of the distinct high nibbles
+    for (uint32_t b = 0; b < 256 && nibbleLookup_; ++b) {
+        if (!Contains(uint8_t(b))) {
+            continue;
+        }
+        uint32_t high = b >> 4u;
+        if (high_[high] == 0) {
+            if (highs == 8) {
+                nibbleLookup_ = false;
+                break;
+            }
+            high_[high] = uint8_t(1u << highs++);
+        }
+        low_[b & 15u] |= high_[high];
+    }
+}
+
+namespace {
+
+inline uint32_t FindAnyScalar(const uint8_t* p, uint32_t i, uint32_t size, const ByteSet& set)
+{
+    for (; i < size; ++i) {
+        if (set.Contains(p[i])) {
+            return i;
+        }
+    }
+    return ByteSearch::kNPos;
+}
+
+inline uint32_t FindCRLFScalar(const uint8_t* p, uint32_t i, uint32_t size)
+{
+    for (; i + 1 < size; ++i) {
+        if (p[i] == '\r' && p[i + 1] == '\n') {
+            return i;
+        }
+    }
+    return ByteSearch::kNPos;
+}
+
+#ifdef SS_SIMD_X86
+
+SS_TARGET_AVX2 uint32_t FindAnyAvx2(const uint8_t* p, uint32_t size, const uint8_t* low, const uint8_t* high, uint32_t* i)
+{
+    const __m256i lowTable = _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(low)));
+    const __m256i highTable = _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(high)));
+    const __m256i nibble = _mm256_set1_epi8(0x0F);
+    const __m256i zero = _mm256_setzero_si256();
+    for (; *i + 32 <= size; *i += 32) {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + *i));
+        __m256i l = _mm256_shuffle_epi8(lowTable, _mm256_and_si256(v, nibble));
+        __m256i h = _mm256_shuffle_epi8(highTable, _mm256_and_si256(_mm256_srli_epi16(v, 4), nibble));
+        auto mask = uint32_t(~_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_and_si256(l, h), zero)));
+        if (mask != 0) {
+            return *i + Simd::CountTrailingZeros(mask);
+        }
+    }
+    return ByteSearch::kNPos;
+}
+
+/// Compares every byte with each byte of a small set
+inline uint32_t FindAnySse2(const uint8_t* p, uint32_t size, const uint8_t* bytes, uint32_t count, uint32_t* i)
+{
+    __m128i set[8];
+    for (uint32_t k = 0; k < count; ++k) {
+        set[k] = _mm_set1_epi8(char(bytes[k]));
+    }
+    for (; *i + 16 <= size; *i += 16) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + *i));
+        __m128i eq = _mm_cmpeq_epi8(v, set[0]);
+        for (uint32_t k = 1; k < count; ++k) {
+            eq = _mm_or_si128(eq, _mm_cmpeq_epi8(v, set[k]));
+        }
+        auto mask = uint32_t(_mm_movemask_epi8(eq));
+        if (mask != 0) {
+            return *i + Simd::CountTrailingZeros(mask);
+        }
+    }
+    return ByteSearch::kNPos;
+}
+
+SS_TARGET_AVX2 uint32_t FindCRLFAvx2(const uint8_t* p, uint32_t size, uint32_t* i)
+{
+    const __m256i cr = _mm256_set1_epi8('\r');
+    const __m256i lf = _mm256_set1_epi8('\n');
+    // The "\n" are loaded one byte later, so both vectors must fit
+    for (; *i + 33 <= size; *i += 32) {
+        __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + *i));
+        __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + *i + 1));
+        auto mask = uint32_t(_mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(a, cr), _mm256_cmpeq_epi8(b, lf))));
+        if (mask != 0) {
+            return *i + Simd::CountTrailingZeros(mask);
+        }
+    }
+    return ByteSearch::kNPos;
+}
+
+inline uint32_t FindCRLFSse2(const uint8_t* p, uint32_t size, uint32_t* i)
+{
+    const __m128i cr = _mm_set1_epi8('\r');
+    const __m128i lf = _mm_set1_epi8('\n');
+    for (; *i + 17 <= size; *i += 16) {
+        __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + *i));
+        __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + *i + 1));
+        auto mask = uint32_t(_mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(a, cr), _mm_cmpeq_epi8(b, lf))));
+        if (mask != 0) {
+            return *i + Simd::CountTrailingZeros(mask);
+        }
+    }
+    return ByteSearch::kNPos;
+}
+
+#endif
+
+} // namespace
+
+uint32_t ByteSearch::Find(const void* data, uint32_t size, uint8_t byte)
+{
+    if (size == 0) {
+        return kNPos;
+    }
+    // memchr of the C library is already vectorized and dispatched by the CPU
+    auto* found = static_cast<const uint8_t*>(memchr(data, byte, size));
+    return found == nullptr ? uint32_t(kNPos) : uint32_t(found - static_cast<const uint8_t*>(data));
+}
+
+uint32_t ByteSearch::Find(const void* data, uint32_t size, const void* pattern, uint32_t length)
+{
+    if (length == 1) {
+        return Find(data, size, *static_cast<const uint8_t*>(pattern));
+    }
+    return FindUnits(static_cast<const uint8_t*>(data), size, static_cast<const uint8_t*>(pattern), length, 0, nullptr);
+}
+
+uint32_t ByteSearch::FindAny(const void* data, uint32_t size, const ByteSet& set)
+{
+    auto* p = static_cast<const uint8_t*>(data);
+    if (set.count_ <= 1) {
+        return set.count_ == 0 ? uint32_t(kNPos) : Find(p, size, set.bytes_[0]);
+    }
+    uint32_t i = 0;
+#ifdef SS_SIMD_X86
+    uint32_t found = kNPos;
+    if (set.nibbleLookup_ && size >= 32 && Simd::HasAvx2()) {
+        found = FindAnyAvx2(p, size, set.low_, set.high_, &i);
+    } else if (set.count_ <= 8) {
+        found = FindAnySse2(p, size, set.bytes_, set.count_, &i);
+    }
+    if (found != kNPos) {
+        return found;
+    }
+#endif
+    return FindAnyScalar(p, i, size, set);
+}
+
+uint32_t ByteSearch::FindCRLF(const void* data, uint32_t size)
+{
+    auto* p = static_cast<const uint8_t*>(data);
+    uint32_t i = 0;
+#ifdef SS_SIMD_X86
+    uint32_t found = size >= 33 && Simd::HasAvx2() ? FindCRLFAvx2(p, size, &i) : FindCRLFSse2(p, size, &i);
+    if (found != kNPos) {
+        return found;
+    }
+#endif
+    return FindCRLFScalar(p, i, size);
+}
+
+} // namespace ss
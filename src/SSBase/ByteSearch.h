@@ -0,0 +1,64 @@
+//
+// Copyright (c) 2020 Carl Chen. All rights reserved.
+//
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+
+namespace ss {
+
+/// A set of bytes to search with `ByteSearch::FindAny`, built once and reused, e.g. the separators of a protocol
+class ByteSet {
+public:
+    ByteSet()
+        : ByteSet("", 0)
+    {
+    }
+
+    ByteSet(const char* bytes) // NOLINT(google-explicit-constructor,hicpp-explicit-conversions)
+        : ByteSet(bytes, uint32_t(strlen(bytes)))
+    {
+    }
+
+    ByteSet(const void* bytes, uint32_t count);
+
+    bool Contains(uint8_t byte) const
+    {
+        return (bits_[byte >> 6u] >> (byte & 63u) & 1u) != 0;
+    }
+
+private:
+    uint64_t bits_[4];
+    // Nibble tables for the vectorized lookup: a byte is in the set if `low_[byte & 15] & high_[byte >> 4]` is not 0,
+    // each bit stands for one of the high nibbles. Only valid if `nibbleLookup_`, which needs at most 8 of them.
+    uint8_t low_[16];
+    uint8_t high_[16];
+    bool nibbleLookup_;
+    uint8_t bytes_[8]; // For the compare lookup of small sets
+    uint32_t count_;
+
+    friend class ByteSearch;
+};
+
+/// Scanning of raw bytes for framing protocols, e.g. lines, CRLF or magic numbers. The loops are vectorized with SSE2
+/// or AVX2 as the CPU supports, which is detected at runtime, and scalar on other architectures. All the offsets are
+/// from `data`, kNPos if nothing is found.
+class ByteSearch {
+public:
+    enum : uint32_t {
+        kNPos = uint32_t(-1)
+    };
+
+    static uint32_t Find(const void* data, uint32_t size, uint8_t byte);
+
+    static uint32_t Find(const void* data, uint32_t size, const void* pattern, uint32_t length);
+
+    static uint32_t FindAny(const void* data, uint32_t size, const ByteSet& set);
+
+    /// The first "\r\n"
+    static uint32_t FindCRLF(const void* data, uint32_t size);
+};
+
+} // namespace ss
@@ -0,0 +1,241 @@
+//
+// Copyright (c) 2020 Carl Chen. All rights reserved.
+//
+
+#include "ChainBuffer.h"
+#include <algorithm>
+
+namespace ss {
+
+ChainBuffer::ChainBuffer()
+    : size_(0)
+{
+}
+
+ChainBuffer::ChainBuffer(ChainBuffer&& b) noexcept
+    : slices_(std::move(b.slices_))
+    , size_(b.size_)
+{
+    b.slices_.clear();
+    b.size_ = 0;
+}
+
+ChainBuffer::~ChainBuffer() = default;
+
+ChainBuffer& ChainBuffer::operator=(ChainBuffer&& b) noexcept
+{
+    std::swap(slices_, b.slices_);
+    std::swap(size_, b.size_);
+    return *this;
+}
+
+void ChainBuffer::PushData(const void* data, uint32_t length)
+{
+    auto* bytes = static_cast<const uint8_t*>(data);
+    size_ += length;
+    if (!slices_.empty() && slices_.back().Extensible()) {
+        BufferSlice& last = slices_.back();
+        SharedBuffer::Block* block = last.buffer_.block_;
+        uint32_t n = std::min(length, block->capacity_ - block->used_);
+        memcpy(block->data_ + block->used_, bytes, n);
+        block->used_ += n;
+        last.size_ += n;
+        bytes += n;
+        length -= n;
+    }
+    if (length > 0) {
+        SharedBuffer::Block* block = SharedBuffer::Block::Create(std::max(length, uint32_t(kSegmentSize)));
+        memcpy(block->data_, bytes, length);
+        block->used_ = length;
+        slices_.emplace_back(SharedBuffer(block), 0, length);
+    }
+}
+
+void ChainBuffer::Append(DynamicBuffer&& buffer)
+{
+    if (!buffer.Empty()) {
+        Append(SharedBuffer(std::move(buffer)));
+    }
+}
+
+void ChainBuffer::Prepend(DynamicBuffer&& buffer)
+{
+    if (!buffer.Empty()) {
+        Prepend(SharedBuffer(std::move(buffer)));
+    }
+}
+
+void ChainBuffer::Append(BufferSlice slice)
+{
+    if (!slice.Empty()) {
+        size_ += slice.Size();
+        slices_.push_back(std::move(slice));
+    }
+}
+
+void ChainBuffer::Prepend(BufferSlice slice)
+{
+    if (!slice.Empty()) {
+        size_ += slice.Size();
+        slices_.push_front(std::move(slice));
+    }
+}
+
+void ChainBuffer::AppendReference(const void* data, uint32_t length, std::function<void()>&& onRelease)
+{
+    Append(SharedBuffer(data, length, std::move(onRelease)));
+}
+
+void ChainBuffer::Append(ChainBuffer&& chain)
+{
+    if (&chain == this) {
+        return;
+    }
+    if (slices_.empty()) {
+        std::swap(slices_, chain.slices_);
+    } else {
+        for (auto& slice : chain.slices_) {
+            slices_.push_back(std::move(slice));
+        }
+        chain.slices_.clear();
+    }
+    size_ += chain.size_;
+    chain.size_ = 0;
+}
+
+void ChainBuffer::Prepend(ChainBuffer&& chain)
+{
+    if (&chain == this) {
+        return;
+    }
+    for (auto it = chain.slices_.rbegin(); it != chain.slices_.rend(); ++it) {
+        slices_.push_front(std::move(*it));
+    }
+    size_ += chain.size_;
+    chain.slices_.clear();
+    chain.size_ = 0;
+}
+
+void ChainBuffer::Splice(ChainBuffer& chain, size_t n)
+{
+    if (&chain == this) {
+        return;
+    }
+    if (n > chain.size_) {
+        n = chain.size_;
+    }
+    chain.size_ -= n;
+    size_ += n;
+    while (n > 0) {
+        BufferSlice& front = chain.slices_.front();
+        if (front.Size() <= n) {
+            n -= front.Size();
+            slices_.push_back(std::move(front));
+            chain.slices_.pop_front();
+        } else {
+            // Share the segment, both parts are immutable from now on
+            slices_.push_back(front.SubSlice(0, uint32_t(n)));
+            front.Skip(uint32_t(n));
+            n = 0;
+        }
+    }
+}
+
+size_t ChainBuffer::ReadData(void* buffer, size_t size) const
+{
+    if (size > size_) {
+        size = size_;
+    }
+    auto* out = static_cast<uint8_t*>(buffer);
+    size_t left = size;
+    for (const auto& slice : slices_) {
+        if (left == 0) {
+            break;
+        }
+        size_t n = std::min(left, size_t(slice.Size()));
+        memcpy(out, slice.Data(), n);
+        out += n;
+        left -= n;
+    }
+    return size;
+}
+
+void ChainBuffer::Skip(size_t n)
+{
+    SSASSERT(size_ >= n);
+    size_ -= n;
+    while (n > 0) {
+        BufferSlice& front = slices_.front();
+        if (front.Size() <= n) {
+            n -= front.Size();
+            slices_.pop_front();
+        } else {
+            front.Skip(uint32_t(n));
+            n = 0;
+        }
+    }
+}
+
+void ChainBuffer::Clear()
+{
+    slices_.clear();
+    size_ = 0;
+}
+
+size_t ChainBuffer::Find(const void* delimiter, uint32_t length, size_t start) const
+{
+    if (length == 0) {
+        return start <= size_ ? start : kNPos;
+    }
+    auto* bytes = static_cast<const uint8_t*>(delimiter);
+    size_t base = 0; // Offset of the current slice in the chain
+    for (size_t i = 0; i < slices_.size() && base + length <= size_; ++i) {
+        const uint8_t* data = slices_[i].Data();
+        uint32_t size = slices_[i].Size();
+        uint32_t from = start > base ? uint32_t(std::min(start - base, size_t(size))) : 0;
+        while (from < size) {
+            // Find the candidates by the first byte, then compare the rest, which may be in the next segments
+            auto* found = static_cast<const uint8_t*>(memchr(data + from, bytes[0], size - from));
+            if (found == nullptr) {
+                break;
+            }
+            auto offset = uint32_t(found - data);
+            if (base + offset + length > size_) {
+                return kNPos;
+            }
+            if (Matches(i, offset, bytes, length)) {
+                return base + offset;
+            }
+            from = offset + 1;
+        }
+        base += size;
+    }
+    return kNPos;
+}
+
+bool ChainBuffer::Matches(size_t index, uint32_t offset, const uint8_t* bytes, uint32_t length) const
+{
+    while (length > 0) {
+        const BufferSlice& slice = slices_[index];
+        uint32_t n = std::min(length, slice.Size() - offset);
+        if (memcmp(slice.Data() + offset, bytes, n) != 0) {
+            return false;
+        }
+        bytes += n;
+        length -= n;
+        offset = 0;
+        ++index;
+    }
+    return true;
+}
+
+uint32_t ChainBuffer::GetReadableSpans(BufferSpan* spans, uint32_t maxCount, uint32_t firstSegment) const
+{
+    uint32_t count = 0;
+    for (size_t i = firstSegment; i < slices_.size() && count < maxCount; ++i) {
+        spans[count++] = slices_[i].Span();
+    }
+    return count;
+}
+
+} // namespace ss
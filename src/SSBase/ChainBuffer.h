@@ -0,0 +1,108 @@
+//
+// Copyright (c) 2020 Carl Chen. All rights reserved.
+//
+
+#pragma once
+
+#include "SharedBuffer.h"
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+
+namespace ss {
+
+/// Bytes held in a chain of `BufferSlice`s, like the evbuffer of libevent. Whole segments are appended and prepended
+/// in O(1), e.g. a received `DynamicBuffer` or a header assembled in front of a body, and moved between chains by
+/// `Splice` without copying the bytes: a segment is shared by the chains holding a part of it. The chain is written by
+/// vectored I/O through `GetReadableSpans`, see `AsyncTcpSocket::Send` and `WriteTo(OutputStream&, ...)`.
+///
+/// NOTE: The segments are immutable once they are shared, so a chain may be handed to another thread while another
+/// chain holds a part of the same segments.
+class ChainBuffer {
+public:
+    enum : size_t {
+        kNPos = size_t(-1)
+    };
+
+    enum : uint32_t {
+        kSegmentSize = 4096 // Of the segments allocated by `PushData`
+    };
+
+    ChainBuffer();
+
+    ChainBuffer(const ChainBuffer&) = delete;
+
+    ChainBuffer(ChainBuffer&& b) noexcept;
+
+    ~ChainBuffer();
+
+    ChainBuffer& operator=(const ChainBuffer&) = delete;
+
+    ChainBuffer& operator=(ChainBuffer&& b) noexcept;
+
+    size_t Size() const
+    {
+        return size_;
+    }
+
+    bool Empty() const
+    {
+        return size_ == 0;
+    }
+
+    uint32_t SegmentsCount() const
+    {
+        return uint32_t(slices_.size());
+    }
+
+    /// Copy `length` bytes to the end, into the free space of the last segment first
+    void PushData(const void* data, uint32_t length);
+
+    /// Take over the readable bytes of `buffer` as a segment, without copying them
+    void Append(DynamicBuffer&& buffer);
+
+    void Prepend(DynamicBuffer&& buffer);
+
+    /// Append `slice` as a segment, without copying the bytes
+    void Append(BufferSlice slice);
+
+    void Prepend(BufferSlice slice);
+
+    /// Append `length` bytes owned by the caller as a segment, without copying them. `onRelease` is invoked once no
+    /// chain refers to them any more.
+    void AppendReference(const void* data, uint32_t length, std::function<void()>&& onRelease);
+
+    /// Move all the segments of `chain` to the end, `chain` becomes empty
+    void Append(ChainBuffer&& chain);
+
+    /// Move all the segments of `chain` to the front, `chain` becomes empty
+    void Prepend(ChainBuffer&& chain);
+
+    /// Move the first `n` bytes of `chain` to the end, a segment which is split is shared by both chains
+    void Splice(ChainBuffer& chain, size_t n);
+
+    /// Do not pop data, invoke skip to pop data instead
+    size_t ReadData(void* buffer, size_t size) const;
+
+    void Skip(size_t n);
+
+    void Clear();
+
+    /// Offset of the first `delimiter` not before `start`, which may span several segments, or kNPos
+    size_t Find(const void* delimiter, uint32_t length, size_t start = 0) const;
+
+    /// Fill at most `maxCount` spans with the segments from `firstSegment`, returns the number of spans used. The bytes
+    /// must not be modified, they may be shared.
+    uint32_t GetReadableSpans(BufferSpan* spans, uint32_t maxCount, uint32_t firstSegment = 0) const;
+
+private:
+    /// Whether the bytes from the `offset` of slice `index` match `length` bytes of `bytes`
+    bool Matches(size_t index, uint32_t offset, const uint8_t* bytes, uint32_t length) const;
+
+private:
+    std::deque<BufferSlice> slices_;
+    size_t size_;
+};
+
+} // namespace ss
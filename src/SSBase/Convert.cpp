@@ -0,0 +1,513 @@
+//
+// Copyright (c) 2020 Carl Chen. All rights reserved.
+//
+
+#include "Convert.h"
+#include "internal/Simd.h"
+#include "thirdparty/fmt/fmt/format.h"
+#include <cerrno>
+#include <clocale>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+
+namespace ss {
+
+namespace {
+
+using ParseResult = Convert::ParseResult;
+
+template <class C>
+inline bool IsDigit(C c)
+{
+    return uint32_t(c) - '0' < 10u;
+}
+
+template <class C>
+inline ParseResult MakeResult(Convert::ParseError error, const C* first, const C* p, const C* last)
+{
+    return ParseResult { error, uint32_t(p - first), p < last ? uint32_t(*p) : 0u };
+}
+
+/// Number of the decimal digits at the start of [p, last)
+template <class C>
+inline size_t CountDigits(const C* p, const C* last)
+{
+    const C* start = p;
+    while (p < last && IsDigit(*p)) {
+        ++p;
+    }
+    return size_t(p - start);
+}
+
+inline size_t CountDigits(const uint8_t* p, const uint8_t* last)
+{
+    const uint8_t* start = p;
+#ifdef SS_SIMD_X86
+    const __m128i zero = _mm_set1_epi8('0');
+    const __m128i nine = _mm_set1_epi8(9);
+    while (last - p >= 16) {
+        // Digits are the bytes whose unsigned distance to '0' is at most 9
+        __m128i offsets = _mm_sub_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p)), zero);
+        __m128i digits = _mm_cmpeq_epi8(_mm_min_epu8(offsets, nine), offsets);
+        uint32_t mask = uint32_t(_mm_movemask_epi8(digits)) ^ 0xFFFFu;
+        if (mask != 0) {
+            return size_t(p - start) + Simd::CountTrailingZeros(mask);
+        }
+        p += 16;
+    }
+#endif
+    while (p < last && IsDigit(*p)) {
+        ++p;
+    }
+    return size_t(p - start);
+}
+
+/// Value of `n` (at most 19) digits
+template <class C>
+inline uint64_t ReadDigits(const C* p, size_t n)
+{
+    uint64_t value = 0;
+    for (size_t i = 0; i < n; ++i) {
+        value = value * 10 + uint32_t(p[i] - '0');
+    }
+    return value;
+}
+
+inline uint64_t ReadDigits(const uint8_t* p, size_t n)
+{
+    uint64_t value = 0;
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__ || defined(_MSC_VER)
+    // Combine 8 digits with 3 multiplications: pairs, then quads, then the 8 digits
+    while (n >= 8) {
+        uint64_t chunk;
+        memcpy(&chunk, p, 8);
+        chunk = ((chunk & 0x0F0F0F0F0F0F0F0Full) * 2561) >> 8;
+        chunk = ((chunk & 0x00FF00FF00FF00FFull) * 6553601) >> 16;
+        chunk = ((chunk & 0x0000FFFF0000FFFFull) * 42949672960001ull) >> 32;
+        value = value * 100000000u + uint32_t(chunk);
+        p += 8;
+        n -= 8;
+    }
+#endif
+    for (size_t i = 0; i < n; ++i) {
+        value = value * 10 + uint32_t(p[i] - '0');
+    }
+    return value;
+}
+
+template <class T, class C>
+ParseResult ParseInteger(const C* first, const C* last, T& value)
+{
+    using Unsigned = typename std::make_unsigned<T>::type;
+    const C* p = first;
+    bool negative = false;
+    if (p < last && (*p == '-' || *p == '+')) {
+        negative = *p == '-';
+        if (negative && !std::is_signed<T>::value) {
+            return MakeResult(Convert::kInvalidChar, first, p, last);
+        }
+        ++p;
+    }
+    const C* digits = p;
+    while (p < last && *p == '0') {
+        ++p;
+    }
+    const C* significant = p;
+    size_t n = CountDigits(p, last);
+    p += n;
+    if (p == digits) {
+        return MakeResult(p == last ? Convert::kEmpty : Convert::kInvalidChar, first, p, last);
+    }
+
+    uint64_t limit = uint64_t(std::numeric_limits<T>::max()) + (negative ? 1 : 0);
+    uint64_t magnitude = 0;
+    bool overflow = n > 20;
+    if (!overflow) {
+        magnitude = ReadDigits(significant, n < 20 ? n : 19);
+        if (n == 20) {
+            uint32_t lastDigit = uint32_t(significant[19] - '0');
+            overflow = magnitude > (std::numeric_limits<uint64_t>::max() - lastDigit) / 10;
+            magnitude = magnitude * 10 + lastDigit;
+        }
+        overflow = overflow || magnitude > limit;
+    }
+    if (overflow) {
+        value = negative ? std::numeric_limits<T>::min() : std::numeric_limits<T>::max();
+        return MakeResult(Convert::kOutOfRange, first, p, last);
+    }
+    value = T(negative ? Unsigned(0 - magnitude) : Unsigned(magnitude));
+    return MakeResult(Convert::kOk, first, p, last);
+}
+
+/// Powers of 10 which are exact in a double
+const double kExactPowers[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+template <class T>
+struct FloatTraits;
+
+template <>
+struct FloatTraits<double> {
+    static constexpr uint64_t kMaxExactMantissa = uint64_t(1) << 53;
+    static constexpr int kMaxExactPower = 22;
+
+    static double FromString(const char* s, char** end)
+    {
+        return strtod(s, end);
+    }
+};
+
+template <>
+struct FloatTraits<float> {
+    static constexpr uint64_t kMaxExactMantissa = uint64_t(1) << 24;
+    static constexpr int kMaxExactPower = 10;
+
+    static float FromString(const char* s, char** end)
+    {
+        return strtof(s, end);
+    }
+};
+
+/// Case insensitive match of the lower case ASCII `word` at `p`
+template <class C>
+inline bool MatchWord(const C* p, const C* last, const char* word)
+{
+    for (; *word != '\0'; ++p, ++word) {
+        if (p == last || (uint32_t(*p) | 0x20u) != uint32_t(uint8_t(*word))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+template <class T, class C>
+ParseResult ParseFloat(const C* first, const C* last, T& value)
+{
+    const C* p = first;
+    bool negative = false;
+    if (p < last && (*p == '-' || *p == '+')) {
+        negative = *p == '-';
+        ++p;
+    }
+    if (p < last && ((uint32_t(*p) | 0x20u) == 'i' || (uint32_t(*p) | 0x20u) == 'n')) {
+        if (MatchWord(p, last, "nan")) {
+            value = negative ? -std::numeric_limits<T>::quiet_NaN() : std::numeric_limits<T>::quiet_NaN();
+            return MakeResult(Convert::kOk, first, p + 3, last);
+        }
+        if (MatchWord(p, last, "inf")) {
+            p += MatchWord(p, last, "infinity") ? 8 : 3;
+            value = negative ? -std::numeric_limits<T>::infinity() : std::numeric_limits<T>::infinity();
+            return MakeResult(Convert::kOk, first, p, last);
+        }
+        return MakeResult(Convert::kInvalidChar, first, p, last);
+    }
+
+    // Collect up to 19 significant digits, the fast path only takes numbers without any more
+    const C* start = p;
+    uint64_t mantissa = 0;
+    int significantDigits = 0;
+    int64_t exponent = 0;
+    bool truncated = false;
+    bool hasDigits = false;
+    for (; p < last && IsDigit(*p); ++p) {
+        uint32_t digit = uint32_t(*p - '0');
+        hasDigits = true;
+        if (significantDigits < 19) {
+            mantissa = mantissa * 10 + digit;
+            significantDigits += mantissa != 0;
+        } else {
+            ++exponent;
+            truncated = truncated || digit != 0;
+        }
+    }
+    if (p < last && *p == '.') {
+        for (++p; p < last && IsDigit(*p); ++p) {
+            uint32_t digit = uint32_t(*p - '0');
+            hasDigits = true;
+            if (significantDigits < 19) {
+                mantissa = mantissa * 10 + digit;
+                significantDigits += mantissa != 0;
+                --exponent;
+            } else {
+                truncated = truncated || digit != 0;
+            }
+        }
+    }
+    if (!hasDigits) {
+        // A lone '.' is not a number either
+        return MakeResult(start == last ? Convert::kEmpty : Convert::kInvalidChar, first, start, last);
+    }
+    if (p < last && (*p == 'e' || *p == 'E')) {
+        // Like strtod, an 'e' without digits is not part of the number
+        const C* q = p + 1;
+        bool negativeExponent = false;
+        if (q < last && (*q == '-' || *q == '+')) {
+            negativeExponent = *q == '-';
+            ++q;
+        }
+        if (q < last && IsDigit(*q)) {
+            int64_t e = 0;
+            for (; q < last && IsDigit(*q); ++q) {
+                if (e < 100000) {
+                    e = e * 10 + (*q - '0');
+                }
+            }
+            exponent += negativeExponent ? -e : e;
+            p = q;
+        }
+    }
+
+    using Traits = FloatTraits<T>;
+    if (!truncated && mantissa <= Traits::kMaxExactMantissa && exponent >= -Traits::kMaxExactPower
+        && exponent <= Traits::kMaxExactPower) {
+        // Both operands are exact, so the single rounding of the operation gives the correctly rounded result
+        T result = T(mantissa);
+        T power = T(kExactPowers[exponent < 0 ? -exponent : exponent]);
+        result = exponent < 0 ? result / power : result * power;
+        value = negative ? -result : result;
+        return MakeResult(Convert::kOk, first, p, last);
+    }
+
+    // Slow path: let the C library do the correct rounding, with the decimal point of the current locale
+    char localBuffer[256];
+    std::string heapBuffer;
+    size_t length = size_t(p - first);
+    char* buffer = localBuffer;
+    if (length >= sizeof(localBuffer)) {
+        heapBuffer.resize(length + 1);
+        buffer = &heapBuffer[0];
+    }
+    char point = *localeconv()->decimal_point;
+    for (size_t i = 0; i < length; ++i) {
+        buffer[i] = first[i] == '.' ? point : char(first[i]);
+    }
+    buffer[length] = '\0';
+    int savedErrno = errno;
+    errno = 0;
+    char* end = nullptr;
+    T result = Traits::FromString(buffer, &end);
+    bool overflow = errno == ERANGE && std::isinf(result);
+    errno = savedErrno;
+    value = result;
+    return MakeResult(overflow ? Convert::kOutOfRange : Convert::kOk, first, p, last);
+}
+
+template <class T, class C>
+inline ParseResult ParseNumber(const C* first, const C* last, T& value, std::true_type)
+{
+    return ParseInteger(first, last, value);
+}
+
+template <class T, class C>
+inline ParseResult ParseNumber(const C* first, const C* last, T& value, std::false_type)
+{
+    return ParseFloat(first, last, value);
+}
+
+template <class T, class C>
+inline ParseResult ParseNumber(const C* first, const C* last, T& value)
+{
+    return ParseNumber(first, last, value, std::is_integral<T>());
+}
+
+const char kDigitPairs[] = "00010203040506070809"
+                           "10111213141516171819"
+                           "20212223242526272829"
+                           "30313233343536373839"
+                           "40414243444546474849"
+                           "50515253545556575859"
+                           "60616263646566676869"
+                           "70717273747576777879"
+                           "80818283848586878889"
+                           "90919293949596979899";
+
+inline uint32_t CountDecimalDigits(uint64_t value)
+{
+    uint32_t n = 1;
+    for (;;) {
+        if (value < 10) {
+            return n;
+        }
+        if (value < 100) {
+            return n + 1;
+        }
+        if (value < 1000) {
+            return n + 2;
+        }
+        if (value < 10000) {
+            return n + 3;
+        }
+        value /= 10000u;
+        n += 4;
+    }
+}
+
+/// Write the `n` digits of `value` ending at `end`, two at a time
+inline void WriteDigits(char* end, uint64_t value)
+{
+    while (value >= 100) {
+        uint32_t pair = uint32_t(value % 100) * 2;
+        value /= 100;
+        *--end = kDigitPairs[pair + 1];
+        *--end = kDigitPairs[pair];
+    }
+    if (value >= 10) {
+        *--end = kDigitPairs[value * 2 + 1];
+        *--end = kDigitPairs[value * 2];
+    } else {
+        *--end = char('0' + value);
+    }
+}
+
+template <class T>
+uint32_t IntegerToChars(char* first, char* last, T value)
+{
+    using Unsigned = typename std::make_unsigned<T>::type;
+    bool negative = value < 0;
+    uint64_t magnitude = negative ? uint64_t(Unsigned(0 - Unsigned(value))) : uint64_t(value);
+    uint32_t length = CountDecimalDigits(magnitude) + (negative ? 1 : 0);
+    if (last - first < ptrdiff_t(length)) {
+        return 0;
+    }
+    if (negative) {
+        *first = '-';
+    }
+    WriteDigits(first + length, magnitude);
+    return length;
+}
+
+template <class T>
+uint32_t FloatToChars(char* first, char* last, T value)
+{
+    // fmt writes the shortest round trip representation (Grisu) with the "{}" format, but marks integral values with
+    // a ".0" which neither `std::to_chars` nor streams write
+    fmt::basic_memory_buffer<char, 64> buffer;
+    fmt::format_to(buffer, "{}", value);
+    size_t length = buffer.size();
+    if (length > 2 && buffer[length - 2] == '.' && buffer[length - 1] == '0') {
+        length -= 2;
+    }
+    if (last - first < ptrdiff_t(length)) {
+        return 0;
+    }
+    memcpy(first, buffer.data(), length);
+    return uint32_t(length);
+}
+
+template <class T>
+inline uint32_t NumberToChars(char* first, char* last, T value, std::true_type)
+{
+    return IntegerToChars(first, last, value);
+}
+
+template <class T>
+inline uint32_t NumberToChars(char* first, char* last, T value, std::false_type)
+{
+    return FloatToChars(first, last, value);
+}
+
+} // namespace
+
+String Convert::ParseResult::Message() const
+{
+    switch (error) {
+    case kOk:
+        return String();
+    case kEmpty:
+        return "no number";
+    case kOutOfRange:
+        return "number out of range";
+    default:
+        break;
+    }
+    String message = "invalid character '";
+    message += CharWrapper(code);
+    message += "' at index ";
+    AppendTo(message, index);
+    return message;
+}
+
+template <class T>
+Convert::ParseResult Convert::Parse(const CharSequence& s, T& value, uint32_t from)
+{
+    T result {};
+    ParseResult r = FromChars(s, from, result);
+    r.index += from;
+    if (r.error == kOk && r.index < s.Length()) {
+        r.error = kInvalidChar;
+    }
+    if (r.error == kOk || r.error == kOutOfRange) {
+        value = result;
+    }
+    return r;
+}
+
+template <class T>
+Convert::ParseResult Convert::FromChars(const char* first, const char* last, T& value)
+{
+    return ParseNumber(reinterpret_cast<const uint8_t*>(first), reinterpret_cast<const uint8_t*>(last), value);
+}
+
+template <class T>
+Convert::ParseResult Convert::FromChars(const CharSequence& s, uint32_t from, T& value)
+{
+    uint32_t length = s.Length();
+    if (from >= length) {
+        return ParseResult { kEmpty, 0, 0 };
+    }
+    CharSequence::Units units = s.GetUnits();
+    switch (units.width) {
+    case 1: {
+        auto* p = static_cast<const uint8_t*>(units.data);
+        return ParseNumber(p + from, p + length, value);
+    }
+    case 2: {
+        auto* p = static_cast<const uint16_t*>(units.data);
+        return ParseNumber(p + from, p + length, value);
+    }
+    default: {
+        auto* p = static_cast<const uint32_t*>(units.data);
+        return ParseNumber(p + from, p + length, value);
+    }
+    }
+}
+
+template <class T>
+uint32_t Convert::ToChars(char* first, char* last, T value)
+{
+    return NumberToChars(first, last, value, std::is_integral<T>());
+}
+
+template <class T>
+void Convert::AppendTo(String& s, T value)
+{
+    char buffer[32];
+    uint32_t length = ToChars(buffer, buffer + sizeof(buffer), value);
+    s.AppendUtf8(buffer, length, length, 1);
+}
+
+#define SS_INSTANTIATE_CONVERT(T)                                                       \
+    template Convert::ParseResult Convert::Parse<T>(const CharSequence&, T&, uint32_t); \
+    template Convert::ParseResult Convert::FromChars<T>(const char*, const char*, T&);  \
+    template Convert::ParseResult Convert::FromChars<T>(const CharSequence&, uint32_t, T&); \
+    template uint32_t Convert::ToChars<T>(char*, char*, T);                             \
+    template void Convert::AppendTo<T>(String&, T);
+
+SS_INSTANTIATE_CONVERT(short)
+SS_INSTANTIATE_CONVERT(unsigned short)
+SS_INSTANTIATE_CONVERT(int)
+SS_INSTANTIATE_CONVERT(unsigned int)
+SS_INSTANTIATE_CONVERT(long)
+SS_INSTANTIATE_CONVERT(unsigned long)
+SS_INSTANTIATE_CONVERT(long long)
+SS_INSTANTIATE_CONVERT(unsigned long long)
+SS_INSTANTIATE_CONVERT(float)
+SS_INSTANTIATE_CONVERT(double)
+
+#undef SS_INSTANTIATE_CONVERT
+
+} // namespace ss
@@ -7,39 +7,91 @@
 #include "Str.h"
 #include <sstream>
 #include <string>
+#include <type_traits>
 
 namespace ss {
 
 class Convert {
 public:
+    enum ParseError {
+        kOk,
+        kEmpty, // No number at all
+        kInvalidChar,
+        kOutOfRange
+    };
+
+    struct ParseResult {
+        ParseError error;
+        /// Index of the first character which is not part of the number, which is the failing character if the error
+        /// is `kInvalidChar`
+        uint32_t index;
+        /// The character at `index`, 0 at the end of the input
+        uint32_t code;
+
+        explicit operator bool() const
+        {
+            return error == kOk;
+        }
+
+        /// e.g. "invalid character 'x' at index 3"
+        String Message() const;
+    };
+
+    /// Numbers `Parse`, `FromChars` and `ToChars` support. Other types, including the character types which streams
+    /// read and write as characters, are converted with streams.
+    template <class T>
+    struct IsNumber {
+        static constexpr bool value = std::is_same<T, float>::value || std::is_same<T, double>::value
+            || (std::is_integral<T>::value && sizeof(T) > 1 && !std::is_same<T, wchar_t>::value
+                && !std::is_same<T, char16_t>::value && !std::is_same<T, char32_t>::value);
+    };
+
+    /// Parse all the characters of `s` from `from` as a decimal number, without streams, locales or allocations.
+    /// Integers may have a sign, floating point numbers may also have a fraction, an exponent, or be "inf" or "nan".
+    /// On errors `value` is not changed, except that it is clamped to the range of `T` if the number is out of range.
+    template <class T>
+    static ParseResult Parse(const CharSequence& s, T& value, uint32_t from = 0);
+
+    /// Parse the number at the start of [first, last) like `std::from_chars`, the rest of the characters is not
+    /// checked. `index` of the result is the length of the number.
+    template <class T>
+    static ParseResult FromChars(const char* first, const char* last, T& value);
+
+    /// Parse the number of `s` starting at `from`, the rest of the characters is not checked
+    template <class T>
+    static ParseResult FromChars(const CharSequence& s, uint32_t from, T& value);
+
+    /// Write `value` to [first, last) like `std::to_chars`, returns the number of characters written, or 0 if they do
+    /// not fit. Floating point numbers are written in the shortest form which parses back to the same value.
+    template <class T>
+    static uint32_t ToChars(char* first, char* last, T value);
+
+    /// Append `value` to `s`, without any temporary string
+    template <class T>
+    static void AppendTo(String& s, T value);
+
     template <class T>
     static T StringTo(const String& s)
     {
-        std::stringstream ss;
-        ss << s;
-        T t;
-        ss >> t;
-        return t;
+        return StringTo<T>((const CharSequence&)s);
+    }
+
+    template <class T>
+    static T StringTo(const CharSequence& s)
+    {
+        return StringToImpl<T>(s, std::integral_constant<bool, IsNumber<T>::value>());
     }
 
     template <class T>
     static T StringTo(const char* s)
     {
-        std::stringstream ss;
-        ss << s;
-        T t;
-        ss >> t;
-        return t;
+        return StringTo<T>(String(s));
     }
 
     template <class T>
     static T StringTo(const std::string& s)
     {
-        std::stringstream ss;
-        ss << s;
-        T t;
-        ss >> t;
-        return t;
+        return StringTo<T>(String(s.c_str(), uint32_t(s.size())));
     }
 
     template <class T>
@@ -64,6 +116,44 @@ public:
 
     template <class T>
     static String ToString(const T& t)
+    {
+        return ToStringImpl(t, std::integral_constant<bool, IsNumber<T>::value>());
+    }
+
+private:
+    /// Like a stream, leading white spaces and trailing characters are ignored, and 0 is returned if there is no number
+    template <class T>
+    static T StringToImpl(const CharSequence& s, std::true_type)
+    {
+        uint32_t from = 0;
+        while (from < s.Length() && CharSequence::IsWhiteSpace(s[from])) {
+            ++from;
+        }
+        T t {};
+        FromChars(s, from, t);
+        return t;
+    }
+
+    template <class T>
+    static T StringToImpl(const CharSequence& s, std::false_type)
+    {
+        std::stringstream ss;
+        ss << s;
+        T t;
+        ss >> t;
+        return t;
+    }
+
+    template <class T>
+    static String ToStringImpl(const T& t, std::true_type)
+    {
+        String s;
+        AppendTo(s, t);
+        return s;
+    }
+
+    template <class T>
+    static String ToStringImpl(const T& t, std::false_type)
     {
         std::stringstream ss;
         String s;
@@ -73,4 +163,4 @@ public:
     }
 };
 
-} // namespace ss
\ No newline at end of file
+} // namespace ss
@@ -0,0 +1,579 @@
+//
+// Copyright (c) 2020 Carl Chen. All rights reserved.
+//
+
+#pragma once
+
+#include "Str.h"
+#include "internal/Simd.h"
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <initializer_list>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace ss {
+
+template <class Key>
+struct DefaultHasher {
+    using Hash = std::hash<Key>;
+    using Equal = std::equal_to<Key>;
+};
+
+template <>
+struct DefaultHasher<String> {
+    using Hash = StringHash;
+    using Equal = StringEqual;
+};
+
+template <>
+struct DefaultHasher<StringView> {
+    using Hash = StringHash;
+    using Equal = StringEqual;
+};
+
+/// Open addressing hash table storing the elements in one flat array, shared by `FlatHashMap` and `FlatHashSet`.
+/// Each slot has a control byte, which is empty, deleted or 7 bits of the hash of the element. Lookups compare a group
+/// of 16 control bytes at once, and only the slots whose bits match are compared with the key. The lookups accept any
+/// key type the `Hash` and `Equal` accept, so e.g. a `FlatHashMap<String, T>` is looked up by a `const char*` without
+/// creating a `String`.
+///
+/// Inserting or erasing elements invalidates the iterators and the pointers to the elements.
+template <class Policy, class Hash, class Equal>
+class FlatHashTable {
+public:
+    using Key = typename Policy::Key;
+    using Element = typename Policy::Element;
+
+    template <bool kConst>
+    class Iterator {
+    public:
+        using Table = typename std::conditional<kConst, const FlatHashTable, FlatHashTable>::type;
+        using Reference = typename std::conditional<kConst, const Element&, Element&>::type;
+        using Pointer = typename std::conditional<kConst, const Element*, Element*>::type;
+
+        Iterator(Table* table, size_t index)
+            : table_(table)
+            , index_(index)
+        {
+            SkipEmpty();
+        }
+
+        /// A non-const iterator converts to a const one
+        operator Iterator<true>() const // NOLINT(google-explicit-constructor,hicpp-explicit-conversions)
+        {
+            return Iterator<true>(table_, index_);
+        }
+
+        Reference operator*() const
+        {
+            return table_->slots_[index_];
+        }
+
+        Pointer operator->() const
+        {
+            return &table_->slots_[index_];
+        }
+
+        Iterator& operator++()
+        {
+            ++index_;
+            SkipEmpty();
+            return *this;
+        }
+
+        bool operator==(const Iterator& other) const
+        {
+            return index_ == other.index_;
+        }
+
+        bool operator!=(const Iterator& other) const
+        {
+            return index_ != other.index_;
+        }
+
+    private:
+        void SkipEmpty()
+        {
+            while (index_ < table_->capacity_ && !IsFull(table_->ctrl_[index_])) {
+                ++index_;
+            }
+        }
+
+        Table* table_;
+        size_t index_;
+
+        friend class FlatHashTable;
+    };
+
+    using iterator = Iterator<false>;
+    using const_iterator = Iterator<true>;
+
+    FlatHashTable() = default;
+
+    FlatHashTable(const FlatHashTable& other)
+        : hash_(other.hash_)
+        , equal_(other.equal_)
+    {
+        Reserve(other.size_);
+        for (auto& element : other) {
+            InsertUnique(Policy::KeyOf(element), element);
+        }
+    }
+
+    FlatHashTable(FlatHashTable&& other) noexcept
+        : hash_(std::move(other.hash_))
+        , equal_(std::move(other.equal_))
+    {
+        Steal(other);
+    }
+
+    ~FlatHashTable()
+    {
+        Destroy();
+    }
+
+    FlatHashTable& operator=(const FlatHashTable& other)
+    {
+        if (&other != this) {
+            FlatHashTable copy(other);
+            Swap(copy);
+        }
+        return *this;
+    }
+
+    FlatHashTable& operator=(FlatHashTable&& other) noexcept
+    {
+        if (&other != this) {
+            Destroy();
+            hash_ = std::move(other.hash_);
+            equal_ = std::move(other.equal_);
+            Steal(other);
+        }
+        return *this;
+    }
+
+    void Swap(FlatHashTable& other) noexcept
+    {
+        std::swap(hash_, other.hash_);
+        std::swap(equal_, other.equal_);
+        std::swap(ctrl_, other.ctrl_);
+        std::swap(slots_, other.slots_);
+        std::swap(capacity_, other.capacity_);
+        std::swap(size_, other.size_);
+        std::swap(growthLeft_, other.growthLeft_);
+    }
+
+    iterator begin()
+    {
+        return iterator(this, 0);
+    }
+
+    iterator end()
+    {
+        return iterator(this, capacity_);
+    }
+
+    const_iterator begin() const
+    {
+        return const_iterator(this, 0);
+    }
+
+    const_iterator end() const
+    {
+        return const_iterator(this, capacity_);
+    }
+
+    size_t Size() const
+    {
+        return size_;
+    }
+
+    bool Empty() const
+    {
+        return size_ == 0;
+    }
+
+    size_t Capacity() const
+    {
+        return capacity_;
+    }
+
+    void Clear()
+    {
+        Destroy();
+        ctrl_ = nullptr;
+        slots_ = nullptr;
+        capacity_ = 0;
+        size_ = 0;
+        growthLeft_ = 0;
+    }
+
+    /// Make sure `n` elements can be stored without rehashing
+    void Reserve(size_t n)
+    {
+        if (n > size_ + growthLeft_) {
+            Rehash(CapacityFor(n));
+        }
+    }
+
+    template <class K>
+    iterator Find(const K& key)
+    {
+        return iterator(this, FindIndex(key, MixHash(hash_(key))));
+    }
+
+    template <class K>
+    const_iterator Find(const K& key) const
+    {
+        return const_iterator(this, FindIndex(key, MixHash(hash_(key))));
+    }
+
+    template <class K>
+    bool Contains(const K& key) const
+    {
+        return FindIndex(key, MixHash(hash_(key))) != capacity_;
+    }
+
+    /// Returns the number of the erased elements, 0 or 1
+    template <class K>
+    size_t Erase(const K& key)
+    {
+        size_t index = FindIndex(key, MixHash(hash_(key)));
+        if (index == capacity_) {
+            return 0;
+        }
+        EraseAt(index);
+        return 1;
+    }
+
+    void Erase(const_iterator it)
+    {
+        EraseAt(it.index_);
+    }
+
+protected:
+    /// Insert the element made of `args` if there is no element of `key`. `key` is only hashed and compared, `args`
+    /// are used only if the element is inserted.
+    template <class K, class... Args>
+    std::pair<iterator, bool> InsertUnique(const K& key, Args&&... args)
+    {
+        uint64_t hash = MixHash(hash_(key));
+        size_t index = FindIndex(key, hash);
+        if (index != capacity_) {
+            return { iterator(this, index), false };
+        }
+        index = PrepareInsert(hash);
+        new (SlotAddress(index)) Element(std::forward<Args>(args)...);
+        SetCtrl(index, int8_t(hash & 0x7Fu));
+        ++size_;
+        return { iterator(this, index), true };
+    }
+
+private:
+    enum : int8_t {
+        kEmpty = -128,
+        kDeleted = -2
+    };
+
+    enum : size_t {
+        kGroupWidth = 16,
+        kMinCapacity = 16
+    };
+
+    static bool IsFull(int8_t ctrl)
+    {
+        return ctrl >= 0;
+    }
+
+    /// The slot is picked by the high bits and the control byte keeps the low 7 bits, so the hash must be well mixed
+    /// (fmix64 of MurmurHash3), e.g. `std::hash` of integers is the integer itself
+    static uint64_t MixHash(uint64_t h)
+    {
+        h ^= h >> 33u;
+        h *= 0xFF51AFD7ED558CCDull;
+        h ^= h >> 33u;
+        h *= 0xC4CEB9FE1A85EC53ull;
+        h ^= h >> 33u;
+        return h;
+    }
+
+    /// One bit for each of the 16 control bytes starting at `ctrl` which equals `value`
+    static uint32_t Match(const int8_t* ctrl, int8_t value)
+    {
+#ifdef SS_SIMD_X86
+        __m128i group = _mm_loadu_si128(reinterpret_cast<const __m128i*>(ctrl));
+        return uint32_t(_mm_movemask_epi8(_mm_cmpeq_epi8(group, _mm_set1_epi8(value))));
+#else
+        uint32_t mask = 0;
+        for (uint32_t i = 0; i < kGroupWidth; ++i) {
+            mask |= uint32_t(ctrl[i] == value) << i;
+        }
+        return mask;
+#endif
+    }
+
+    /// One bit for each of the 16 control bytes starting at `ctrl` which is empty or deleted
+    static uint32_t MatchFree(const int8_t* ctrl)
+    {
+#ifdef SS_SIMD_X86
+        // Both have the sign bit set, the full ones do not
+        return uint32_t(_mm_movemask_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(ctrl))));
+#else
+        uint32_t mask = 0;
+        for (uint32_t i = 0; i < kGroupWidth; ++i) {
+            mask |= uint32_t(ctrl[i] < 0) << i;
+        }
+        return mask;
+#endif
+    }
+
+    static size_t CapacityFor(size_t n)
+    {
+        // At most 7/8 of the slots are used
+        size_t capacity = kMinCapacity;
+        while (capacity - capacity / 8 < n) {
+            capacity *= 2;
+        }
+        return capacity;
+    }
+
+    template <class K>
+    size_t FindIndex(const K& key, uint64_t hash) const
+    {
+        if (capacity_ == 0) {
+            return capacity_;
+        }
+        size_t mask = capacity_ - 1;
+        auto h2 = int8_t(hash & 0x7Fu);
+        for (size_t pos = size_t(hash >> 7u) & mask, probed = 0; probed < capacity_; probed += kGroupWidth) {
+            uint32_t match = Match(ctrl_ + pos, h2);
+            while (match != 0) {
+                size_t index = (pos + Simd::CountTrailingZeros(match)) & mask;
+                if (equal_(Policy::KeyOf(slots_[index]), key)) {
+                    return index;
+                }
+                match &= match - 1;
+            }
+            if (Match(ctrl_ + pos, kEmpty) != 0) {
+                break;
+            }
+            pos = (pos + kGroupWidth) & mask;
+        }
+        return capacity_;
+    }
+
+    /// Returns a free slot for an element of `hash`, rehashing if needed
+    size_t PrepareInsert(uint64_t hash)
+    {
+        if (capacity_ == 0) {
+            Rehash(kMinCapacity);
+        }
+        size_t index = FindFree(hash);
+        if (growthLeft_ == 0 && ctrl_[index] == kEmpty) {
+            // Reusing deleted slots does not take the growth, otherwise grow, or just drop the deleted slots if
+            // they are many
+            Rehash(size_ + 1 > capacity_ / 2 ? capacity_ * 2 : capacity_);
+            index = FindFree(hash);
+        }
+        if (ctrl_[index] == kEmpty) {
+            --growthLeft_;
+        }
+        return index;
+    }
+
+    size_t FindFree(uint64_t hash) const
+    {
+        size_t mask = capacity_ - 1;
+        size_t pos = size_t(hash >> 7u) & mask;
+        while (true) {
+            uint32_t free = MatchFree(ctrl_ + pos);
+            if (free != 0) {
+                return (pos + Simd::CountTrailingZeros(free)) & mask;
+            }
+            pos = (pos + kGroupWidth) & mask;
+        }
+    }
+
+    /// The elements of a set are const
+    void* SlotAddress(size_t index) const
+    {
+        return const_cast<void*>(static_cast<const void*>(&slots_[index]));
+    }
+
+    void SetCtrl(size_t index, int8_t value)
+    {
+        ctrl_[index] = value;
+        // The first group is mirrored after the last slot, so a group can be loaded from any position
+        if (index < kGroupWidth) {
+            ctrl_[capacity_ + index] = value;
+        }
+    }
+
+    void EraseAt(size_t index)
+    {
+        slots_[index].~Element();
+        SetCtrl(index, kDeleted);
+        --size_;
+    }
+
+    /// Allocate the control bytes and the slots in one block
+    static size_t SlotsOffset(size_t capacity)
+    {
+        size_t ctrlSize = capacity + kGroupWidth;
+        return (ctrlSize + alignof(Element) - 1) / alignof(Element) * alignof(Element);
+    }
+
+    void Rehash(size_t capacity)
+    {
+        int8_t* oldCtrl = ctrl_;
+        Element* oldSlots = slots_;
+        size_t oldCapacity = capacity_;
+
+        auto* block = static_cast<char*>(::operator new(SlotsOffset(capacity) + capacity * sizeof(Element)));
+        ctrl_ = reinterpret_cast<int8_t*>(block);
+        slots_ = reinterpret_cast<Element*>(block + SlotsOffset(capacity));
+        memset(ctrl_, kEmpty, capacity + kGroupWidth);
+        capacity_ = capacity;
+        growthLeft_ = capacity - capacity / 8 - size_;
+
+        for (size_t i = 0; i < oldCapacity; ++i) {
+            if (IsFull(oldCtrl[i])) {
+                uint64_t hash = MixHash(hash_(Policy::KeyOf(oldSlots[i])));
+                size_t index = FindFree(hash);
+                new (SlotAddress(index)) Element(std::move(oldSlots[i]));
+                SetCtrl(index, int8_t(hash & 0x7Fu));
+                oldSlots[i].~Element();
+            }
+        }
+        ::operator delete(oldCtrl);
+    }
+
+    void Destroy()
+    {
+        for (size_t i = 0; i < capacity_; ++i) {
+            if (IsFull(ctrl_[i])) {
+                slots_[i].~Element();
+            }
+        }
+        ::operator delete(ctrl_);
+    }
+
+    void Steal(FlatHashTable& other)
+    {
+        ctrl_ = other.ctrl_;
+        slots_ = other.slots_;
+        capacity_ = other.capacity_;
+        size_ = other.size_;
+        growthLeft_ = other.growthLeft_;
+        other.ctrl_ = nullptr;
+        other.slots_ = nullptr;
+        other.capacity_ = 0;
+        other.size_ = 0;
+        other.growthLeft_ = 0;
+    }
+
+    Hash hash_ {};
+    Equal equal_ {};
+    int8_t* ctrl_ = nullptr;
+    Element* slots_ = nullptr;
+    size_t capacity_ = 0;
+    size_t size_ = 0;
+    size_t growthLeft_ = 0; // Number of the empty slots which may be used before rehashing
+};
+
+template <class K, class V>
+struct FlatMapPolicy {
+    using Key = K;
+    using Element = std::pair<const K, V>;
+
+    static const K& KeyOf(const Element& element)
+    {
+        return element.first;
+    }
+};
+
+template <class K>
+struct FlatSetPolicy {
+    using Key = K;
+    using Element = const K;
+
+    static const K& KeyOf(const K& element)
+    {
+        return element;
+    }
+};
+
+template <class Key, class Value, class Hash = typename DefaultHasher<Key>::Hash,
+    class Equal = typename DefaultHasher<Key>::Equal>
+class FlatHashMap : public FlatHashTable<FlatMapPolicy<Key, Value>, Hash, Equal> {
+    using Base = FlatHashTable<FlatMapPolicy<Key, Value>, Hash, Equal>;
+
+public:
+    using iterator = typename Base::iterator;
+    using Element = typename Base::Element;
+
+    FlatHashMap() = default;
+
+    FlatHashMap(std::initializer_list<Element> elements)
+    {
+        Base::Reserve(elements.size());
+        for (auto& element : elements) {
+            Insert(element);
+        }
+    }
+
+    std::pair<iterator, bool> Insert(const Element& element)
+    {
+        return Base::InsertUnique(element.first, element);
+    }
+
+    std::pair<iterator, bool> Insert(Element&& element)
+    {
+        return Base::InsertUnique(element.first, std::move(element));
+    }
+
+    /// Insert the value made of `args` if there is no element of `key`, the key is converted to `Key` only if it is
+    /// inserted
+    template <class K, class... Args>
+    std::pair<iterator, bool> TryEmplace(K&& key, Args&&... args)
+    {
+        return Base::InsertUnique(key, std::piecewise_construct, std::forward_as_tuple(std::forward<K>(key)),
+            std::forward_as_tuple(std::forward<Args>(args)...));
+    }
+
+    template <class K>
+    Value& operator[](K&& key)
+    {
+        return TryEmplace(std::forward<K>(key)).first->second;
+    }
+};
+
+template <class Key, class Hash = typename DefaultHasher<Key>::Hash, class Equal = typename DefaultHasher<Key>::Equal>
+class FlatHashSet : public FlatHashTable<FlatSetPolicy<Key>, Hash, Equal> {
+    using Base = FlatHashTable<FlatSetPolicy<Key>, Hash, Equal>;
+
+public:
+    using iterator = typename Base::iterator;
+
+    FlatHashSet() = default;
+
+    FlatHashSet(std::initializer_list<Key> keys)
+    {
+        Base::Reserve(keys.size());
+        for (auto& key : keys) {
+            Insert(key);
+        }
+    }
+
+    /// The key is converted to `Key` only if it is inserted
+    template <class K>
+    std::pair<iterator, bool> Insert(K&& key)
+    {
+        return Base::InsertUnique(key, std::forward<K>(key));
+    }
+};
+
+}
@@ -0,0 +1,61 @@
+//
+// Copyright (c) 2020 Carl Chen. All rights reserved.
+//
+
+#pragma once
+
+#include "Buffer.h"
+#include "Str.h"
+
+namespace ss {
+
+namespace internal {
+
+/// fmt writes to the free space after the data of a `DynamicBuffer`, which grows in place. The text is appended to
+/// the data by `Commit`, so a format error leaves the data untouched.
+class DynamicBufferFormatSink final : public fmt::internal::buffer<char> {
+public:
+    explicit DynamicBufferFormatSink(DynamicBuffer& buffer)
+        : buffer_(buffer)
+    {
+        set(buffer.GetEndPtr<char>(), buffer.FreeSpaceSize());
+    }
+
+    void Commit()
+    {
+        buffer_.Reset(Offset(), buffer_.Size() + uint32_t(size()));
+    }
+
+private:
+    void grow(std::size_t capacity) override
+    {
+        // Count the text as data for a while, so it is kept if the data is moved
+        uint32_t size = buffer_.Size();
+        uint32_t written = uint32_t(this->size());
+        buffer_.Reset(Offset(), size + written);
+        buffer_.EnsureSpace(uint32_t(capacity) - written);
+        set(buffer_.GetEndPtr<char>() - written, written + buffer_.FreeSpaceSize());
+        buffer_.Reset(Offset(), size);
+    }
+
+    uint32_t Offset() const
+    {
+        return uint32_t(buffer_.GetData<uint8_t>() - static_cast<const uint8_t*>(buffer_.GetBufferHead()));
+    }
+
+    DynamicBuffer& buffer_;
+};
+
+} // namespace internal
+
+/// Append the text formatted by fmt to the data of `buffer`, without any temporary. See `FormatTo(String&, ...)`
+/// for the formats.
+template <class Format, class... Args>
+void FormatTo(DynamicBuffer& buffer, const Format& format, const Args&... args)
+{
+    internal::DynamicBufferFormatSink sink(buffer);
+    internal::FormatToBuffer(sink, format, args...);
+    sink.Commit();
+}
+
+} // namespace ss
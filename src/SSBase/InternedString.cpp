@@ -0,0 +1,230 @@
+//
+// Copyright (c) 2020 Carl Chen. All rights reserved.
+//
+
+#include "InternedString.h"
+#include "Arena.h"
+#include "Misc.h"
+#include <mutex>
+#include <new>
+#include <vector>
+
+namespace ss {
+
+namespace {
+
+/// The shard and the slot are picked by different bits of the hash, so the bits must be well mixed (fmix64 of
+/// MurmurHash3)
+inline uint64_t MixHash(uint64_t h)
+{
+    h ^= h >> 33u;
+    h *= 0xFF51AFD7ED558CCDull;
+    h ^= h >> 33u;
+    h *= 0xC4CEB9FE1A85EC53ull;
+    h ^= h >> 33u;
+    return h;
+}
+
+}
+
+struct InternTable::Shard {
+    using Entry = InternedString::Entry;
+
+    enum {
+        kInitialSlots = 16,
+        kArenaBlockSize = 16 * 1024
+    };
+
+    mutable std::mutex mutex;
+    /// Open addressing with linear probing, the size is a power of two and at most 3/4 of the slots are used
+    std::vector<Entry*> slots;
+    size_t size = 0;
+    std::vector<void*> arenaBlocks;
+    size_t arenaUsed = kArenaBlockSize;
+
+    Shard() = default;
+    Shard(const Shard&) = delete;
+    Shard& operator=(const Shard&) = delete;
+
+    ~Shard()
+    {
+        for (Entry* entry : slots) {
+            if (entry == nullptr) {
+                continue;
+            }
+            if (arenaBlocks.empty()) {
+                delete entry;
+            } else {
+                entry->~Entry();
+            }
+        }
+        for (void* block : arenaBlocks) {
+            free(block);
+        }
+    }
+
+    Entry* Find(const CharSequence& s, uint64_t hash, uint64_t mixedHash) const
+    {
+        if (slots.empty()) {
+            return nullptr;
+        }
+        size_t mask = slots.size() - 1;
+        for (size_t i = size_t(mixedHash) & mask;; i = (i + 1) & mask) {
+            Entry* entry = slots[i];
+            if (entry == nullptr) {
+                return nullptr;
+            }
+            if (entry->hash == hash && entry->string == s) {
+                return entry;
+            }
+        }
+    }
+
+    Entry* Insert(const CharSequence& s, uint64_t hash, uint64_t mixedHash, bool useArena)
+    {
+        if ((size + 1) * 4 > slots.size() * 3) {
+            Grow();
+        }
+        // Kept by the table until the process exits, so not in the arena of a request
+        Arena::Scope heap(nullptr);
+        Entry* entry = useArena ? new (AllocateFromArena()) Entry { String(s), hash } : new Entry { String(s), hash };
+        size_t mask = slots.size() - 1;
+        size_t i = size_t(mixedHash) & mask;
+        while (slots[i] != nullptr) {
+            i = (i + 1) & mask;
+        }
+        slots[i] = entry;
+        ++size;
+        return entry;
+    }
+
+    void Grow()
+    {
+        std::vector<Entry*> old(slots.empty() ? size_t(kInitialSlots) : slots.size() * 2, nullptr);
+        old.swap(slots);
+        size_t mask = slots.size() - 1;
+        for (Entry* entry : old) {
+            if (entry == nullptr) {
+                continue;
+            }
+            size_t i = size_t(MixHash(entry->hash)) & mask;
+            while (slots[i] != nullptr) {
+                i = (i + 1) & mask;
+            }
+            slots[i] = entry;
+        }
+    }
+
+    void* AllocateFromArena()
+    {
+        const size_t kEntrySize = (sizeof(Entry) + alignof(Entry) - 1) / alignof(Entry) * alignof(Entry);
+        if (arenaUsed + kEntrySize > kArenaBlockSize) {
+            void* block = malloc(kArenaBlockSize); // malloc'ed memory is aligned for any type
+            if (block == nullptr) {
+                throw std::bad_alloc();
+            }
+            arenaBlocks.push_back(block);
+            arenaUsed = 0;
+        }
+        void* p = static_cast<char*>(arenaBlocks.back()) + arenaUsed;
+        arenaUsed += kEntrySize;
+        return p;
+    }
+};
+
+InternedString::InternedString(const CharSequence& s)
+    : InternedString(InternTable::Global().Intern(s))
+{
+}
+
+InternedString::InternedString(const char* utf8)
+    : InternedString(String(utf8))
+{
+}
+
+InternedString::InternedString(const CharSequence& s, InternTable& table)
+    : InternedString(table.Intern(s))
+{
+}
+
+const InternedString::Entry& InternedString::EmptyEntry()
+{
+    static const Entry kEmpty { String(), String().Hash() };
+    return kEmpty;
+}
+
+InternTable::InternTable(uint32_t shardCount, bool useArena)
+    : shards_()
+    , shardMask_(0)
+    , useArena_(useArena)
+{
+    shardCount = Misc::CeilToPowerOfTwo(shardCount == 0 ? 1 : shardCount);
+    shards_.reset(new Shard[shardCount]);
+    shardMask_ = shardCount - 1;
+}
+
+InternTable::~InternTable() = default;
+
+InternedString InternTable::Intern(const CharSequence& s)
+{
+    if (s.Empty()) {
+        return InternedString();
+    }
+    uint64_t hash = s.Hash();
+    uint64_t mixedHash = MixHash(hash);
+    Shard& shard = ShardOf(mixedHash);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    const InternedString::Entry* entry = shard.Find(s, hash, mixedHash);
+    if (entry == nullptr) {
+        entry = shard.Insert(s, hash, mixedHash, useArena_);
+    }
+    return InternedString(entry);
+}
+
+bool InternTable::Lookup(const CharSequence& s, InternedString& result) const
+{
+    if (s.Empty()) {
+        result = InternedString();
+        return true;
+    }
+    uint64_t hash = s.Hash();
+    uint64_t mixedHash = MixHash(hash);
+    Shard& shard = ShardOf(mixedHash);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    const InternedString::Entry* entry = shard.Find(s, hash, mixedHash);
+    if (entry == nullptr) {
+        return false;
+    }
+    result = InternedString(entry);
+    return true;
+}
+
+size_t InternTable::Size() const
+{
+    size_t size = 0;
+    for (uint32_t i = 0; i <= shardMask_; ++i) {
+        std::lock_guard<std::mutex> lock(shards_[i].mutex);
+        size += shards_[i].size;
+    }
+    return size;
+}
+
+InternTable& InternTable::Global()
+{
+    // Never destroyed, so interned strings held by static objects are valid till the process exits
+    static auto* table = new InternTable();
+    return *table;
+}
+
+InternTable::Shard& InternTable::ShardOf(uint64_t mixedHash) const
+{
+    // The slots are picked by the low bits, so the shard is picked by the high bits
+    return shards_[(mixedHash >> 48u) & shardMask_];
+}
+
+std::ostream& operator<<(std::ostream& os, const InternedString& s)
+{
+    return os << s.GetString();
+}
+
+}
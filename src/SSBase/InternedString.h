@@ -0,0 +1,137 @@
+//
+// Copyright (c) 2020 Carl Chen. All rights reserved.
+//
+
+#pragma once
+
+#include "Str.h"
+#include <cstdint>
+#include <functional>
+#include <memory>
+
+namespace ss {
+
+class InternTable;
+
+/// A handle of a string stored once in an `InternTable`. Interned strings of the same table are equal if and only if
+/// they are the same entry, so they compare by pointer, and their hash is computed once when the string is interned.
+/// The entries are immutable and live as long as the table, the global table is never destroyed.
+class InternedString {
+public:
+    struct Entry {
+        String string;
+        uint64_t hash; // `CharSequence::Hash()` of the string
+    };
+
+    /// The empty string, which is shared by all the tables
+    InternedString()
+        : entry_(&EmptyEntry())
+    {
+    }
+
+    /// Intern `s` in the global table
+    explicit InternedString(const CharSequence& s);
+    explicit InternedString(const String& s)
+        : InternedString((const CharSequence&)s)
+    {
+    }
+    explicit InternedString(const char* utf8);
+    InternedString(const CharSequence& s, InternTable& table);
+
+    const String& GetString() const
+    {
+        return entry_->string;
+    }
+
+    uint64_t Hash() const
+    {
+        return entry_->hash;
+    }
+
+    uint32_t Length() const
+    {
+        return entry_->string.Length();
+    }
+
+    bool Empty() const
+    {
+        return Length() == 0;
+    }
+
+    bool operator==(InternedString other) const
+    {
+        return entry_ == other.entry_;
+    }
+
+    bool operator!=(InternedString other) const
+    {
+        return entry_ != other.entry_;
+    }
+
+private:
+    explicit InternedString(const Entry* entry)
+        : entry_(entry)
+    {
+    }
+
+    static const Entry& EmptyEntry();
+
+    const Entry* entry_;
+
+    friend class InternTable;
+};
+
+/// A deduplicated store of strings. It is split into shards by the hash of the strings, each with its own lock, so
+/// threads interning different strings rarely wait for each other. With `useArena`, the entries are carved out of
+/// large blocks instead of being allocated one by one, which is faster and more compact for many short strings.
+class InternTable {
+public:
+    enum {
+        kDefaultShardCount = 16
+    };
+
+    /// `shardCount` is rounded up to a power of two
+    explicit InternTable(uint32_t shardCount = kDefaultShardCount, bool useArena = true);
+    ~InternTable();
+
+    InternTable(const InternTable&) = delete;
+    InternTable(InternTable&&) = delete;
+    InternTable& operator=(const InternTable&) = delete;
+    InternTable& operator=(InternTable&&) = delete;
+
+    /// Returns the entry of `s`, adding it if it is not in the table yet
+    InternedString Intern(const CharSequence& s);
+
+    /// Returns false if `s` is not in the table, without adding it
+    bool Lookup(const CharSequence& s, InternedString& result) const;
+
+    /// Number of the strings in the table, the empty string is not counted
+    size_t Size() const;
+
+    static InternTable& Global();
+
+private:
+    struct Shard;
+
+    Shard& ShardOf(uint64_t mixedHash) const;
+
+    std::unique_ptr<Shard[]> shards_;
+    uint32_t shardMask_;
+    bool useArena_;
+};
+
+std::ostream& operator<<(std::ostream& os, const InternedString& s);
+
+}
+
+namespace std {
+
+template <>
+struct hash<ss::InternedString> {
+    size_t operator()(const ss::InternedString& s) const
+    {
+        return size_t(s.Hash());
+    }
+};
+
+}
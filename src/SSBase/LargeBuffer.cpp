@@ -0,0 +1,189 @@
+//
+// Copyright (c) 2020 Carl Chen. All rights reserved.
+//
+
+#include "LargeBuffer.h"
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <utility>
+#ifdef SS_PLATFORM_UNIX
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace ss {
+
+namespace {
+
+constexpr size_t kHugePageSize = 2 * 1024 * 1024;
+
+size_t PageSize()
+{
+#ifdef SS_PLATFORM_UNIX
+    static const size_t size = size_t(sysconf(_SC_PAGESIZE));
+    return size;
+#else
+    return 4096;
+#endif
+}
+
+inline size_t RoundUp(size_t n, size_t alignment)
+{
+    return (n + alignment - 1) & ~(alignment - 1);
+}
+
+#ifdef SS_PLATFORM_UNIX
+void AdviseHugePages(void* p, size_t size)
+{
+#ifdef MADV_HUGEPAGE
+    madvise(p, size, MADV_HUGEPAGE);
+#else
+    (void)p;
+    (void)size;
+#endif
+}
+#endif
+
+} // namespace
+
+LargeBuffer::LargeBuffer(size_t capacity, bool hugePages)
+    : offset_(0)
+    , size_(0)
+    , capacity_(0)
+    , buf_(nullptr)
+    , hugePages_(hugePages)
+{
+    if (capacity > 0) {
+        ReAllocate(capacity);
+    }
+}
+
+LargeBuffer::LargeBuffer(LargeBuffer&& b) noexcept
+    : offset_(b.offset_)
+    , size_(b.size_)
+    , capacity_(b.capacity_)
+    , buf_(b.buf_)
+    , hugePages_(b.hugePages_)
+{
+    b.offset_ = 0;
+    b.size_ = 0;
+    b.capacity_ = 0;
+    b.buf_ = nullptr;
+}
+
+LargeBuffer::~LargeBuffer()
+{
+    if (buf_ != nullptr) {
+#ifdef SS_PLATFORM_UNIX
+        munmap(buf_, capacity_);
+#else
+        free(buf_);
+#endif
+        buf_ = nullptr;
+    }
+    offset_ = 0;
+    size_ = 0;
+    capacity_ = 0;
+}
+
+LargeBuffer& LargeBuffer::operator=(LargeBuffer&& b) noexcept
+{
+    std::swap(offset_, b.offset_);
+    std::swap(size_, b.size_);
+    std::swap(capacity_, b.capacity_);
+    std::swap(buf_, b.buf_);
+    std::swap(hugePages_, b.hugePages_);
+    return *this;
+}
+
+size_t LargeBuffer::ReadData(void* buffer, size_t size) const
+{
+    if (size > Size()) {
+        size = Size();
+    }
+    memcpy(buffer, GetData<void>(), size);
+    return size;
+}
+
+void LargeBuffer::PushData(const void* data, size_t length)
+{
+    EnsureSpace(length);
+    memcpy(GetEndPtr<uint8_t>(), data, length);
+    size_ += length;
+}
+
+void LargeBuffer::EnsureSpace(size_t size)
+{
+    if (size == 0) {
+        return;
+    }
+    if (Size() + size > Capacity()) {
+        size_t newCapacity = Capacity() * 2;
+        if (newCapacity < Size() + size) {
+            newCapacity = Size() + size;
+        }
+        ReAllocate(newCapacity);
+    }
+    if (FreeSpaceSize() >= size) {
+        return;
+    }
+    memmove(buf_, GetData<uint8_t>(), Size());
+    offset_ = 0;
+}
+
+void LargeBuffer::Shrink()
+{
+#ifdef SS_PLATFORM_UNIX
+    if (buf_ == nullptr) {
+        return;
+    }
+    size_t page = PageSize();
+    // Only the whole pages outside of the data
+    size_t head = offset_ / page * page;
+    if (head > 0) {
+        madvise(buf_, head, MADV_DONTNEED);
+    }
+    size_t tail = RoundUp(offset_ + size_, page);
+    if (tail < capacity_) {
+        madvise(buf_ + tail, capacity_ - tail, MADV_DONTNEED);
+    }
+#endif
+}
+
+void LargeBuffer::ReAllocate(size_t length)
+{
+    length = RoundUp(length, hugePages_ ? kHugePageSize : PageSize());
+#ifdef SS_PLATFORM_UNIX
+    void* p;
+    if (buf_ == nullptr) {
+        p = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    } else {
+#ifdef SS_PLATFORM_LINUX
+        // The pages are moved to the new address by the page tables, nothing is copied
+        p = mremap(buf_, capacity_, length, MREMAP_MAYMOVE);
+#else
+        p = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (p != MAP_FAILED) {
+            memcpy(static_cast<uint8_t*>(p) + offset_, buf_ + offset_, size_);
+            munmap(buf_, capacity_);
+        }
+#endif
+    }
+    if (p == MAP_FAILED) {
+        throw std::bad_alloc();
+    }
+    if (hugePages_) {
+        AdviseHugePages(p, length);
+    }
+#else
+    void* p = realloc(buf_, length);
+    if (p == nullptr) {
+        throw std::bad_alloc();
+    }
+#endif
+    buf_ = static_cast<uint8_t*>(p);
+    capacity_ = length;
+}
+
+} // namespace ss
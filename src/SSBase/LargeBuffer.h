@@ -0,0 +1,108 @@
+//
+// Copyright (c) 2020 Carl Chen. All rights reserved.
+//
+
+#pragma once
+
+#include "Assert.h"
+#include <cstddef>
+#include <cstdint>
+
+namespace ss {
+
+/// Byte buffer with 64-bit sizes for payloads beyond the 2 GB of `DynamicBuffer`, whose power of two capacity overflows
+/// past it, e.g. archives or snapshots built in memory. The storage is anonymous memory mapped from the OS: on Linux,
+/// growing remaps the pages instead of copying them, so the peak RSS stays about the size of the data instead of two or
+/// three times of it, and `Shrink` gives the pages not holding data back with MADV_DONTNEED. Other platforms fall back
+/// to copying.
+class LargeBuffer {
+public:
+    /// With `hugePages`, transparent huge pages are requested for the storage, which reduces the TLB misses of large
+    /// buffers but makes the RSS grow by 2 MB steps
+    explicit LargeBuffer(size_t capacity = 0, bool hugePages = false);
+
+    LargeBuffer(const LargeBuffer&) = delete;
+
+    LargeBuffer(LargeBuffer&& b) noexcept;
+
+    ~LargeBuffer();
+
+    LargeBuffer& operator=(const LargeBuffer&) = delete;
+
+    LargeBuffer& operator=(LargeBuffer&& b) noexcept;
+
+    void Reset(size_t offset = 0, size_t size = 0)
+    {
+        SSASSERT(offset + size <= capacity_);
+        offset_ = offset;
+        size_ = size;
+    }
+
+    template <class T>
+    T* GetData()
+    {
+        return reinterpret_cast<T*>(buf_ + offset_);
+    }
+
+    template <class T>
+    const T* GetData() const
+    {
+        return reinterpret_cast<const T*>(buf_ + offset_);
+    }
+
+    template <class T>
+    T* GetEndPtr()
+    {
+        return reinterpret_cast<T*>(buf_ + offset_ + size_);
+    }
+
+    /// Do not pop data, invoke skip to pop data instead
+    size_t ReadData(void* buffer, size_t size) const;
+
+    void PushData(const void* data, size_t length);
+
+    void Skip(size_t n)
+    {
+        SSASSERT(Size() >= n);
+        offset_ += n;
+        size_ -= n;
+    }
+
+    size_t Capacity() const
+    {
+        return capacity_;
+    }
+
+    size_t Size() const
+    {
+        return size_;
+    }
+
+    bool Empty() const
+    {
+        return Size() == 0;
+    }
+
+    size_t FreeSpaceSize() const
+    {
+        return Capacity() - offset_ - Size();
+    }
+
+    void EnsureSpace(size_t size);
+
+    /// Give the pages before and after the data back to the OS, e.g. after skipping a consumed part or resetting to a
+    /// smaller size. The capacity is kept, and the pages are mapped again when they are written.
+    void Shrink();
+
+private:
+    void ReAllocate(size_t length);
+
+private:
+    size_t offset_;
+    size_t size_;
+    size_t capacity_;
+    uint8_t* buf_;
+    bool hugePages_;
+};
+
+} // namespace ss
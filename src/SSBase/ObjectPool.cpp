@@ -0,0 +1,91 @@
+//
+// Copyright (c) 2020 Carl Chen. All rights reserved.
+//
+
+#include "ObjectPool.h"
+#include <utility>
+
+namespace ss {
+namespace internal {
+
+namespace {
+
+struct PoolCacheEntry {
+    uint64_t poolId;
+    PoolCache* cache;
+};
+
+// Set once the caches of this thread are retired, the pools fall back to their depot from then on
+thread_local bool gPoolCachesRetired = false;
+
+// The last one found, most threads use a single pool at a time
+thread_local PoolCacheEntry gLastPoolCache = { 0, nullptr };
+
+struct PoolCaches {
+    std::vector<PoolCacheEntry> entries;
+
+    ~PoolCaches()
+    {
+        gPoolCachesRetired = true;
+        gLastPoolCache = { 0, nullptr };
+        // Destroying the objects may put objects to other pools
+        std::vector<PoolCacheEntry> retiring;
+        retiring.swap(entries);
+        for (auto& entry : retiring) {
+            entry.cache->Retire();
+            delete entry.cache;
+        }
+    }
+};
+
+thread_local PoolCaches gPoolCaches;
+
+} // namespace
+
+uint64_t NextPoolId()
+{
+    static std::atomic<uint64_t> id(0);
+    return id.fetch_add(1, std::memory_order_relaxed) + 1;
+}
+
+PoolCache* FindPoolCache(uint64_t poolId)
+{
+    if (gLastPoolCache.poolId == poolId) {
+        return gLastPoolCache.cache;
+    }
+    if (gPoolCachesRetired) {
+        return nullptr;
+    }
+    for (auto& entry : gPoolCaches.entries) {
+        if (entry.poolId == poolId) {
+            gLastPoolCache = entry;
+            return entry.cache;
+        }
+    }
+    return nullptr;
+}
+
+bool AddPoolCache(uint64_t poolId, PoolCache* cache)
+{
+    if (gPoolCachesRetired) {
+        return false;
+    }
+    // The caches of the destroyed pools would pile up on the threads which outlive many pools
+    auto& entries = gPoolCaches.entries;
+    for (size_t i = 0; i < entries.size();) {
+        if (entries[i].cache->Orphaned()) {
+            entries[i].cache->Retire();
+            delete entries[i].cache;
+            entries[i] = entries.back();
+            entries.pop_back();
+        } else {
+            ++i;
+        }
+    }
+    entries.push_back({ poolId, cache });
+    gLastPoolCache = entries.back();
+    return true;
+}
+
+} // namespace internal
+} // namespace ss
@@ -3,78 +3,507 @@
 //
 
 #pragma once
+
+#include "Arena.h"
+#include "Ptr.h"
+#include "ThreadPolicy.h"
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <memory>
 #include <mutex>
-#include <queue>
+#include <new>
+#include <vector>
 
 namespace ss {
 
-class SingleThreadPolicy {
+namespace internal {
+
+/// The cache of a pool on a thread, which is owned by the thread
+class PoolCache {
 public:
-    static void Lock()
-    {
-    }
+    virtual ~PoolCache() = default;
 
-    static void Unlock()
-    {
-    }
+    /// The thread is exiting, give the objects back to the pool
+    virtual void Retire() = 0;
+
+    /// The pool is destroyed
+    virtual bool Orphaned() const = 0;
 };
 
-class MultiThreadPolicy {
+uint64_t NextPoolId();
+
+/// The cache of the pool `poolId` on this thread, nullptr if there is none yet
+PoolCache* FindPoolCache(uint64_t poolId);
+
+/// This thread owns `cache` from now on, and retires it when it exits. Returns false if the thread is already exiting,
+/// the caller keeps `cache` then.
+bool AddPoolCache(uint64_t poolId, PoolCache* cache);
+
+/// Lock-free LIFO of the indices of preallocated nodes, the head is tagged against ABA
+class PoolIndexStack {
 public:
-    static std::mutex& GetMutex()
+    explicit PoolIndexStack(std::atomic<uint32_t>* next)
+        : head_(0)
+        , next_(next)
     {
-        static std::mutex mutex;
-        return mutex;
     }
 
-    static void Lock()
+    void Push(uint32_t index)
     {
-        GetMutex().lock();
+        uint64_t head = head_.load(std::memory_order_relaxed);
+        uint64_t newHead;
+        do {
+            next_[index].store(uint32_t(head), std::memory_order_relaxed);
+            newHead = ((head >> 32u) + 1) << 32u | (index + 1);
+        } while (!head_.compare_exchange_weak(head, newHead, std::memory_order_release, std::memory_order_relaxed));
     }
 
-    static void Unlock()
+    bool Pop(uint32_t* index)
     {
-        GetMutex().unlock();
+        uint64_t head = head_.load(std::memory_order_acquire);
+        uint64_t newHead;
+        do {
+            auto top = uint32_t(head);
+            if (top == 0) {
+                return false;
+            }
+            newHead = ((head >> 32u) + 1) << 32u | next_[top - 1].load(std::memory_order_relaxed);
+        } while (!head_.compare_exchange_weak(head, newHead, std::memory_order_acquire, std::memory_order_acquire));
+        *index = uint32_t(head) - 1;
+        return true;
     }
+
+private:
+    std::atomic<uint64_t> head_; // Tag in the high half, index + 1 of the top node in the low half, 0 if empty
+    std::atomic<uint32_t>* next_; // Index + 1 of the node below each node
 };
 
+} // namespace internal
+
+/// Pool of reusable objects. With `MultiThreadPolicy`, each thread keeps a small cache of free objects, so `Get` and
+/// `Put` touch no shared state most of the time. A full cache spills a batch of objects to a lock-free depot of the
+/// pool, and an empty one refills a batch from it. The depot holds up to `capacity` objects, beyond which the objects
+/// spilled are destroyed, and each thread caches up to `2 * kBatchSize` more. An object may be put back by another
+/// thread than the one which got it. With `SingleThreadPolicy`, it keeps up to `capacity` objects.
+///
+/// NOTE: All the objects must be put back before the pool is destroyed, and the pool must not be used by other
+/// threads while it is destroyed.
 template <class T, class ThreadPolicy = SingleThreadPolicy>
 class ObjectPool {
 public:
-    explicit ObjectPool(size_t capacity)
-        : cap_(capacity)
-        , queue_()
+    enum : uint32_t {
+        kBatchSize = 16
+    };
+
+    /// Optional, invoked on the objects created by the pool, and on the objects put back before they are reused
+    struct Hooks {
+        std::function<void(T*)> onCreate;
+        std::function<void(T*)> onReset;
+    };
+
+    struct Stats {
+        uint64_t hits; // Objects got from the pool
+        uint64_t misses; // Objects created because the pool was empty
+        uint64_t spills; // Batches moved from a thread cache to the depot
+        uint64_t drops; // Objects destroyed because the pool was full
+    };
+
+    /// The objects are created in `arena` if it is not nullptr, and they are only destructed when they leave the pool,
+    /// the arena frees their memory. Otherwise they are created with new.
+    explicit ObjectPool(size_t capacity, Arena* arena = nullptr)
+        : ObjectPool(capacity, Hooks(), arena)
+    {
+    }
+
+    ObjectPool(size_t capacity, Hooks hooks, Arena* arena = nullptr)
+        : id_(internal::NextPoolId())
+        , shared_(std::make_shared<Shared>(ThreadPolicy::kThreadSafe ? capacity : 0, std::move(hooks), arena))
+        , cap_(capacity)
+        , stats_ {}
     {
     }
 
+    ObjectPool(const ObjectPool&) = delete;
+    ObjectPool& operator=(const ObjectPool&) = delete;
+
+    ~ObjectPool()
+    {
+        std::lock_guard<std::mutex> lock(shared_->mutex);
+        shared_->alive.store(false, std::memory_order_relaxed);
+        for (Cache* cache : shared_->caches) {
+            cache->Clear();
+        }
+        for (T* t : free_) {
+            shared_->Destroy(t);
+        }
+        uint32_t node;
+        while (shared_->full.Pop(&node)) {
+            Batch& batch = shared_->batches[node];
+            for (uint32_t i = 0; i < batch.count; ++i) {
+                shared_->Destroy(batch.objects[i]);
+            }
+        }
+    }
+
     T* Get()
     {
-        ThreadPolicy::Lock();
-        if (queue_.size() == 0) {
-            ThreadPolicy::Unlock();
-            return new T;
-        } else {
-            T* t = queue_.front();
-            queue_.pop();
-            ThreadPolicy::Unlock();
+        if (!ThreadPolicy::kThreadSafe) {
+            if (free_.empty()) {
+                ++stats_.misses;
+                return shared_->Create();
+            }
+            ++stats_.hits;
+            T* t = free_.back();
+            free_.pop_back();
             return t;
         }
+        Cache* cache = LocalCache();
+        if (cache == nullptr) {
+            shared_->CountExiting(&Stats::misses);
+            return shared_->Create();
+        }
+        if (cache->count == 0) {
+            cache->Refill();
+        }
+        if (cache->count > 0) {
+            cache->Count(cache->hits);
+            return cache->objects[--cache->count];
+        }
+        cache->Count(cache->misses);
+        return shared_->Create();
     }
 
+    /// `onReset` is only invoked on the objects which are kept
     void Put(T* t)
     {
-        ThreadPolicy::Lock();
-        if (queue_.size() >= cap_) {
-            ThreadPolicy::Unlock();
-            delete t;
-        } else {
-            queue_.push(t);
-            ThreadPolicy::Unlock();
+        if (!ThreadPolicy::kThreadSafe) {
+            if (free_.size() < cap_) {
+                shared_->Reset(t);
+                free_.push_back(t);
+            } else {
+                ++stats_.drops;
+                shared_->Destroy(t);
+            }
+            return;
+        }
+        Cache* cache = LocalCache();
+        if (cache == nullptr) {
+            shared_->CountExiting(&Stats::drops);
+            shared_->Destroy(t);
+            return;
+        }
+        if (cache->count == 2 * kBatchSize) {
+            cache->Spill();
+        }
+        shared_->Reset(t);
+        cache->objects[cache->count++] = t;
+    }
+
+    /// Sum of all the threads
+    Stats GetStats() const
+    {
+        std::lock_guard<std::mutex> lock(shared_->mutex);
+        Stats stats = shared_->retired;
+        stats.hits += stats_.hits;
+        stats.misses += stats_.misses;
+        stats.drops += stats_.drops;
+        for (const Cache* cache : shared_->caches) {
+            cache->AddTo(stats);
+        }
+        return stats;
+    }
+
+private:
+    struct Batch {
+        T* objects[kBatchSize];
+        uint32_t count;
+    };
+
+    class Cache;
+
+    /// Shared by the pool and the thread caches, which may outlive the pool
+    struct Shared {
+        Shared(size_t c, Hooks&& h, Arena* a)
+            : hooks(std::move(h))
+            , arena(a)
+            , capacity(c)
+            , kept(0)
+            , batches((c + kBatchSize - 1) / kBatchSize)
+            , next(new std::atomic<uint32_t>[batches.size() + 1])
+            , full(next.get())
+            , empty(next.get())
+            , retired {}
+            , alive(true)
+        {
+            for (size_t i = 0; i < batches.size(); ++i) {
+                empty.Push(uint32_t(i));
+            }
+        }
+
+        T* Create()
+        {
+            T* t;
+            if (arena != nullptr) {
+                void* p;
+                {
+                    // The arena is not thread safe
+                    std::lock_guard<std::mutex> lock(mutex);
+                    p = arena->Allocate(sizeof(T), alignof(T));
+                }
+                t = new (p) T;
+            } else {
+                t = new T;
+            }
+            if (hooks.onCreate != nullptr) {
+                hooks.onCreate(t);
+            }
+            return t;
+        }
+
+        void Reset(T* t)
+        {
+            if (hooks.onReset != nullptr) {
+                hooks.onReset(t);
+            }
+        }
+
+        void Destroy(T* t)
+        {
+            if (arena != nullptr) {
+                t->~T();
+            } else {
+                delete t;
+            }
+        }
+
+        /// Reserve room in the depot for up to `n` objects, returns how many it takes
+        uint32_t Reserve(uint32_t n)
+        {
+            size_t count = kept.load(std::memory_order_relaxed);
+            uint32_t taken;
+            do {
+                size_t room = count < capacity ? capacity - count : 0;
+                taken = room < n ? uint32_t(room) : n;
+            } while (taken > 0 && !kept.compare_exchange_weak(count, count + taken, std::memory_order_relaxed));
+            return taken;
+        }
+
+        /// The thread has no cache any more
+        void CountExiting(uint64_t Stats::*counter)
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            ++(retired.*counter);
+        }
+
+        Hooks hooks;
+        Arena* arena;
+        size_t capacity; // Of the depot, the last batch may be partly used
+        std::atomic<size_t> kept; // Objects in the depot, at most `capacity`
+        std::vector<Batch> batches; // The nodes of the depot
+        std::unique_ptr<std::atomic<uint32_t>[]> next;
+        internal::PoolIndexStack full; // Batches of free objects
+        internal::PoolIndexStack empty; // Unused batches
+        std::mutex mutex; // Guards the members below, the arena, and the retirement of the caches
+        std::vector<Cache*> caches; // Of the threads
+        Stats retired; // Of the caches of the exited threads
+        std::atomic<bool> alive;
+    };
+
+    class Cache final : public internal::PoolCache {
+    public:
+        explicit Cache(std::shared_ptr<Shared> shared)
+            : shared_(std::move(shared))
+            , count(0)
+            , hits(0)
+            , misses(0)
+            , spills(0)
+            , drops(0)
+        {
+        }
+
+        /// Refill a batch from the depot
+        void Refill()
+        {
+            uint32_t node;
+            if (shared_->full.Pop(&node)) {
+                Batch& batch = shared_->batches[node];
+                memcpy(objects, batch.objects, batch.count * sizeof(T*));
+                count = batch.count;
+                shared_->kept.fetch_sub(batch.count, std::memory_order_relaxed);
+                shared_->empty.Push(node);
+            }
+        }
+
+        /// Move the older half of the objects to the depot, or destroy those beyond its capacity
+        void Spill()
+        {
+            uint32_t n = count < kBatchSize ? count : uint32_t(kBatchSize);
+            uint32_t moved = shared_->Reserve(n);
+            uint32_t node;
+            if (moved > 0 && shared_->empty.Pop(&node)) {
+                Batch& batch = shared_->batches[node];
+                memcpy(batch.objects, objects, moved * sizeof(T*));
+                batch.count = moved;
+                shared_->full.Push(node);
+                Count(spills);
+            } else if (moved > 0) {
+                // The partly used batches took all the nodes
+                shared_->kept.fetch_sub(moved, std::memory_order_relaxed);
+                moved = 0;
+            }
+            for (uint32_t i = moved; i < n; ++i) {
+                shared_->Destroy(objects[i]);
+            }
+            if (moved < n) {
+                Count(drops, n - moved);
+            }
+            memmove(objects, objects + n, (count - n) * sizeof(T*));
+            count -= n;
+        }
+
+        void Retire() override
+        {
+            std::lock_guard<std::mutex> lock(shared_->mutex);
+            if (shared_->alive.load(std::memory_order_relaxed)) {
+                while (count > 0) {
+                    Spill();
+                }
+            }
+            AddTo(shared_->retired);
+            auto& caches = shared_->caches;
+            for (size_t i = 0; i < caches.size(); ++i) {
+                if (caches[i] == this) {
+                    caches[i] = caches.back();
+                    caches.pop_back();
+                    break;
+                }
+            }
+        }
+
+        bool Orphaned() const override
+        {
+            return !shared_->alive.load(std::memory_order_relaxed);
+        }
+
+        /// The pool is destroyed
+        void Clear()
+        {
+            for (uint32_t i = 0; i < count; ++i) {
+                shared_->Destroy(objects[i]);
+            }
+            count = 0;
+        }
+
+        /// Only the owner thread writes the counters, so they need no atomic increment
+        static void Count(std::atomic<uint64_t>& counter, uint64_t n = 1)
+        {
+            counter.store(counter.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+        }
+
+        void AddTo(Stats& stats) const
+        {
+            stats.hits += hits.load(std::memory_order_relaxed);
+            stats.misses += misses.load(std::memory_order_relaxed);
+            stats.spills += spills.load(std::memory_order_relaxed);
+            stats.drops += drops.load(std::memory_order_relaxed);
+        }
+
+        std::shared_ptr<Shared> shared_;
+        T* objects[2 * kBatchSize];
+        uint32_t count;
+        std::atomic<uint64_t> hits;
+        std::atomic<uint64_t> misses;
+        std::atomic<uint64_t> spills;
+        std::atomic<uint64_t> drops;
+    };
+
+    /// nullptr if the thread is exiting
+    Cache* LocalCache()
+    {
+        auto* cache = static_cast<Cache*>(internal::FindPoolCache(id_));
+        if (cache == nullptr) {
+            cache = new Cache(shared_);
+            {
+                std::lock_guard<std::mutex> lock(shared_->mutex);
+                shared_->caches.push_back(cache);
+            }
+            if (!internal::AddPoolCache(id_, cache)) {
+                cache->Retire();
+                delete cache;
+                return nullptr;
+            }
         }
+        return cache;
     }
 
+    uint64_t id_;
+    std::shared_ptr<Shared> shared_;
+    // With `SingleThreadPolicy`, the pool is a plain stack without any cache or depot
     size_t cap_;
-    std::queue<T> queue_;
+    std::vector<T*> free_;
+    Stats stats_;
 };
 
-} // namespace ss
\ No newline at end of file
+/// Pool of the memory of `RefCounted` objects of type T, see `MakePooled`. An object goes back to the pool when its
+/// last SharedPtr is released, so objects which are made and released repeatedly allocate nothing once the pool is
+/// warm. Objects made by the pool must be of type T exactly, not derived from it. All the objects must be released
+/// before the pool is destroyed.
+template <class T, class ThreadPolicy = SingleThreadPolicy>
+class RefCountedPool final : public RefCounted::Recycler {
+public:
+    using Stats = typename ObjectPool<void*, ThreadPolicy>::Stats;
+
+    explicit RefCountedPool(size_t capacity)
+        : slots_(capacity)
+    {
+    }
+
+    RefCountedPool(const RefCountedPool&) = delete;
+    RefCountedPool& operator=(const RefCountedPool&) = delete;
+
+    template <class... Args>
+    SharedPtr<T> Make(Args&&... args)
+    {
+        Slot* slot = slots_.Get();
+        T* t;
+        try {
+            t = new (slot) T(std::forward<Args>(args)...);
+        } catch (...) {
+            slots_.Put(slot);
+            throw;
+        }
+        static_cast<RefCounted*>(t)->recycler_ = this;
+        return SharedPtr<T>(t);
+    }
+
+    Stats GetStats() const
+    {
+        auto stats = slots_.GetStats();
+        return { stats.hits, stats.misses, stats.spills, stats.drops };
+    }
+
+private:
+    struct Slot {
+        alignas(T) unsigned char bytes[sizeof(T)];
+    };
+
+    void Recycle(RefCounted* object) override
+    {
+        T* t = static_cast<T*>(object);
+        t->~T();
+        slots_.Put(reinterpret_cast<Slot*>(t));
+    }
+
+    ObjectPool<Slot, ThreadPolicy> slots_;
+};
+
+/// Like `MakeShared`, but the memory comes from `pool` and goes back to it
+template <class T, class ThreadPolicy, class... Args>
+inline SharedPtr<T> MakePooled(RefCountedPool<T, ThreadPolicy>& pool, Args&&... args)
+{
+    return pool.Make(std::forward<Args>(args)...);
+}
+
+} // namespace ss
@@ -7,50 +7,51 @@
 #include "RefCounted.h"
 #include <functional>
 #include <memory>
+#include <type_traits>
 
 namespace ss {
 
+template <class T>
+class AtomicSharedPtr;
+
 template <class T>
 class SharedPtr {
 public:
     SharedPtr()
-        : refCounter_(nullptr)
+        : ptr_(nullptr)
     {
     }
 
     SharedPtr(decltype(nullptr)) // NOLINT(google-explicit-constructor,hicpp-explicit-conversions)
-        : refCounter_(nullptr)
+        : ptr_(nullptr)
     {
     }
 
     SharedPtr(T* t)
-        : refCounter_(nullptr) // NOLINT(google-explicit-constructor,hicpp-explicit-conversions)
+        : ptr_(t) // NOLINT(google-explicit-constructor,hicpp-explicit-conversions)
     {
         if (t != nullptr) {
-            refCounter_ = static_cast<RefCounted*>(t)->refCounter_;
-            SSASSERT(refCounter_ != nullptr);
-            refCounter_->IncreaseShared();
+            static_cast<RefCounted*>(t)->Adopt(T::RefCountPolicy::kThreadSafe);
         }
     }
 
     template <class P>
     SharedPtr(const SharedPtr<P>& p) // NOLINT(google-explicit-constructor,hicpp-explicit-conversions)
-        : refCounter_(p.refCounter_)
+        : ptr_(static_cast<T*>(p.ptr_)) // static_cast to ensure type T and P are compatible
     {
-        (void)static_cast<T*>(p.Get()); // to ensure type T and P are compatible
         IncreaseRefCount();
     }
 
     SharedPtr(const SharedPtr& p)
-        : refCounter_(p.refCounter_)
+        : ptr_(p.ptr_)
     {
         IncreaseRefCount();
     }
 
     SharedPtr(SharedPtr&& p) noexcept
-        : refCounter_(p.refCounter_)
+        : ptr_(p.ptr_)
     {
-        p.refCounter_ = nullptr;
+        p.ptr_ = nullptr;
     }
 
     ~SharedPtr()
@@ -60,10 +61,7 @@ public:
 
     T* Get() const
     {
-        if (refCounter_ == nullptr) {
-            return nullptr;
-        }
-        return static_cast<T*>(refCounter_->object);
+        return ptr_;
     }
 
     explicit operator bool() const
@@ -93,9 +91,9 @@ public:
 
     SharedPtr& operator=(const SharedPtr& p) noexcept
     {
-        if (p.refCounter_ != refCounter_) {
+        if (p.ptr_ != ptr_) {
             DecreaseRefCount();
-            refCounter_ = p.refCounter_;
+            ptr_ = p.ptr_;
             IncreaseRefCount();
         }
         return *this;
@@ -103,10 +101,10 @@ public:
 
     SharedPtr& operator=(SharedPtr&& p) noexcept
     {
-        if (p.refCounter_ != refCounter_) {
+        if (p.ptr_ != ptr_) {
             DecreaseRefCount();
-            refCounter_ = p.refCounter_;
-            p.refCounter_ = nullptr;
+            ptr_ = p.ptr_;
+            p.ptr_ = nullptr;
         }
         return *this;
     }
@@ -114,98 +112,88 @@ public:
     template <class P>
     SharedPtr& operator=(const SharedPtr<P>& p)
     {
-        (void)static_cast<T*>(p.Get()); // static_cast to ensure type T and P are compatible
-        if (refCounter_ != p.refCounter_) {
+        auto* ptr = static_cast<T*>(p.ptr_); // static_cast to ensure type T and P are compatible
+        if (ptr_ != ptr) {
             DecreaseRefCount();
-            refCounter_ = p.refCounter_;
+            ptr_ = ptr;
             IncreaseRefCount();
         }
         return *this;
     }
 
 private:
-    SharedPtr(RefCounted::RefCounter* refCounter) // NOLINT(google-explicit-constructor,hicpp-explicit-conversions)
-        : refCounter_(refCounter)
+    struct Adopted {
+    };
+
+    /// Takes a reference which is already counted
+    SharedPtr(T* t, Adopted)
+        : ptr_(t)
     {
-        IncreaseRefCount();
     }
 
     void IncreaseRefCount()
     {
-        if (refCounter_ != nullptr) {
-            refCounter_->IncreaseShared();
+        if (ptr_ != nullptr) {
+            static_cast<RefCounted*>(ptr_)->IncreaseShared();
         }
     }
     void DecreaseRefCount()
     {
-        if (refCounter_ != nullptr) {
-            refCounter_->DecreaseShared();
+        if (ptr_ != nullptr) {
+            static_cast<RefCounted*>(ptr_)->DecreaseShared();
         }
     }
 
 private:
-    RefCounted::RefCounter* refCounter_;
+    T* ptr_;
 
     template <class P>
     friend class SharedPtr;
     template <class P>
     friend class WeakPtr;
-    template <class Q, class P>
-    friend bool operator==(const SharedPtr<Q>& t, const SharedPtr<P>& p);
-    template <class Q, class P>
-    friend bool operator!=(const SharedPtr<Q>& t, const SharedPtr<P>& p);
+    template <class P>
+    friend class AtomicSharedPtr;
 };
 
 template <class T>
 class WeakPtr {
 public:
     WeakPtr()
-        : refCounter_(nullptr)
+        : block_(nullptr)
     {
     }
 
     WeakPtr(T* p)
-        : refCounter_(nullptr) // NOLINT(google-explicit-constructor,hicpp-explicit-conversions)
-    {
-        if (p != nullptr) {
-            refCounter_ = static_cast<RefCounted*>(p)->refCounter_;
-            SSASSERT(refCounter_ != nullptr);
-            refCounter_->IncreaseWeak();
-        }
-    }
-
-    WeakPtr(const SharedPtr<T>& p) // NOLINT(google-explicit-constructor,hicpp-explicit-conversions)
-        : refCounter_(p.refCounter_)
+        : block_(nullptr) // NOLINT(google-explicit-constructor,hicpp-explicit-conversions)
     {
-        IncreaseRefCount();
+        Reset(p);
     }
 
     template <class P>
     WeakPtr(const SharedPtr<P>& p) // NOLINT(google-explicit-constructor,hicpp-explicit-conversions)
-        : refCounter_(p.refCounter_)
+        : block_(nullptr)
     {
-        (void)static_cast<T*>(p.Get()); // static_cast to ensure type T and P are compatible
-        IncreaseRefCount();
+        Reset(static_cast<T*>(p.ptr_)); // static_cast to ensure type T and P are compatible
     }
 
     template <class P>
     WeakPtr(const WeakPtr<P>& p) // NOLINT(google-explicit-constructor,hicpp-explicit-conversions)
-        : refCounter_(p.refCounter_)
+        : block_(p.block_)
     {
-        (void)static_cast<T*>(p.Get()); // to ensure type T and P are compatible
+        static_assert(std::is_convertible<P*, T*>::value || std::is_base_of<P, T>::value, "T and P are not compatible");
         IncreaseRefCount();
     }
 
     WeakPtr(const WeakPtr& p)
-        : refCounter_(p.refCounter_)
+        : block_(p.block_)
     {
         IncreaseRefCount();
     }
 
     WeakPtr(WeakPtr&& p) noexcept
-        : refCounter_(p.refCounter_)
+        : block_(p.block_)
     {
-        p.refCounter_ = nullptr;
+        p.block_ = nullptr;
     }
 
     ~WeakPtr()
@@ -215,17 +203,17 @@ public:
 
     SharedPtr<T> Lock() const
     {
-        if (refCounter_ == nullptr || refCounter_->Expired()) {
+        if (block_ == nullptr || !block_->TryIncreaseShared()) {
             return nullptr;
         }
-        return SharedPtr<T>(refCounter_);
+        return SharedPtr<T>(static_cast<T*>(block_->object), typename SharedPtr<T>::Adopted());
     }
 
     WeakPtr& operator=(const WeakPtr& p)
     {
-        if (p.refCounter_ != refCounter_) {
+        if (p.block_ != block_) {
             DecreaseRefCount();
-            refCounter_ = p.refCounter_;
+            block_ = p.block_;
             IncreaseRefCount();
         }
         return *this;
@@ -233,10 +221,10 @@ public:
 
     WeakPtr& operator=(WeakPtr&& p) noexcept
     {
-        if (p.refCounter_ != refCounter_) {
+        if (p.block_ != block_) {
             DecreaseRefCount();
-            refCounter_ = p.refCounter_;
-            p.refCounter_ = nullptr;
+            block_ = p.block_;
+            p.block_ = nullptr;
         }
         return *this;
     }
@@ -244,35 +232,43 @@ public:
     template <class P>
     WeakPtr& operator=(const WeakPtr<P>& p)
     {
-        (void)static_cast<T*>(p.Get()); // static_cast to ensure type T and P are compatible
-        if (p.refCounter_ != refCounter_) {
+        static_assert(std::is_convertible<P*, T*>::value || std::is_base_of<P, T>::value, "T and P are not compatible");
+        if (p.block_ != block_) {
             DecreaseRefCount();
-            refCounter_ = p.refCounter_;
+            block_ = p.block_;
             IncreaseRefCount();
         }
         return *this;
     }
 
 private:
+    void Reset(T* p)
+    {
+        if (p != nullptr) {
+            block_ = static_cast<RefCounted*>(p)->GetWeakBlock();
+            block_->IncreaseWeak();
+        }
+    }
+
     void IncreaseRefCount()
     {
-        if (refCounter_ != nullptr) {
-            refCounter_->IncreaseWeak();
+        if (block_ != nullptr) {
+            block_->IncreaseWeak();
         }
     }
     void DecreaseRefCount()
     {
-        if (refCounter_ != nullptr) {
-            refCounter_->DecreaseWeak();
+        if (block_ != nullptr) {
+            block_->DecreaseWeak();
         }
     }
 
 private:
-    RefCounted::RefCounter* refCounter_;
+    RefCounted::WeakBlock* block_;
     template <class P>
     friend class WeakPtr;
     template <class Q, class P>
-    friend bool operator!=(const WeakPtr<Q>& t, const WeakPtr<P>& p);
+    friend bool operator==(const WeakPtr<Q>& t, const WeakPtr<P>& p);
     template <class Q, class P>
     friend bool operator!=(const WeakPtr<Q>& t, const WeakPtr<P>& p);
 };
@@ -280,13 +276,13 @@ private:
 template <class T, class P>
 inline bool operator==(const SharedPtr<T>& t, const SharedPtr<P>& p)
 {
-    return t.refCounter_ == p.refCounter_;
+    return static_cast<const RefCounted*>(t.Get()) == static_cast<const RefCounted*>(p.Get());
 }
 
 template <class T, class P>
 inline bool operator!=(const SharedPtr<T>& t, const SharedPtr<P>& p)
 {
-    return t.refCounter_ != p.refCounter_;
+    return !(t == p);
 }
 
 template <class T, class P>
@@ -328,13 +324,13 @@ inline bool operator!=(const P* p, const SharedPtr<T>& t)
 template <class T, class P>
 inline bool operator==(const WeakPtr<T>& t, const WeakPtr<P>& p)
 {
-    return t.refCounter_ == p.refCounter_;
+    return t.block_ == p.block_;
 }
 
 template <class T, class P>
 inline bool operator!=(const WeakPtr<T>& t, const WeakPtr<P>& p)
 {
-    return t.refCounter_ != p.refCounter_;
+    return t.block_ != p.block_;
 }
 
 template <class T, class... Args>
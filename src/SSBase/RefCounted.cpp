@@ -3,7 +3,36 @@
 //
 
 #include "RefCounted.h"
+#include "ObjectPool.h"
 
 namespace ss {
 
+namespace {
+
+struct WeakBlockStorage {
+    alignas(std::max_align_t) unsigned char bytes[32];
+};
+
+/// Weakly referenced objects which are short-lived churn through the blocks from all the threads. The pool is never
+/// destroyed, as blocks may be released until the process exits.
+ObjectPool<WeakBlockStorage, MultiThreadPolicy>& GetWeakBlockPool()
+{
+    static auto* pool = new ObjectPool<WeakBlockStorage, MultiThreadPolicy>(4096);
+    return *pool;
+}
+
+} // namespace
+
+void* RefCounted::WeakBlock::operator new(size_t size)
+{
+    static_assert(sizeof(WeakBlock) <= sizeof(WeakBlockStorage), "WeakBlockStorage is too small");
+    SSASSERT(size <= sizeof(WeakBlockStorage));
+    return GetWeakBlockPool().Get();
+}
+
+void RefCounted::WeakBlock::operator delete(void* p)
+{
+    GetWeakBlockPool().Put(static_cast<WeakBlockStorage*>(p));
 }
+
+} // namespace ss
@@ -5,6 +5,10 @@
 #pragma once
 
 #include "Assert.h"
+#include "ThreadPolicy.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
 
 namespace ss {
 
@@ -12,71 +16,257 @@ template <class T>
 class SharedPtr;
 template <class T>
 class WeakPtr;
+template <class T, class ThreadPolicy>
+class RefCountedPool;
 
+/// Base of the objects held by SharedPtr. The shared count is embedded in the object, so making one is a single
+/// allocation and SharedPtr points to the object itself. The weak block is only allocated by the first WeakPtr of an
+/// object, as most objects are never weakly referenced, and the shared count moves to it from then on.
 class RefCounted {
+public:
+    /// How the references are counted, which the derived classes inherit. The classes whose objects are shared by
+    /// threads declare `using RefCountPolicy = MultiThreadPolicy;` to count atomically, the others keep the cheaper
+    /// non-atomic counting. An object counts by the policy of the type it is first held as by a SharedPtr, which is
+    /// its own type with `MakeShared`.
+    using RefCountPolicy = SingleThreadPolicy;
+
+    /// Takes the objects made by `MakePooled` back on their last release, instead of deleting them
+    class Recycler {
+    public:
+        virtual void Recycle(RefCounted* object) = 0;
+
+    protected:
+        ~Recycler() = default;
+    };
+
+    RefCounted()
+        : refCount_(0)
+        , recycler_(nullptr)
+    {
+    }
+
+    /// A copy is another object, with its own references
+    RefCounted(const RefCounted&)
+        : RefCounted()
+    {
+    }
+
+    RefCounted& operator=(const RefCounted&)
+    {
+        return *this;
+    }
+
+    virtual ~RefCounted()
+    {
+        uintptr_t bits = refCount_.load(std::memory_order_acquire);
+        if ((bits & kWeakBlock) != 0) {
+            // The weak pointers see the object expired, the block goes with the last of them
+            ToWeakBlock(bits)->DecreaseWeak();
+        }
+    }
+
 private:
-    struct RefCounter {
+    /// Allocated by the first WeakPtr of an object, and kept until the object and all its WeakPtr are gone
+    struct WeakBlock {
         RefCounted* object;
-        int sharedCount;
-        int weakCount;
+        std::atomic<int> sharedCount;
+        std::atomic<int> weakCount; // The object holds one until it is destroyed
+        bool threadSafe;
+
+        /// The blocks are recycled, see RefCounted.cpp
+        static void* operator new(size_t size);
+        static void operator delete(void* p);
 
         void IncreaseShared()
         {
-            SSASSERT(sharedCount >= 0);
-            ++sharedCount;
+            SSASSERT(sharedCount.load(std::memory_order_relaxed) >= 0);
+            Increase(sharedCount);
+        }
+
+        /// True if it was the last one
+        bool DecreaseShared()
+        {
+            SSASSERT(sharedCount.load(std::memory_order_relaxed) > 0);
+            return Decrease(sharedCount) == 0;
         }
 
-        void DecreaseShared()
+        /// For `WeakPtr::Lock`, false if the object is already released
+        bool TryIncreaseShared()
         {
-            SSASSERT(sharedCount > 0);
-            if (--sharedCount == 0) {
-                delete object;
+            int count = sharedCount.load(std::memory_order_relaxed);
+            if (!threadSafe) {
+                if (count == 0) {
+                    return false;
+                }
+                sharedCount.store(count + 1, std::memory_order_relaxed);
+                return true;
             }
+            // The last reference may be released by another thread meanwhile, so 0 must never be increased
+            do {
+                if (count == 0) {
+                    return false;
+                }
+            } while (!sharedCount.compare_exchange_weak(count, count + 1, std::memory_order_acq_rel, std::memory_order_relaxed));
+            return true;
         }
 
         void IncreaseWeak()
         {
-            SSASSERT(weakCount >= 0);
-            ++weakCount;
+            SSASSERT(weakCount.load(std::memory_order_relaxed) > 0);
+            Increase(weakCount);
         }
 
         void DecreaseWeak()
         {
-            SSASSERT(weakCount > 0);
-            if (--weakCount == 0) {
+            SSASSERT(weakCount.load(std::memory_order_relaxed) > 0);
+            if (Decrease(weakCount) == 0) {
                 delete this;
             }
         }
 
-        bool Expired()
+        // The non-atomic counting loads and stores separately, which compiles to plain instructions
+        void Increase(std::atomic<int>& count)
         {
-            return sharedCount == 0;
+            if (threadSafe) {
+                count.fetch_add(1, std::memory_order_relaxed);
+            } else {
+                count.store(count.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            }
+        }
+
+        int Decrease(std::atomic<int>& count)
+        {
+            if (!threadSafe) {
+                int n = count.load(std::memory_order_relaxed) - 1;
+                count.store(n, std::memory_order_relaxed);
+                return n;
+            }
+            // Releases the uses through this reference, and acquires those through the others if it is the last one
+            return count.fetch_sub(1, std::memory_order_acq_rel) - 1;
         }
     };
 
-public:
-    RefCounted()
-        : refCounter_(new RefCounter)
+    // `refCount_` holds either the shared count in units of kShared along with the kThreadSafe flag, or the address of
+    // the weak block tagged with kWeakBlock. It only changes from the former to the latter, which is a CAS when the
+    // counting is thread safe.
+    enum : uintptr_t {
+        kWeakBlock = 1,
+        kThreadSafe = 2,
+        kShared = 4
+    };
+
+    static WeakBlock* ToWeakBlock(uintptr_t bits)
     {
-        refCounter_->object = this;
-        refCounter_->sharedCount = 0;
-        refCounter_->weakCount = 0;
-        // This object has one weakCount
-        refCounter_->IncreaseWeak();
+        return reinterpret_cast<WeakBlock*>(bits & ~uintptr_t(kWeakBlock));
     }
 
-    virtual ~RefCounted()
+    /// By a SharedPtr from a raw pointer, which picks the policy if the object is not shared yet
+    void Adopt(bool threadSafe)
+    {
+        uintptr_t bits = refCount_.load(std::memory_order_acquire);
+        if ((bits & kWeakBlock) != 0) {
+            WeakBlock* block = ToWeakBlock(bits);
+            if (block->sharedCount.load(std::memory_order_relaxed) == 0) {
+                block->threadSafe = threadSafe;
+            }
+        } else if (bits < kShared) {
+            refCount_.store(threadSafe ? uintptr_t(kThreadSafe) : 0, std::memory_order_relaxed);
+        }
+        IncreaseShared();
+    }
+
+    // The loads acquire, so a weak block installed by another thread is seen initialized
+    void IncreaseShared()
+    {
+        uintptr_t bits = refCount_.load(std::memory_order_acquire);
+        for (;;) {
+            if ((bits & kWeakBlock) != 0) {
+                ToWeakBlock(bits)->IncreaseShared();
+                return;
+            }
+            if ((bits & kThreadSafe) == 0) {
+                refCount_.store(bits + kShared, std::memory_order_relaxed);
+                return;
+            }
+            // A weak block may be installed meanwhile, so it cannot be a plain atomic add
+            if (refCount_.compare_exchange_weak(bits, bits + kShared, std::memory_order_acquire, std::memory_order_acquire)) {
+                return;
+            }
+        }
+    }
+
+    void DecreaseShared()
     {
-        refCounter_->DecreaseWeak();
+        uintptr_t bits = refCount_.load(std::memory_order_acquire);
+        for (;;) {
+            if ((bits & kWeakBlock) != 0) {
+                if (ToWeakBlock(bits)->DecreaseShared()) {
+                    Release();
+                }
+                return;
+            }
+            SSASSERT(bits >= kShared);
+            if ((bits & kThreadSafe) == 0) {
+                refCount_.store(bits - kShared, std::memory_order_relaxed);
+                break;
+            }
+            if (refCount_.compare_exchange_weak(bits, bits - kShared, std::memory_order_acq_rel, std::memory_order_acquire)) {
+                break;
+            }
+        }
+        if (bits < 2 * kShared) {
+            Release();
+        }
+    }
+
+    void Release()
+    {
+        if (recycler_ != nullptr) {
+            recycler_->Recycle(this);
+        } else {
+            delete this;
+        }
+    }
+
+    /// Allocated on the first call, the caller must hold the object
+    WeakBlock* GetWeakBlock()
+    {
+        uintptr_t bits = refCount_.load(std::memory_order_acquire);
+        if ((bits & kWeakBlock) != 0) {
+            return ToWeakBlock(bits);
+        }
+        auto* block = new WeakBlock;
+        block->object = this;
+        block->weakCount.store(1, std::memory_order_relaxed);
+        block->threadSafe = (bits & kThreadSafe) != 0;
+        auto blockBits = reinterpret_cast<uintptr_t>(block) | kWeakBlock;
+        for (;;) {
+            block->sharedCount.store(int(bits / kShared), std::memory_order_relaxed);
+            if (!block->threadSafe) {
+                refCount_.store(blockBits, std::memory_order_relaxed);
+                return block;
+            }
+            if (refCount_.compare_exchange_weak(bits, blockBits, std::memory_order_acq_rel, std::memory_order_acquire)) {
+                return block;
+            }
+            if ((bits & kWeakBlock) != 0) {
+                // Installed by another thread
+                delete block;
+                return ToWeakBlock(bits);
+            }
+        }
     }
 
 private:
-    RefCounter* refCounter_;
+    std::atomic<uintptr_t> refCount_;
+    Recycler* recycler_; // nullptr if the object is deleted on the last release
 
     template <class T>
     friend class SharedPtr;
     template <class T>
     friend class WeakPtr;
+    template <class T, class ThreadPolicy>
+    friend class RefCountedPool;
 };
 
-}
\ No newline at end of file
+}
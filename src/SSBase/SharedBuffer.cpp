@@ -0,0 +1,76 @@
+//
+// Copyright (c) 2020 Carl Chen. All rights reserved.
+//
+
+#include "SharedBuffer.h"
+#include <cstdlib>
+#include <new>
+
+namespace ss {
+
+SharedBuffer::Block::Block()
+    : refs_(1)
+    , capacity_(0)
+    , used_(0)
+    , data_(nullptr)
+    , adopted_(0, nullptr)
+    , onRelease_(nullptr)
+{
+}
+
+SharedBuffer::Block::~Block()
+{
+    if (onRelease_ != nullptr) {
+        onRelease_();
+    }
+}
+
+SharedBuffer::Block* SharedBuffer::Block::Create(uint32_t capacity)
+{
+    void* p = malloc(sizeof(Block) + capacity);
+    if (p == nullptr) {
+        throw std::bad_alloc();
+    }
+    auto* block = new (p) Block;
+    block->capacity_ = capacity;
+    block->data_ = reinterpret_cast<uint8_t*>(block + 1);
+    return block;
+}
+
+void SharedBuffer::Block::Destroy(Block* block)
+{
+    block->~Block();
+    free(block);
+}
+
+SharedBuffer::SharedBuffer(const void* data, uint32_t size)
+    : block_(Block::Create(size))
+{
+    memcpy(block_->data_, data, size);
+    block_->used_ = size;
+}
+
+SharedBuffer::SharedBuffer(DynamicBuffer&& buffer)
+    : block_(Block::Create(0))
+{
+    block_->data_ = buffer.GetData<uint8_t>();
+    block_->used_ = buffer.Size();
+    block_->adopted_ = std::move(buffer);
+}
+
+SharedBuffer::SharedBuffer(const void* data, uint32_t size, std::function<void()>&& onRelease)
+    : block_(Block::Create(0))
+{
+    block_->data_ = static_cast<uint8_t*>(const_cast<void*>(data));
+    block_->used_ = size;
+    block_->onRelease_ = std::move(onRelease);
+}
+
+bool BufferSlice::Extensible() const
+{
+    const SharedBuffer::Block* block = buffer_.block_;
+    return block != nullptr && block->used_ < block->capacity_ && offset_ + size_ == block->used_
+        && block->refs_.load(std::memory_order_acquire) == 1;
+}
+
+} // namespace ss
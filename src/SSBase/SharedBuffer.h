@@ -0,0 +1,226 @@
+//
+// Copyright (c) 2020 Carl Chen. All rights reserved.
+//
+
+#pragma once
+
+#include "Buffer.h"
+#include <atomic>
+#include <cstdint>
+#include <functional>
+
+namespace ss {
+
+class BufferSlice;
+class ChainBuffer;
+
+/// Immutable block of bytes shared by atomic reference counting, so one payload can be handed to many consumers,
+/// e.g. broadcast to thousands of sockets, without a copy per consumer and without tracking when the last of them is
+/// done: every `BufferSlice` or pending send holds a reference, and the block is freed with the last one.
+class SharedBuffer {
+public:
+    SharedBuffer()
+        : block_(nullptr)
+    {
+    }
+
+    /// Copy `size` bytes into a new block
+    SharedBuffer(const void* data, uint32_t size);
+
+    /// Take over the readable bytes of `buffer`, without copying them
+    explicit SharedBuffer(DynamicBuffer&& buffer);
+
+    /// Refer to `size` bytes owned by the caller, `onRelease` is invoked once no one refers to them any more
+    SharedBuffer(const void* data, uint32_t size, std::function<void()>&& onRelease);
+
+    SharedBuffer(const SharedBuffer& b)
+        : block_(b.block_)
+    {
+        Block::Retain(block_);
+    }
+
+    SharedBuffer(SharedBuffer&& b) noexcept
+        : block_(b.block_)
+    {
+        b.block_ = nullptr;
+    }
+
+    ~SharedBuffer()
+    {
+        Block::Release(block_);
+    }
+
+    SharedBuffer& operator=(const SharedBuffer& b)
+    {
+        SharedBuffer(b).Swap(*this);
+        return *this;
+    }
+
+    SharedBuffer& operator=(SharedBuffer&& b) noexcept
+    {
+        SharedBuffer(std::move(b)).Swap(*this);
+        return *this;
+    }
+
+    void Swap(SharedBuffer& b) noexcept
+    {
+        std::swap(block_, b.block_);
+    }
+
+    const uint8_t* Data() const
+    {
+        return block_ == nullptr ? nullptr : block_->data_;
+    }
+
+    uint32_t Size() const
+    {
+        return block_ == nullptr ? 0 : block_->used_;
+    }
+
+    bool Empty() const
+    {
+        return Size() == 0;
+    }
+
+    /// Number of the references to the block, 0 if there is none
+    uint32_t UseCount() const
+    {
+        return block_ == nullptr ? 0 : block_->refs_.load(std::memory_order_acquire);
+    }
+
+    /// The `size` bytes from `offset`, without copying them
+    BufferSlice Slice(uint32_t offset, uint32_t size = uint32_t(-1)) const;
+
+private:
+    struct Block {
+        std::atomic<uint32_t> refs_;
+        uint32_t capacity_; // Of the bytes following this header, 0 if the bytes are adopted or referenced
+        uint32_t used_; // Number of bytes written, which are immutable once the block is shared
+        uint8_t* data_;
+        DynamicBuffer adopted_;
+        std::function<void()> onRelease_;
+
+        Block();
+        ~Block();
+
+        /// The bytes follow the header in the same allocation
+        static Block* Create(uint32_t capacity);
+
+        /// `block` may be nullptr
+        static void Retain(Block* block)
+        {
+            if (block != nullptr) {
+                block->refs_.fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+
+        /// `block` may be nullptr
+        static void Release(Block* block)
+        {
+            if (block != nullptr && block->refs_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+                Destroy(block);
+            }
+        }
+
+        static void Destroy(Block* block);
+    };
+
+    /// Take over the reference of `block`
+    explicit SharedBuffer(Block* block)
+        : block_(block)
+    {
+    }
+
+    Block* block_;
+
+    friend class BufferSlice;
+    friend class ChainBuffer;
+};
+
+/// A part of a `SharedBuffer`, which keeps the whole block alive. Slicing and copying never copy the bytes.
+class BufferSlice {
+public:
+    BufferSlice()
+        : offset_(0)
+        , size_(0)
+    {
+    }
+
+    /// The whole buffer
+    BufferSlice(SharedBuffer buffer) // NOLINT(google-explicit-constructor,hicpp-explicit-conversions)
+        : buffer_(std::move(buffer))
+        , offset_(0)
+        , size_(buffer_.Size())
+    {
+    }
+
+    BufferSlice(SharedBuffer buffer, uint32_t offset, uint32_t size)
+        : buffer_(std::move(buffer))
+        , offset_(offset)
+        , size_(size)
+    {
+        SSASSERT(offset <= buffer_.Size() && size <= buffer_.Size() - offset);
+    }
+
+    const uint8_t* Data() const
+    {
+        return buffer_.Data() + offset_;
+    }
+
+    uint32_t Size() const
+    {
+        return size_;
+    }
+
+    bool Empty() const
+    {
+        return size_ == 0;
+    }
+
+    /// The buffer this is a part of
+    const SharedBuffer& Buffer() const
+    {
+        return buffer_;
+    }
+
+    /// The `size` bytes from `offset` of this slice
+    BufferSlice SubSlice(uint32_t offset, uint32_t size = uint32_t(-1)) const
+    {
+        SSASSERT(offset <= size_);
+        if (size > size_ - offset) {
+            size = size_ - offset;
+        }
+        return BufferSlice(buffer_, offset_ + offset, size);
+    }
+
+    /// Drop the first `n` bytes
+    void Skip(uint32_t n)
+    {
+        SSASSERT(n <= size_);
+        offset_ += n;
+        size_ -= n;
+    }
+
+    /// For vectored I/O, the bytes must not be modified
+    BufferSpan Span() const
+    {
+        return { const_cast<uint8_t*>(Data()), size_ };
+    }
+
+private:
+    /// The bytes of a block which is not shared yet may be appended in place, see `ChainBuffer::PushData`
+    bool Extensible() const;
+
+    SharedBuffer buffer_;
+    uint32_t offset_;
+    uint32_t size_;
+
+    friend class ChainBuffer;
+};
+
+inline BufferSlice SharedBuffer::Slice(uint32_t offset, uint32_t size) const
+{
+    return BufferSlice(*this).SubSlice(offset, size);
+}
+
+} // namespace ss
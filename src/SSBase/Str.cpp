@@ -3,12 +3,19 @@
 //
 
 #include "Str.h"
+#include "Arena.h"
 #include "Assert.h"
 #include "Misc.h"
+#include "internal/Hash.h"
+#include "internal/Search.h"
+#include "internal/Unicode.h"
+#include "internal/Utf8.h"
 #include "thirdparty/fmt/fmt/format.h"
+#include <atomic>
 #include <cstring>
 #include <cwchar>
-#include <unordered_set>
+#include <new>
+#include <type_traits>
 
 #ifdef SS_PLATFORM_WIN32
 #include <Windows.h>
@@ -28,173 +35,135 @@ static WindowsUtf8ConsoleHelper __windowsUtf8ConsoleHelper;
 
 namespace ss {
 
-// modified version of utfcpp : https://github.com/ww898/utf-cpp
-// Supported combinations:
-//   0xxx_xxxx
-//   110x_xxxx 10xx_xxxx
-//   1110_xxxx 10xx_xxxx 10xx_xxxx
-//   1111_0xxx 10xx_xxxx 10xx_xxxx 10xx_xxxx
-//   1111_10xx 10xx_xxxx 10xx_xxxx 10xx_xxxx 10xx_xxxx
-//   1111_110x 10xx_xxxx 10xx_xxxx 10xx_xxxx 10xx_xxxx 10xx_xxxx
-struct utf8 final {
-    static size_t const max_unicode_symbol_size = 4;
-    static size_t const max_supported_symbol_size = 6;
+inline uint32_t WidthOf(uint32_t code)
+{
+    return code <= 0xFFu ? 1 : (code <= 0xFFFFu ? 2 : 4);
+}
 
-    static uint32_t const max_supported_code_point = 0x7FFFFFFF;
+/// Invoke `fn` with the units casted to the pointer type of their width
+template <class Fn>
+inline auto VisitUnits(const void* data, uint32_t width, Fn&& fn) -> decltype(fn(static_cast<const uint8_t*>(data)))
+{
+    switch (width) {
+    case 1:
+        return fn(static_cast<const uint8_t*>(data));
+    case 2:
+        return fn(static_cast<const uint16_t*>(data));
+    default:
+        return fn(static_cast<const uint32_t*>(data));
+    }
+}
 
-    using char_type = uint8_t;
+template <class Fn>
+inline auto VisitMutableUnits(void* data, uint32_t width, Fn&& fn) -> decltype(fn(static_cast<uint8_t*>(data)))
+{
+    switch (width) {
+    case 1:
+        return fn(static_cast<uint8_t*>(data));
+    case 2:
+        return fn(static_cast<uint16_t*>(data));
+    default:
+        return fn(static_cast<uint32_t*>(data));
+    }
+}
 
-    template <typename PeekFn>
-    static size_t char_size(PeekFn&& peek_fn)
-    {
-        char_type const ch0 = std::forward<PeekFn>(peek_fn)();
-        if (ch0 < 0x80) // 0xxx_xxxx
-            return 1;
-        if (ch0 < 0xC0)
-            // throw std::runtime_error("The utf8 first char in sequence is incorrect");
-            return -1;
-        if (ch0 < 0xE0) // 110x_xxxx 10xx_xxxx
-            return 2;
-        if (ch0 < 0xF0) // 1110_xxxx 10xx_xxxx 10xx_xxxx
-            return 3;
-        if (ch0 < 0xF8) // 1111_0xxx 10xx_xxxx 10xx_xxxx 10xx_xxxx
-            return 4;
-        if (ch0 < 0xFC) // 1111_10xx 10xx_xxxx 10xx_xxxx 10xx_xxxx 10xx_xxxx
-            return 5;
-        if (ch0 < 0xFE) // 1111_110x 10xx_xxxx 10xx_xxxx 10xx_xxxx 10xx_xxxx 10xx_xxxx
-            return 6;
-        return -1;
-        // throw std::runtime_error("The utf8 first char in sequence is incorrect");
-    }
-
-    template <typename ReadFn>
-    static uint32_t read(ReadFn&& read_fn)
-    {
-        char_type const ch0 = read_fn();
-        if (ch0 < 0x80) // 0xxx_xxxx
-            return ch0;
-        if (ch0 < 0xC0)
-            // throw std::runtime_error("The utf8 first char in sequence is incorrect");
-            return -1;
-        if (ch0 < 0xE0) // 110x_xxxx 10xx_xxxx
-        {
-            char_type const ch1 = read_fn();
-            if (ch1 >> 6 != 2)
-                goto _err;
-            return (ch0 << 6) + ch1 - 0x3080;
-        }
-        if (ch0 < 0xF0) // 1110_xxxx 10xx_xxxx 10xx_xxxx
-        {
-            char_type const ch1 = read_fn();
-            if (ch1 >> 6 != 2)
-                goto _err;
-            char_type const ch2 = read_fn();
-            if (ch2 >> 6 != 2)
-                goto _err;
-            return (ch0 << 12) + (ch1 << 6) + ch2 - 0xE2080;
-        }
-        if (ch0 < 0xF8) // 1111_0xxx 10xx_xxxx 10xx_xxxx 10xx_xxxx
-        {
-            char_type const ch1 = read_fn();
-            if (ch1 >> 6 != 2)
-                goto _err;
-            char_type const ch2 = read_fn();
-            if (ch2 >> 6 != 2)
-                goto _err;
-            char_type const ch3 = read_fn();
-            if (ch3 >> 6 != 2)
-                goto _err;
-            return (ch0 << 18) + (ch1 << 12) + (ch2 << 6) + ch3 - 0x3C82080;
-        }
-        if (ch0 < 0xFC) // 1111_10xx 10xx_xxxx 10xx_xxxx 10xx_xxxx 10xx_xxxx
-        {
-            char_type const ch1 = read_fn();
-            if (ch1 >> 6 != 2)
-                goto _err;
-            char_type const ch2 = read_fn();
-            if (ch2 >> 6 != 2)
-                goto _err;
-            char_type const ch3 = read_fn();
-            if (ch3 >> 6 != 2)
-                goto _err;
-            char_type const ch4 = read_fn();
-            if (ch4 >> 6 != 2)
-                goto _err;
-            return (ch0 << 24) + (ch1 << 18) + (ch2 << 12) + (ch3 << 6) + ch4 - 0xFA082080;
-        }
-        if (ch0 < 0xFE) // 1111_110x 10xx_xxxx 10xx_xxxx 10xx_xxxx 10xx_xxxx 10xx_xxxx
-        {
-            char_type const ch1 = read_fn();
-            if (ch1 >> 6 != 2)
-                goto _err;
-            char_type const ch2 = read_fn();
-            if (ch2 >> 6 != 2)
-                goto _err;
-            char_type const ch3 = read_fn();
-            if (ch3 >> 6 != 2)
-                goto _err;
-            char_type const ch4 = read_fn();
-            if (ch4 >> 6 != 2)
-                goto _err;
-            char_type const ch5 = read_fn();
-            if (ch5 >> 6 != 2)
-                goto _err;
-            return (ch0 << 30) + (ch1 << 24) + (ch2 << 18) + (ch3 << 12) + (ch4 << 6) + ch5 - 0x82082080;
-        }
-        return -1;
-        // throw std::runtime_error("The utf8 first char in sequence is incorrect");
-    _err:
-        //        return -1;
-        throw std::runtime_error("The utf8 slave char in sequence is incorrect");
+inline uint32_t ReadUnit(const void* data, uint32_t width, uint32_t index)
+{
+    return VisitUnits(data, width, [index](auto* p) -> uint32_t { return p[index]; });
+}
+
+inline void WriteUnit(void* data, uint32_t width, uint32_t index, uint32_t code)
+{
+    VisitMutableUnits(data, width, [index, code](auto* p) { p[index] = std::remove_reference_t<decltype(*p)>(code); });
+}
+
+/// Returns the width needed to store all the `n` code points
+template <class T>
+inline uint32_t MaxWidth(const T* units, uint32_t n)
+{
+    uint32_t bits = 0;
+    for (uint32_t i = 0; i < n; ++i) {
+        bits |= uint32_t(units[i]);
     }
+    return WidthOf(bits);
+}
 
-    template <typename WriteFn>
-    static void write(uint32_t const cp, WriteFn&& write_fn)
-    {
-        if (cp < 0x80) // 0xxx_xxxx
-            write_fn(static_cast<char_type>(cp));
-        else if (cp < 0x800) // 110x_xxxx 10xx_xxxx
-        {
-            write_fn(static_cast<char_type>(0xC0 | cp >> 6));
-            goto _1;
-        } else if (cp < 0x10000) // 1110_xxxx 10xx_xxxx 10xx_xxxx
-        {
-            write_fn(static_cast<char_type>(0xE0 | cp >> 12));
-            goto _2;
-        } else if (cp < 0x200000) // 1111_0xxx 10xx_xxxx 10xx_xxxx 10xx_xxxx
-        {
-            write_fn(static_cast<char_type>(0xF0 | cp >> 18));
-            goto _3;
-        } else if (cp < 0x4000000) // 1111_10xx 10xx_xxxx 10xx_xxxx 10xx_xxxx 10xx_xxxx
-        {
-            write_fn(static_cast<char_type>(0xF8 | cp >> 24));
-            goto _4;
-        } else if (cp < 0x80000000) // 1111_110x 10xx_xxxx 10xx_xxxx 10xx_xxxx 10xx_xxxx 10xx_xxxx
-        {
-            write_fn(static_cast<char_type>(0xFC | cp >> 30));
-            goto _5;
-        } else
-            throw std::runtime_error("Tool large UTF8 code point");
+inline uint32_t MaxWidth(const uint8_t*, uint32_t)
+{
+    return 1;
+}
+
+inline uint32_t MaxWidth(const void* data, uint32_t width, uint32_t n)
+{
+    return VisitUnits(data, width, [n](auto* p) { return MaxWidth(p, n); });
+}
+
+/// Copy `n` code points, the destination width should be large enough to hold all of them
+inline void ConvertUnits(void* dst, uint32_t dstWidth, const void* src, uint32_t srcWidth, uint32_t n)
+{
+    if (dstWidth == srcWidth) {
+        memmove(dst, src, size_t(n) * dstWidth);
         return;
-    _5:
-        write_fn(static_cast<char_type>(0x80 | (cp >> 24 & 0x3F)));
-    _4:
-        write_fn(static_cast<char_type>(0x80 | (cp >> 18 & 0x3F)));
-    _3:
-        write_fn(static_cast<char_type>(0x80 | (cp >> 12 & 0x3F)));
-    _2:
-        write_fn(static_cast<char_type>(0x80 | (cp >> 6 & 0x3F)));
-    _1:
-        write_fn(static_cast<char_type>(0x80 | (cp & 0x3F)));
     }
-};
+    VisitMutableUnits(dst, dstWidth, [src, srcWidth, n](auto* d) {
+        VisitUnits(src, srcWidth, [d, n](auto* s) {
+            for (uint32_t i = 0; i < n; ++i) {
+                d[i] = std::remove_reference_t<decltype(*d)>(s[i]);
+            }
+        });
+    });
+}
+
+/// Widen `n` code points in place, the buffer should be large enough to hold `n * newWidth` bytes
+inline void WidenUnits(void* data, uint32_t oldWidth, uint32_t newWidth, uint32_t n)
+{
+    if (oldWidth == newWidth) {
+        return;
+    }
+    // Go backwards, so no unit is overwritten before it is read
+    VisitMutableUnits(data, newWidth, [data, oldWidth, n](auto* d) {
+        VisitUnits(static_cast<const void*>(data), oldWidth, [d, n](auto* s) {
+            auto* dst = d + n;
+            auto* src = s + n;
+            while (src != s) {
+                *--dst = std::remove_reference_t<decltype(*d)>(*--src);
+            }
+        });
+    });
+}
 
 struct CharSequence::SequenceData {
-    CharType* chars_;
+    void* units_;
+    Arena* arena_; // Where this and the units are allocated, nullptr for the heap
+    uint32_t capacity_; // In code points
+    uint32_t size_; // Number of initialized code points, may be larger than the length of the owner
+    uint32_t width_;
+    // The Strings holding this in the high half, they share it copy-on-write, and all the Strings and StringViews in
+    // the low half. A single atomic, so a copy or a release is one atomic operation.
+    std::atomic<uint64_t> counts_;
+
+    enum : uint64_t {
+        kView = 1,
+        kOwner = (uint64_t(1) << 32u) + 1
+    };
+
+    /// Hash of the `size_` code points, see `CharSequence::Hash`
+    std::atomic<uint64_t> hash_;
+
+    enum : uint64_t {
+        kHashUnknown = 0,
+        kHashNotCached = 1 // A pointer to the units has been handed out, they may change at any time
+    };
 
-    explicit SequenceData(uint32_t length)
+    SequenceData(uint32_t capacity, uint32_t width, Arena* arena)
+        : units_(Arena::AllocateFrom(arena, size_t(capacity) * width))
+        , arena_(arena)
+        , capacity_(capacity)
+        , size_(0)
+        , width_(width)
+        , counts_(kOwner)
+        , hash_(kHashUnknown)
     {
-        chars_ = static_cast<CharType*>(malloc(length * sizeof(CharType)));
     }
 
     SequenceData(const SequenceData&) = delete;
@@ -204,15 +173,195 @@ struct CharSequence::SequenceData {
 
     ~SequenceData()
     {
-        free(chars_);
+        Arena::DeallocateFrom(arena_, units_, size_t(capacity_) * width_);
+    }
+
+    /// Allocated from `arena`, or from the heap if it is nullptr
+    static SequenceData* Create(uint32_t capacity, uint32_t width, Arena* arena)
+    {
+        void* p = Arena::AllocateFrom(arena, sizeof(SequenceData));
+        return new (p) SequenceData(capacity, width, arena);
+    }
+
+    static void Destroy(SequenceData* sequenceData)
+    {
+        Arena* arena = sequenceData->arena_;
+        sequenceData->~SequenceData();
+        Arena::DeallocateFrom(arena, sequenceData, sizeof(SequenceData));
+    }
+
+    void Retain(bool owner)
+    {
+        counts_.fetch_add(owner ? kOwner : kView, std::memory_order_relaxed);
+    }
+
+    /// `sequenceData` may be nullptr
+    static void Release(SequenceData* sequenceData, bool owner)
+    {
+        if (sequenceData == nullptr) {
+            return;
+        }
+        uint64_t count = owner ? kOwner : kView;
+        if (sequenceData->counts_.fetch_sub(count, std::memory_order_acq_rel) == count) {
+            Destroy(sequenceData);
+        }
+    }
+
+    /// More than one string refers to this, so it must not be modified in place
+    bool IsShared() const
+    {
+        return (counts_.load(std::memory_order_acquire) >> 32u) > 1;
+    }
+
+    /// The units are about to be modified
+    void ResetHash()
+    {
+        if (hash_.load(std::memory_order_relaxed) != kHashNotCached) {
+            hash_.store(kHashUnknown, std::memory_order_relaxed);
+        }
     }
 
-    void ReAllocate(uint32_t length)
+    /// `Data` has handed out a pointer to the units, which may be written through at any time
+    bool IsExposed() const
     {
-        chars_ = static_cast<CharType*>(realloc(chars_, length * sizeof(CharType)));
+        return hash_.load(std::memory_order_relaxed) == kHashNotCached;
+    }
+
+    bool HasViews() const
+    {
+        uint64_t counts = counts_.load(std::memory_order_acquire);
+        return (counts >> 32u) != (counts & 0xFFFFFFFFu);
+    }
+
+    void Reserve(uint32_t capacity, uint32_t width)
+    {
+        if (capacity <= capacity_ && width <= width_) {
+            return;
+        }
+        if (capacity < capacity_) {
+            capacity = capacity_;
+        }
+        if (width < width_) {
+            width = width_;
+        }
+        units_ = Arena::ReallocateFrom(arena_, units_, size_t(capacity_) * width_, size_t(capacity) * width);
+        WidenUnits(units_, width_, width, size_);
+        capacity_ = capacity;
+        width_ = width;
     }
 };
 
+template <class A, class B>
+inline int CompareUnits(const A* a, uint32_t na, const B* b, uint32_t nb)
+{
+    uint32_t n = na < nb ? na : nb;
+    for (uint32_t i = 0; i < n; ++i) {
+        if (a[i] != b[i]) {
+            return uint32_t(a[i]) < uint32_t(b[i]) ? -1 : 1;
+        }
+    }
+    return na < nb ? -1 : (na > nb ? 1 : 0);
+}
+
+inline int CompareUnits(const uint8_t* a, uint32_t na, const uint8_t* b, uint32_t nb)
+{
+    int ret = memcmp(a, b, na < nb ? na : nb);
+    if (ret != 0) {
+        return ret < 0 ? -1 : 1;
+    }
+    return na < nb ? -1 : (na > nb ? 1 : 0);
+}
+
+/// Compares the simple case foldings of the code points
+template <class A, class B>
+inline int CompareFolded(const A* a, uint32_t na, const B* b, uint32_t nb)
+{
+    uint32_t n = na < nb ? na : nb;
+    for (uint32_t i = 0; i < n; ++i) {
+        uint32_t ca = Unicode::Fold(a[i]);
+        uint32_t cb = Unicode::Fold(b[i]);
+        if (ca != cb) {
+            return ca < cb ? -1 : 1;
+        }
+    }
+    return na < nb ? -1 : (na > nb ? 1 : 0);
+}
+
+inline int CompareFolded(const uint8_t* a, uint32_t na, const uint8_t* b, uint32_t nb)
+{
+    uint32_t n = na < nb ? na : nb;
+    for (uint32_t i = 0; i < n; ++i) {
+        // Skip the ASCII characters which are equal, 16 at a time
+        i += Unicode::AsciiEqualIgnoreCase(a + i, b + i, n - i);
+        if (i == n) {
+            break;
+        }
+        uint32_t ca = Unicode::Fold(a[i]);
+        uint32_t cb = Unicode::Fold(b[i]);
+        if (ca != cb) {
+            return ca < cb ? -1 : 1;
+        }
+    }
+    return na < nb ? -1 : (na > nb ? 1 : 0);
+}
+
+inline uint32_t FindIn(const void* h, uint32_t hWidth, uint32_t hn, const void* n, uint32_t nWidth, uint32_t nn,
+    uint32_t start, const SearchPlan* plan)
+{
+    return VisitUnits(h, hWidth, [n, nWidth, hn, nn, start, plan](auto* ph) {
+        return VisitUnits(n, nWidth, [ph, hn, nn, start, plan](auto* pn) { return FindUnits(ph, hn, pn, nn, start, plan); });
+    });
+}
+
+inline uint32_t RFindIn(const void* h, uint32_t hWidth, uint32_t end, const void* n, uint32_t nWidth, uint32_t nn,
+    const SearchPlan* plan)
+{
+    return VisitUnits(h, hWidth, [n, nWidth, end, nn, plan](auto* ph) {
+        return VisitUnits(n, nWidth, [ph, end, nn, plan](auto* pn) { return RFindUnits(ph, end, pn, nn, plan); });
+    });
+}
+
+inline uint32_t Utf8Size(uint32_t cp)
+{
+    if (cp < 0x80) {
+        return 1;
+    }
+    if (cp < 0x800) {
+        return 2;
+    }
+    if (cp < 0x10000) {
+        return 3;
+    }
+    uint32_t size = 0;
+    utf8::write(cp, [&size](utf8::char_type) { ++size; });
+    return size;
+}
+
+template <class T>
+inline uint32_t Utf8Length(const T* units, uint32_t n)
+{
+    uint32_t utf8Length = 0;
+    for (uint32_t i = 0; i < n; ++i) {
+        utf8Length += Utf8Size(units[i]);
+    }
+    return utf8Length;
+}
+
+inline uint32_t Utf8Length(const uint8_t* units, uint32_t n)
+{
+    // Latin-1 code points take 1 or 2 bytes
+    uint32_t utf8Length = n;
+    for (uint32_t i = 0; i < n; ++i) {
+        utf8Length += units[i] >> 7u;
+    }
+    return utf8Length;
+}
+
+inline uint32_t CalculateCapacity(uint32_t len)
+{
+    return Misc::CeilToPowerOfTwo(len);
+}
+
 bool CharSequence::IsAsciiAlpha(CharType ch)
 {
     auto& c = ch.code;
@@ -221,130 +370,37 @@ bool CharSequence::IsAsciiAlpha(CharType ch)
 
 bool CharSequence::IsAlpha(CharType ch)
 {
-    const uint32_t AA = L'Ａ';
-    const uint32_t ZZ = L'Ｚ';
-    const uint32_t aa = L'ａ';
-    const uint32_t zz = L'ｚ';
-    auto& c = ch.code;
-    return IsAsciiAlpha(ch) || (c >= aa && c <= zz) || (c >= AA && c <= ZZ);
+    return Unicode::Is(ch.code, Unicode::kAlpha);
 }
 
 bool CharSequence::IsUpper(CharSequence::CharType ch)
 {
-    const uint32_t A = 'A';
-    const uint32_t Z = 'Z';
-    const uint32_t AA = L'Ａ';
-    const uint32_t ZZ = L'Ｚ';
-    auto& c = ch.code;
-    return (c >= A && c <= Z) || (c >= AA && c <= ZZ);
+    return Unicode::Is(ch.code, Unicode::kUpper);
 }
 
 bool CharSequence::IsLower(CharSequence::CharType ch)
 {
-    const uint32_t a = 'a';
-    const uint32_t z = 'z';
-    const uint32_t aa = L'ａ';
-    const uint32_t zz = L'ｚ';
-    auto& c = ch.code;
-    return (c >= aa && c <= zz) || (c >= a && c <= z);
+    return Unicode::Is(ch.code, Unicode::kLower);
 }
 
 CharSequence::CharType CharSequence::ToUpper(CharSequence::CharType ch)
 {
-    const uint32_t a = 'a';
-    const uint32_t A = 'A';
-    const uint32_t z = 'z';
-    const uint32_t aa = L'ａ';
-    const uint32_t AA = L'Ａ';
-    const uint32_t zz = L'ｚ';
-    auto& c = ch.code;
-    if (c >= a && c <= z) {
-        return CharType { c + A - a };
-    }
-    if (c >= aa && c <= zz) {
-        return CharType { c + AA - aa };
-    }
-    return ch;
+    return CharType { Unicode::ToUpper(ch.code) };
 }
 
 CharSequence::CharType CharSequence::ToLower(CharSequence::CharType ch)
 {
-    const uint32_t a = 'a';
-    const uint32_t A = 'A';
-    const uint32_t Z = 'Z';
-    const uint32_t aa = L'ａ';
-    const uint32_t AA = L'Ａ';
-    const uint32_t ZZ = L'Ｚ';
-    auto& c = ch.code;
-    if (c >= A && c <= Z) {
-        return CharType { c + a - A };
-    }
-    if (c >= AA && c <= ZZ) {
-        return CharType { c + aa - AA };
-    }
-    return ch;
+    return CharType { Unicode::ToLower(ch.code) };
+}
+
+CharSequence::CharType CharSequence::FoldCase(CharSequence::CharType ch)
+{
+    return CharType { Unicode::Fold(ch.code) };
 }
 
 bool CharSequence::IsWhiteSpace(CharSequence::CharType c)
 {
-    enum Spaces : uint32_t {
-        ///
-        TABULATION = 0x0009,
-        LINE_FEED = 0x000A,
-        LINE_TABULATION = 0x000B,
-        FORM_FEED = 0x000C,
-        CARRIAGE_RETURN = 0x000D,
-        ///
-        SPACE = 0x20,
-        NO_BREAK_SPACE = 0xA0,
-        OGHAM_SPACE_MARK = 0x1680,
-        ///
-        EN_QUAD = 0x2000,
-        EM_QUAD = 0x2001,
-        EN_SPACE = 0x2002,
-        EM_SPACE = 0x2003,
-        THREE_PER_EM_SPACE = 0x2004,
-        FOUR_PER_EM_SPACE = 0x2005,
-        SIX_PER_EM_SPACE = 0x2006,
-        FIGURE_SPACE = 0x2007,
-        PUNCTUATION_SPACE = 0x2008,
-        THIN_SPACE = 0x2009,
-        HAIR_SPACE = 0x200A,
-        ///
-        NARROW_NO_BREAK_SPACE = 0x202F,
-        MEDIUM_MATHEMATICAL_SPACE = 0x205F,
-        IDEOGRAPHIC_SPACE = 0x3000,
-        ///
-        LINE_SEPARATOR = 0x2028,
-        PARAGRAPH_SEPARATOR = 0x2029,
-    }; ///
-    static const std::unordered_set<uint32_t> kSpaces = {
-        TABULATION,
-        LINE_FEED,
-        LINE_TABULATION,
-        FORM_FEED,
-        CARRIAGE_RETURN,
-        SPACE,
-        NO_BREAK_SPACE,
-        OGHAM_SPACE_MARK,
-        EN_QUAD,
-        EM_QUAD,
-        EN_SPACE,
-        EM_SPACE,
-        THREE_PER_EM_SPACE,
-        FOUR_PER_EM_SPACE,
-        SIX_PER_EM_SPACE,
-        FIGURE_SPACE,
-        PUNCTUATION_SPACE,
-        THIN_SPACE,
-        HAIR_SPACE,
-        NARROW_NO_BREAK_SPACE,
-        MEDIUM_MATHEMATICAL_SPACE,
-        IDEOGRAPHIC_SPACE,
-        LINE_SEPARATOR,
-        PARAGRAPH_SEPARATOR,
-    };
-    return kSpaces.find(c.code) != kSpaces.end();
+    return Unicode::IsSpace(c.code);
 }
 
 CharSequence::CharSequence()
@@ -362,7 +418,9 @@ String CharSequence::SubString(uint32_t from, uint32_t length) const
     {
         length = Length() - from;
     }
-    return String(Data() + from, length);
+    Units units = GetUnits();
+    units.data = static_cast<const uint8_t*>(units.data) + size_t(from) * units.width;
+    return String(units, length);
 }
 
 StringView CharSequence::SubStringView(uint32_t from, uint32_t length) const
@@ -372,36 +430,37 @@ StringView CharSequence::SubStringView(uint32_t from, uint32_t length) const
 
 int CharSequence::Compare(const CharSequence& s) const
 {
-    uint32_t n = Length() > s.Length() ? s.Length() : Length();
-    for (uint32_t i = 0; i < n; ++i) {
-        if (At(i) > s.At(i)) {
-            return 1;
-        }
-        if (At(i) < s.At(i)) {
-            return -1;
-        }
-    }
-    if (Length() > s.Length()) {
-        return 1;
-    }
-    if (Length() < s.Length()) {
-        return -1;
-    }
-    return 0;
+    Units a = GetUnits();
+    Units b = s.GetUnits();
+    uint32_t na = Length();
+    uint32_t nb = s.Length();
+    return VisitUnits(a.data, a.width, [b, na, nb](auto* pa) {
+        return VisitUnits(b.data, b.width, [pa, na, nb](auto* pb) { return CompareUnits(pa, na, pb, nb); });
+    });
 }
 
 int CharSequence::CompareIgnoreCase(const CharSequence& s) const
 {
-    String thisStr(*this);
-    String otherStr(s);
-    thisStr.ToLower();
-    otherStr.ToLower();
-    return thisStr.Compare(otherStr);
+    Units a = GetUnits();
+    Units b = s.GetUnits();
+    uint32_t na = Length();
+    uint32_t nb = s.Length();
+    return VisitUnits(a.data, a.width, [b, na, nb](auto* pa) {
+        return VisitUnits(b.data, b.width, [pa, na, nb](auto* pb) { return CompareFolded(pa, na, pb, nb); });
+    });
 }
 
 bool CharSequence::StartsWith(const CharSequence& s) const
 {
-    return Length() >= s.Length() && memcmp(Data(), s.Data(), s.Length() * sizeof(CharType)) == 0;
+    if (Length() < s.Length()) {
+        return false;
+    }
+    Units a = GetUnits();
+    Units b = s.GetUnits();
+    uint32_t n = s.Length();
+    return VisitUnits(a.data, a.width, [b, n](auto* pa) {
+        return VisitUnits(b.data, b.width, [pa, n](auto* pb) { return EqualUnits(pa, pb, n); });
+    });
 }
 
 bool CharSequence::StartsWith(const String& s) const
@@ -411,7 +470,16 @@ bool CharSequence::StartsWith(const String& s) const
 
 bool CharSequence::EndsWith(const CharSequence& s) const
 {
-    return Length() >= s.Length() && memcmp(Data() + Length() - s.Length(), s.Data(), s.Length() * sizeof(CharType)) == 0;
+    if (Length() < s.Length()) {
+        return false;
+    }
+    Units a = GetUnits();
+    Units b = s.GetUnits();
+    uint32_t n = s.Length();
+    uint32_t offset = Length() - n;
+    return VisitUnits(a.data, a.width, [b, n, offset](auto* pa) {
+        return VisitUnits(b.data, b.width, [pa, n, offset](auto* pb) { return EqualUnits(pa + offset, pb, n); });
+    });
 }
 
 bool CharSequence::EndsWith(const String& s) const
@@ -421,16 +489,9 @@ bool CharSequence::EndsWith(const String& s) const
 
 uint32_t CharSequence::Find(const CharSequence& s, uint32_t start) const
 {
-    if (Length() < s.Length() + start) {
-        return kNPos;
-    }
-    uint32_t n = Length() - s.Length() + 1;
-    for (uint32_t i = start; i < n; ++i) {
-        if (memcmp(Data() + i, s.Data(), s.Length() * sizeof(CharType)) == 0) {
-            return i;
-        }
-    }
-    return kNPos;
+    Units h = GetUnits();
+    Units n = s.GetUnits();
+    return FindIn(h.data, h.width, Length(), n.data, n.width, s.Length(), start, nullptr);
 }
 
 uint32_t CharSequence::RFind(const CharSequence& s, uint32_t end) const
@@ -438,30 +499,43 @@ uint32_t CharSequence::RFind(const CharSequence& s, uint32_t end) const
     if (end > Length()) {
         end = Length();
     }
-    if (end < s.Length()) {
-        return kNPos;
-    }
-
-    uint32_t n = end - s.Length() + 1;
-    for (uint32_t i = n; i > 0; --i) {
-        if (memcmp(Data() + i - 1, s.Data(), s.Length() * sizeof(CharType)) == 0) {
-            return i - 1;
-        }
-    }
-    return kNPos;
+    Units h = GetUnits();
+    Units n = s.GetUnits();
+    return RFindIn(h.data, h.width, end, n.data, n.width, s.Length(), nullptr);
 }
 
 void CharSequence::ToUpper()
 {
-    for (uint32_t i = 0; i < Length(); ++i) {
-        At(i) = ToUpper(At(i));
-    }
+    MapCase(GetUnits().width, true);
 }
 
 void CharSequence::ToLower()
 {
+    MapCase(GetUnits().width, false);
+}
+
+void CharSequence::MapCase(uint32_t width, bool upper)
+{
+    if (Length() == 0) {
+        return;
+    }
+    void* units = Widen(width);
     for (uint32_t i = 0; i < Length(); ++i) {
-        At(i) = ToLower(At(i));
+        if (width == 1) {
+            // ASCII characters are mapped 16 at a time
+            auto* p = static_cast<uint8_t*>(units) + i;
+            i += upper ? Unicode::AsciiToUpper(p, p, Length() - i) : Unicode::AsciiToLower(p, p, Length() - i);
+            if (i == Length()) {
+                break;
+            }
+        }
+        uint32_t code = ReadUnit(units, width, i);
+        code = upper ? Unicode::ToUpper(code) : Unicode::ToLower(code);
+        if (WidthOf(code) > width) {
+            width = WidthOf(code);
+            units = Widen(width);
+        }
+        WriteUnit(units, width, i, code);
     }
 }
 
@@ -517,66 +591,184 @@ String CharSequence::ReplaceAll(const String& oldStr, const String& newStr)
 uint32_t CharSequence::GetBytesLength(CharSequence::CharSet charSet) const
 {
     SSASSERT(charSet == kUtf8);
-    uint32_t utf8Length = 0;
-    for (uint32_t i = 0; i < Length(); ++i) {
-        utf8::write(At(i).code, [&utf8Length](utf8::char_type c) { ++utf8Length; });
-    }
-    return utf8Length;
+    Units units = GetUnits();
+    uint32_t n = Length();
+    return VisitUnits(units.data, units.width, [n](auto* p) { return Utf8Length(p, n); });
 }
 
 void CharSequence::GetBytes(CharSet charSet, void* buffer) const
 {
     SSASSERT(charSet == kUtf8);
-    auto* p = static_cast<utf8::char_type*>(buffer);
-    uint32_t index = 0;
-    for (uint32_t i = 0; i < Length(); ++i) {
-        utf8::write(At(i).code, [p, &index](utf8::char_type c) { p[index++] = c; });
+    auto* p = static_cast<char*>(buffer);
+    Units units = GetUnits();
+    // The buffer is required to hold GetBytesLength() bytes, which is always enough
+    uint32_t length = Utf8Codec::Encode(units.data, units.width, Length(), p, uint32_t(-1));
+    p[length] = '\0';
+}
+
+uint32_t CharSequence::EncodeUtf8(uint32_t* index, char* out, uint32_t capacity) const
+{
+    Units units = GetUnits();
+    uint32_t from = *index < Length() ? *index : Length();
+    // Take as many code points as surely fit, fewer if some are beyond U+10FFFF and take up to 6 bytes
+    uint32_t count = capacity / (units.width == 1 ? 2 : (units.width == 2 ? 3 : 4));
+    if (count == 0) {
+        count = 1; // Which may still fit
     }
-    p[index] = '\0';
+    if (count > Length() - from) {
+        count = Length() - from;
+    }
+    for (; count > 0; count /= 2) {
+        uint32_t length = Utf8Codec::Encode(static_cast<const uint8_t*>(units.data) + size_t(from) * units.width,
+            units.width, count, out, capacity);
+        if (length != Utf8Codec::kNoSpace) {
+            *index = from + count;
+            return length;
+        }
+    }
+    *index = from;
+    return 0;
 }
 
 std::string CharSequence::ToStdString(CharSequence::CharSet charSet) const
 {
-    uint32_t utf8Length = GetBytesLength(charSet);
-
-    std::string ss(utf8Length, '\0');
-    GetBytes(CharSequence::kUtf8, const_cast<char*>(ss.data()));
+    SSASSERT(charSet == kUtf8);
+    Units units = GetUnits();
+    uint32_t n = Length();
+    uint64_t maxLength = Utf8Codec::MaxEncodedLength(units.width, n);
+    // Short strings are encoded on stack, so the result is allocated with the exact length
+    char stackBuffer[256];
+    if (maxLength <= sizeof(stackBuffer)) {
+        uint32_t length = Utf8Codec::Encode(units.data, units.width, n, stackBuffer, sizeof(stackBuffer));
+        if (length != Utf8Codec::kNoSpace) {
+            return std::string(stackBuffer, length);
+        }
+    } else if (maxLength < UINT32_MAX) {
+        std::string ss(size_t(maxLength), '\0');
+        uint32_t length = Utf8Codec::Encode(units.data, units.width, n, &ss[0], uint32_t(maxLength));
+        if (length != Utf8Codec::kNoSpace) {
+            ss.resize(length);
+            if (ss.capacity() - length > length / 4) {
+                ss.shrink_to_fit();
+            }
+            return ss;
+        }
+    }
+    // Code points larger than 0x10FFFF take more than 4 bytes, count the exact length
+    std::string ss(GetBytesLength(charSet), '\0');
+    GetBytes(CharSequence::kUtf8, &ss[0]);
     return ss;
 }
 
 std::wstring CharSequence::ToStdWString() const
 {
     std::wstring ss(Length(), L'\0');
-    for (uint32_t i = 0; i < Length(); ++i) {
-        ss[i] = At(i).code;
-    }
+    Units units = GetUnits();
+    uint32_t n = Length();
+    VisitUnits(units.data, units.width, [&ss, n](auto* p) {
+        for (uint32_t i = 0; i < n; ++i) {
+            ss[i] = wchar_t(p[i]);
+        }
+    });
     return ss;
 }
 
 uint64_t CharSequence::Hash() const
 {
-    // djb2
-    uint64_t hash = 5381;
-    for (uint32_t i = 0; i < Length(); ++i) {
-        hash = ((hash << 5u) + hash) + At(i).code; /* hash * 33 + c */
+    Units units = GetUnits();
+    // Only the hash of all the units of the storage is cached, which is the same for all the strings sharing it
+    SequenceData* sequenceData = sequenceData_;
+    bool cache = sequenceData != nullptr && units.data == sequenceData->units_ && Length() == sequenceData->size_;
+    if (cache) {
+        uint64_t hash = sequenceData->hash_.load(std::memory_order_acquire);
+        if (hash > SequenceData::kHashNotCached) {
+            return hash;
+        }
+        cache = hash == SequenceData::kHashUnknown;
+    }
+    uint64_t hash = UnitsHash::Hash(units.data, units.width, Length());
+    if (cache && hash > SequenceData::kHashNotCached) {
+        uint64_t expected = SequenceData::kHashUnknown;
+        sequenceData->hash_.compare_exchange_strong(expected, hash, std::memory_order_release, std::memory_order_relaxed);
     }
     return hash;
 }
 
+uint64_t CharSequence::HashIgnoreCase() const
+{
+    Units units = GetUnits();
+    return UnitsHash::HashIgnoreCase(units.data, units.width, Length());
+}
+
+uint64_t CharSequence::HashUtf8(const char* utf8, uint32_t bytesCount)
+{
+    return UnitsHash::HashUtf8(utf8, bytesCount);
+}
+
+bool CharSequence::Equals(const char* utf8) const
+{
+    Units units = GetUnits();
+    auto* p = reinterpret_cast<const uint8_t*>(utf8);
+    // Encode a chunk at a time and compare the bytes, a code point takes up to 6 bytes
+    const uint32_t kChunk = 64;
+    char buffer[kChunk * 6];
+    for (uint32_t i = 0; i < Length(); i += kChunk) {
+        uint32_t n = Length() - i < kChunk ? Length() - i : kChunk;
+        uint32_t length = Utf8Codec::Encode(static_cast<const uint8_t*>(units.data) + size_t(i) * units.width,
+            units.width, n, buffer, sizeof(buffer));
+        for (uint32_t k = 0; k < length; ++k, ++p) {
+            if (*p == 0 || *p != uint8_t(buffer[k])) {
+                return false;
+            }
+        }
+    }
+    // Decoding `utf8` stops at '\0' and at invalid lead bytes
+    return *p == 0 || (*p >= 0x80 && *p < 0xC0) || *p >= 0xFE;
+}
+
+void CharSequence::Store(uint32_t index, uint32_t code)
+{
+    uint32_t width = GetUnits().width;
+    if (WidthOf(code) > width) {
+        width = WidthOf(code);
+    }
+    WriteUnit(Widen(width), width, index, code);
+}
+
+void CharSequence::DisableHashCache()
+{
+    if (sequenceData_ != nullptr) {
+        sequenceData_->hash_.store(SequenceData::kHashNotCached, std::memory_order_relaxed);
+    }
+}
+
+/// The units of the views which have no characters
+static const uint32_t kNoUnits = 0;
+
 StringView::StringView(SequenceData* sequenceData, uint32_t offset, uint32_t length)
     : CharSequence()
+    , offset_(offset)
+    , borrowed_ { &kNoUnits, 1 }
 {
     sequenceData_ = sequenceData;
-    offset_ = offset;
     length_ = length;
+    if (sequenceData_ != nullptr) {
+        sequenceData_->Retain(false);
+    }
 }
 
-StringView::StringView(const StringView& sv)
+StringView::StringView(Units units, uint32_t length)
     : CharSequence()
+    , offset_(0)
+    , borrowed_(units)
 {
-    sequenceData_ = sv.sequenceData_;
-    offset_ = sv.offset_;
-    length_ = sv.length_;
+    length_ = length;
+}
+
+StringView::StringView(const StringView& sv)
+    : StringView(sv.sequenceData_, sv.offset_, sv.length_)
+{
+    borrowed_ = sv.borrowed_;
 }
 
 StringView::StringView(StringView&& sv) noexcept
@@ -585,13 +777,16 @@ StringView::StringView(StringView&& sv) noexcept
     sequenceData_ = sv.sequenceData_;
     offset_ = sv.offset_;
     length_ = sv.length_;
+    borrowed_ = sv.borrowed_;
     sv.sequenceData_ = nullptr;
     sv.offset_ = 0;
     sv.length_ = 0;
+    sv.borrowed_ = { &kNoUnits, 1 };
 }
 
 StringView::~StringView()
 {
+    SequenceData::Release(sequenceData_, false);
     sequenceData_ = nullptr;
     offset_ = 0;
     length_ = 0;
@@ -601,191 +796,228 @@ StringView StringView::SubStringViewImpl(uint32_t from, uint32_t length) const
 {
     if (from > length_) // start out of bounds
     {
-        return StringView(sequenceData_, offset_ + length_, 0);
+        from = length_;
     }
     if (uint64_t(from) + length > length_) // end out of bound
     {
         length = length_ - from;
     }
-    from += offset_;
-    return StringView(sequenceData_, from, length);
+    if (sequenceData_ == nullptr) {
+        return StringView({ static_cast<const uint8_t*>(borrowed_.data) + size_t(from) * borrowed_.width,
+                              borrowed_.width },
+            length);
+    }
+    return StringView(sequenceData_, offset_ + from, length);
 }
 
-CharSequence::CharType* StringView::Data()
+CharSequence::Units StringView::GetUnits() const
 {
-    return sequenceData_->chars_ + offset_;
+    if (sequenceData_ == nullptr) {
+        return borrowed_;
+    }
+    return { static_cast<const uint8_t*>(sequenceData_->units_) + size_t(offset_) * sequenceData_->width_,
+        sequenceData_->width_ };
 }
 
-const CharSequence::CharType* StringView::Data() const
+void* StringView::Widen(uint32_t width)
 {
-    return sequenceData_->chars_ + offset_;
+    // The other strings sharing the storage must not see the writes, and the borrowed characters are of a const string
+    SSASSERT2(sequenceData_ != nullptr && !sequenceData_->IsShared(), "The view of a const string is read only");
+    sequenceData_->ResetHash();
+    sequenceData_->Reserve(sequenceData_->capacity_, width);
+    return static_cast<uint8_t*>(sequenceData_->units_) + size_t(offset_) * sequenceData_->width_;
 }
 
 StringView& StringView::operator=(const StringView& sv)
 {
+    if (sv.sequenceData_ != nullptr) {
+        sv.sequenceData_->Retain(false);
+    }
+    SequenceData::Release(sequenceData_, false);
     sequenceData_ = sv.sequenceData_;
     offset_ = sv.offset_;
     length_ = sv.length_;
+    borrowed_ = sv.borrowed_;
     return *this;
 }
 
 StringView& StringView::operator=(StringView&& sv) noexcept
 {
+    if (&sv == this) {
+        return *this;
+    }
+    SequenceData::Release(sequenceData_, false);
     sequenceData_ = sv.sequenceData_;
     offset_ = sv.offset_;
     length_ = sv.length_;
+    borrowed_ = sv.borrowed_;
     sv.sequenceData_ = nullptr;
     sv.offset_ = 0;
     sv.length_ = 0;
+    sv.borrowed_ = { &kNoUnits, 1 };
     return *this;
 }
 
 String::String()
     : CharSequence()
-    , capacity_(0)
+    , inlineWidth_(1)
+    , arena_(Arena::Current())
 {
-    ReAllocate(16);
 }
 
 String::String(char c)
     : CharSequence()
-    , capacity_(0)
+    , inlineWidth_(1)
+    , arena_(Arena::Current())
 {
-    ReAllocate(16);
     *this += c;
 }
 
 String::String(wchar_t c)
     : CharSequence()
-    , capacity_(0)
+    , inlineWidth_(1)
+    , arena_(Arena::Current())
 {
-    ReAllocate(16);
     *this += c;
 }
 
-inline uint32_t GetUtf8Length(const char* utf8, uint32_t bytesCount)
-{
-    uint32_t count = 0;
-    uint32_t index = 0;
-
-    auto fn = [&index, utf8]() -> utf8::char_type { return (utf8::char_type)utf8[index]; };
-    while (utf8[index] != 0 && index < bytesCount) {
-        auto size = utf8::char_size(fn);
-        if (size == -1) {
-            return count;
-        }
-        ++count;
-        index += uint32_t(size);
-    }
-    return count;
-}
-
-inline uint32_t CalculateCapacity(uint32_t len)
-{
-    return Misc::CeilToPowerOfTwo(len);
-}
-
 String::String(const char* utf8, uint32_t bytesCount)
     : CharSequence()
-    , capacity_(0)
+    , inlineWidth_(1)
+    , arena_(Arena::Current())
 {
-    length_ = GetUtf8Length(utf8, bytesCount);
-
-    ReAllocate(CalculateCapacity(length_));
-
-    uint32_t index = 0;
-    auto readFn = [&index, utf8]() -> utf8::char_type { return (utf8::char_type)utf8[index++]; };
-
-    for (uint32_t i = 0; i < length_; ++i) {
-        sequenceData_->chars_[i] = CharType { utf8::read(readFn) };
-    }
+    AssignUtf8(utf8, bytesCount);
 }
 
 String::String(const wchar_t* unicode, uint32_t charCount)
     : CharSequence()
-    , capacity_(0)
+    , inlineWidth_(1)
+    , arena_(Arena::Current())
 {
-    length_ = uint32_t(wcslen(unicode));
-    if (length_ > charCount) {
-        length_ = charCount;
-    }
-    ReAllocate(CalculateCapacity(length_));
-
-    for (uint32_t i = 0; i < length_; ++i) {
-        sequenceData_->chars_[i] = CharType { unicode[i] };
-    }
+    AssignUnicode(unicode, charCount);
 }
 
 String::String(const CharSequence::CharType* chars, uint32_t length)
     : CharSequence()
-    , capacity_(0)
+    , inlineWidth_(1)
+    , arena_(Arena::Current())
 {
-    length_ = length;
-    ReAllocate(CalculateCapacity(length_));
-
-    for (uint32_t i = 0; i < length; ++i) {
-        sequenceData_->chars_[i] = chars[i];
-    }
+    Assign({ chars, sizeof(CharType) }, length);
 }
 
 String::String(const CharSequence& s)
     : CharSequence()
-    , capacity_(0)
+    , inlineWidth_(1)
+    , arena_(Arena::Current())
 {
-    length_ = s.Length();
-    ReAllocate(CalculateCapacity(length_));
-    memcpy(sequenceData_->chars_, s.Data(), length_ * sizeof(CharType));
+    Assign(s.GetUnits(), s.Length());
 }
 
 String::String(const String& s)
     : CharSequence()
-    , capacity_(0)
+    , inlineWidth_(1)
+    , arena_(Arena::Current())
 {
-    new (this) String((CharSequence&)s);
+    if (CanShare(s)) {
+        Share(s);
+    } else {
+        Assign(s.GetUnits(), s.Length());
+    }
 }
 
 String::String(String&& s) noexcept
     : CharSequence()
+    , inlineWidth_(s.inlineWidth_)
+    , arena_(s.arena_) // Along with the storage
 {
     length_ = s.length_;
-    capacity_ = s.capacity_;
     sequenceData_ = s.sequenceData_;
+    if (s.IsInline()) {
+        memcpy(inlineUnits_, s.inlineUnits_, size_t(length_) * inlineWidth_);
+    }
     s.length_ = 0;
-    s.capacity_ = 0;
+    s.inlineWidth_ = 1;
     s.sequenceData_ = nullptr;
 }
 
-String::~String()
+String::String(Units units, uint32_t length)
+    : CharSequence()
+    , inlineWidth_(1)
+    , arena_(Arena::Current())
 {
-    Free();
+    Assign(units, length);
 }
 
-CharSequence::CharType* String::Data()
+String::~String()
 {
-    return sequenceData_->chars_;
+    Free();
 }
 
-const CharSequence::CharType* String::Data() const
+StringView String::SubStringView(uint32_t from, uint32_t length)
 {
-    return sequenceData_->chars_;
+    if (IsInline()) {
+        MoveToHeap(Capacity(), inlineWidth_);
+    } else {
+        // Characters written through the view must not be seen by the other strings
+        Detach(length_, sequenceData_->width_);
+    }
+    return SubStringViewImpl(from, length);
 }
 
 StringView String::SubStringViewImpl(uint32_t from, uint32_t length) const
 {
     if (from > length_) // Start out of bounds
     {
-        return StringView(sequenceData_, length_, 0);
+        from = length_;
     }
     if (uint64_t(from) + length > length_) // from + length may larger than 2^32-1
     {
         length = length_ - from;
     }
+    if (IsInline()) {
+        return StringView({ inlineUnits_ + size_t(from) * inlineWidth_, inlineWidth_ }, length);
+    }
     return StringView(sequenceData_, from, length);
 }
 
+CharSequence::Units String::GetUnits() const
+{
+    if (IsInline()) {
+        return { inlineUnits_, inlineWidth_ };
+    }
+    return { sequenceData_->units_, sequenceData_->width_ };
+}
+
+void* String::Widen(uint32_t width)
+{
+    if (!IsInline()) {
+        Detach(length_, width);
+        sequenceData_->ResetHash();
+        sequenceData_->Reserve(sequenceData_->capacity_, width);
+        return sequenceData_->units_;
+    }
+    if (width > inlineWidth_) {
+        if (size_t(length_) * width > sizeof(inlineUnits_)) {
+            MoveToHeap(CalculateCapacity(length_), width);
+            return sequenceData_->units_;
+        }
+        WidenUnits(inlineUnits_, inlineWidth_, width, length_);
+        inlineWidth_ = uint8_t(width);
+    }
+    return inlineUnits_;
+}
+
 String& String::operator=(const String& s)
 {
-    operator=((const CharSequence&)s);
+    if (&s == this) {
+        return *this;
+    }
+    if (CanShare(s)) {
+        Free();
+        Share(s);
+    } else {
+        Assign(s.GetUnits(), s.Length());
+    }
     return *this;
 }
 
@@ -797,110 +1029,82 @@ String& String::operator+=(const String& s)
 
 String& String::operator=(String&& s) noexcept
 {
-    auto oldCap = capacity_;
-    auto oldChars = sequenceData_->chars_;
-    length_ = s.length_;
-    capacity_ = s.capacity_;
+    if (&s == this) {
+        return *this;
+    }
+    // The storage is only taken if it outlives this string, the storage in an arena may not
+    Arena* arena = s.IsInline() ? nullptr : s.sequenceData_->arena_;
+    if (s.IsInline() || (arena != nullptr && arena != arena_)) {
+        Assign(s.GetUnits(), s.length_);
+    } else {
+        // StringViews of this string keep the old storage alive
+        Free();
+        sequenceData_ = s.sequenceData_;
+        length_ = s.length_;
+        s.sequenceData_ = nullptr;
+        s.inlineWidth_ = 1;
+    }
     s.length_ = 0;
-    s.capacity_ = oldCap;
-
-    sequenceData_->chars_ = s.sequenceData_->chars_;
-    s.sequenceData_->chars_ = oldChars;
     return *this;
 }
 
 String& String::operator=(const CharSequence& s)
 {
-    if (Capacity() < s.Length()) {
-        ReAllocate(CalculateCapacity(s.Length()));
+    if (&s != this) {
+        Assign(s.GetUnits(), s.Length());
     }
-    length_ = s.Length();
-    memcpy(sequenceData_->chars_, s.Data(), length_ * sizeof(CharType));
     return *this;
 }
 
 String& String::operator+=(const CharSequence& s)
 {
-    if (s.Empty()) {
-        return *this;
-    }
-    auto oldLen = length_;
-    auto sLen = s.Length(); // Use a temp var, in case `s` and this is same object
-    length_ = oldLen + sLen;
-    if (Capacity() < length_) {
-        ReAllocate(CalculateCapacity(length_));
-    }
-    memcpy(sequenceData_->chars_ + oldLen, s.Data(), sLen * sizeof(CharType));
+    Append(s);
     return *this;
 }
 
 String& String::operator=(const char* utf8)
 {
-    length_ = GetUtf8Length(utf8, kNPos);
-    if (Capacity() < length_) {
-        ReAllocate(CalculateCapacity(length_));
-    }
-    uint32_t index = 0;
-    auto readFn = [&index, utf8]() -> utf8::char_type { return (utf8::char_type)utf8[index++]; };
-
-    for (uint32_t i = 0; i < length_; ++i) {
-        sequenceData_->chars_[i] = CharType { utf8::read(readFn) };
-    }
+    AssignUtf8(utf8, kNPos);
     return *this;
 }
 
-String& String::operator+=(const char* utf8)
+void String::AppendUtf8(const char* utf8, uint32_t bytesCount)
 {
-    auto utf8Len = GetUtf8Length(utf8, kNPos);
-    if (utf8Len == 0) {
-        return *this;
-    }
-    auto oldLen = length_;
-    length_ = utf8Len + oldLen;
-    if (Capacity() < length_) {
-        ReAllocate(CalculateCapacity(length_));
-    }
-
-    uint32_t index = 0;
-    auto readFn = [&index, utf8]() -> utf8::char_type { return (utf8::char_type)utf8[index++]; };
+    uint32_t width;
+    auto utf8Len = Utf8Codec::Scan(utf8, bytesCount, &bytesCount, &width);
+    AppendUtf8(utf8, bytesCount, utf8Len, width);
+}
 
-    for (uint32_t i = 0; i < utf8Len; ++i) {
-        sequenceData_->chars_[i + oldLen] = CharType { utf8::read(readFn) };
-    }
+String& String::operator+=(const char* utf8)
+{
+    uint32_t bytesCount;
+    uint32_t width;
+    auto utf8Len = Utf8Codec::Scan(utf8, kNPos, &bytesCount, &width);
+    AppendUtf8(utf8, bytesCount, utf8Len, width);
     return *this;
 }
 
 String& String::operator=(const wchar_t* unicode)
 {
-    length_ = (uint32_t)wcslen(unicode);
-    if (Capacity() < length_) {
-        ReAllocate(CalculateCapacity(length_));
-    }
-    for (uint32_t i = 0; i < length_; ++i) {
-        sequenceData_->chars_[i] = CharType { unicode[i] };
-    }
+    AssignUnicode(unicode, kNPos);
     return *this;
 }
 
 String& String::operator+=(const wchar_t unicode)
 {
-    auto oldLen = length_;
-    ++length_;
-    if (Capacity() < length_) {
-        ReAllocate(CalculateCapacity(length_));
-    }
-    sequenceData_->chars_[oldLen] = CharType { unicode };
+    AppendCode(CharType { unicode }.code);
     return *this;
 }
 
 String& String::operator+=(const char c)
 {
-    auto oldLen = length_;
-    ++length_;
-    if (Capacity() < length_) {
-        ReAllocate(CalculateCapacity(length_));
-    }
-    sequenceData_->chars_[oldLen].code = c;
+    AppendCode(CharType { c }.code);
+    return *this;
+}
+
+String& String::operator+=(CharType c)
+{
+    AppendCode(c.code);
     return *this;
 }
 
@@ -911,37 +1115,45 @@ String& String::operator+=(const wchar_t* unicode)
         return *this;
     }
     auto oldLen = length_;
-    length_ = len + oldLen;
-    if (Capacity() < length_) {
-        ReAllocate(CalculateCapacity(length_));
-    }
-    for (uint32_t i = 0; i < len; ++i) {
-        sequenceData_->chars_[i + oldLen] = CharType { unicode[i] };
-    }
+    EnsureStorage(oldLen + len, MaxWidth(unicode, len));
+    void* units = static_cast<uint8_t*>(MutableUnits()) + size_t(oldLen) * Width();
+    VisitMutableUnits(units, Width(), [unicode, len](auto* p) {
+        for (uint32_t i = 0; i < len; ++i) {
+            p[i] = std::remove_reference_t<decltype(*p)>(unicode[i]);
+        }
+    });
+    SetLength(oldLen + len);
     return *this;
 }
 
+uint32_t String::Capacity() const
+{
+    return IsInline() ? uint32_t(sizeof(inlineUnits_)) / inlineWidth_ : sequenceData_->capacity_;
+}
+
 void String::Reserve(uint32_t n)
 {
-    if (Capacity() < n) {
-        ReAllocate(CalculateCapacity(n));
-    }
+    EnsureStorage(n, Width());
 }
 
 void String::Resize(uint32_t n)
 {
-    if (Capacity() < n) {
-        ReAllocate(CalculateCapacity(n));
+    EnsureStorage(n, Width());
+    if (n > length_) {
+        memset(static_cast<uint8_t*>(MutableUnits()) + size_t(length_) * Width(), 0, size_t(n - length_) * Width());
     }
-    length_ = n;
+    SetLength(n);
 }
 
 void String::TrimLeading()
 {
+    Detach(length_, Width());
+    Units units = GetUnits();
     for (uint32_t i = 0; i < Length(); ++i) {
-        if (!IsWhiteSpace(At(i))) {
+        if (!IsWhiteSpace(ReadUnit(units.data, units.width, i))) {
             length_ -= i;
-            memmove(sequenceData_->chars_, sequenceData_->chars_ + i, Length() * sizeof(CharType));
+            memmove(MutableUnits(), static_cast<const uint8_t*>(units.data) + size_t(i) * units.width,
+                size_t(Length()) * units.width);
             return;
         }
     }
@@ -950,8 +1162,9 @@ void String::TrimLeading()
 
 void String::TrimTrailing()
 {
+    Units units = GetUnits();
     for (uint32_t i = Length(); i > 0; --i) {
-        if (!IsWhiteSpace(At(i - 1))) {
+        if (!IsWhiteSpace(ReadUnit(units.data, units.width, i - 1))) {
             length_ = i;
             return;
         }
@@ -959,22 +1172,424 @@ void String::TrimTrailing()
     length_ = 0;
 }
 
-void String::ReAllocate(uint32_t newCapacity)
+uint32_t String::Width() const
 {
-    capacity_ = newCapacity;
-    if (sequenceData_ == nullptr) {
-        sequenceData_ = new SequenceData(capacity_);
-    } else {
-        sequenceData_->ReAllocate(capacity_);
+    return IsInline() ? inlineWidth_ : sequenceData_->width_;
+}
+
+void* String::MutableUnits()
+{
+    if (IsInline()) {
+        return inlineUnits_;
+    }
+    sequenceData_->ResetHash();
+    return sequenceData_->units_;
+}
+
+void String::EnsureStorage(uint32_t capacity, uint32_t width, bool exact)
+{
+    if (width < Width()) {
+        width = Width();
+    }
+    Detach(capacity, width);
+    if (IsInline()) {
+        if (size_t(capacity) * width <= sizeof(inlineUnits_)) {
+            WidenUnits(inlineUnits_, inlineWidth_, width, length_);
+            inlineWidth_ = uint8_t(width);
+        } else {
+            MoveToHeap(exact ? capacity : CalculateCapacity(capacity), width);
+        }
+        return;
+    }
+    if (capacity > sequenceData_->capacity_ && !exact) {
+        capacity = CalculateCapacity(capacity);
+    }
+    sequenceData_->Reserve(capacity, width);
+}
+
+void String::SetLength(uint32_t length)
+{
+    length_ = length;
+    if (!IsInline() && sequenceData_->size_ < length) {
+        sequenceData_->size_ = length;
+    }
+}
+
+void String::Discard()
+{
+    length_ = 0;
+    if (!IsInline() && sequenceData_->IsShared()) {
+        SequenceData::Release(sequenceData_, true);
+        sequenceData_ = nullptr;
+    }
+    if (IsInline()) {
+        // Nothing else refers to the inline storage, so the new content may use a narrower width
+        inlineWidth_ = 1;
     }
 }
 
+void String::Assign(Units units, uint32_t length)
+{
+    uint32_t width = MaxWidth(units.data, units.width, length);
+    Discard();
+    EnsureStorage(length, width);
+    ConvertUnits(MutableUnits(), Width(), units.data, units.width, length);
+    SetLength(length);
+}
+
+void String::AssignUtf8(const char* utf8, uint32_t bytesCount)
+{
+    uint32_t width;
+    uint32_t length = Utf8Codec::Scan(utf8, bytesCount, &bytesCount, &width);
+    Discard();
+    EnsureStorage(length, width);
+    Utf8Codec::Decode(utf8, bytesCount, MutableUnits(), Width());
+    SetLength(length);
+}
+
+void String::AssignUnicode(const wchar_t* unicode, uint32_t charCount)
+{
+    auto length = uint32_t(wcslen(unicode));
+    if (length > charCount) {
+        length = charCount;
+    }
+    Discard();
+    EnsureStorage(length, MaxWidth(unicode, length));
+    VisitMutableUnits(MutableUnits(), Width(), [unicode, length](auto* p) {
+        for (uint32_t i = 0; i < length; ++i) {
+            p[i] = std::remove_reference_t<decltype(*p)>(unicode[i]);
+        }
+    });
+    SetLength(length);
+}
+
+void String::Append(const CharSequence& s)
+{
+    auto sLen = s.Length(); // Use a temp var, in case `s` and this is same object
+    if (sLen == 0) {
+        return;
+    }
+    Units units = s.GetUnits();
+    uint32_t width = units.width > Width() ? MaxWidth(units.data, units.width, sLen) : units.width;
+    auto oldLen = length_;
+    EnsureStorage(oldLen + sLen, width);
+    units = s.GetUnits(); // `s` may refer to this string, whose storage may have been changed
+    ConvertUnits(static_cast<uint8_t*>(MutableUnits()) + size_t(oldLen) * Width(), Width(), units.data, units.width,
+        sLen);
+    SetLength(oldLen + sLen);
+}
+
+void String::AppendUtf8(const char* utf8, uint32_t bytesCount, uint32_t length, uint32_t width)
+{
+    if (length == 0) {
+        return;
+    }
+    auto oldLen = length_;
+    EnsureStorage(oldLen + length, width);
+    Utf8Codec::Decode(utf8, bytesCount, static_cast<uint8_t*>(MutableUnits()) + size_t(oldLen) * Width(), Width());
+    SetLength(oldLen + length);
+}
+
+void String::AppendCode(uint32_t code)
+{
+    auto oldLen = length_;
+    EnsureStorage(oldLen + 1, WidthOf(code));
+    WriteUnit(MutableUnits(), Width(), oldLen, code);
+    SetLength(oldLen + 1);
+}
+
+void String::MoveToHeap(uint32_t capacity, uint32_t width)
+{
+    auto* sequenceData = SequenceData::Create(capacity, width, arena_);
+    ConvertUnits(sequenceData->units_, width, inlineUnits_, inlineWidth_, length_);
+    sequenceData->size_ = length_;
+    sequenceData_ = sequenceData;
+}
+
+bool String::CanShare(const String& s)
+{
+    // Short strings are cheaper to copy inline. A view or a pointer from `Data` may write through, so such storage is
+    // not shared. Nor is storage in an arena, so a copy outlives the arena.
+    return !s.IsInline() && size_t(s.length_) * s.sequenceData_->width_ > sizeof(inlineUnits_)
+        && !s.sequenceData_->HasViews() && !s.sequenceData_->IsExposed() && s.sequenceData_->arena_ == nullptr;
+}
+
+void String::Share(const String& s)
+{
+    s.sequenceData_->Retain(true);
+    sequenceData_ = s.sequenceData_;
+    length_ = s.length_;
+}
+
+void String::Detach(uint32_t capacity, uint32_t width)
+{
+    if (IsInline() || !sequenceData_->IsShared()) {
+        return;
+    }
+    if (capacity < length_) {
+        capacity = length_;
+    }
+    if (width < sequenceData_->width_) {
+        width = sequenceData_->width_;
+    }
+    auto* sequenceData = SequenceData::Create(CalculateCapacity(capacity > 0 ? capacity : 1), width, arena_);
+    ConvertUnits(sequenceData->units_, width, sequenceData_->units_, sequenceData_->width_, length_);
+    sequenceData->size_ = length_;
+    SequenceData::Release(sequenceData_, true);
+    sequenceData_ = sequenceData;
+}
+
 void String::Free()
 {
-    delete sequenceData_;
+    SequenceData::Release(sequenceData_, true);
     sequenceData_ = nullptr;
     length_ = 0;
-    capacity_ = 0;
+    inlineWidth_ = 1;
+}
+
+StrDelimiter::StrDelimiter(Kind kind)
+    : kind_(kind)
+    , chars_()
+    , code_(0)
+    , predicate_(nullptr)
+    , asciiSet_ { 0, 0 }
+{
+}
+
+StrDelimiter StrDelimiter::Sequence(const CharSequence& s)
+{
+    if (s.Length() == 1) {
+        return Char(s[0]);
+    }
+    StrDelimiter delimiter(kSequence);
+    delimiter.chars_ = s;
+    return delimiter;
+}
+
+StrDelimiter StrDelimiter::Char(CharSequence::CharType c)
+{
+    StrDelimiter delimiter(kChar);
+    delimiter.code_ = c.code;
+    return delimiter;
+}
+
+StrDelimiter StrDelimiter::AnyOf(const CharSequence& chars)
+{
+    StrDelimiter delimiter(kAnyOf);
+    delimiter.chars_ = chars;
+    for (uint32_t i = 0; i < chars.Length(); ++i) {
+        uint32_t c = chars[i].code;
+        if (c < 128) {
+            delimiter.asciiSet_[c / 64] |= uint64_t(1) << (c % 64);
+        }
+    }
+    return delimiter;
+}
+
+StrDelimiter StrDelimiter::If(Predicate isDelimiter)
+{
+    StrDelimiter delimiter(kIf);
+    delimiter.predicate_ = isDelimiter;
+    return delimiter;
+}
+
+bool StrDelimiter::InSet(uint32_t code) const
+{
+    for (uint32_t i = 0; i < chars_.Length(); ++i) {
+        if (chars_[i].code == code) {
+            return true;
+        }
+    }
+    return false;
+}
+
+uint32_t StrDelimiter::Find(const CharSequence& s, uint32_t start, uint32_t* length) const
+{
+    *length = 1;
+    uint32_t n = s.Length();
+    if (start >= n) {
+        return CharSequence::kNPos;
+    }
+    CharSequence::Units units = s.GetUnits();
+    switch (kind_) {
+    case kSequence:
+        *length = chars_.Length();
+        // An empty delimiter splits nothing
+        return chars_.Empty() ? CharSequence::kNPos : s.Find(chars_, start);
+    case kChar: {
+        uint32_t code = code_;
+        return VisitUnits(units.data, units.width, [code, start, n](auto* p) -> uint32_t {
+            using Unit = std::remove_const_t<std::remove_reference_t<decltype(*p)>>;
+            if (code > Unit(-1)) {
+                return CharSequence::kNPos;
+            }
+            if (sizeof(Unit) == 1) {
+                auto* found = static_cast<const Unit*>(memchr(p + start, int(code), n - start));
+                return found == nullptr ? CharSequence::kNPos : uint32_t(found - p);
+            }
+            for (uint32_t i = start; i < n; ++i) {
+                if (p[i] == code) {
+                    return i;
+                }
+            }
+            return CharSequence::kNPos;
+        });
+    }
+    case kAnyOf: {
+        const StrDelimiter* self = this;
+        return VisitUnits(units.data, units.width, [self, start, n](auto* p) -> uint32_t {
+            for (uint32_t i = start; i < n; ++i) {
+                uint32_t c = p[i];
+                if (c < 128 ? ((self->asciiSet_[c / 64] >> (c % 64)) & 1u) != 0 : self->InSet(c)) {
+                    return i;
+                }
+            }
+            return CharSequence::kNPos;
+        });
+    }
+    case kIf:
+        for (uint32_t i = start; i < n; ++i) {
+            if (predicate_(ReadUnit(units.data, units.width, i))) {
+                return i;
+            }
+        }
+        return CharSequence::kNPos;
+    }
+    return CharSequence::kNPos;
+}
+
+StrTokenizer::Iterator::Iterator(const StrTokenizer* tokenizer)
+    : tokenizer_(tokenizer)
+    , tokenStart_(0)
+    , tokenEnd_(0)
+    , next_(0)
+    , splits_(0)
+{
+    Advance();
+}
+
+StrTokenizer::Iterator::Iterator(const StrTokenizer* tokenizer, uint32_t end)
+    : tokenizer_(tokenizer)
+    , tokenStart_(end)
+    , tokenEnd_(end)
+    , next_(end)
+    , splits_(0)
+{
+}
+
+StringView StrTokenizer::Iterator::operator*() const
+{
+    // Neither a reference to the storage is taken, nor is a short string copied
+    CharSequence::Units units = tokenizer_->str_.GetUnits();
+    units.data = static_cast<const uint8_t*>(units.data) + size_t(tokenStart_) * units.width;
+    return StringView(units, tokenEnd_ - tokenStart_);
+}
+
+void StrTokenizer::Iterator::Advance()
+{
+    const CharSequence& str = tokenizer_->str_;
+    while (next_ != kEnd) {
+        tokenStart_ = next_;
+        uint32_t length;
+        if (splits_ < tokenizer_->maxSplits_) {
+            uint32_t found = tokenizer_->delimiter_.Find(str, next_, &length);
+            if (found != CharSequence::kNPos) {
+                tokenEnd_ = found;
+                next_ = found + length;
+                if (tokenEnd_ == tokenStart_ && tokenizer_->skipEmpty_) {
+                    continue;
+                }
+                ++splits_;
+                return;
+            }
+        } else if (tokenizer_->skipEmpty_) {
+            // The rest of the string does not start with a delimiter either
+            while (tokenizer_->delimiter_.Find(str, tokenStart_, &length) == tokenStart_ && length > 0) {
+                tokenStart_ += length;
+            }
+        }
+        tokenEnd_ = str.Length();
+        next_ = kEnd;
+        if (tokenEnd_ == tokenStart_ && tokenizer_->skipEmpty_) {
+            break;
+        }
+        return;
+    }
+    // Past the last token
+    tokenStart_ = kEnd;
+    tokenEnd_ = kEnd;
+}
+
+void StringBuilder::Reserve(uint32_t length, uint32_t width)
+{
+    string_.EnsureStorage(length, width, true);
+}
+
+void StringBuilder::SequencePiece::Measure(uint32_t& length, uint32_t& width) const
+{
+    length += s_.Length();
+    CharSequence::Units units = s_.GetUnits();
+    if (units.width > width) {
+        // The units may be wider than the code points need, e.g. after `Data()`
+        uint32_t sWidth = MaxWidth(units.data, units.width, s_.Length());
+        width = sWidth > width ? sWidth : width;
+    }
+}
+
+void StringBuilder::Utf8Piece::Measure(uint32_t& length, uint32_t& width) const
+{
+    length_ = Utf8Codec::Scan(utf8_, CharSequence::kNPos, &bytesCount_, &width_);
+    length += length_;
+    width = width_ > width ? width_ : width;
+}
+
+void StringBuilder::Utf8Piece::AppendTo(String& s) const
+{
+    s.AppendUtf8(utf8_, bytesCount_, length_, width_);
+}
+
+void StringBuilder::UnicodePiece::Measure(uint32_t& length, uint32_t& width) const
+{
+    auto n = uint32_t(wcslen(unicode_));
+    length += n;
+    uint32_t unicodeWidth = MaxWidth(unicode_, n);
+    width = unicodeWidth > width ? unicodeWidth : width;
+}
+
+Searcher::Searcher(const CharSequence& pattern)
+    : pattern_(pattern)
+{
+    if (pattern_.Length() > SearchPlan::kShortNeedle) {
+        auto plan = std::make_shared<SearchPlan>();
+        CharSequence::Units units = static_cast<const CharSequence&>(pattern_).GetUnits();
+        uint32_t n = pattern_.Length();
+        VisitUnits(units.data, units.width, [&plan, n](auto* p) { plan->Build(p, n); });
+        plan_ = std::move(plan);
+    }
+}
+
+uint32_t Searcher::Find(const CharSequence& s, uint32_t start) const
+{
+    CharSequence::Units h = s.GetUnits();
+    CharSequence::Units n = static_cast<const CharSequence&>(pattern_).GetUnits();
+    // The pattern is stored with the narrowest width, so a wider pattern has a code point the string can not hold
+    if (n.width > h.width && pattern_.Length() != 0) {
+        return CharSequence::kNPos;
+    }
+    return FindIn(h.data, h.width, s.Length(), n.data, n.width, pattern_.Length(), start, plan_.get());
+}
+
+uint32_t Searcher::RFind(const CharSequence& s, uint32_t end) const
+{
+    if (end > s.Length()) {
+        end = s.Length();
+    }
+    CharSequence::Units h = s.GetUnits();
+    CharSequence::Units n = static_cast<const CharSequence&>(pattern_).GetUnits();
+    if (n.width > h.width && pattern_.Length() != 0) {
+        return CharSequence::kNPos;
+    }
+    return RFindIn(h.data, h.width, end, n.data, n.width, pattern_.Length(), plan_.get());
 }
 
 std::ostream& operator<<(std::ostream& os, const CharSequence& s)
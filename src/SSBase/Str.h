@@ -5,19 +5,30 @@
 #pragma once
 
 #include <cstdint>
+#include <cstddef>
 #include <iostream>
+#include <iterator>
+#include <memory>
+#include <type_traits>
+#include <utility>
 #include <vector>
 
 #include "internal/Str.h"
+#include "thirdparty/fmt/fmt/compile.h"
 #include "thirdparty/fmt/fmt/format.h"
 
 namespace ss {
 
+class Arena;
 class String;
 class StringView;
+class StrDelimiter;
+class StrTokenizer;
+struct SearchPlan;
 
 // clang-format off
 struct CharWrapper {
+    CharWrapper() = default;
     template <class T>
     CharWrapper(T c): code(c) {} // NOLINT(google-explicit-constructor,hicpp-explicit-conversions)
     uint32_t code;
@@ -47,6 +58,8 @@ public:
     static bool IsLower(CharType c);
     static CharType ToUpper(CharType c);
     static CharType ToLower(CharType c);
+    /// Simple case folding, characters which differ only in case fold to the same character
+    static CharType FoldCase(CharType c);
     /// From MSDN(https://docs.microsoft.com/en-us/dotnet/api/system.char.iswhitespace?view=netframework-4.8)
     /// White space characters are the following Unicode characters:
     ///
@@ -69,6 +82,13 @@ public:
 protected:
     struct SequenceData;
 
+    /// Code points are stored with 1 (Latin-1), 2 (UCS-2) or 4 (UTF-32) bytes each, the width is chosen by the widest
+    /// code point in the sequence.
+    struct Units {
+        const void* data;
+        uint32_t width;
+    };
+
     CharSequence();
 
 public:
@@ -79,31 +99,79 @@ public:
 
     String SubString(uint32_t from, uint32_t length = kNPos) const;
 
+    /// The view of a const short string borrows its characters, see `StringView`
     StringView SubStringView(uint32_t from, uint32_t length = kNPos) const;
 
+    /// A character of a non-const sequence. Assigning it stores the character as narrow as the sequence allows (see
+    /// `Units`), unlike writing through `Data`.
+    class CharReference {
+    public:
+        operator CharType() const // NOLINT(google-explicit-constructor,hicpp-explicit-conversions)
+        {
+            return static_cast<const CharSequence&>(s_).At(index_);
+        }
+
+        CharReference& operator=(CharType c)
+        {
+            s_.Store(index_, c.code);
+            return *this;
+        }
+
+        CharReference& operator=(const CharReference& c)
+        {
+            return *this = c.operator CharType();
+        }
+
+    private:
+        CharReference(CharSequence& s, uint32_t index)
+            : s_(s)
+            , index_(index)
+        {
+        }
+
+        CharSequence& s_;
+        uint32_t index_;
+
+        friend class CharSequence;
+    };
+
     CharType operator[](uint32_t index) const
     {
         return At(index);
     }
 
-    CharType& operator[](uint32_t index)
+    CharReference operator[](uint32_t index)
     {
         return At(index);
     }
 
     CharType At(uint32_t index) const
     {
-        return Data()[index];
+        Units units = GetUnits();
+        switch (units.width) {
+        case 1:
+            return static_cast<const uint8_t*>(units.data)[index];
+        case 2:
+            return static_cast<const uint16_t*>(units.data)[index];
+        default:
+            return static_cast<const uint32_t*>(units.data)[index];
+        }
     }
 
-    CharType& At(uint32_t index)
+    CharReference At(uint32_t index)
     {
-        return Data()[index];
+        return { *this, index };
     }
 
-    virtual CharType* Data() = 0;
-
-    virtual const CharType* Data() const = 0;
+    /// NOTE: Accessing the characters as `CharType` widens the storage to 4 bytes per code point (see `Units`), which
+    /// is kept until the string is assigned again. Read and write the characters with `At` instead, there is no const
+    /// `Data` as a const string is not widened.
+    CharType* Data()
+    {
+        auto* data = static_cast<CharType*>(Widen(sizeof(CharType)));
+        DisableHashCache(); // The characters may be written through the pointer at any time
+        return data;
+    }
 
     uint32_t Length() const
     {
@@ -120,6 +188,7 @@ public:
     {
         return Compare((const CharSequence&)s);
     }
+    /// Compares the case folded characters, without allocating
     int CompareIgnoreCase(const CharSequence& s) const;
     int CompareIgnoreCase(const String& s) const
     {
@@ -158,6 +227,7 @@ public:
     String CopyToUpper() const;
     String CopyToLower() const;
 
+    /// The split-ed strings are views, see `SubStringView`
     StrSplitter Split(const CharSequence& splitter) const
     {
         return { *this, splitter };
@@ -175,6 +245,12 @@ public:
         StrSplitter(*this, splitter).Split(c);
     }
 
+    /// Lazily split at `delimiter`, see `StrTokenizer`. Unlike `Split`, no container is filled, and a string may be
+    /// split at a character class with `StrDelimiter`.
+    StrTokenizer Tokenize(const StrDelimiter& delimiter, uint32_t maxSplits = kNPos, bool skipEmpty = false) const;
+    StrTokenizer Tokenize(const CharSequence& delimiter, uint32_t maxSplits = kNPos, bool skipEmpty = false) const;
+    StrTokenizer Tokenize(const String& delimiter, uint32_t maxSplits = kNPos, bool skipEmpty = false) const;
+
     String ReplaceAll(const CharSequence& oldStr, const CharSequence& newStr);
     String ReplaceAll(const String& oldStr, const CharSequence& newStr);
     String ReplaceAll(const CharSequence& oldStr, const String& newStr);
@@ -184,19 +260,62 @@ public:
     /// NOTE: This function assumes the buffer is big enough, you can check the required size by invoking
     /// `GetBytesLength` function.
     void GetBytes(CharSet charSet, void* buffer) const;
+    /// Encode the characters from `*index` as UTF-8 to `out`, as many as fit in `capacity` bytes, and move `*index`
+    /// past them. Returns the number of bytes written, which is 0 only if the next character does not fit.
+    uint32_t EncodeUtf8(uint32_t* index, char* out, uint32_t capacity) const;
     std::string ToStdString(CharSet charSet = kUtf8) const;
     std::wstring ToStdWString() const;
 
+    /// XXH3 of the code points, which does not depend on the width they are stored with. The hash of a whole heap
+    /// string is cached in its storage until the string is modified.
     uint64_t Hash() const;
 
+    /// Hash of the case folded characters, strings which `CompareIgnoreCase` equal have the same hash
+    uint64_t HashIgnoreCase() const;
+
+    /// Same as `String(utf8, bytesCount).Hash()`, without creating the string
+    static uint64_t HashUtf8(const char* utf8, uint32_t bytesCount = kNPos);
+
+    /// Same as `*this == String(utf8)`, without creating the string
+    bool Equals(const char* utf8) const;
+
 protected:
     virtual StringView SubStringViewImpl(uint32_t from, uint32_t length) const = 0;
 
+    virtual Units GetUnits() const = 0;
+
+    /// Make sure the code points are stored with at least `width` bytes each, returns the storage to be written
+    virtual void* Widen(uint32_t width) = 0;
+
+    void DisableHashCache();
+
+    /// Write `code` at `index`, widening the units only if `code` needs it
+    void Store(uint32_t index, uint32_t code);
+
+    void MapCase(uint32_t width, bool upper);
+
 protected:
+    friend class String;
+    friend class Searcher;
+    friend class StringBuilder;
+    friend class StrDelimiter;
+    friend class StrTokenizer;
+    friend class Convert;
+
+    /// nullptr if the characters are not stored in a heap allocated `SequenceData`, e.g. a short `String` which keeps
+    /// its characters inline. Otherwise it is reference counted, and shared by copies of a `String` and by views.
     SequenceData* sequenceData_;
     uint32_t length_;
 };
 
+/// A range of the characters stored in a `String`, no characters are copied. The view holds a reference to the storage,
+/// so it stays valid after the string is destroyed or assigned another heap string. Writing through the view writes
+/// the string it was created on, and it sees later in-place modifications of that string.
+///
+/// NOTE: Creating a view does not modify a const string, so the view of a const short string, whose characters are
+/// stored inline (see `String::kInlineCapacity`), borrows them and is valid only until the string is modified or
+/// destroyed. Such a view can not be written through, nor can a view of storage shared by copies of the string. The
+/// views of a non-const `String` have none of these limits.
 class StringView : public CharSequence {
 public:
     StringView(SequenceData* sequenceData, uint32_t offset, uint32_t length);
@@ -204,21 +323,37 @@ public:
     StringView(StringView&& sv) noexcept;
     ~StringView() override;
 
-    CharType* Data() override;
-    const CharType* Data() const override;
-
     StringView& operator=(const StringView& sv);
     StringView& operator=(StringView&& sv) noexcept;
 
 protected:
     StringView SubStringViewImpl(uint32_t from, uint32_t length) const override;
+    Units GetUnits() const override;
+    void* Widen(uint32_t width) override;
 
 private:
+    /// Borrows `units`, which the view does not keep alive
+    StringView(Units units, uint32_t length);
+
     uint32_t offset_;
+    Units borrowed_; // The characters if there is no `sequenceData_`
+
+    friend class String;
+    friend class StrTokenizer;
 };
 
+/// The storage of a string comes from the arena of the thread when the string is constructed (see `Arena::Scope`), or
+/// when it is moved from, and keeps coming from that arena whichever scope is active when the string grows. So a string
+/// constructed outside of a scope never allocates from its arena.
 class String : public CharSequence {
 public:
+    /// Strings not longer than this are stored inside the `String` object itself, no heap allocation is needed.
+    /// The value is chosen to make `sizeof(String)` 64 bytes on 64-bit platforms. It is counted in 4-byte code points,
+    /// so strings of narrower code points (see `Units`) may be up to 4 times longer and still inline.
+    enum {
+        kInlineCapacity = 8
+    };
+
     explicit String();
     String(char c);
     String(wchar_t c);
@@ -230,8 +365,6 @@ public:
     String(String&& s) noexcept;
     ~String() override;
 
-    CharType* Data() override;
-    const CharType* Data() const override;
     String& operator=(const String& s);
     String& operator=(String&& s) noexcept;
     String& operator+=(const String& s);
@@ -243,11 +376,9 @@ public:
     String& operator+=(const wchar_t* unicode);
     String& operator+=(const wchar_t unicode);
     String& operator+=(const char unicode);
+    String& operator+=(CharType c);
 
-    uint32_t Capacity() const
-    {
-        return capacity_;
-    }
+    uint32_t Capacity() const;
 
     void Reserve(uint32_t n);
     void Resize(uint32_t n);
@@ -260,112 +391,541 @@ public:
     void TrimLeading();
     void TrimTrailing();
 
-    /// API refer to: https://fmt.dev/dev/api.html
-    /// FIXME: A better solution?
+    /// Append `bytesCount` bytes of `utf8`, the same characters as `String(utf8, bytesCount)` has
+    void AppendUtf8(const char* utf8, uint32_t bytesCount);
+
+    /// Format `args` with this string as the format string, API refer to: https://fmt.dev/dev/api.html
+    /// See `FormatTo` to append to an existing string or buffer instead.
     template <class... Args>
-    String Format(Args&&... args)
-    {
-        auto utf8Len = GetBytesLength(kUtf8);
-        std::string utf8(utf8Len, '\0');
-        GetBytes(kUtf8, &utf8[0]);
-        return String(fmt::format(utf8, std::forward<Args>(args)...).c_str());
-    }
+    String Format(const Args&... args) const;
+
+    using CharSequence::SubStringView;
+
+    /// Unlike the view of a const string, the view keeps the characters of a short string alive, and writing through it
+    /// does not change the copies of this string. So a short string is moved to heap, and shared storage is copied.
+    StringView SubStringView(uint32_t from, uint32_t length = kNPos);
 
 private:
+    String(Units units, uint32_t length);
+
     StringView SubStringViewImpl(uint32_t from, uint32_t length) const override;
-    void ReAllocate(uint32_t newCapacity);
+    Units GetUnits() const override;
+    void* Widen(uint32_t width) override;
     void Free();
 
+    /// Copies of a long string share its storage until one of them is modified
+    static bool CanShare(const String& s);
+    void Share(const String& s);
+    /// Make sure the storage is not shared with other strings before modifying it, keeping the content
+    void Detach(uint32_t capacity, uint32_t width);
+
+    bool IsInline() const
+    {
+        return sequenceData_ == nullptr;
+    }
+
+    uint32_t Width() const;
+    void* MutableUnits();
+
+    /// Make sure there is space for `capacity` code points of `width` bytes, the content is kept. The capacity is
+    /// rounded up to a power of two unless `exact`.
+    void EnsureStorage(uint32_t capacity, uint32_t width, bool exact = false);
+    void SetLength(uint32_t length);
+    /// Drop the content, so the new content may be stored with a narrower width
+    void Discard();
+    void Assign(Units units, uint32_t length);
+    void AssignUtf8(const char* utf8, uint32_t bytesCount);
+    void AssignUnicode(const wchar_t* unicode, uint32_t charCount);
+    void Append(const CharSequence& s);
+    /// Append `length` code points decoded from `bytesCount` bytes of `utf8`, which need `width` bytes each
+    void AppendUtf8(const char* utf8, uint32_t bytesCount, uint32_t length, uint32_t width);
+    void AppendCode(uint32_t code);
+
+    /// StringViews which keep the characters alive refer to `SequenceData`, so an inline string is moved to heap before
+    /// such a view is created on it.
+    void MoveToHeap(uint32_t capacity, uint32_t width);
+
 private:
-    uint32_t capacity_;
+    uint8_t inlineWidth_;
+    alignas(uint32_t) uint8_t inlineUnits_[kInlineCapacity * sizeof(CharType)];
+    Arena* arena_; // Of the storage, nullptr for the heap
+
+    friend class CharSequence;
+    friend class StringBuilder;
+    friend class Convert;
 };
 
-inline String operator+(const CharSequence& s1, const CharSequence& s2)
-{
-    String s(s1);
-    s += s2;
-    return s;
-}
+/// A pattern prepared for being searched repeatedly, e.g. by `Split`. The factorization of a long pattern, which the
+/// search falls back to on repetitive text, is computed once here instead of on every `Find`.
+class Searcher {
+public:
+    explicit Searcher(const CharSequence& pattern);
 
-inline String operator+(const CharSequence& s1, const String& s2)
-{
-    String s(s1);
-    s += s2;
-    return s;
-}
+    uint32_t Find(const CharSequence& s, uint32_t start = 0) const;
+    uint32_t RFind(const CharSequence& s, uint32_t end = CharSequence::kNPos) const;
 
-inline String operator+(const CharSequence& s1, char c)
-{
-    String s(s1);
-    s += c;
-    return s;
-}
+    const String& Pattern() const
+    {
+        return pattern_;
+    }
 
-inline String operator+(char c, const CharSequence& s1)
-{
-    String s;
-    s += c;
-    s += s1;
-    return s;
-}
+private:
+    String pattern_;
+    std::shared_ptr<const SearchPlan> plan_;
+};
+
+/// What `CharSequence::Tokenize` splits a string at: a string, a single character, any character of a set, or any
+/// character a predicate accepts (e.g. `&CharSequence::IsWhiteSpace`). The strings are held by copy, which shares the
+/// storage of long strings, so no characters are copied.
+class StrDelimiter {
+public:
+    using Predicate = bool (*)(CharSequence::CharType c);
+
+    /// A single character string is searched as a character
+    static StrDelimiter Sequence(const CharSequence& s);
+    static StrDelimiter Char(CharSequence::CharType c);
+    static StrDelimiter AnyOf(const CharSequence& chars);
+    static StrDelimiter If(Predicate isDelimiter);
+
+    /// Index of the first delimiter in `s` at or after `start`, and its length. Returns `CharSequence::kNPos` if
+    /// there is none.
+    uint32_t Find(const CharSequence& s, uint32_t start, uint32_t* length) const;
+
+private:
+    enum Kind {
+        kSequence,
+        kChar,
+        kAnyOf,
+        kIf
+    };
+
+    explicit StrDelimiter(Kind kind);
+
+    bool InSet(uint32_t code) const;
+
+    Kind kind_;
+    String chars_; // The sequence, or the set of characters
+    uint32_t code_;
+    Predicate predicate_;
+    uint64_t asciiSet_[2]; // The ASCII characters of the set, so most of them are tested by one bit
+};
+
+/// A lazy range of the tokens of a string, see `CharSequence::Tokenize`. Nothing is allocated while iterating, each
+/// token is found when the iterator is advanced to it, so stopping early skips the rest of the string. The string is
+/// referenced, so it must outlive the tokenizer, and the tokens are views borrowing its characters (see `StringView`),
+/// which are valid until the string is modified or destroyed.
+class StrTokenizer {
+public:
+    class Iterator {
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = StringView;
+        using difference_type = std::ptrdiff_t;
+        using pointer = void;
+        using reference = StringView;
+
+        Iterator()
+            : Iterator(nullptr, kEnd)
+        {
+        }
+
+        /// The current token
+        StringView operator*() const;
+
+        Iterator& operator++()
+        {
+            Advance();
+            return *this;
+        }
+
+        Iterator operator++(int)
+        {
+            Iterator it = *this;
+            Advance();
+            return it;
+        }
+
+        /// Index of the current token in the string
+        uint32_t Offset() const
+        {
+            return tokenStart_;
+        }
+
+        uint32_t Length() const
+        {
+            return tokenEnd_ - tokenStart_;
+        }
+
+        bool operator==(const Iterator& other) const
+        {
+            return tokenizer_ == other.tokenizer_ && tokenStart_ == other.tokenStart_ && next_ == other.next_;
+        }
+
+        bool operator!=(const Iterator& other) const
+        {
+            return !(*this == other);
+        }
+
+    private:
+        explicit Iterator(const StrTokenizer* tokenizer);
+        Iterator(const StrTokenizer* tokenizer, uint32_t end);
+
+        void Advance();
+
+        const StrTokenizer* tokenizer_;
+        uint32_t tokenStart_;
+        uint32_t tokenEnd_;
+        uint32_t next_; // Where the next token starts, kEnd after the last token
+        uint32_t splits_;
+
+        friend class StrTokenizer;
+    };
 
-inline String operator+(const CharSequence& s1, wchar_t c)
+    /// At most `maxSplits` delimiters split the string, the last token is the rest of the string. Empty tokens are
+    /// skipped with `skipEmpty`, and they do not count as splits.
+    StrTokenizer(const CharSequence& str, const StrDelimiter& delimiter, uint32_t maxSplits, bool skipEmpty)
+        : str_(str)
+        , delimiter_(delimiter)
+        , maxSplits_(maxSplits)
+        , skipEmpty_(skipEmpty)
+    {
+    }
+
+    Iterator begin() const
+    {
+        return Iterator(this);
+    }
+
+    Iterator end() const
+    {
+        return Iterator(this, kEnd);
+    }
+
+    template <class Container>
+    operator Container() const // NOLINT(google-explicit-constructor,hicpp-explicit-conversions)
+    {
+        return Container(begin(), end());
+    }
+
+private:
+    enum : uint32_t {
+        kEnd = uint32_t(-1)
+    };
+
+    const CharSequence& str_;
+    StrDelimiter delimiter_;
+    uint32_t maxSplits_;
+    bool skipEmpty_;
+};
+
+inline StrTokenizer CharSequence::Tokenize(const StrDelimiter& delimiter, uint32_t maxSplits, bool skipEmpty) const
 {
-    String s(s1);
-    s += c;
-    return s;
+    return StrTokenizer(*this, delimiter, maxSplits, skipEmpty);
 }
 
-inline String operator+(wchar_t c, const CharSequence& s1)
+inline StrTokenizer CharSequence::Tokenize(const CharSequence& delimiter, uint32_t maxSplits, bool skipEmpty) const
 {
-    String s;
-    s += c;
-    s += s1;
-    return s;
+    return StrTokenizer(*this, StrDelimiter::Sequence(delimiter), maxSplits, skipEmpty);
 }
 
-inline String operator+(const String& s1, const CharSequence& s2)
+inline StrTokenizer CharSequence::Tokenize(const String& delimiter, uint32_t maxSplits, bool skipEmpty) const
 {
-    String s(s1);
-    s += s2;
-    return s;
+    return Tokenize((const CharSequence&)delimiter, maxSplits, skipEmpty);
 }
 
-inline String operator+(const String& s1, const String& s2)
+template <class Left, class Right>
+class StringConcat;
+
+/// Builds a string from pieces, which are `CharSequence`s, UTF-8 `const char*`, `const wchar_t*` or characters.
+/// `Append` measures all the pieces before copying any, so the string grows at most once per call, and a string
+/// built by one call is allocated with exactly the right size. Concatenations with `+` are evaluated the same way.
+class StringBuilder {
+public:
+    StringBuilder() = default;
+
+    /// Reserve space for `length` code points of up to `width` bytes each
+    explicit StringBuilder(uint32_t length, uint32_t width = 1)
+    {
+        Reserve(length, width);
+    }
+
+    /// Append to `s`, reusing its storage
+    explicit StringBuilder(String&& s)
+        : string_(std::move(s))
+    {
+    }
+
+    void Reserve(uint32_t length, uint32_t width = 1);
+
+    template <class... Pieces>
+    StringBuilder& Append(const Pieces&... pieces)
+    {
+        AppendTo(string_, pieces...);
+        return *this;
+    }
+
+    template <class Piece>
+    StringBuilder& operator<<(const Piece& piece)
+    {
+        AppendTo(string_, piece);
+        return *this;
+    }
+
+    uint32_t Length() const
+    {
+        return string_.Length();
+    }
+
+    const String& GetString() const
+    {
+        return string_;
+    }
+
+    /// Moves the string out, the builder is empty after that
+    String ToString()
+    {
+        return std::move(string_);
+    }
+
+    /// Append the pieces to `s`, allocating at most once
+    template <class... Pieces>
+    static void AppendTo(String& s, const Pieces&... pieces);
+
+    class SequencePiece {
+    public:
+        explicit SequencePiece(const CharSequence& s)
+            : s_(s)
+        {
+        }
+
+        void Measure(uint32_t& length, uint32_t& width) const;
+
+        void AppendTo(String& s) const
+        {
+            s.Append(s_);
+        }
+
+    private:
+        const CharSequence& s_;
+    };
+
+    class Utf8Piece {
+    public:
+        explicit Utf8Piece(const char* utf8)
+            : utf8_(utf8)
+        {
+        }
+
+        /// Also remembers the scan, so the UTF-8 is scanned once
+        void Measure(uint32_t& length, uint32_t& width) const;
+        void AppendTo(String& s) const;
+
+    private:
+        const char* utf8_;
+        mutable uint32_t bytesCount_ = 0;
+        mutable uint32_t length_ = 0;
+        mutable uint32_t width_ = 0;
+    };
+
+    class UnicodePiece {
+    public:
+        explicit UnicodePiece(const wchar_t* unicode)
+            : unicode_(unicode)
+        {
+        }
+
+        void Measure(uint32_t& length, uint32_t& width) const;
+
+        void AppendTo(String& s) const
+        {
+            s += unicode_;
+        }
+
+    private:
+        const wchar_t* unicode_;
+    };
+
+    class CodePiece {
+    public:
+        explicit CodePiece(CharWrapper c)
+            : code_(c.code)
+        {
+        }
+
+        void Measure(uint32_t& length, uint32_t& width) const
+        {
+            ++length;
+            uint32_t codeWidth = code_ <= 0xFFu ? 1 : (code_ <= 0xFFFFu ? 2 : 4);
+            width = codeWidth > width ? codeWidth : width;
+        }
+
+        void AppendTo(String& s) const
+        {
+            s.AppendCode(code_);
+        }
+
+    private:
+        uint32_t code_;
+    };
+
+private:
+    template <class Piece>
+    static auto Concat(const Piece& piece);
+    template <class Piece, class... Pieces>
+    static auto Concat(const Piece& piece, const Pieces&... pieces);
+
+    String string_;
+};
+
+/// The type a piece of a concatenation is stored as, no type if it can not be concatenated
+template <class T, class = void>
+struct StringPieceOf {
+};
+
+template <class T>
+struct StringPieceOf<T, std::enable_if_t<std::is_base_of<CharSequence, T>::value>> {
+    using Type = StringBuilder::SequencePiece;
+};
+
+template <class T>
+struct StringPieceOf<T,
+    std::enable_if_t<std::is_same<std::decay_t<T>, const char*>::value || std::is_same<std::decay_t<T>, char*>::value>> {
+    using Type = StringBuilder::Utf8Piece;
+};
+
+template <class T>
+struct StringPieceOf<T,
+    std::enable_if_t<std::is_same<std::decay_t<T>, const wchar_t*>::value
+        || std::is_same<std::decay_t<T>, wchar_t*>::value>> {
+    using Type = StringBuilder::UnicodePiece;
+};
+
+template <class T>
+struct StringPieceOf<T,
+    std::enable_if_t<std::is_same<T, char>::value || std::is_same<T, wchar_t>::value
+        || std::is_same<T, CharWrapper>::value>> {
+    using Type = StringBuilder::CodePiece;
+};
+
+template <class Left, class Right>
+struct StringPieceOf<StringConcat<Left, Right>> {
+    using Type = StringConcat<Left, Right>;
+};
+
+template <class T>
+using StringPieceType = typename StringPieceOf<T>::Type;
+
+/// The result of `+` on strings, which is evaluated when it is converted to a `String`, so `a + "/" + b` allocates once
+/// with the right size instead of once per `+`. The operands are referenced, so do not keep the expression (e.g. with
+/// `auto`) after its temporary operands are destroyed.
+template <class Left, class Right>
+class StringConcat {
+public:
+    StringConcat(const Left& left, const Right& right)
+        : left_(left)
+        , right_(right)
+    {
+    }
+
+    operator String() const // NOLINT(google-explicit-constructor,hicpp-explicit-conversions)
+    {
+        return ToString();
+    }
+
+    String ToString() const
+    {
+        String s;
+        StringBuilder::AppendTo(s, *this);
+        return s;
+    }
+
+    void Measure(uint32_t& length, uint32_t& width) const
+    {
+        left_.Measure(length, width);
+        right_.Measure(length, width);
+    }
+
+    void AppendTo(String& s) const
+    {
+        left_.AppendTo(s);
+        right_.AppendTo(s);
+    }
+
+#define SS_DEFINE_CONCAT_COMPARE_OPERATOR(op)                                                \
+    template <class T>                                                                      \
+    friend bool operator op(const StringConcat& s1, const T& s2)                            \
+    {                                                                                       \
+        return s1.ToString() op s2;                                                         \
+    }                                                                                       \
+    template <class T, class = std::enable_if_t<!std::is_same<StringPieceType<T>, T>::value>> \
+    friend bool operator op(const T& s1, const StringConcat& s2)                            \
+    {                                                                                       \
+        return s1 op s2.ToString();                                                         \
+    }
+
+    SS_DEFINE_CONCAT_COMPARE_OPERATOR(==)
+    SS_DEFINE_CONCAT_COMPARE_OPERATOR(!=)
+    SS_DEFINE_CONCAT_COMPARE_OPERATOR(>)
+    SS_DEFINE_CONCAT_COMPARE_OPERATOR(<)
+    SS_DEFINE_CONCAT_COMPARE_OPERATOR(>=)
+    SS_DEFINE_CONCAT_COMPARE_OPERATOR(<=)
+
+#undef SS_DEFINE_CONCAT_COMPARE_OPERATOR
+
+private:
+    Left left_;
+    Right right_;
+};
+
+template <class Piece>
+auto StringBuilder::Concat(const Piece& piece)
 {
-    String s(s1);
-    s += s2;
-    return s;
+    return StringPieceType<Piece>(piece);
 }
 
-inline String operator+(const String& s1, char c)
+template <class Piece, class... Pieces>
+auto StringBuilder::Concat(const Piece& piece, const Pieces&... pieces)
 {
-    String s(s1);
-    s += c;
-    return s;
+    auto right = Concat(pieces...);
+    return StringConcat<StringPieceType<Piece>, decltype(right)>(StringPieceType<Piece>(piece), right);
 }
 
-inline String operator+(char c, const String& s1)
+template <class... Pieces>
+void StringBuilder::AppendTo(String& s, const Pieces&... pieces)
 {
-    String s;
-    s += c;
-    s += s1;
-    return s;
+    auto concat = Concat(pieces...);
+    uint32_t length = s.Length();
+    uint32_t width = 1;
+    concat.Measure(length, width);
+    // The right size if the string is built at once, otherwise it grows geometrically
+    s.EnsureStorage(length, width, s.Empty());
+    concat.AppendTo(s);
 }
 
-inline String operator+(const String& s1, wchar_t c)
+template <class Left, class Right>
+struct IsStringConcatenation {
+    template <class T>
+    static constexpr bool IsString()
+    {
+        return std::is_base_of<CharSequence, T>::value || std::is_same<StringPieceType<T>, T>::value;
+    }
+
+    static constexpr bool kValue = IsString<Left>() || IsString<Right>();
+};
+
+template <class Left, class Right, class = StringPieceType<Left>, class = StringPieceType<Right>,
+    class = std::enable_if_t<IsStringConcatenation<Left, Right>::kValue>>
+inline StringConcat<StringPieceType<Left>, StringPieceType<Right>> operator+(const Left& left, const Right& right)
 {
-    String s(s1);
-    s += c;
-    return s;
+    return { StringPieceType<Left>(left), StringPieceType<Right>(right) };
 }
 
-inline String operator+(wchar_t c, const String& s1)
+/// Appends to the temporary string, reusing its capacity
+template <class Right, class = StringPieceType<Right>>
+inline String operator+(String&& left, const Right& right)
 {
-    String s;
-    s += c;
-    s += s1;
-    return s;
+    StringBuilder::AppendTo(left, right);
+    return std::move(left);
 }
 
 #define SS_DEFINE_COMPARE_OPERATOR(type1, type2)             \
@@ -404,8 +964,130 @@ SS_DEFINE_COMPARE_OPERATOR(String, String)
 std::ostream& operator<<(std::ostream& os, const CharSequence& s);
 std::istream& operator>>(std::istream& is, String& s);
 
+/// Hashes any kind of string consistently, so hash containers keyed by `String` (see `FlatHashMap`) can be looked up
+/// by a `StringView` or a `const char*` without creating a `String`
+struct StringHash {
+    using is_transparent = void;
+
+    size_t operator()(const CharSequence& s) const
+    {
+        return size_t(s.Hash());
+    }
+
+    size_t operator()(const char* utf8) const
+    {
+        return size_t(CharSequence::HashUtf8(utf8));
+    }
+};
+
+struct StringEqual {
+    using is_transparent = void;
+
+    bool operator()(const CharSequence& a, const CharSequence& b) const
+    {
+        return a.Length() == b.Length() && a.Compare(b) == 0;
+    }
+
+    bool operator()(const CharSequence& a, const char* b) const
+    {
+        return a.Equals(b);
+    }
+
+    bool operator()(const char* a, const CharSequence& b) const
+    {
+        return b.Equals(a);
+    }
+};
+
+/// For hash containers whose keys are compared ignoring case, e.g. `FlatHashMap<String, T, StringHashIgnoreCase,
+/// StringEqualIgnoreCase>`
+struct StringHashIgnoreCase {
+    using is_transparent = void;
+
+    size_t operator()(const CharSequence& s) const
+    {
+        return size_t(s.HashIgnoreCase());
+    }
+};
+
+struct StringEqualIgnoreCase {
+    using is_transparent = void;
+
+    bool operator()(const CharSequence& a, const CharSequence& b) const
+    {
+        // Case folding maps a character to one character, so equal strings have the same length
+        return a.Length() == b.Length() && a.CompareIgnoreCase(b) == 0;
+    }
+};
+
+
+namespace internal {
+
+/// Format strings compiled by `fmt::compile`, which are neither text nor `CharSequence`
+template <class Format>
+struct IsCompiledFormat : std::integral_constant<bool,
+                              !std::is_convertible<const Format&, fmt::string_view>::value
+                                  && !std::is_base_of<CharSequence, Format>::value> {
+};
+
+template <class... Args>
+void FormatToBuffer(fmt::internal::buffer<char>& out, fmt::string_view format, const Args&... args)
+{
+    fmt::internal::vformat_to(out, format, fmt::basic_format_args<fmt::format_context>(fmt::make_format_args(args...)));
+}
+
+template <class... Args>
+void FormatToBuffer(fmt::internal::buffer<char>& out, const CharSequence& format, const Args&... args)
+{
+    // fmt parses UTF-8, which is encoded on the stack unless the format string is long
+    fmt::basic_memory_buffer<char, 256> utf8;
+    for (uint32_t i = 0; i < format.Length();) {
+        utf8.reserve(utf8.size() + 64);
+        utf8.resize(utf8.size() + format.EncodeUtf8(&i, utf8.end(), uint32_t(utf8.capacity() - utf8.size())));
+    }
+    FormatToBuffer(out, fmt::string_view(utf8.data(), utf8.size()), args...);
+}
+
+template <class Format, class... Args, typename std::enable_if<IsCompiledFormat<Format>::value, int>::type = 0>
+void FormatToBuffer(fmt::internal::buffer<char>& out, const Format& format, const Args&... args)
+{
+    fmt::format_to(std::back_inserter(out), format, args...);
+}
+
+} // namespace internal
+
+/// Append the text formatted by fmt to `s`. `format` may be UTF-8 text, a `CharSequence`, or compiled at compile
+/// time by `fmt::compile<Args...>("...")`. The text is formatted on the stack unless it is long, then decoded once.
+template <class Format, class... Args>
+void FormatTo(String& s, const Format& format, const Args&... args)
+{
+    fmt::basic_memory_buffer<char, 512> utf8;
+    internal::FormatToBuffer(utf8, format, args...);
+    s.AppendUtf8(utf8.data(), uint32_t(utf8.size()));
+}
+
+template <class... Args>
+String String::Format(const Args&... args) const
+{
+    String s;
+    FormatTo(s, *this, args...);
+    return s;
+}
+
 } // namespace ss
 
+namespace std {
+
+template <>
+struct hash<ss::String> : ss::StringHash {
+};
+
+template <>
+struct hash<ss::StringView> : ss::StringHash {
+};
+
+}
+
 #define SS_DEFINE_FORMATTER(type)                                     \
     template <>                                                       \
     struct fmt::formatter<type> {                                     \
@@ -414,13 +1096,18 @@ std::istream& operator>>(std::istream& is, String& s);
             return ctx.begin();                                       \
         }                                                             \
                                                                       \
+        /* Encode a chunk at a time straight to the output */        \
         template <typename FormatContext>                             \
         auto format(const type& s, FormatContext& ctx)                \
         {                                                             \
-            auto utf8Len = s.GetBytesLength(ss::CharSequence::kUtf8); \
-            std::string bytes(utf8Len, '\0');                         \
-            s.GetBytes(ss::CharSequence::kUtf8, &bytes[0]);           \
-            return format_to(ctx.out(), "{}", bytes);                 \
+            auto out = ctx.out();                                     \
+            char chunk[256];                                          \
+            for (uint32_t i = 0; i < s.Length();) {                   \
+                uint32_t n = s.EncodeUtf8(&i, chunk, sizeof(chunk));  \
+                auto&& it = internal::reserve(out, n);                \
+                it = std::copy(chunk, chunk + n, it);                 \
+            }                                                         \
+            return out;                                               \
         }                                                             \
     };
 
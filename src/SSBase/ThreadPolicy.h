@@ -0,0 +1,25 @@
+//
+// Copyright (c) 2020 Carl Chen. All rights reserved.
+//
+
+#pragma once
+
+namespace ss {
+
+/// Only used by one thread, see `ObjectPool` and `RefCounted`
+class SingleThreadPolicy {
+public:
+    enum : bool {
+        kThreadSafe = false
+    };
+};
+
+/// Shared by threads, see `ObjectPool` and `RefCounted`
+class MultiThreadPolicy {
+public:
+    enum : bool {
+        kThreadSafe = true
+    };
+};
+
+} // namespace ss
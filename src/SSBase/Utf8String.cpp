@@ -0,0 +1,262 @@
+//
+// Copyright (c) 2020 Carl Chen. All rights reserved.
+//
+
+#include "Utf8String.h"
+#include "Str.h"
+#include "internal/Search.h"
+#include "internal/Simd.h"
+#include "internal/Utf8.h"
+
+namespace ss {
+
+namespace {
+
+inline bool IsAscii16(const char* p)
+{
+#ifdef SS_SIMD_X86
+    return _mm_movemask_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p))) == 0;
+#else
+    uint64_t a;
+    uint64_t b;
+    memcpy(&a, p, 8);
+    memcpy(&b, p + 8, 8);
+    return ((a | b) & 0x8080808080808080ull) == 0;
+#endif
+}
+
+/// Encode `code` to `out`, returns the number of bytes
+inline uint32_t EncodeCode(uint32_t code, char* out)
+{
+    char* p = out;
+    utf8::write(code, [&p](uint8_t c) { *p++ = char(c); });
+    return uint32_t(p - out);
+}
+
+} // namespace
+
+uint32_t Utf8View::Decode(const char* p, const char* end, uint32_t* code)
+{
+    auto* s = reinterpret_cast<const uint8_t*>(p);
+    uint8_t lead = s[0];
+    if (lead < 0x80u) {
+        *code = lead;
+        return 1;
+    }
+    uint32_t size;
+    uint32_t value;
+    uint32_t min;
+    if (lead >= 0xC2u && lead <= 0xDFu) {
+        size = 2;
+        value = lead & 0x1Fu;
+        min = 0x80;
+    } else if ((lead & 0xF0u) == 0xE0u) {
+        size = 3;
+        value = lead & 0x0Fu;
+        min = 0x800;
+    } else if (lead >= 0xF0u && lead <= 0xF4u) {
+        size = 4;
+        value = lead & 0x07u;
+        min = 0x10000;
+    } else {
+        *code = 0xFFFD;
+        return 1;
+    }
+    if (end - p < ptrdiff_t(size)) {
+        *code = 0xFFFD;
+        return 1;
+    }
+    for (uint32_t i = 1; i < size; ++i) {
+        if ((s[i] & 0xC0u) != 0x80u) {
+            *code = 0xFFFD;
+            return 1;
+        }
+        value = (value << 6u) | (s[i] & 0x3Fu);
+    }
+    if (value < min || value > 0x10FFFFu || (value >= 0xD800u && value <= 0xDFFFu)) {
+        *code = 0xFFFD;
+        return 1;
+    }
+    *code = value;
+    return size;
+}
+
+uint32_t Utf8View::Length() const
+{
+    // Every code point has exactly one byte which is not a continuation byte (10xx_xxxx)
+    uint32_t count = 0;
+    uint32_t i = 0;
+#ifdef SS_SIMD_X86
+    // Continuation bytes are the signed bytes below -64
+    const __m128i limit = _mm_set1_epi8(-65);
+    for (; i + 16 <= size_; i += 16) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data_ + i));
+        count += Simd::PopCount(uint32_t(_mm_movemask_epi8(_mm_cmpgt_epi8(v, limit))));
+    }
+#endif
+    for (; i < size_; ++i) {
+        count += (uint8_t(data_[i]) & 0xC0u) != 0x80u;
+    }
+    return count;
+}
+
+bool Utf8View::IsValid() const
+{
+    const char* p = data_;
+    const char* end = data_ + size_;
+    while (p < end) {
+        if (end - p >= 16 && IsAscii16(p)) {
+            p += 16;
+            continue;
+        }
+        uint32_t code;
+        uint32_t size = Decode(p, end, &code);
+        if (size == 1 && uint8_t(*p) >= 0x80u) {
+            return false;
+        }
+        p += size;
+    }
+    return true;
+}
+
+int Utf8View::Compare(Utf8View s) const
+{
+    uint32_t n = size_ < s.size_ ? size_ : s.size_;
+    int result = memcmp(data_, s.data_, n);
+    if (result != 0) {
+        return result < 0 ? -1 : 1;
+    }
+    return size_ == s.size_ ? 0 : (size_ < s.size_ ? -1 : 1);
+}
+
+uint32_t Utf8View::Find(Utf8View s, uint32_t start) const
+{
+    return FindUnits(reinterpret_cast<const uint8_t*>(data_), size_, reinterpret_cast<const uint8_t*>(s.data_), s.size_,
+        start, nullptr);
+}
+
+uint32_t Utf8View::Find(uint32_t code, uint32_t start) const
+{
+    if (start >= size_) {
+        return kNPos;
+    }
+    if (code < 0x80u) {
+        auto* found = static_cast<const char*>(memchr(data_ + start, int(code), size_ - start));
+        return found == nullptr ? uint32_t(kNPos) : uint32_t(found - data_);
+    }
+    char bytes[8];
+    return Find(Utf8View(bytes, EncodeCode(code, bytes)), start);
+}
+
+uint32_t Utf8View::RFind(Utf8View s, uint32_t end) const
+{
+    if (end > size_) {
+        end = size_;
+    }
+    return RFindUnits(reinterpret_cast<const uint8_t*>(data_), end, reinterpret_cast<const uint8_t*>(s.data_), s.size_,
+        nullptr);
+}
+
+uint64_t Utf8View::Hash() const
+{
+    return CharSequence::HashUtf8(data_, size_);
+}
+
+String Utf8View::ToString() const
+{
+    return String(data_, size_);
+}
+
+Utf8String::Utf8String(const CharSequence& s)
+{
+    uint32_t bytesCount = s.GetBytesLength(CharSequence::kUtf8);
+    if (bytesCount == 0) {
+        return;
+    }
+    buffer_.EnsureSpace(bytesCount);
+    for (uint32_t index = 0; index < s.Length();) {
+        uint32_t size = buffer_.Size();
+        buffer_.Reset(0, size + s.EncodeUtf8(&index, buffer_.GetData<char>() + size, bytesCount - size));
+    }
+    Update();
+}
+
+void Utf8String::Append(Utf8View s)
+{
+    if (s.Empty()) {
+        return;
+    }
+    const char* bytes = s.Data();
+    auto address = reinterpret_cast<uintptr_t>(bytes);
+    auto begin = reinterpret_cast<uintptr_t>(data_);
+    if (address >= begin && address < begin + size_) {
+        // Appending a part of itself, which moves if the buffer grows
+        uintptr_t offset = address - begin;
+        buffer_.EnsureSpace(s.Size());
+        bytes = buffer_.GetData<char>() + offset;
+    }
+    buffer_.PushData(bytes, s.Size());
+    Update();
+}
+
+void Utf8String::Append(uint32_t code)
+{
+    char bytes[8];
+    Append(Utf8View(bytes, EncodeCode(code, bytes)));
+}
+
+Utf8Splitter::Iterator::Iterator(const Utf8Splitter* splitter)
+    : splitter_(splitter)
+    , tokenStart_(0)
+    , tokenEnd_(0)
+    , next_(0)
+    , splits_(0)
+{
+    Advance();
+}
+
+Utf8Splitter::Iterator::Iterator(const Utf8Splitter* splitter, uint32_t end)
+    : splitter_(splitter)
+    , tokenStart_(end)
+    , tokenEnd_(end)
+    , next_(end)
+    , splits_(0)
+{
+}
+
+void Utf8Splitter::Iterator::Advance()
+{
+    Utf8View str = splitter_->str_;
+    Utf8View delimiter = splitter_->delimiter_;
+    while (next_ != kEnd) {
+        tokenStart_ = next_;
+        if (splits_ < splitter_->maxSplits_) {
+            uint32_t found = str.Find(delimiter, next_);
+            if (found != Utf8View::kNPos) {
+                tokenEnd_ = found;
+                next_ = found + delimiter.Size();
+                if (tokenEnd_ == tokenStart_ && splitter_->skipEmpty_) {
+                    continue;
+                }
+                ++splits_;
+                return;
+            }
+        } else if (splitter_->skipEmpty_ && !delimiter.Empty()) {
+            // The rest of the string does not start with a delimiter either
+            while (str.SubView(tokenStart_).StartsWith(delimiter)) {
+                tokenStart_ += delimiter.Size();
+            }
+        }
+        tokenEnd_ = str.Size();
+        next_ = kEnd;
+        if (tokenEnd_ == tokenStart_ && splitter_->skipEmpty_) {
+            break;
+        }
+        return;
+    }
+    // Past the last token
+    tokenStart_ = kEnd;
+    tokenEnd_ = kEnd;
+}
+
+} // namespace ss
@@ -0,0 +1,461 @@
+//
+// Copyright (c) 2020 Carl Chen. All rights reserved.
+//
+
+#pragma once
+
+#include "Buffer.h"
+#include "thirdparty/fmt/fmt/format.h"
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <string>
+
+namespace ss {
+
+class String;
+class CharSequence;
+class Utf8String;
+class Utf8Splitter;
+
+/// Non-owning view of UTF-8 bytes, e.g. the contents of a `DynamicBuffer` read from a socket or a file. Unlike
+/// `CharSequence`, the bytes are never decoded: searching and comparing run on the bytes, which is correct for
+/// UTF-8 because no character is a part of another, and byte order is code point order. So all the offsets and sizes
+/// are in bytes, and code points are decoded only on demand by `CodePoints` and `Length`.
+///
+/// NOTE: The viewed bytes must outlive the view, and a view of a `DynamicBuffer` is invalidated by any modification
+/// of the buffer.
+class Utf8View {
+public:
+    enum {
+        kNPos = uint32_t(-1)
+    };
+
+    /// Iterates the code points, malformed bytes are returned one by one as U+FFFD
+    class CodePointIterator {
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = uint32_t;
+        using difference_type = std::ptrdiff_t;
+        using pointer = void;
+        using reference = uint32_t;
+
+        CodePointIterator()
+            : CodePointIterator(nullptr, nullptr)
+        {
+        }
+
+        uint32_t operator*() const
+        {
+            uint32_t code;
+            Decode(p_, end_, &code);
+            return code;
+        }
+
+        CodePointIterator& operator++()
+        {
+            uint32_t code;
+            p_ += Decode(p_, end_, &code);
+            return *this;
+        }
+
+        CodePointIterator operator++(int)
+        {
+            CodePointIterator it = *this;
+            ++*this;
+            return it;
+        }
+
+        /// Pointer to the bytes of the current code point
+        const char* Position() const
+        {
+            return p_;
+        }
+
+        bool operator==(const CodePointIterator& other) const
+        {
+            return p_ == other.p_;
+        }
+
+        bool operator!=(const CodePointIterator& other) const
+        {
+            return p_ != other.p_;
+        }
+
+    private:
+        CodePointIterator(const char* p, const char* end)
+            : p_(p)
+            , end_(end)
+        {
+        }
+
+        const char* p_;
+        const char* end_;
+
+        friend class Utf8View;
+    };
+
+    struct CodePointRange {
+        CodePointIterator first;
+        CodePointIterator last;
+
+        CodePointIterator begin() const
+        {
+            return first;
+        }
+
+        CodePointIterator end() const
+        {
+            return last;
+        }
+    };
+
+    Utf8View()
+        : data_("")
+        , size_(0)
+    {
+    }
+
+    Utf8View(const char* utf8) // NOLINT(google-explicit-constructor,hicpp-explicit-conversions)
+        : Utf8View(utf8, uint32_t(strlen(utf8)))
+    {
+    }
+
+    Utf8View(const char* utf8, uint32_t bytesCount)
+        : data_(bytesCount == 0 ? "" : utf8)
+        , size_(bytesCount)
+    {
+    }
+
+    Utf8View(const std::string& s) // NOLINT(google-explicit-constructor,hicpp-explicit-conversions)
+        : Utf8View(s.data(), uint32_t(s.size()))
+    {
+    }
+
+    /// View the readable bytes of `buffer` without copying them
+    explicit Utf8View(const DynamicBuffer& buffer)
+        : Utf8View(buffer.GetData<char>(), buffer.Size())
+    {
+    }
+
+    const char* Data() const
+    {
+        return data_;
+    }
+
+    /// Number of bytes
+    uint32_t Size() const
+    {
+        return size_;
+    }
+
+    bool Empty() const
+    {
+        return size_ == 0;
+    }
+
+    uint8_t operator[](uint32_t index) const
+    {
+        SSASSERT(index < size_);
+        return uint8_t(data_[index]);
+    }
+
+    /// Number of code points, which is counted every time
+    uint32_t Length() const;
+
+    /// Whether the bytes are well-formed UTF-8: no overlong forms, surrogates or code points beyond U+10FFFF
+    bool IsValid() const;
+
+    CodePointRange CodePoints() const
+    {
+        return { CodePointIterator(data_, data_ + size_), CodePointIterator(data_ + size_, data_ + size_) };
+    }
+
+    Utf8View SubView(uint32_t from, uint32_t bytesCount = kNPos) const
+    {
+        SSASSERT(from <= size_);
+        if (bytesCount > size_ - from) {
+            bytesCount = size_ - from;
+        }
+        return Utf8View(data_ + from, bytesCount);
+    }
+
+    int Compare(Utf8View s) const;
+
+    bool StartsWith(Utf8View s) const
+    {
+        return s.size_ <= size_ && memcmp(data_, s.data_, s.size_) == 0;
+    }
+
+    bool EndsWith(Utf8View s) const
+    {
+        return s.size_ <= size_ && memcmp(data_ + size_ - s.size_, s.data_, s.size_) == 0;
+    }
+
+    bool Contains(Utf8View s) const
+    {
+        return Find(s) != kNPos;
+    }
+
+    /// Byte offset of the first `s` not before `start`, or kNPos
+    uint32_t Find(Utf8View s, uint32_t start = 0) const;
+    /// Byte offset of the first code point `code` not before `start`, or kNPos
+    uint32_t Find(uint32_t code, uint32_t start = 0) const;
+    /// NOTE: end is not included
+    uint32_t RFind(Utf8View s, uint32_t end = kNPos) const;
+
+    /// Lazily split at `delimiter`, like `CharSequence::Tokenize`
+    Utf8Splitter Split(Utf8View delimiter, uint32_t maxSplits = kNPos, bool skipEmpty = false) const;
+
+    /// Same as `String(Data(), Size()).Hash()`, so a `Utf8View` may look up a `String` key without decoding
+    uint64_t Hash() const;
+
+    String ToString() const;
+
+    std::string ToStdString() const
+    {
+        return std::string(data_, size_);
+    }
+
+protected:
+    /// Decode the code point at `p`, returns its size in bytes
+    static uint32_t Decode(const char* p, const char* end, uint32_t* code);
+
+    const char* data_;
+    uint32_t size_;
+};
+
+// clang-format off
+inline bool operator==(Utf8View a, Utf8View b) { return a.Size() == b.Size() && memcmp(a.Data(), b.Data(), a.Size()) == 0; }
+inline bool operator!=(Utf8View a, Utf8View b) { return !(a == b); }
+inline bool operator< (Utf8View a, Utf8View b) { return a.Compare(b) <  0; }
+inline bool operator> (Utf8View a, Utf8View b) { return a.Compare(b) >  0; }
+inline bool operator<=(Utf8View a, Utf8View b) { return a.Compare(b) <= 0; }
+inline bool operator>=(Utf8View a, Utf8View b) { return a.Compare(b) >= 0; }
+// clang-format on
+
+/// UTF-8 string which owns its bytes in a `DynamicBuffer`. All the `Utf8View` methods work on it, and a received
+/// buffer can be adopted without copying, or released to be sent.
+class Utf8String : public Utf8View {
+public:
+    Utf8String() = default;
+
+    Utf8String(const char* utf8) // NOLINT(google-explicit-constructor,hicpp-explicit-conversions)
+        : Utf8String(Utf8View(utf8))
+    {
+    }
+
+    Utf8String(const char* utf8, uint32_t bytesCount)
+        : Utf8String(Utf8View(utf8, bytesCount))
+    {
+    }
+
+    Utf8String(const std::string& s) // NOLINT(google-explicit-constructor,hicpp-explicit-conversions)
+        : Utf8String(Utf8View(s))
+    {
+    }
+
+    explicit Utf8String(Utf8View s)
+    {
+        Append(s);
+    }
+
+    /// Encode the characters of `s`
+    explicit Utf8String(const CharSequence& s);
+
+    /// Take over the readable bytes of `buffer`
+    explicit Utf8String(DynamicBuffer&& buffer)
+        : buffer_(std::move(buffer))
+    {
+        Update();
+    }
+
+    Utf8String(const Utf8String& s)
+        : Utf8String((Utf8View)s)
+    {
+    }
+
+    Utf8String(Utf8String&& s) noexcept
+        : buffer_(std::move(s.buffer_))
+    {
+        Update();
+        s.Update();
+    }
+
+    Utf8String& operator=(const Utf8String& s)
+    {
+        if (this != &s) {
+            Clear();
+            Append(s);
+        }
+        return *this;
+    }
+
+    Utf8String& operator=(Utf8String&& s) noexcept
+    {
+        buffer_ = std::move(s.buffer_);
+        Update();
+        s.Update();
+        return *this;
+    }
+
+    /// Make sure `bytesCount` more bytes can be appended without reallocation
+    void Reserve(uint32_t bytesCount)
+    {
+        buffer_.EnsureSpace(bytesCount);
+        Update();
+    }
+
+    void Append(Utf8View s);
+
+    void Append(uint32_t code);
+
+    Utf8String& operator+=(Utf8View s)
+    {
+        Append(s);
+        return *this;
+    }
+
+    void Clear()
+    {
+        buffer_.Reset();
+        Update();
+    }
+
+    /// Give the bytes away, e.g. to be written to a socket, the string becomes empty
+    DynamicBuffer Release()
+    {
+        DynamicBuffer buffer(std::move(buffer_));
+        Update();
+        return buffer;
+    }
+
+private:
+    void Update()
+    {
+        Utf8View::operator=(Utf8View(buffer_));
+    }
+
+    DynamicBuffer buffer_;
+};
+
+class Utf8Splitter {
+public:
+    class Iterator {
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = Utf8View;
+        using difference_type = std::ptrdiff_t;
+        using pointer = void;
+        using reference = Utf8View;
+
+        Iterator()
+            : Iterator(nullptr, kEnd)
+        {
+        }
+
+        /// The current token
+        Utf8View operator*() const
+        {
+            return splitter_->str_.SubView(tokenStart_, tokenEnd_ - tokenStart_);
+        }
+
+        Iterator& operator++()
+        {
+            Advance();
+            return *this;
+        }
+
+        Iterator operator++(int)
+        {
+            Iterator it = *this;
+            Advance();
+            return it;
+        }
+
+        /// Byte offset of the current token in the string
+        uint32_t Offset() const
+        {
+            return tokenStart_;
+        }
+
+        bool operator==(const Iterator& other) const
+        {
+            return splitter_ == other.splitter_ && tokenStart_ == other.tokenStart_ && next_ == other.next_;
+        }
+
+        bool operator!=(const Iterator& other) const
+        {
+            return !(*this == other);
+        }
+
+    private:
+        explicit Iterator(const Utf8Splitter* splitter);
+        Iterator(const Utf8Splitter* splitter, uint32_t end);
+
+        void Advance();
+
+        const Utf8Splitter* splitter_;
+        uint32_t tokenStart_;
+        uint32_t tokenEnd_;
+        uint32_t next_; // Where the next token starts, kEnd after the last token
+        uint32_t splits_;
+
+        friend class Utf8Splitter;
+    };
+
+    /// See `StrTokenizer`, an empty delimiter does not split the string
+    Utf8Splitter(Utf8View str, Utf8View delimiter, uint32_t maxSplits, bool skipEmpty)
+        : str_(str)
+        , delimiter_(delimiter)
+        , maxSplits_(delimiter.Empty() ? 0 : maxSplits)
+        , skipEmpty_(skipEmpty)
+    {
+    }
+
+    Iterator begin() const
+    {
+        return Iterator(this);
+    }
+
+    Iterator end() const
+    {
+        return Iterator(this, kEnd);
+    }
+
+    template <class Container>
+    operator Container() const // NOLINT(google-explicit-constructor,hicpp-explicit-conversions)
+    {
+        return Container(begin(), end());
+    }
+
+private:
+    enum : uint32_t {
+        kEnd = uint32_t(-1)
+    };
+
+    Utf8View str_;
+    Utf8View delimiter_;
+    uint32_t maxSplits_;
+    bool skipEmpty_;
+};
+
+inline Utf8Splitter Utf8View::Split(Utf8View delimiter, uint32_t maxSplits, bool skipEmpty) const
+{
+    return Utf8Splitter(*this, delimiter, maxSplits, skipEmpty);
+}
+
+} // namespace ss
+
+template <>
+struct fmt::formatter<ss::Utf8View> : fmt::formatter<fmt::string_view> {
+    template <typename FormatContext>
+    auto format(const ss::Utf8View& s, FormatContext& ctx)
+    {
+        return formatter<string_view>::format(string_view(s.Data(), s.Size()), ctx);
+    }
+};
+
+template <>
+struct fmt::formatter<ss::Utf8String> : fmt::formatter<ss::Utf8View> {
+};
@@ -0,0 +1,230 @@
+//
+// Copyright (c) 2020 Carl Chen. All rights reserved.
+//
+
+#include "Hash.h"
+#include "Unicode.h"
+#include "Utf8.h"
+#include <cstring>
+
+#define XXH_INLINE_ALL
+#include "../thirdparty/xxhash/xxhash.h"
+
+namespace ss {
+
+namespace {
+
+/// OR of all the bytes of `n` units, a word at a time
+inline uint64_t OrUnits(const void* units, uint32_t width, uint32_t count)
+{
+    auto* p = static_cast<const uint8_t*>(units);
+    size_t n = size_t(count) * width;
+    uint64_t bits = 0;
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        uint64_t word;
+        memcpy(&word, p + i, 8);
+        bits |= word;
+    }
+    if (i < n) {
+        uint64_t word = 0;
+        memcpy(&word, p + i, n - i); // Units never straddle the words, n and i are multiples of the width
+        bits |= word;
+    }
+    return bits;
+}
+
+inline uint32_t NarrowestWidth(const void* units, uint32_t width, uint32_t count)
+{
+    if (width == 1) {
+        return 1;
+    }
+    // The OR of the units is the OR of the lanes of the word
+    uint64_t bits = OrUnits(units, width, count);
+    auto* bytes = reinterpret_cast<const uint8_t*>(&bits);
+    uint32_t unitBits = 0;
+    for (uint32_t i = 0; i < 8; i += width) {
+        if (width == 2) {
+            uint16_t unit;
+            memcpy(&unit, bytes + i, 2);
+            unitBits |= unit;
+        } else {
+            uint32_t unit;
+            memcpy(&unit, bytes + i, 4);
+            unitBits |= unit;
+        }
+    }
+    return unitBits <= 0xFFu ? 1 : (unitBits <= 0xFFFFu ? 2 : 4);
+}
+
+template <class D, class S>
+inline void NarrowUnits(D* dst, const S* src, uint32_t n)
+{
+    for (uint32_t i = 0; i < n; ++i) {
+        dst[i] = D(src[i]);
+    }
+}
+
+inline void NarrowUnits(void* dst, uint32_t dstWidth, const void* src, uint32_t srcWidth, uint32_t n)
+{
+    if (srcWidth == 2) {
+        NarrowUnits(static_cast<uint8_t*>(dst), static_cast<const uint16_t*>(src), n);
+    } else if (dstWidth == 1) {
+        NarrowUnits(static_cast<uint8_t*>(dst), static_cast<const uint32_t*>(src), n);
+    } else {
+        NarrowUnits(static_cast<uint16_t*>(dst), static_cast<const uint32_t*>(src), n);
+    }
+}
+
+template <class T>
+inline void FoldUnits(const T* units, uint32_t n, uint32_t* folded)
+{
+    for (uint32_t i = 0; i < n; ++i) {
+        folded[i] = Unicode::Fold(units[i]);
+    }
+}
+
+/// Collects bytes into a buffer, and hashes the buffer in one shot if it never fills up
+class BufferedHash {
+public:
+    enum : uint32_t {
+        kCapacity = 1024
+    };
+
+    BufferedHash()
+    {
+        XXH3_INITSTATE(&state_);
+    }
+
+    uint8_t* Reserve(uint32_t n)
+    {
+        if (kCapacity - size_ < n) {
+            if (!streaming_) {
+                XXH3_64bits_reset(&state_);
+                streaming_ = true;
+            }
+            XXH3_64bits_update(&state_, buffer_, size_);
+            size_ = 0;
+        }
+        return buffer_ + size_;
+    }
+
+    uint32_t Available() const
+    {
+        return kCapacity - size_;
+    }
+
+    void Commit(uint32_t n)
+    {
+        size_ += n;
+    }
+
+    uint64_t Digest()
+    {
+        if (!streaming_) {
+            return XXH3_64bits(buffer_, size_);
+        }
+        XXH3_64bits_update(&state_, buffer_, size_);
+        return XXH3_64bits_digest(&state_);
+    }
+
+private:
+    XXH3_state_t state_;
+    bool streaming_ = false;
+    uint32_t size_ = 0;
+    uint8_t buffer_[kCapacity];
+};
+
+}
+
+uint64_t UnitsHash::Hash(const void* units, uint32_t width, uint32_t count)
+{
+    uint32_t narrowest = NarrowestWidth(units, width, count);
+    if (narrowest == width) {
+        return XXH3_64bits_withSeed(units, size_t(count) * width, narrowest);
+    }
+    // Wide storage of narrow code points, e.g. a string whose characters were accessed as `CharType`
+    XXH3_state_t state;
+    XXH3_INITSTATE(&state);
+    XXH3_64bits_reset_withSeed(&state, narrowest);
+    alignas(uint32_t) uint8_t buffer[1024];
+    const uint32_t kChunk = sizeof(buffer) / 2;
+    auto* p = static_cast<const uint8_t*>(units);
+    for (uint32_t i = 0; i < count; i += kChunk) {
+        uint32_t n = count - i < kChunk ? count - i : kChunk;
+        NarrowUnits(buffer, narrowest, p + size_t(i) * width, width, n);
+        XXH3_64bits_update(&state, buffer, size_t(n) * narrowest);
+    }
+    return XXH3_64bits_digest(&state);
+}
+
+uint64_t UnitsHash::HashUtf8(const char* utf8, uint32_t bytesCount)
+{
+    uint32_t bytesUsed;
+    uint32_t width;
+    uint32_t count = Utf8Codec::Scan(utf8, bytesCount, &bytesUsed, &width);
+    if (count == bytesUsed) {
+        // ASCII, the bytes are the Latin-1 units
+        return XXH3_64bits_withSeed(utf8, bytesUsed, 1);
+    }
+    XXH3_state_t state;
+    XXH3_INITSTATE(&state);
+    XXH3_64bits_reset_withSeed(&state, width);
+    alignas(uint32_t) uint8_t buffer[1024];
+    // A code point takes at least one byte, so the units of `kChunk` bytes fit in the buffer
+    const uint32_t kChunk = sizeof(buffer) / width;
+    while (bytesUsed > 0) {
+        uint32_t chunkBytes = bytesUsed;
+        if (chunkBytes > kChunk) {
+            chunkBytes = kChunk;
+            // Cut before a lead byte, so no sequence is split
+            while ((uint8_t(utf8[chunkBytes]) & 0xC0u) == 0x80u) {
+                --chunkBytes;
+            }
+        }
+        uint32_t chunkWidth;
+        uint32_t n = Utf8Codec::Scan(utf8, chunkBytes, &chunkBytes, &chunkWidth);
+        Utf8Codec::Decode(utf8, chunkBytes, buffer, width);
+        XXH3_64bits_update(&state, buffer, size_t(n) * width);
+        utf8 += chunkBytes;
+        bytesUsed -= chunkBytes;
+    }
+    return XXH3_64bits_digest(&state);
+}
+
+uint64_t UnitsHash::HashIgnoreCase(const void* units, uint32_t width, uint32_t count)
+{
+    BufferedHash hash;
+    auto* p = static_cast<const uint8_t*>(units);
+    // A code point takes up to 6 bytes
+    const uint32_t kChunk = 64;
+    uint32_t folded[kChunk];
+    for (uint32_t i = 0; i < count;) {
+        if (width == 1) {
+            // ASCII is its own UTF-8
+            uint8_t* out = hash.Reserve(16);
+            uint32_t n = count - i < hash.Available() ? count - i : hash.Available();
+            n = Unicode::AsciiToLower(p + i, out, n);
+            hash.Commit(n);
+            i += n;
+            if (i == count || p[i] < 0x80) {
+                continue;
+            }
+        }
+        uint32_t n = count - i < kChunk ? count - i : kChunk;
+        const uint8_t* chunk = p + size_t(i) * width;
+        if (width == 1) {
+            FoldUnits(chunk, n, folded);
+        } else if (width == 2) {
+            FoldUnits(reinterpret_cast<const uint16_t*>(chunk), n, folded);
+        } else {
+            FoldUnits(reinterpret_cast<const uint32_t*>(chunk), n, folded);
+        }
+        auto* out = reinterpret_cast<char*>(hash.Reserve(kChunk * 6));
+        hash.Commit(Utf8Codec::Encode(folded, 4, n, out, kChunk * 6));
+        i += n;
+    }
+    return hash.Digest();
+}
+
+}
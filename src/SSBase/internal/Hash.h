@@ -0,0 +1,26 @@
+//
+// Copyright (c) 2020 Carl Chen. All rights reserved.
+//
+
+#pragma once
+
+#include <cstdint>
+
+namespace ss {
+
+/// Hashes of code point units (see `CharSequence::Units`) with XXH3. The units are hashed as if they were stored with
+/// the narrowest width which holds all of them, and the width is the seed, so the hash of a string does not depend on
+/// the width it happens to be stored with.
+class UnitsHash final {
+public:
+    static uint64_t Hash(const void* units, uint32_t width, uint32_t count);
+
+    /// Same as `Hash` of the code points decoded by `Utf8Codec::Scan`, without storing all of them
+    static uint64_t HashUtf8(const char* utf8, uint32_t bytesCount);
+
+    /// Hash of the simple case foldings of the units, which are hashed as UTF-8 so the hash does not depend on the width
+    /// either. It is not compatible with `Hash`.
+    static uint64_t HashIgnoreCase(const void* units, uint32_t width, uint32_t count);
+};
+
+}
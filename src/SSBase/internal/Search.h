@@ -0,0 +1,327 @@
+//
+// Copyright (c) 2020 Carl Chen. All rights reserved.
+//
+
+#pragma once
+
+#include "Simd.h"
+#include <cstdint>
+#include <cstring>
+
+// Substring search kernels on code point units of 1, 2 or 4 bytes (see `CharSequence::Units`). The haystack and the
+// needle may have different widths.
+//   - Candidates are filtered by comparing the first and the last unit of the needle with a whole vector of haystack
+//     positions at once, only the positions matching both are compared fully. This is the fastest in practice.
+//   - Long needles fall back to Two-Way (Crochemore-Perrin) once the filter lets too many candidates through, e.g.
+//     searching "aa...ab" in "aaaa...", so the search is never worse than linear.
+
+namespace ss {
+
+template <class A, class B>
+inline bool EqualUnits(const A* a, const B* b, uint32_t n)
+{
+    for (uint32_t i = 0; i < n; ++i) {
+        if (a[i] != b[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+template <class T>
+inline bool EqualUnits(const T* a, const T* b, uint32_t n)
+{
+    return memcmp(a, b, n * sizeof(T)) == 0;
+}
+
+#ifdef SS_SIMD_X86
+
+inline __m128i SearchSet1(uint8_t c)
+{
+    return _mm_set1_epi8(char(c));
+}
+
+inline __m128i SearchSet1(uint16_t c)
+{
+    return _mm_set1_epi16(short(c));
+}
+
+inline __m128i SearchSet1(uint32_t c)
+{
+    return _mm_set1_epi32(int(c));
+}
+
+/// Bit mask of the vector lanes of the haystack equals to the needle unit in both positions, one bit per lane
+template <class H>
+inline uint32_t SearchMatch(const H* a, const H* b, __m128i first, __m128i last)
+{
+    __m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a));
+    __m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b));
+    __m128i eq;
+    uint32_t lanes;
+    switch (sizeof(H)) {
+    case 1:
+        eq = _mm_and_si128(_mm_cmpeq_epi8(va, first), _mm_cmpeq_epi8(vb, last));
+        lanes = 0xFFFFu;
+        break;
+    case 2:
+        eq = _mm_and_si128(_mm_cmpeq_epi16(va, first), _mm_cmpeq_epi16(vb, last));
+        lanes = 0x5555u;
+        break;
+    default:
+        eq = _mm_and_si128(_mm_cmpeq_epi32(va, first), _mm_cmpeq_epi32(vb, last));
+        lanes = 0x1111u;
+        break;
+    }
+    return uint32_t(_mm_movemask_epi8(eq)) & lanes;
+}
+
+#endif
+
+/// A needle unit which the haystack type can not hold matches nothing
+template <class H, class N>
+inline bool FitsUnit(N c)
+{
+    return sizeof(N) <= sizeof(H) || c == N(H(c));
+}
+
+/// Critical factorization of a needle for the Two-Way algorithm. The needle is read through `at`, so the same code
+/// searches backwards on the reversed needle.
+struct TwoWay {
+    int64_t ell; // The critical position minus 1
+    int64_t period;
+    bool periodic;
+
+    template <class At>
+    void Build(At&& at, uint32_t m)
+    {
+        int64_t p1;
+        int64_t p2;
+        int64_t ms1 = MaxSuffix(at, m, &p1, false);
+        int64_t ms2 = MaxSuffix(at, m, &p2, true);
+        ell = ms1 > ms2 ? ms1 : ms2;
+        period = ms1 > ms2 ? p1 : p2;
+        periodic = true;
+        for (int64_t i = 0; i <= ell; ++i) {
+            if (at(i) != at(i + period)) {
+                periodic = false;
+                break;
+            }
+        }
+        if (!periodic) {
+            period = (ell + 1 > int64_t(m) - ell - 1 ? ell + 1 : int64_t(m) - ell - 1) + 1;
+        }
+    }
+
+    /// Returns the first j in [from, to] where the needle matches the haystack read through `hat(j + i)`, or -1
+    template <class At, class HAt>
+    int64_t Search(At&& at, int64_t m, HAt&& hat, int64_t from, int64_t to) const
+    {
+        int64_t j = from;
+        int64_t memory = -1;
+        while (j <= to) {
+            int64_t i = (periodic && memory > ell ? memory : ell) + 1;
+            while (i < m && at(i) == hat(i + j)) {
+                ++i;
+            }
+            if (i < m) {
+                j += i - ell;
+                memory = -1;
+                continue;
+            }
+            int64_t lower = periodic ? memory : -1;
+            i = ell;
+            while (i > lower && at(i) == hat(i + j)) {
+                --i;
+            }
+            if (i <= lower) {
+                return j;
+            }
+            j += period;
+            memory = periodic ? m - period - 1 : -1;
+        }
+        return -1;
+    }
+
+private:
+    template <class At>
+    static int64_t MaxSuffix(At& at, uint32_t m, int64_t* period, bool reversed)
+    {
+        int64_t ms = -1;
+        int64_t j = 0;
+        int64_t k = 1;
+        int64_t p = 1;
+        while (j + k < int64_t(m)) {
+            auto a = at(j + k);
+            auto b = at(ms + k);
+            if (reversed ? a > b : a < b) {
+                j += k;
+                k = 1;
+                p = j - ms;
+            } else if (a == b) {
+                if (k != p) {
+                    ++k;
+                } else {
+                    j += p;
+                    k = 1;
+                }
+            } else {
+                ms = j;
+                j = ms + 1;
+                k = p = 1;
+            }
+        }
+        *period = p;
+        return ms;
+    }
+};
+
+/// Precomputed for needles longer than kShortNeedle
+struct SearchPlan {
+    enum {
+        kShortNeedle = 16
+    };
+
+    TwoWay forward;
+    TwoWay backward;
+
+    template <class N>
+    void Build(const N* n, uint32_t nn)
+    {
+        forward.Build([n](int64_t i) { return n[i]; }, nn);
+        backward.Build([n, nn](int64_t i) { return n[nn - 1 - i]; }, nn);
+    }
+};
+
+/// Too many candidates which fail to match, switch to Two-Way if the needle is long
+inline bool FilterIneffective(uint32_t candidates, uint32_t scanned, uint32_t nn)
+{
+    return nn > SearchPlan::kShortNeedle && candidates > 64 && candidates > scanned / 8;
+}
+
+template <class H, class N>
+inline uint32_t FindTwoWay(const H* h, uint32_t hn, const N* n, uint32_t nn, uint32_t start, const SearchPlan* plan)
+{
+    SearchPlan local; // NOLINT(cppcoreguidelines-pro-type-member-init)
+    if (plan == nullptr) {
+        local.Build(n, nn);
+        plan = &local;
+    }
+    int64_t j = plan->forward.Search([n](int64_t i) { return n[i]; }, nn, [h](int64_t i) { return h[i]; }, start, int64_t(hn) - nn);
+    return j < 0 ? uint32_t(-1) : uint32_t(j);
+}
+
+template <class H, class N>
+inline uint32_t RFindTwoWay(const H* h, uint32_t end, const N* n, uint32_t nn, uint32_t from, const SearchPlan* plan)
+{
+    SearchPlan local; // NOLINT(cppcoreguidelines-pro-type-member-init)
+    if (plan == nullptr) {
+        local.Build(n, nn);
+        plan = &local;
+    }
+    // Search the reversed needle in the reversed haystack, position j there is `end - nn - j` here
+    int64_t j = plan->backward.Search([n, nn](int64_t i) { return n[nn - 1 - i]; }, nn, [h, end](int64_t i) { return h[end - 1 - i]; },
+        int64_t(end) - nn - from, int64_t(end) - nn);
+    return j < 0 ? uint32_t(-1) : uint32_t(int64_t(end) - nn - j);
+}
+
+/// Returns the first position not before `start`, `plan` may be nullptr
+template <class H, class N>
+inline uint32_t FindUnits(const H* h, uint32_t hn, const N* n, uint32_t nn, uint32_t start, const SearchPlan* plan)
+{
+    if (uint64_t(nn) + start > hn) {
+        return uint32_t(-1);
+    }
+    if (nn == 0) {
+        return start;
+    }
+    if (!FitsUnit<H>(n[0]) || !FitsUnit<H>(n[nn - 1])) {
+        return uint32_t(-1);
+    }
+    uint32_t last = hn - nn; // The last possible position
+    uint32_t i = start;
+    uint32_t candidates = 0;
+#ifdef SS_SIMD_X86
+    const uint32_t kLanes = 16 / sizeof(H);
+    __m128i first = SearchSet1(H(n[0]));
+    __m128i lastUnit = SearchSet1(H(n[nn - 1]));
+    while (last - i + 1 >= kLanes) {
+        uint32_t mask = SearchMatch(h + i, h + i + nn - 1, first, lastUnit);
+        while (mask != 0) {
+            uint32_t pos = i + Simd::CountTrailingZeros(mask) / sizeof(H);
+            if (EqualUnits(h + pos, n, nn)) {
+                return pos;
+            }
+            ++candidates;
+            mask &= mask - 1;
+        }
+        i += kLanes;
+        if (FilterIneffective(candidates, i - start, nn)) {
+            return FindTwoWay(h, hn, n, nn, i, plan);
+        }
+    }
+#endif
+    for (; i <= last; ++i) {
+        if (h[i] == n[0] && h[i + nn - 1] == n[nn - 1]) {
+            if (EqualUnits(h + i, n, nn)) {
+                return i;
+            }
+            if (FilterIneffective(++candidates, i - start, nn)) {
+                return FindTwoWay(h, hn, n, nn, i + 1, plan);
+            }
+        }
+    }
+    return uint32_t(-1);
+}
+
+/// Returns the last position whose match does not go beyond `end`, `plan` may be nullptr
+template <class H, class N>
+inline uint32_t RFindUnits(const H* h, uint32_t end, const N* n, uint32_t nn, const SearchPlan* plan)
+{
+    if (end < nn) {
+        return uint32_t(-1);
+    }
+    if (nn == 0) {
+        return end;
+    }
+    if (!FitsUnit<H>(n[0]) || !FitsUnit<H>(n[nn - 1])) {
+        return uint32_t(-1);
+    }
+    uint32_t i = end - nn + 1; // Positions before this are to be checked
+    uint32_t candidates = 0;
+#ifdef SS_SIMD_X86
+    const uint32_t kLanes = 16 / sizeof(H);
+    __m128i first = SearchSet1(H(n[0]));
+    __m128i lastUnit = SearchSet1(H(n[nn - 1]));
+    while (i >= kLanes) {
+        uint32_t base = i - kLanes;
+        uint32_t mask = SearchMatch(h + base, h + base + nn - 1, first, lastUnit);
+        while (mask != 0) {
+            uint32_t bit = Simd::HighestBit(mask);
+            uint32_t pos = base + bit / sizeof(H);
+            if (EqualUnits(h + pos, n, nn)) {
+                return pos;
+            }
+            ++candidates;
+            mask &= ~(1u << bit);
+        }
+        i = base;
+        if (FilterIneffective(candidates, end - nn + 1 - i, nn)) {
+            return i == 0 ? uint32_t(-1) : RFindTwoWay(h, end, n, nn, i - 1, plan);
+        }
+    }
+#endif
+    for (; i > 0; --i) {
+        if (h[i - 1] == n[0] && h[i + nn - 2] == n[nn - 1]) {
+            if (EqualUnits(h + i - 1, n, nn)) {
+                return i - 1;
+            }
+            if (FilterIneffective(++candidates, end - nn + 1 - i, nn)) {
+                return i == 1 ? uint32_t(-1) : RFindTwoWay(h, end, n, nn, i - 2, plan);
+            }
+        }
+    }
+    return uint32_t(-1);
+}
+
+}
@@ -0,0 +1,109 @@
+//
+// Copyright (c) 2020 Carl Chen. All rights reserved.
+//
+
+#pragma once
+
+#include <cstdint>
+
+// SSE2 is part of x86-64, so it is always used there. AVX2 kernels are compiled with a target attribute and selected
+// at runtime, so the library still runs on CPUs without AVX2.
+#if defined(__x86_64__) || defined(_M_X64)
+#define SS_SIMD_X86 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+#if defined(SS_SIMD_X86) && (defined(__GNUC__) || defined(__clang__))
+#define SS_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define SS_TARGET_AVX2
+#endif
+
+namespace ss {
+
+class Simd {
+public:
+    static bool HasAvx2()
+    {
+        static const bool hasAvx2 = DetectAvx2();
+        return hasAvx2;
+    }
+
+    static uint32_t PopCount(uint32_t x)
+    {
+#if defined(__GNUC__) || defined(__clang__)
+        return uint32_t(__builtin_popcount(x));
+#else
+        x = x - ((x >> 1u) & 0x55555555u);
+        x = (x & 0x33333333u) + ((x >> 2u) & 0x33333333u);
+        return (((x + (x >> 4u)) & 0x0F0F0F0Fu) * 0x01010101u) >> 24u;
+#endif
+    }
+
+    /// `x` must not be 0
+    static uint32_t CountTrailingZeros(uint32_t x)
+    {
+#if defined(__GNUC__) || defined(__clang__)
+        return uint32_t(__builtin_ctz(x));
+#elif defined(_MSC_VER)
+        unsigned long index;
+        _BitScanForward(&index, x);
+        return uint32_t(index);
+#else
+        uint32_t n = 0;
+        while ((x & 1u) == 0) {
+            x >>= 1u;
+            ++n;
+        }
+        return n;
+#endif
+    }
+
+    /// Index of the highest set bit, `x` must not be 0
+    static uint32_t HighestBit(uint32_t x)
+    {
+#if defined(__GNUC__) || defined(__clang__)
+        return 31u - uint32_t(__builtin_clz(x));
+#elif defined(_MSC_VER)
+        unsigned long index;
+        _BitScanReverse(&index, x);
+        return uint32_t(index);
+#else
+        uint32_t n = 0;
+        while (x >>= 1u) {
+            ++n;
+        }
+        return n;
+#endif
+    }
+
+private:
+    static bool DetectAvx2()
+    {
+#if defined(SS_SIMD_X86) && (defined(__GNUC__) || defined(__clang__))
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("avx2") != 0;
+#elif defined(SS_SIMD_X86) && defined(_MSC_VER)
+        int info[4];
+        __cpuid(info, 0);
+        if (info[0] < 7) {
+            return false;
+        }
+        __cpuid(info, 1);
+        bool osxsave = (info[2] & (1 << 27)) != 0;
+        bool avx = (info[2] & (1 << 28)) != 0;
+        if (!osxsave || !avx || (_xgetbv(0) & 6) != 6) { // The OS must save the YMM registers
+            return false;
+        }
+        __cpuidex(info, 7, 0);
+        return (info[1] & (1 << 5)) != 0;
+#else
+        return false;
+#endif
+    }
+};
+
+}
@@ -19,9 +19,10 @@ StrSplitter::operator Container() const
 template <class Container>
 void StrSplitter::Split(Container& container) const
 {
+    Searcher searcher(splitter_);
     uint32_t indexStart = 0;
     while (true) {
-        uint32_t indexEnd = str_.Find(splitter_, indexStart);
+        uint32_t indexEnd = searcher.Find(str_, indexStart);
         if (indexEnd == CharSequence::kNPos) {
             container.insert(container.end(), str_.SubStringView(indexStart));
             break;
@@ -0,0 +1,86 @@
+//
+// Copyright (c) 2020 Carl Chen. All rights reserved.
+//
+
+#include "Unicode.h"
+#include "Simd.h"
+
+namespace ss {
+
+namespace {
+
+inline uint8_t AsciiUpper(uint8_t c)
+{
+    return c >= 'a' && c <= 'z' ? uint8_t(c - ('a' - 'A')) : c;
+}
+
+inline uint8_t AsciiLower(uint8_t c)
+{
+    return c >= 'A' && c <= 'Z' ? uint8_t(c + ('a' - 'A')) : c;
+}
+
+#ifdef SS_SIMD_X86
+/// Flip the case bit (0x20) of the bytes in [first, last]. The bytes must be ASCII, so signed comparisons work.
+inline __m128i FlipCaseInRange(__m128i v, char first, char last)
+{
+    __m128i inRange = _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8(char(first - 1))),
+        _mm_cmplt_epi8(v, _mm_set1_epi8(char(last + 1))));
+    return _mm_xor_si128(v, _mm_and_si128(inRange, _mm_set1_epi8(0x20)));
+}
+#endif
+
+template <bool kUpper>
+inline uint32_t ConvertAscii(const uint8_t* src, uint8_t* dst, uint32_t n)
+{
+    uint32_t i = 0;
+#ifdef SS_SIMD_X86
+    for (; i + 16 <= n; i += 16) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+        if (_mm_movemask_epi8(v) != 0) {
+            break;
+        }
+        v = kUpper ? FlipCaseInRange(v, 'a', 'z') : FlipCaseInRange(v, 'A', 'Z');
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), v);
+    }
+#endif
+    for (; i < n && src[i] < 0x80; ++i) {
+        dst[i] = kUpper ? AsciiUpper(src[i]) : AsciiLower(src[i]);
+    }
+    return i;
+}
+
+}
+
+uint32_t Unicode::AsciiToUpper(const uint8_t* src, uint8_t* dst, uint32_t n)
+{
+    return ConvertAscii<true>(src, dst, n);
+}
+
+uint32_t Unicode::AsciiToLower(const uint8_t* src, uint8_t* dst, uint32_t n)
+{
+    return ConvertAscii<false>(src, dst, n);
+}
+
+uint32_t Unicode::AsciiEqualIgnoreCase(const uint8_t* a, const uint8_t* b, uint32_t n)
+{
+    uint32_t i = 0;
+#ifdef SS_SIMD_X86
+    for (; i + 16 <= n; i += 16) {
+        __m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i));
+        __m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i));
+        if (_mm_movemask_epi8(_mm_or_si128(va, vb)) != 0) {
+            break;
+        }
+        __m128i equal = _mm_cmpeq_epi8(FlipCaseInRange(va, 'A', 'Z'), FlipCaseInRange(vb, 'A', 'Z'));
+        uint32_t mask = uint32_t(_mm_movemask_epi8(equal));
+        if (mask != 0xFFFFu) {
+            return i + Simd::CountTrailingZeros(~mask);
+        }
+    }
+#endif
+    for (; i < n && a[i] < 0x80 && b[i] < 0x80 && AsciiLower(a[i]) == AsciiLower(b[i]); ++i) {
+    }
+    return i;
+}
+
+}
@@ -0,0 +1,89 @@
+//
+// Copyright (c) 2020 Carl Chen. All rights reserved.
+//
+
+#pragma once
+
+#include <cstdint>
+
+namespace ss {
+
+/// Unicode properties and simple case mappings of code points. The records are looked up in two stages: the high bits
+/// of the code point pick a block of record indices in `kStage2`, and the low bits pick the record in the block. The
+/// tables are generated by UnicodeTables.py.
+class Unicode final {
+public:
+    enum : uint8_t {
+        kSpace = 1,
+        kAlpha = 2,
+        kUpper = 4,
+        kLower = 8
+    };
+
+    enum : uint32_t {
+        kBlockBits = 7,
+        kCodePoints = 0x110000
+    };
+
+    struct Record {
+        uint8_t flags;
+        // Differences to the mapped code points, 0 if a code point maps to itself or to several code points
+        int32_t upper;
+        int32_t lower;
+        int32_t fold;
+    };
+
+    static const Record& Lookup(uint32_t c)
+    {
+        if (c >= kCodePoints) {
+            return kRecords[0];
+        }
+        uint32_t block = kStage1[c >> kBlockBits];
+        return kRecords[kStage2[(block << kBlockBits) | (c & ((1u << kBlockBits) - 1))]];
+    }
+
+    static bool IsSpace(uint32_t c)
+    {
+        if (c < 64) {
+            // \t \n \v \f \r and space
+            return ((uint64_t(0x100003E00) >> c) & 1u) != 0;
+        }
+        return c >= 0x80 && (Lookup(c).flags & kSpace) != 0;
+    }
+
+    static bool Is(uint32_t c, uint8_t flag)
+    {
+        return (Lookup(c).flags & flag) != 0;
+    }
+
+    static uint32_t ToUpper(uint32_t c)
+    {
+        return c + uint32_t(Lookup(c).upper);
+    }
+
+    static uint32_t ToLower(uint32_t c)
+    {
+        return c + uint32_t(Lookup(c).lower);
+    }
+
+    /// Simple case folding, code points which differ only in case fold to the same one
+    static uint32_t Fold(uint32_t c)
+    {
+        return c + uint32_t(Lookup(c).fold);
+    }
+
+    /// Copy the leading ASCII characters of `src` to `dst` converting them to upper case, stops at the first non ASCII
+    /// character, returns the number of the copied characters. `src` and `dst` may be the same.
+    static uint32_t AsciiToUpper(const uint8_t* src, uint8_t* dst, uint32_t n);
+    static uint32_t AsciiToLower(const uint8_t* src, uint8_t* dst, uint32_t n);
+
+    /// Number of the leading ASCII characters of `a` and `b` which are equal ignoring case
+    static uint32_t AsciiEqualIgnoreCase(const uint8_t* a, const uint8_t* b, uint32_t n);
+
+private:
+    static const Record kRecords[];
+    static const uint8_t kStage1[];
+    static const uint8_t kStage2[];
+};
+
+}
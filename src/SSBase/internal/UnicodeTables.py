@@ -0,0 +1,88 @@
+#!/usr/bin/env python3
+#
+# Copyright (c) 2020 Carl Chen. All rights reserved.
+#
+# Generates UnicodeTables.cpp from the Unicode database of the running Python:
+#     python3 UnicodeTables.py > UnicodeTables.cpp
+#
+# Every code point maps to a record of its properties and simple (one to one) case mappings. The records are looked up
+# in two stages: the high bits of the code point pick a block of the record indices, and identical blocks are stored
+# once, which keeps the tables small.
+
+import unicodedata
+
+BLOCK_BITS = 7
+CODE_POINTS = 0x110000
+
+# See CharSequence::IsWhiteSpace
+SPACES = {0x9, 0xA, 0xB, 0xC, 0xD, 0x20, 0x85, 0xA0, 0x1680, 0x2028, 0x2029, 0x202F, 0x205F, 0x3000}
+SPACES |= set(range(0x2000, 0x200B))
+
+SPACE, ALPHA, UPPER, LOWER = 1, 2, 4, 8
+
+
+def simple_mapping(cp, mapped):
+    return ord(mapped) - cp if len(mapped) == 1 else 0
+
+
+def record_of(cp):
+    c = chr(cp)
+    flags = 0
+    if cp in SPACES:
+        flags |= SPACE
+    if c.isalpha():
+        flags |= ALPHA
+    if c.isupper():
+        flags |= UPPER
+    if c.islower():
+        flags |= LOWER
+    upper = simple_mapping(cp, c.upper())
+    lower = simple_mapping(cp, c.lower())
+    # Simple case folding, characters folded to several ones (e.g. U+00DF to "ss") fold to their lowercase
+    fold = simple_mapping(cp, c.casefold()) if len(c.casefold()) == 1 else lower
+    return flags, upper, lower, fold
+
+
+def main():
+    records = {}
+    indices = [records.setdefault(record_of(cp), len(records)) for cp in range(CODE_POINTS)]
+    block_size = 1 << BLOCK_BITS
+    blocks = {}
+    stage1 = []
+    for start in range(0, CODE_POINTS, block_size):
+        stage1.append(blocks.setdefault(tuple(indices[start:start + block_size]), len(blocks)))
+    assert len(records) <= 256 and len(blocks) <= 256
+
+    print('//')
+    print('// Copyright (c) 2020 Carl Chen. All rights reserved.')
+    print('//')
+    print()
+    print('// Generated by UnicodeTables.py from the Unicode %s database, do not edit.' % unicodedata.unidata_version)
+    print()
+    print('#include "Unicode.h"')
+    print()
+    print('namespace ss {')
+    print()
+    print('static_assert(Unicode::kBlockBits == %d, "Regenerate the tables");' % BLOCK_BITS)
+    print()
+    print('const Unicode::Record Unicode::kRecords[%d] = {' % len(records))
+    for flags, upper, lower, fold in sorted(records, key=records.get):
+        print('    { %d, %d, %d, %d },' % (flags, upper, lower, fold))
+    print('};')
+    print()
+    print('const uint8_t Unicode::kStage1[%d] = {' % len(stage1))
+    for i in range(0, len(stage1), 32):
+        print('    ' + ', '.join(str(b) for b in stage1[i:i + 32]) + ',')
+    print('};')
+    print()
+    print('const uint8_t Unicode::kStage2[%d] = {' % (len(blocks) * block_size))
+    for block in sorted(blocks, key=blocks.get):
+        for i in range(0, block_size, 32):
+            print('    ' + ', '.join(str(r) for r in block[i:i + 32]) + ',')
+    print('};')
+    print()
+    print('}')
+
+
+if __name__ == '__main__':
+    main()
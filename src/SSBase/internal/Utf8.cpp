@@ -0,0 +1,529 @@
+//
+// Copyright (c) 2020 Carl Chen. All rights reserved.
+//
+
+#include "Utf8.h"
+#include "Simd.h"
+#include <cstring>
+
+namespace ss {
+
+namespace {
+
+void ThrowBadSlave()
+{
+    throw std::runtime_error("The utf8 slave char in sequence is incorrect");
+}
+
+struct ScanState {
+    uint32_t pos;
+    uint32_t count;
+    uint8_t maxLead;
+};
+
+/// True if the 8 bytes are all ASCII and none of them is '\0'
+inline bool IsAsciiWord(const uint8_t* s)
+{
+    uint64_t w;
+    memcpy(&w, s, sizeof(w));
+    // Without the high bits set, `w - 0x01..01` borrows to the high bit of a byte only if the byte is 0
+    return ((w | (w - 0x0101010101010101ull)) & 0x8080808080808080ull) == 0;
+}
+
+/// Scan code points until `st.pos` reaches `end`, returns false if a terminator ('\0' or an invalid lead byte) is met
+bool ScanScalar(const uint8_t* s, uint32_t end, uint32_t bytesCount, ScanState& st)
+{
+    uint32_t pos = st.pos;
+    uint32_t count = st.count;
+    bool more = true;
+    while (pos < end) {
+        if (end - pos >= 8 && IsAsciiWord(s + pos)) {
+            pos += 8;
+            count += 8;
+            continue;
+        }
+        uint8_t lead = s[pos];
+        if (uint8_t(lead - 1u) < 0x7Fu) {
+            ++pos;
+            ++count;
+            continue;
+        }
+        size_t size = lead == 0 ? size_t(-1) : utf8::char_size([lead]() { return lead; });
+        if (size == size_t(-1)) {
+            more = false;
+            break;
+        }
+        if (size > bytesCount - pos) {
+            ThrowBadSlave();
+        }
+        for (size_t k = 1; k < size; ++k) {
+            if ((s[pos + k] & 0xC0u) != 0x80u) {
+                ThrowBadSlave();
+            }
+        }
+        if (lead > st.maxLead) {
+            st.maxLead = lead;
+        }
+        ++count;
+        pos += uint32_t(size);
+    }
+    st.pos = pos;
+    st.count = count;
+    return more;
+}
+
+template <class T>
+void DecodeScalar(const uint8_t* s, uint32_t& pos, uint32_t end, T*& out)
+{
+    uint32_t index = pos;
+    T* o = out;
+    while (index < end) {
+        if (end - index >= 8 && IsAsciiWord(s + index)) {
+            for (uint32_t k = 0; k < 8; ++k) {
+                o[k] = T(s[index + k]);
+            }
+            index += 8;
+            o += 8;
+            continue;
+        }
+        if (s[index] < 0x80u) {
+            *o++ = T(s[index++]);
+            continue;
+        }
+        const uint8_t* p = s + index;
+        *o++ = T(utf8::read([&p]() -> utf8::char_type { return *p++; }));
+        index = uint32_t(p - s);
+    }
+    pos = index;
+    out = o;
+}
+
+/// Returns false if there is not enough space
+template <class T>
+bool EncodeScalar(const T* units, uint32_t& index, uint32_t end, uint8_t* out, uint32_t& written, uint32_t capacity)
+{
+    for (; index < end; ++index) {
+        uint32_t cp = units[index];
+        if (cp < 0x80u) {
+            if (written == capacity) {
+                return false;
+            }
+            out[written++] = uint8_t(cp);
+            continue;
+        }
+        uint32_t size = cp < 0x800u ? 2 : (cp < 0x10000u ? 3 : (cp < 0x200000u ? 4 : (cp < 0x4000000u ? 5 : 6)));
+        if (capacity - written < size) {
+            return false;
+        }
+        utf8::write(cp, [out, &written](utf8::char_type c) { out[written++] = c; });
+    }
+    return true;
+}
+
+/// Bit i of each mask describes byte i of a block
+struct BlockMasks {
+    uint32_t nonAscii;
+    uint32_t cont; // 10xx_xxxx
+    uint32_t lead2; // 11xx_xxxx
+    uint32_t lead3; // 111x_xxxx
+    uint32_t lead4; // 1111_xxxx
+    uint32_t stop; // '\0' and the 5, 6 bytes leads, which are left to the scalar code
+};
+
+/// Returns the number of bytes of the complete code points at the start of a block of `bits` bytes, or 0 if the block
+/// should be scanned by the scalar code
+inline uint32_t ScanBlock(const BlockMasks& m, uint32_t bits, ScanState& st)
+{
+    uint32_t all = bits == 32 ? 0xFFFFFFFFu : (1u << bits) - 1u;
+    if (m.stop != 0) {
+        return 0;
+    }
+    if (m.nonAscii == 0) {
+        st.count += bits;
+        return bits;
+    }
+    // Every lead byte requires the following 1 to 3 bytes to be continuation bytes, and no others may be
+    uint64_t expected = (uint64_t(m.lead2) << 1u) | (uint64_t(m.lead3) << 2u) | (uint64_t(m.lead4) << 3u);
+    if (((uint32_t(expected) ^ m.cont) & all) != 0) {
+        return 0;
+    }
+    uint32_t starts = ~m.cont & all;
+    uint32_t used = bits;
+    if ((expected >> bits) != 0) {
+        // The last code point continues in the next block
+        used = Simd::HighestBit(starts);
+        starts &= (1u << used) - 1u;
+    }
+    st.count += Simd::PopCount(starts);
+    return used;
+}
+
+#ifdef SS_SIMD_X86
+
+inline uint32_t MaskEq(__m128i v, uint8_t bits, uint8_t value)
+{
+    __m128i masked = _mm_and_si128(v, _mm_set1_epi8(char(bits)));
+    return uint32_t(_mm_movemask_epi8(_mm_cmpeq_epi8(masked, _mm_set1_epi8(char(value)))));
+}
+
+inline uint8_t MaxByte(__m128i v)
+{
+    v = _mm_max_epu8(v, _mm_srli_si128(v, 8));
+    v = _mm_max_epu8(v, _mm_srli_si128(v, 4));
+    v = _mm_max_epu8(v, _mm_srli_si128(v, 2));
+    v = _mm_max_epu8(v, _mm_srli_si128(v, 1));
+    return uint8_t(_mm_cvtsi128_si32(v));
+}
+
+/// Returns false if a terminator is met
+bool ScanSse2(const uint8_t* s, uint32_t bytesCount, ScanState& st)
+{
+    __m128i vmax = _mm_setzero_si128();
+    bool more = true;
+    while (bytesCount - st.pos >= 16) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + st.pos));
+        BlockMasks m {};
+        m.nonAscii = uint32_t(_mm_movemask_epi8(v));
+        m.stop = uint32_t(_mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_setzero_si128())));
+        if (m.nonAscii != 0) {
+            m.cont = MaskEq(v, 0xC0, 0x80);
+            m.lead2 = MaskEq(v, 0xC0, 0xC0);
+            m.lead3 = MaskEq(v, 0xE0, 0xE0);
+            m.lead4 = MaskEq(v, 0xF0, 0xF0);
+            m.stop |= MaskEq(v, 0xF8, 0xF8);
+        }
+        uint32_t used = ScanBlock(m, 16, st);
+        if (used == 0) {
+            if (!ScanScalar(s, st.pos + 16, bytesCount, st)) {
+                more = false;
+                break;
+            }
+            continue;
+        }
+        if (m.nonAscii != 0) {
+            vmax = _mm_max_epu8(vmax, v);
+        }
+        st.pos += used;
+    }
+    uint8_t maxLead = MaxByte(vmax);
+    st.maxLead = maxLead > st.maxLead ? maxLead : st.maxLead;
+    return more;
+}
+
+SS_TARGET_AVX2 inline uint32_t MaskEq(__m256i v, uint8_t bits, uint8_t value)
+{
+    __m256i masked = _mm256_and_si256(v, _mm256_set1_epi8(char(bits)));
+    return uint32_t(_mm256_movemask_epi8(_mm256_cmpeq_epi8(masked, _mm256_set1_epi8(char(value)))));
+}
+
+SS_TARGET_AVX2 bool ScanAvx2(const uint8_t* s, uint32_t bytesCount, ScanState& st)
+{
+    __m256i vmax = _mm256_setzero_si256();
+    bool more = true;
+    while (bytesCount - st.pos >= 32) {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(s + st.pos));
+        BlockMasks m {};
+        m.nonAscii = uint32_t(_mm256_movemask_epi8(v));
+        m.stop = uint32_t(_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, _mm256_setzero_si256())));
+        if (m.nonAscii != 0) {
+            m.cont = MaskEq(v, 0xC0, 0x80);
+            m.lead2 = MaskEq(v, 0xC0, 0xC0);
+            m.lead3 = MaskEq(v, 0xE0, 0xE0);
+            m.lead4 = MaskEq(v, 0xF0, 0xF0);
+            m.stop |= MaskEq(v, 0xF8, 0xF8);
+        }
+        uint32_t used = ScanBlock(m, 32, st);
+        if (used == 0) {
+            if (!ScanScalar(s, st.pos + 32, bytesCount, st)) {
+                more = false;
+                break;
+            }
+            continue;
+        }
+        if (m.nonAscii != 0) {
+            vmax = _mm256_max_epu8(vmax, v);
+        }
+        st.pos += used;
+    }
+    __m128i vmax128 = _mm_max_epu8(_mm256_castsi256_si128(vmax), _mm256_extracti128_si256(vmax, 1));
+    uint8_t maxLead = MaxByte(vmax128);
+    st.maxLead = maxLead > st.maxLead ? maxLead : st.maxLead;
+    return more;
+}
+
+inline void StoreAscii(uint8_t* out, __m128i v)
+{
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out), v);
+}
+
+inline void StoreAscii(uint16_t* out, __m128i v)
+{
+    __m128i zero = _mm_setzero_si128();
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out), _mm_unpacklo_epi8(v, zero));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 8), _mm_unpackhi_epi8(v, zero));
+}
+
+inline void StoreAscii(uint32_t* out, __m128i v)
+{
+    __m128i zero = _mm_setzero_si128();
+    __m128i lo = _mm_unpacklo_epi8(v, zero);
+    __m128i hi = _mm_unpackhi_epi8(v, zero);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out), _mm_unpacklo_epi16(lo, zero));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 4), _mm_unpackhi_epi16(lo, zero));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 8), _mm_unpacklo_epi16(hi, zero));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 12), _mm_unpackhi_epi16(hi, zero));
+}
+
+template <class T>
+void DecodeSse2(const uint8_t* s, uint32_t bytesCount, T* out)
+{
+    uint32_t pos = 0;
+    while (bytesCount - pos >= 16) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + pos));
+        if (_mm_movemask_epi8(v) == 0) {
+            StoreAscii(out, v);
+            pos += 16;
+            out += 16;
+            continue;
+        }
+        DecodeScalar(s, pos, pos + 16, out);
+    }
+    DecodeScalar(s, pos, bytesCount, out);
+}
+
+SS_TARGET_AVX2 inline void StoreAscii(uint8_t* out, __m256i v)
+{
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(out), v);
+}
+
+SS_TARGET_AVX2 inline void StoreAscii(uint16_t* out, __m256i v)
+{
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(out), _mm256_cvtepu8_epi16(_mm256_castsi256_si128(v)));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + 16), _mm256_cvtepu8_epi16(_mm256_extracti128_si256(v, 1)));
+}
+
+SS_TARGET_AVX2 inline void StoreAscii(uint32_t* out, __m256i v)
+{
+    __m128i lo = _mm256_castsi256_si128(v);
+    __m128i hi = _mm256_extracti128_si256(v, 1);
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(out), _mm256_cvtepu8_epi32(lo));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + 8), _mm256_cvtepu8_epi32(_mm_srli_si128(lo, 8)));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + 16), _mm256_cvtepu8_epi32(hi));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + 24), _mm256_cvtepu8_epi32(_mm_srli_si128(hi, 8)));
+}
+
+template <class T>
+SS_TARGET_AVX2 void DecodeAvx2(const uint8_t* s, uint32_t bytesCount, T* out)
+{
+    uint32_t pos = 0;
+    while (bytesCount - pos >= 32) {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(s + pos));
+        if (_mm256_movemask_epi8(v) == 0) {
+            StoreAscii(out, v);
+            pos += 32;
+            out += 32;
+            continue;
+        }
+        DecodeScalar(s, pos, pos + 32, out);
+    }
+    DecodeScalar(s, pos, bytesCount, out);
+}
+
+/// Load 16 units and narrow them to bytes, returns false if they are not all ASCII
+inline bool LoadAscii(const uint8_t* units, __m128i* v)
+{
+    *v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(units));
+    return _mm_movemask_epi8(*v) == 0;
+}
+
+inline bool LoadAscii(const uint16_t* units, __m128i* v)
+{
+    __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(units));
+    __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(units + 8));
+    __m128i high = _mm_and_si128(_mm_or_si128(a, b), _mm_set1_epi16(short(0xFF80)));
+    if (_mm_movemask_epi8(_mm_cmpeq_epi16(high, _mm_setzero_si128())) != 0xFFFF) {
+        return false;
+    }
+    *v = _mm_packus_epi16(a, b);
+    return true;
+}
+
+inline bool LoadAscii(const uint32_t* units, __m128i* v)
+{
+    __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(units));
+    __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(units + 4));
+    __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i*>(units + 8));
+    __m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i*>(units + 12));
+    __m128i all = _mm_or_si128(_mm_or_si128(a, b), _mm_or_si128(c, d));
+    __m128i high = _mm_and_si128(all, _mm_set1_epi32(int(0xFFFFFF80)));
+    if (_mm_movemask_epi8(_mm_cmpeq_epi32(high, _mm_setzero_si128())) != 0xFFFF) {
+        return false;
+    }
+    *v = _mm_packus_epi16(_mm_packs_epi32(a, b), _mm_packs_epi32(c, d));
+    return true;
+}
+
+template <class T>
+uint32_t EncodeSse2(const T* units, uint32_t count, uint8_t* out, uint32_t capacity)
+{
+    uint32_t index = 0;
+    uint32_t written = 0;
+    while (count - index >= 16 && capacity - written >= 16) {
+        __m128i v;
+        if (LoadAscii(units + index, &v)) {
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out + written), v);
+            index += 16;
+            written += 16;
+        } else if (!EncodeScalar(units, index, index + 16, out, written, capacity)) {
+            return Utf8Codec::kNoSpace;
+        }
+    }
+    return EncodeScalar(units, index, count, out, written, capacity) ? written : uint32_t(Utf8Codec::kNoSpace);
+}
+
+SS_TARGET_AVX2 inline bool LoadAscii(const uint8_t* units, __m256i* v)
+{
+    *v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(units));
+    return _mm256_movemask_epi8(*v) == 0;
+}
+
+SS_TARGET_AVX2 inline bool LoadAscii(const uint16_t* units, __m256i* v)
+{
+    __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(units));
+    __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(units + 16));
+    if (!_mm256_testz_si256(_mm256_or_si256(a, b), _mm256_set1_epi16(short(0xFF80)))) {
+        return false;
+    }
+    // Packing works on each 128 bits lane, put the 64 bits quarters back in order
+    *v = _mm256_permute4x64_epi64(_mm256_packus_epi16(a, b), 0xD8);
+    return true;
+}
+
+SS_TARGET_AVX2 inline bool LoadAscii(const uint32_t* units, __m256i* v)
+{
+    __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(units));
+    __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(units + 8));
+    __m256i c = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(units + 16));
+    __m256i d = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(units + 24));
+    __m256i all = _mm256_or_si256(_mm256_or_si256(a, b), _mm256_or_si256(c, d));
+    if (!_mm256_testz_si256(all, _mm256_set1_epi32(int(0xFFFFFF80)))) {
+        return false;
+    }
+    __m256i ab = _mm256_permute4x64_epi64(_mm256_packs_epi32(a, b), 0xD8);
+    __m256i cd = _mm256_permute4x64_epi64(_mm256_packs_epi32(c, d), 0xD8);
+    *v = _mm256_permute4x64_epi64(_mm256_packus_epi16(ab, cd), 0xD8);
+    return true;
+}
+
+template <class T>
+SS_TARGET_AVX2 uint32_t EncodeAvx2(const T* units, uint32_t count, uint8_t* out, uint32_t capacity)
+{
+    uint32_t index = 0;
+    uint32_t written = 0;
+    while (count - index >= 32 && capacity - written >= 32) {
+        __m256i v;
+        if (LoadAscii(units + index, &v)) {
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + written), v);
+            index += 32;
+            written += 32;
+            continue;
+        }
+        // Some compilers omit this before calling the non-AVX code, which makes the SSE code afterwards much slower
+        _mm256_zeroupper();
+        if (!EncodeScalar(units, index, index + 32, out, written, capacity)) {
+            return Utf8Codec::kNoSpace;
+        }
+    }
+    _mm256_zeroupper();
+    return EncodeScalar(units, index, count, out, written, capacity) ? written : uint32_t(Utf8Codec::kNoSpace);
+}
+
+#endif
+
+template <class T>
+void Decode(const uint8_t* s, uint32_t bytesCount, T* out)
+{
+#ifdef SS_SIMD_X86
+    // Short ones are not worth the AVX2 kernels
+    if (bytesCount >= 32 && Simd::HasAvx2()) {
+        DecodeAvx2(s, bytesCount, out);
+    } else {
+        DecodeSse2(s, bytesCount, out);
+    }
+#else
+    uint32_t pos = 0;
+    DecodeScalar(s, pos, bytesCount, out);
+#endif
+}
+
+template <class T>
+uint32_t Encode(const T* units, uint32_t count, uint8_t* out, uint32_t capacity)
+{
+#ifdef SS_SIMD_X86
+    if (count >= 32 && Simd::HasAvx2()) {
+        return EncodeAvx2(units, count, out, capacity);
+    }
+    return EncodeSse2(units, count, out, capacity);
+#else
+    uint32_t index = 0;
+    uint32_t written = 0;
+    return EncodeScalar(units, index, count, out, written, capacity) ? written : uint32_t(Utf8Codec::kNoSpace);
+#endif
+}
+
+}
+
+uint32_t Utf8Codec::Scan(const char* utf8, uint32_t bytesCount, uint32_t* bytesUsed, uint32_t* width)
+{
+    if (bytesCount == uint32_t(-1)) {
+        bytesCount = uint32_t(strlen(utf8));
+    }
+    auto* s = reinterpret_cast<const uint8_t*>(utf8);
+    ScanState st { 0, 0, 0 };
+    bool more = true;
+#ifdef SS_SIMD_X86
+    if (bytesCount >= 32 && Simd::HasAvx2()) {
+        more = ScanAvx2(s, bytesCount, st);
+    } else if (bytesCount >= 16) {
+        more = ScanSse2(s, bytesCount, st);
+    }
+#endif
+    if (more) {
+        ScanScalar(s, bytesCount, bytesCount, st);
+    }
+    *bytesUsed = st.pos;
+    // 0xC0 ~ 0xC3 leads 2 bytes code points not larger than 0xFF, 0xE0 ~ 0xEF leads 3 bytes ones not larger than 0xFFFF
+    *width = st.maxLead < 0xC4 ? 1 : (st.maxLead < 0xF0 ? 2 : 4);
+    return st.count;
+}
+
+void Utf8Codec::Decode(const char* utf8, uint32_t bytesCount, void* units, uint32_t width)
+{
+    auto* s = reinterpret_cast<const uint8_t*>(utf8);
+    switch (width) {
+    case 1:
+        ss::Decode(s, bytesCount, static_cast<uint8_t*>(units));
+        break;
+    case 2:
+        ss::Decode(s, bytesCount, static_cast<uint16_t*>(units));
+        break;
+    default:
+        ss::Decode(s, bytesCount, static_cast<uint32_t*>(units));
+        break;
+    }
+}
+
+uint32_t Utf8Codec::Encode(const void* units, uint32_t width, uint32_t count, char* out, uint32_t capacity)
+{
+    auto* o = reinterpret_cast<uint8_t*>(out);
+    switch (width) {
+    case 1:
+        return ss::Encode(static_cast<const uint8_t*>(units), count, o, capacity);
+    case 2:
+        return ss::Encode(static_cast<const uint16_t*>(units), count, o, capacity);
+    default:
+        return ss::Encode(static_cast<const uint32_t*>(units), count, o, capacity);
+    }
+}
+
+}
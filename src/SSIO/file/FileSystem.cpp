@@ -43,32 +43,28 @@ String FileSystem::GetRelativePath(const CharSequence& path, const CharSequence&
 {
     String absolutePath = GetAbsolutePath(path);
     String relativeToAbsolute = relativeTo.Empty() ? GetCWD() : GetAbsolutePath(relativeTo);
-    std::vector<StringView> paths = absolutePath.Split(kInternalSeparator);
-    std::vector<StringView> relativeToPaths = relativeToAbsolute.Split(kInternalSeparator);
-
-    size_t index = 0;
-    while (index < paths.size() && index < relativeToPaths.size()) {
-        if (paths[index] != relativeToPaths[index]) {
-            break;
-        }
-        ++index;
+    StrTokenizer paths = absolutePath.Tokenize(kInternalSeparator);
+    StrTokenizer relativeToPaths = relativeToAbsolute.Tokenize(kInternalSeparator);
+
+    auto it = paths.begin();
+    auto relativeToIt = relativeToPaths.begin();
+    while (it != paths.end() && relativeToIt != relativeToPaths.end() && *it == *relativeToIt) {
+        ++it;
+        ++relativeToIt;
     }
 
     // path       = /a/b/c/d/e
     // relativeTo = /a/b/f/g/h
     // result     = ../../../c/d/e
     String result;
-    size_t numDotDot = relativeToPaths.size() - index;
-
-    for (size_t i = 0; i < numDotDot; ++i) {
+    char separator = internalSeparator ? kInternalSeparator : kSeparator;
+    for (; relativeToIt != relativeToPaths.end(); ++relativeToIt) {
         result += "..";
-        result += internalSeparator ? kInternalSeparator : kSeparator;
+        result += separator;
     }
-
-    size_t numDirs = paths.size() - index;
-    for (size_t i = 0; i < numDirs; ++i) {
-        result += paths[i + index];
-        result += internalSeparator ? kInternalSeparator : kSeparator;
+    for (; it != paths.end(); ++it) {
+        result += *it;
+        result += separator;
     }
 
     if (result.Empty()) {
@@ -339,7 +335,7 @@ std::vector<String> FileSystem::ListFiles(const CharSequence& path, bool interna
     HANDLE hFind = NULL;
 
     //Specify a file mask. *.* = We want everything!
-    std::wstring pattern = (normalizedPath + "\\*").ToStdWString();
+    std::wstring pattern = String(normalizedPath + "\\*").ToStdWString();
 
     std::vector<String> result;
     if ((hFind = FindFirstFileW(pattern.c_str(), &fdFile)) == INVALID_HANDLE_VALUE) {
@@ -392,7 +388,7 @@ std::vector<String> FileSystem::ListFileNames(const CharSequence& path, const Fi
     HANDLE hFind = NULL;
 
     //Specify a file mask. *.* = We want everything!
-    std::wstring pattern = (path + "\\*").ToStdWString();
+    std::wstring pattern = String(path + "\\*").ToStdWString();
 
     std::vector<String> result;
     if ((hFind = FindFirstFileW(pattern.c_str(), &fdFile)) == INVALID_HANDLE_VALUE) {
@@ -418,30 +414,42 @@ std::vector<String> FileSystem::ListFileNames(const CharSequence& path, const Fi
 
 String FileSystem::RemoveDotDotInternal(const CharSequence& path, char separator)
 {
-    std::vector<StringView> paths = path.Split(separator);
-    std::vector<const CharSequence*> stack;
+    const String kDot = ".";
     const String kDotDot = "..";
+    StrTokenizer components = path.Tokenize(separator);
 
-    for (auto& sv : paths) {
-        if (sv == "..") {
-            if (!stack.empty() && *stack[stack.size() - 1] != "..") {
+    // Most paths have no dot components, and are returned without being split
+    bool hasDots = false;
+    for (auto it = components.begin(); it != components.end() && !hasDots; ++it) {
+        hasDots = it.Length() <= 2 && (*it == kDot || *it == kDotDot);
+    }
+    if (!hasDots) {
+        return path;
+    }
+
+    // The views borrow the characters of `path`, which must outlive them, no component is copied until the result is
+    // built
+    std::vector<StringView> stack;
+    for (StringView sv : components) {
+        if (sv == kDotDot) {
+            if (!stack.empty() && stack.back() != kDotDot) {
                 stack.pop_back();
             } else {
-                stack.push_back(&kDotDot);
+                stack.push_back(std::move(sv));
             }
-        } else if (sv == ".") {
-        } else {
-            stack.push_back(&sv);
+        } else if (sv != kDot) {
+            stack.push_back(std::move(sv));
         }
     }
 
     String result;
+    result.Reserve(path.Length());
     if (!stack.empty()) {
         auto it = stack.begin();
-        result += **it;
+        result += *it;
         for (++it; it < stack.end(); ++it) {
             result += separator;
-            result += **it;
+            result += *it;
         }
     }
     return result;
@@ -453,24 +461,31 @@ bool FileSystem::IsSeparatorInternal(CharSequence::CharType c)
 
 void FileSystem::NormalizeSeparatorInternal(String& path, char separator)
 {
+    // Read through a const reference, and write through the references of `path` only the characters which change,
+    // so the string is edited in place without being copied or widened
+    const String& src = path;
     uint32_t i = 0, j = 0;
-    while (j < path.Length()) {
-        if (IsSeparatorInternal(path[j])) {
-            path[i].code = separator;
+    while (j < src.Length()) {
+        if (IsSeparatorInternal(src[j])) {
+            if (i != j || src[j].code != uint32_t(separator)) {
+                path[i] = separator;
+            }
             ++i;
             ++j;
             // Skip the rest continuous separators
-            while (j < path.Length() && IsSeparatorInternal(path[j])) {
+            while (j < src.Length() && IsSeparatorInternal(src[j])) {
                 ++j;
             }
         } else {
-            path[i] = path[j];
+            if (i != j) {
+                path[i] = src[j];
+            }
             ++i;
             ++j;
         }
     }
     SSASSERT(i > 0);
-    if (path.EndsWith(separator))
+    if (src[i - 1].code == uint32_t(separator))
         --i;
     path.Resize(i);
 }
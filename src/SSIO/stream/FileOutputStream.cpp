@@ -4,6 +4,10 @@
 
 #include "FileOutputStream.h"
 #include "StreamConstant.h"
+#ifdef SS_PLATFORM_UNIX
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
 
 namespace ss {
 
@@ -40,6 +44,40 @@ int32_t FileOutputStream::Write(const void* data, uint32_t count)
     return int32_t(c);
 }
 
+int32_t FileOutputStream::WriteSpans(const BufferSpan* spans, uint32_t count)
+{
+#ifdef SS_PLATFORM_UNIX
+    SSASSERT(filePtr_ != nullptr);
+    // Bypass the buffer of the FILE, after what has been buffered so far
+    if (fflush(filePtr_) != 0) {
+        return StreamConstant::ErrorCode::kUnknown;
+    }
+    int fd = fileno(filePtr_);
+    int32_t c = 0;
+    iovec iov[64];
+    while (count > 0) {
+        uint32_t n = count < 64 ? count : 64;
+        size_t total = 0;
+        for (uint32_t i = 0; i < n; ++i) {
+            iov[i].iov_base = spans[i].data;
+            iov[i].iov_len = spans[i].size;
+            total += spans[i].size;
+        }
+        // writev of a regular file only writes less on error, e.g. when the disk is full
+        ssize_t written = writev(fd, iov, int(n));
+        if (written < 0 || size_t(written) < total) {
+            return StreamConstant::ErrorCode::kUnknown;
+        }
+        c += int32_t(written);
+        spans += n;
+        count -= n;
+    }
+    return c;
+#else
+    return OutputStream::WriteSpans(spans, count);
+#endif
+}
+
 void FileOutputStream::Close()
 {
     if (filePtr_ != nullptr) {
@@ -22,6 +22,8 @@ public:
 
     int32_t Write(const void* data, uint32_t count) override;
 
+    int32_t WriteSpans(const BufferSpan* spans, uint32_t count) override;
+
     void Close() override;
 
     bool IsValid() const override;
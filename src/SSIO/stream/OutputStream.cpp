@@ -22,4 +22,43 @@ int32_t OutputStream::Write(const void* buf, uint32_t count)
     return c;
 }
 
+int32_t OutputStream::WriteSpans(const BufferSpan* spans, uint32_t count)
+{
+    int32_t c = 0;
+    for (uint32_t i = 0; i < count; ++i) {
+        int32_t ret = Write(spans[i].data, spans[i].size);
+        if (ret < 0) {
+            return ret;
+        }
+        c += ret;
+        if (uint32_t(ret) < spans[i].size) {
+            break;
+        }
+    }
+    return c;
+}
+
+int32_t WriteTo(OutputStream& stream, const ChainBuffer& chain)
+{
+    BufferSpan spans[64];
+    int32_t c = 0;
+    for (uint32_t first = 0; first < chain.SegmentsCount();) {
+        uint32_t count = chain.GetReadableSpans(spans, 64, first);
+        int32_t ret = stream.WriteSpans(spans, count);
+        if (ret < 0) {
+            return ret;
+        }
+        c += ret;
+        uint64_t size = 0;
+        for (uint32_t i = 0; i < count; ++i) {
+            size += spans[i].size;
+        }
+        if (uint64_t(ret) < size) {
+            break; // The stream takes no more for now, the next batch must not be written after a gap
+        }
+        first += count;
+    }
+    return c;
+}
+
 } // namespace ss
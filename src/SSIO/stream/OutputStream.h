@@ -4,6 +4,7 @@
 
 #pragma once
 
+#include "../../SSBase/ChainBuffer.h"
 #include "../../SSBase/Object.h"
 #include "../../SSBase/Str.h"
 
@@ -27,6 +28,10 @@ public:
     /// NOTE: Invoke Write() function by default, you'd better override it for better performance.
     virtual int32_t Write(const void* data, uint32_t count);
 
+    /// Write the bytes of all the spans in order, returns the actual written bytes number, returns error code on error
+    /// NOTE: Invoke Write() for each span by default, override it if the stream supports vectored writes.
+    virtual int32_t WriteSpans(const BufferSpan* spans, uint32_t count);
+
     /// NOTE: This function is provide here just for early closing a file. The destructor `~InputStream()`
     /// is not able to invoke the overrides of `Close` function, so you may need to release resources
     /// in subclasses' destructors.
@@ -51,4 +56,24 @@ public:
     }
 };
 
+/// Write the text formatted by fmt to `stream` with a single `Write`, returns what `Write` returns. See
+/// `FormatTo(String&, ...)` for the formats. The text is formatted on the stack unless it is long.
+template <class Format, class... Args>
+int32_t FormatTo(OutputStream& stream, const Format& format, const Args&... args)
+{
+    fmt::basic_memory_buffer<char, 512> bytes;
+    internal::FormatToBuffer(bytes, format, args...);
+    return stream.Write(bytes.data(), uint32_t(bytes.size()));
+}
+
+/// Write all the bytes of `chain` by vectored writes, without copying them, returns the written bytes number, returns
+/// error code on error. The writing stops at a short write, so fewer bytes than the chain holds may be written.
+int32_t WriteTo(OutputStream& stream, const ChainBuffer& chain);
+
+/// Write the bytes of `slice`, returns what `Write` returns
+inline int32_t WriteTo(OutputStream& stream, const BufferSlice& slice)
+{
+    return stream.Write(slice.Data(), slice.Size());
+}
+
 } // namespace ss
\ No newline at end of file
@@ -4,6 +4,8 @@
 
 #include "AsyncTcpSocket.h"
 #include "EndPoint.h"
+#include <memory>
+#include <vector>
 
 namespace ss {
 
@@ -22,4 +24,34 @@ int AsyncTcpSocket::Bind(const String& host, uint16_t port)
     return Bind(EndPoint(host, port));
 }
 
+int AsyncTcpSocket::Send(ChainBuffer&& chain, OnSendCb&& cb)
+{
+    if (chain.Empty()) {
+        // Nothing to write, uv_write does not take an empty list of buffers
+        if (cb != nullptr) {
+            cb(0);
+        }
+        return 0;
+    }
+    // OnSendCb has to be copyable, so the chain is shared with it
+    auto holder = std::make_shared<ChainBuffer>(std::move(chain));
+    std::vector<BufferSpan> spans(holder->SegmentsCount());
+    uint32_t count = holder->GetReadableSpans(spans.data(), uint32_t(spans.size()));
+    return Send(spans.data(), count, [holder, cb = std::forward<OnSendCb>(cb)](int status) {
+        if (cb != nullptr) {
+            cb(status);
+        }
+    });
+}
+
+int AsyncTcpSocket::Send(const BufferSlice& slice, OnSendCb&& cb)
+{
+    BufferSpan span = slice.Span();
+    return Send(&span, 1, [slice, cb = std::forward<OnSendCb>(cb)](int status) {
+        if (cb != nullptr) {
+            cb(status);
+        }
+    });
+}
+
 } // namespace ss
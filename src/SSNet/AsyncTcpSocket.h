@@ -4,6 +4,7 @@
 
 #pragma once
 
+#include "../SSBase/ChainBuffer.h"
 #include "../SSBase/Object.h"
 #include "../SSBase/Ptr.h"
 #include "EndPoint.h"
@@ -16,6 +17,9 @@ class AsyncTcpSocket : public Object {
     SS_OBJECT(AsyncTcpSocket, Object);
 
 public:
+    // Handed between the loop thread and the worker threads
+    using RefCountPolicy = MultiThreadPolicy;
+
     using OnConnectCb = std::function<void(int status)>; // status will be 0 in case of success, < 0 otherwise.
     using OnCloseCb = std::function<void()>;
     using OnSendCb = std::function<void(int status)>; // status will be 0 in case of success, < 0 otherwise.
@@ -49,6 +53,18 @@ public:
     // The data pointed by `data` should keey valid untile `cb` is called.
     virtual int Send(const void* data, uint32_t length, OnSendCb&& cb) = 0;
 
+    // Send the bytes of all the spans with a single vectored write. The bytes should keep valid until `cb` is called,
+    // the spans array need not.
+    virtual int Send(const BufferSpan* spans, uint32_t count, OnSendCb&& cb) = 0;
+
+    // Send the bytes of `chain` without copying them, the chain is kept until `cb` is called. An empty chain is not
+    // sent, `cb` is called with success before returning.
+    int Send(ChainBuffer&& chain, OnSendCb&& cb);
+
+    // Send the bytes of `slice` without copying them, a reference is held until `cb` is called. So a payload can be
+    // sent to many sockets without being copied or tracked.
+    int Send(const BufferSlice& slice, OnSendCb&& cb);
+
     virtual int StartReceive(OnDataCb&& cb) = 0;
 
     virtual void StopReceive() = 0;
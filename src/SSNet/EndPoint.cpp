@@ -167,9 +167,11 @@ void EndPoint::InitWithString(const CharSequence& ipAndPort)
         if (index == CharSequence::kNPos) {
             return;
         }
-        StringView ip = ipAndPort.SubStringView(0, index);
-        auto port = Convert::StringTo<uint16_t>(ipAndPort.SubString(index + 1));
-        InitWithIpAndPort(ip, port);
+        uint16_t port;
+        if (!Convert::Parse(ipAndPort, port, index + 1)) {
+            return;
+        }
+        InitWithIpAndPort(ipAndPort.SubStringView(0, index), port);
     } else {
         auto startIndex = ipAndPort.Find("[");
         if (startIndex == CharSequence::kNPos) {
@@ -179,9 +181,11 @@ void EndPoint::InitWithString(const CharSequence& ipAndPort)
         if (endIndex == CharSequence::kNPos) {
             return;
         }
-        StringView ip = ipAndPort.SubStringView(startIndex + 1, endIndex - startIndex - 1);
-        auto port = Convert::StringTo<int16_t>(ipAndPort.SubStringView(endIndex + 2));
-        InitWithIpAndPort(ip, port);
+        uint16_t port;
+        if (!Convert::Parse(ipAndPort, port, endIndex + 2)) {
+            return;
+        }
+        InitWithIpAndPort(ipAndPort.SubStringView(startIndex + 1, endIndex - startIndex - 1), port);
     }
 }
 
@@ -15,6 +15,9 @@ class Loop : public Object {
     SS_OBJECT(Loop, Object);
 
 public:
+    // Sockets and callbacks hold the loop from the worker threads
+    using RefCountPolicy = MultiThreadPolicy;
+
     Loop();
     Loop(const Loop& l) = delete;
     Loop(Loop&& l) = delete;
@@ -5,6 +5,7 @@
 #include "TcpSocket.h"
 #include "../SSIO/stream/InputStream.h"
 #include "../SSIO/stream/OutputStream.h"
+#include "../SSBase/ObjectPool.h"
 #include "EndPoint.h"
 #include "SocketDef.h"
 #include "impl/TcpSocketImpl.h"
@@ -110,7 +111,9 @@ private:
 
 SharedPtr<InputStream> TcpSocket::GetInputStream()
 {
-    return MakeShared<TcpSocketInputStream>(this);
+    // Streams are got per request by the workers, the pool is never destroyed as they may outlive it
+    static auto* pool = new RefCountedPool<TcpSocketInputStream, MultiThreadPolicy>(256);
+    return MakePooled(*pool, this);
 }
 
 class TcpSocketOutputStream : public OutputStream {
@@ -159,7 +162,8 @@ private:
 
 SharedPtr<OutputStream> TcpSocket::GetOutputStream()
 {
-    return MakeShared<TcpSocketOutputStream>(this);
+    static auto* pool = new RefCountedPool<TcpSocketOutputStream, MultiThreadPolicy>(256);
+    return MakePooled(*pool, this);
 }
 
 int TcpSocket::GetLastErrorCode()
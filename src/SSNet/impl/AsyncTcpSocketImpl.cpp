@@ -6,9 +6,27 @@
 #include "../EndPoint.h"
 #include "../EndPointInternal.h"
 #include "../Loop.h"
+#include "../../SSBase/ObjectPool.h"
+#include <vector>
 
 namespace ss {
 
+namespace {
+
+struct WriteReq {
+    uv_write_t req {};
+    AsyncTcpSocket::OnSendCb cb { nullptr };
+};
+
+/// Sends are issued by the loops of all the worker threads, the pool is never destroyed as they may outlive it
+ObjectPool<WriteReq, MultiThreadPolicy>& GetWriteReqPool()
+{
+    static auto* pool = new ObjectPool<WriteReq, MultiThreadPolicy>(1024, { nullptr, [](WriteReq* req) { req->cb = nullptr; } });
+    return *pool;
+}
+
+} // namespace
+
 AsyncTcpSocketImpl::AsyncTcpSocketImpl(Data* data)
     : data_(data)
 {
@@ -118,29 +136,43 @@ SharedPtr<AsyncTcpSocket> AsyncTcpSocketImpl::Accept()
 }
 
 int AsyncTcpSocketImpl::Send(const void* data, uint32_t length, OnSendCb&& cb)
+{
+    BufferSpan span { (uint8_t*)data, length };
+    return Send(&span, 1, std::forward<OnSendCb>(cb));
+}
+
+int AsyncTcpSocketImpl::Send(const BufferSpan* spans, uint32_t count, OnSendCb&& cb)
 {
     // TODO: try send first, then send the rest
     if (data_ == nullptr) {
         return UV_EINVAL;
     }
 
-    struct Req {
-        uv_write_t req {};
-        OnSendCb cb { nullptr };
-    };
-    Req* req = new Req;
+    WriteReq* req = GetWriteReqPool().Get();
     req->cb = std::forward<OnSendCb>(cb);
 
-    uv_buf_t buf;
-    buf.base = (char*)data;
-    buf.len = length;
-    return uv_write((uv_write_t*)req, (uv_stream_t*)data_, &buf, 1, [](uv_write_t* req, int status) {
-        auto* r = (Req*)req;
+    // uv_write copies the uv_buf_t array, so it may live on the stack
+    uv_buf_t stackBufs[16];
+    std::vector<uv_buf_t> heapBufs;
+    uv_buf_t* bufs = stackBufs;
+    if (count > 16) {
+        heapBufs.resize(count);
+        bufs = heapBufs.data();
+    }
+    for (uint32_t i = 0; i < count; ++i) {
+        bufs[i] = uv_buf_init((char*)spans[i].data, spans[i].size);
+    }
+    int ret = uv_write((uv_write_t*)req, (uv_stream_t*)data_, bufs, count, [](uv_write_t* req, int status) {
+        auto* r = (WriteReq*)req;
         if (r->cb != nullptr) {
             r->cb(status);
         }
-        delete r;
+        GetWriteReqPool().Put(r);
     });
+    if (ret != 0) {
+        GetWriteReqPool().Put(req);
+    }
+    return ret;
 }
 
 static void UvAllocCb(uv_handle_t* handle, size_t suggested_size, uv_buf_t* buf)
@@ -67,8 +67,13 @@ public:
 
     SharedPtr<AsyncTcpSocket> Accept() override;
 
+    // Not hidden by the overrides, the overloads of ChainBuffer and BufferSlice send through them
+    using AsyncTcpSocket::Send;
+
     int Send(const void* data, uint32_t length, OnSendCb&& cb) override;
 
+    int Send(const BufferSpan* spans, uint32_t count, OnSendCb&& cb) override;
+
     int StartReceive(OnDataCb&& cb) override;
 
     void StopReceive() override;
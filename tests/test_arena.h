@@ -0,0 +1,110 @@
+//
+// Copyright (c) 2020 Carl Chen. All rights reserved.
+//
+
+#pragma once
+
+#include <SSBase/Arena.h>
+#include <SSBase/Assert.h>
+#include <SSBase/Format.h>
+#include <SSBase/InternedString.h>
+#include <SSBase/ObjectPool.h>
+#include <SSBase/Str.h>
+#include <string>
+#include <vector>
+
+namespace TestArena {
+
+bool test()
+{
+    using namespace ss;
+    alignas(std::max_align_t) char stack[1024];
+    Arena arena(stack, sizeof(stack));
+    String kept;
+    for (int request = 0; request < 3; ++request) {
+        {
+            Arena::Scope scope(arena);
+            String path = String("/users/") + String(L"用户名") + "/" + String(std::to_string(request).c_str());
+            String copy = path;
+            DynamicBuffer body;
+            FormatTo(body, "GET {} HTTP/1.1\r\n", path);
+            for (int i = 0; i < 200; ++i) {
+                body.PushData("0123456789", 10);
+            }
+            SSASSERT(copy == path && body.Size() > 2000 && arena.Allocated() > 2000);
+            kept = path.SubString(7); // Copied, as `kept` is not in the arena
+        }
+        // Copied outside of the scope, so it is kept on the heap
+        String outside = kept;
+        SSASSERT(outside.StartsWith(String(L"用户名")) && arena.Capacity() >= arena.Allocated());
+        arena.Reset();
+        SSASSERT(arena.Allocated() == 0 && outside.EndsWith(String(std::to_string(request).c_str())));
+        SSASSERT(kept == outside);
+    }
+    {
+        // Strings constructed outside of a scope do not allocate from its arena, even if they grow in the scope
+        Arena heapArena;
+        String outlived("short");
+        String original("a string which is long enough to be stored on the heap");
+        const String shared = original;
+        {
+            Arena::Scope scope(heapArena);
+            outlived += " and grown in a scope, which moves it to the heap";
+            std::vector<StringView> words = shared.Split(" ");
+            SSASSERT(words.size() == 12 && outlived.Capacity() > String::kInlineCapacity * sizeof(String::CharType));
+        }
+        heapArena.Release();
+        SSASSERT(outlived == "short and grown in a scope, which moves it to the heap" && shared == original);
+    }
+    {
+        // The interned strings and those constructed in a scope of no arena are kept on the heap
+        Arena requestArena;
+        InternedString id;
+        String kept;
+        {
+            Arena::Scope scope(requestArena);
+            id = InternedString(String("x-request-header-interned-in-a-request-arena"));
+            Arena::Scope heap(nullptr);
+            kept = String("a string constructed on the heap within a request");
+        }
+        requestArena.Reset();
+        {
+            Arena::Scope scope(requestArena);
+            String reused("the next request overwrites the memory of the previous one");
+            SSASSERT(reused.Length() > 32 && requestArena.Allocated() > 0);
+        }
+        SSASSERT(id.GetString() == "x-request-header-interned-in-a-request-arena");
+        requestArena.Release();
+        SSASSERT(id == InternedString("x-request-header-interned-in-a-request-arena") && kept.EndsWith(String("request")));
+    }
+    size_t capacity = arena.Capacity();
+    {
+        Arena::Scope scope(arena);
+        String grown;
+        for (int i = 0; i < 100; ++i) {
+            grown += "abcdefghij"; // The last allocation grows in place
+        }
+        SSASSERT(grown.Length() == 1000 && arena.Capacity() == capacity);
+    }
+    SSASSERT(Arena::Current() == nullptr);
+
+    struct Session {
+        String user;
+        int requests = 0;
+    };
+    Arena poolArena;
+    {
+        ObjectPool<Session> pool(1, &poolArena);
+        Session* a = pool.Get();
+        Session* b = pool.Get();
+        a->user = "alice";
+        pool.Put(a);
+        pool.Put(b); // Over capacity, only destructed
+        SSASSERT(pool.Get() == a && a->user == "alice" && poolArena.Allocated() >= 2 * sizeof(Session));
+        pool.Put(a);
+    }
+    poolArena.Reset();
+    return true;
+}
+
+} // namespace TestArena
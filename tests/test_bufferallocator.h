@@ -0,0 +1,48 @@
+//
+// Copyright (c) 2020 Carl Chen. All rights reserved.
+//
+
+#pragma once
+
+#include <SSBase/Assert.h>
+#include <SSBase/Buffer.h>
+#include <SSBase/BufferAllocator.h>
+#include <thread>
+
+namespace TestBufferAllocator {
+
+bool test()
+{
+    using namespace ss;
+    // Other tests use the allocator too, so only the changes from the start are checked
+    BufferAllocator::Trim();
+    auto before = BufferAllocator::GetStats();
+    for (int i = 0; i < 100; ++i) {
+        DynamicBuffer buffer(64 * 1024); // Recycled after the first round
+        buffer.PushData("x", 1);
+        RingBuffer ring(4096);
+        ring.PushData(buffer.GetData<char>(), 1);
+        buffer.EnsureSpace(128 * 1024);
+    }
+    auto after = BufferAllocator::GetStats();
+    SSASSERT(after.systemAllocations - before.systemAllocations == 3 && after.systemFrees == before.systemFrees);
+
+    // Freed by another thread, it is moved to the depot when the thread exits
+    auto* moved = new DynamicBuffer(8192);
+    std::thread([moved] { delete moved; }).join();
+    SSASSERT(BufferAllocator::GetStats().depotBytes - after.depotBytes == 8192);
+
+    auto policy = BufferAllocator::GetPolicy();
+    BufferAllocator::SetPolicy({ 0, 0 });
+    {
+        DynamicBuffer buffer(8192); // Taken from the depot
+        SSASSERT(BufferAllocator::GetStats().depotBytes == after.depotBytes);
+    }
+    SSASSERT(BufferAllocator::GetStats().systemFrees == after.systemFrees + 1);
+    BufferAllocator::SetPolicy(policy);
+    BufferAllocator::Trim();
+    SSASSERT(BufferAllocator::GetStats().depotBytes == 0);
+    return true;
+}
+
+} // namespace TestBufferAllocator
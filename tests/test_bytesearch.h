@@ -0,0 +1,54 @@
+//
+// Copyright (c) 2020 Carl Chen. All rights reserved.
+//
+
+#pragma once
+
+#include <SSBase/Assert.h>
+#include <SSBase/Buffer.h>
+#include <SSBase/ByteSearch.h>
+#include <string>
+
+namespace TestByteSearch {
+
+bool test()
+{
+    using namespace ss;
+    DynamicBuffer received;
+    const char request[] = "GET /index.html HTTP/1.1\r\nHost: example.com\r\nAccept: */*\r\n\r\nbody";
+    received.PushData(request, sizeof(request) - 1);
+    received.Skip(4); // The offsets are from the data
+    SSASSERT(received.Find('/') == 0 && received.Find(' ') == 11 && received.Find('/', 1) == 16);
+    SSASSERT(received.FindCRLF() == 20 && received.FindCRLF(22) == 39 && received.Find("\r\n\r\n", 4) == 52);
+    SSASSERT(received.FindAny(":\r") == 20 && received.FindAny(ByteSet(":*"), 22) == 26 && received.Find('#') == DynamicBuffer::kNPos);
+    SSASSERT(DynamicBuffer().FindCRLF() == DynamicBuffer::kNPos && DynamicBuffer().FindAny("ab") == DynamicBuffer::kNPos);
+
+    // Every length, position and lookup against a plain loop, for the vector loops and their tails
+    Buffer<256> bytes {};
+    std::string text(200, 'a');
+    for (uint32_t i = 0; i < text.size(); ++i) {
+        text[i] = char('a' + (i * 7) % 23);
+    }
+    bytes.PushData(text.data(), uint32_t(text.size()));
+    const ByteSet sets[] = { ByteSet("xz"), ByteSet("\r\n\t ,;:=&?#"), ByteSet("\x01\x11\x21\x31\x41\x51\x61\x71\x81\x91") };
+    for (uint32_t end = 0; end <= 70; ++end) {
+        for (uint32_t at = 0; at + 1 < end; at += 3) {
+            Buffer<256> scan {};
+            scan.PushData(text.data(), end);
+            scan[at] = '\r';
+            scan[at + 1] = '\n';
+            SSASSERT(scan.FindCRLF() == at && scan.Find('\n') == at + 1 && scan.Find("\r\n", 2) == at);
+            for (const ByteSet& set : sets) {
+                uint32_t expected = Buffer<256>::kNPos;
+                for (uint32_t i = 0; i < end && expected == Buffer<256>::kNPos; ++i) {
+                    expected = set.Contains(scan[i]) ? i : expected;
+                }
+                SSASSERT(scan.FindAny(set) == expected);
+            }
+        }
+    }
+    SSASSERT(bytes.FindCRLF() == Buffer<256>::kNPos && bytes.FindAny(sets[0]) == Buffer<256>::kNPos && bytes.Find("ovf", 3) == 2);
+    return true;
+}
+
+} // namespace TestByteSearch
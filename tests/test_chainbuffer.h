@@ -0,0 +1,57 @@
+//
+// Copyright (c) 2020 Carl Chen. All rights reserved.
+//
+
+#pragma once
+
+#include <SSBase/Assert.h>
+#include <SSBase/Buffer.h>
+#include <SSBase/ChainBuffer.h>
+#include <cstring>
+
+namespace TestChainBuffer {
+
+bool test()
+{
+    using namespace ss;
+    ChainBuffer received;
+    received.PushData("GET / HTTP/1.1\r", 15);
+    DynamicBuffer packet;
+    packet.PushData("\nHost: a\r\n\r\nGET /next", 21);
+    received.Append(std::move(packet)); // Taken over without copying
+    int released = 0;
+    static const char kTail[] = " HTTP/1.1\r\n\r\n";
+    received.AppendReference(kTail, 13, [&released] { ++released; });
+    SSASSERT(packet.Empty() && received.Size() == 49 && received.SegmentsCount() == 3);
+
+    // The delimiters span the segments
+    SSASSERT(received.Find("\r\n", 2) == 14 && received.Find("\r\n\r\n", 4) == 23);
+    SSASSERT(received.Find("1\r\n\r", 4, 24) == 44 && received.Find("\r\n\r\nX", 5) == ChainBuffer::kNPos);
+
+    ChainBuffer request;
+    request.Splice(received, received.Find("\r\n\r\n", 4) + 4);
+    SSASSERT(request.Size() == 27 && received.Size() == 22 && received.SegmentsCount() == 2);
+    char out[64];
+    SSASSERT(received.ReadData(out, 64) == 22 && memcmp(out, "GET /next HTTP/1.1\r\n\r\n", 22) == 0);
+
+    ChainBuffer response;
+    response.PushData("body", 4);
+    ChainBuffer header;
+    header.PushData("200 OK\r\n", 8);
+    response.Prepend(std::move(header));
+    response.PushData("!", 1); // Fills the last segment in place
+    SSASSERT(header.Empty() && response.SegmentsCount() == 2 && response.Size() == 13);
+    BufferSpan spans[4];
+    SSASSERT(response.GetReadableSpans(spans, 4) == 2 && spans[0].size == 8 && memcmp(spans[1].data, "body!", 5) == 0);
+    response.Append(std::move(request));
+    response.Skip(10);
+    SSASSERT(response.ReadData(out, 5) == 5 && memcmp(out, "dy!GE", 5) == 0 && response.Find("Host", 4) == 19);
+
+    response.Clear();
+    SSASSERT(released == 0);
+    received.Clear();
+    SSASSERT(released == 1);
+    return true;
+}
+
+} // namespace TestChainBuffer
@@ -262,6 +262,7 @@ bool test()
     SSASSERT(cwd + "/a/b/c" == FileSystem::GetAbsolutePath("a/b/c"));
     SSASSERT(FileSystem::GetParent(cwd) == FileSystem::GetAbsolutePath("a/../a/b/c/../../../.."));
 
+    SSASSERT(FileSystem::NormalizePath(String(L"数据\\\\日志//今天/")) == String(L"数据/日志/今天"));
     SSASSERT(FileSystem::GetFileName("../..") == "..");
     SSASSERT(FileSystem::GetFileName("../../name") == "name");
     SSASSERT(FileSystem::GetFileExtName("../../name.txt.gz") == "gz");
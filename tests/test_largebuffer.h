@@ -0,0 +1,39 @@
+//
+// Copyright (c) 2020 Carl Chen. All rights reserved.
+//
+
+#pragma once
+
+#include <SSBase/Assert.h>
+#include <SSBase/LargeBuffer.h>
+#include <cstring>
+#include <vector>
+
+namespace TestLargeBuffer {
+
+bool test()
+{
+    using namespace ss;
+    LargeBuffer large;
+    std::vector<uint8_t> chunk(1024 * 1024);
+    for (int i = 0; i < 24; ++i) {
+        memset(chunk.data(), 'a' + i, chunk.size());
+        large.PushData(chunk.data(), chunk.size());
+    }
+    SSASSERT(large.Size() == 24u * 1024 * 1024 && large.Capacity() >= large.Size() && large.Capacity() % 4096 == 0);
+    SSASSERT(large.GetData<uint8_t>()[0] == 'a' && large.GetEndPtr<uint8_t>()[-1] == 'a' + 23);
+    large.Skip(20u * 1024 * 1024);
+    large.Shrink(); // The consumed pages are given back
+    SSASSERT(large.GetData<uint8_t>()[0] == 'a' + 20 && large.Size() == 4u * 1024 * 1024);
+#ifdef SS_PLATFORM_LINUX
+    large.Reset(0, 24u * 1024 * 1024);
+    SSASSERT(large.GetData<uint8_t>()[0] == 0 && large.GetData<uint8_t>()[20u * 1024 * 1024] == 'a' + 20);
+#endif
+    LargeBuffer moved(std::move(large));
+    moved.Reset(20u * 1024 * 1024, 4u * 1024 * 1024);
+    uint8_t out[16];
+    SSASSERT(large.Capacity() == 0 && moved.ReadData(out, 16) == 16 && out[15] == 'a' + 20 && moved.FreeSpaceSize() == moved.Capacity() - 24u * 1024 * 1024);
+    return true;
+}
+
+} // namespace TestLargeBuffer
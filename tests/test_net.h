@@ -215,6 +215,8 @@ void test_AsyncTcpSocket_client()
 
             client->Send("bye", 3, [](int status) { SSASSERT(status == 0); });
         });
+        bool emptySent = false; // An empty chain is not written, the callback is called at once
+        SSASSERT(client->Send(ChainBuffer(), [&emptySent](int status) { emptySent = status == 0; }) == 0 && emptySent);
         client->Send("Hello, world!", 13, [](int status) { SSASSERT(status == 0); });
     };
     SSASSERT(0 == client->Connect("127.0.0.1", 1234, cb));
@@ -0,0 +1,99 @@
+//
+// Copyright (c) 2020 Carl Chen. All rights reserved.
+//
+
+#pragma once
+
+#include <SSBase/Assert.h>
+#include <SSBase/ObjectPool.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+namespace TestObjectPool {
+
+bool test()
+{
+    using namespace ss;
+    struct Request {
+        std::vector<char> body;
+        int uses = 0;
+    };
+    std::atomic<uint64_t> created(0);
+    ObjectPool<Request, MultiThreadPolicy>::Hooks hooks;
+    hooks.onCreate = [&created](Request* r) {
+        ++created;
+        r->body.reserve(64);
+    };
+    hooks.onReset = [](Request* r) { r->body.clear(); };
+    {
+        ObjectPool<Request, MultiThreadPolicy> pool(256, hooks);
+        std::vector<std::thread> threads;
+        for (int t = 0; t < 4; ++t) {
+            threads.emplace_back([&pool] {
+                // More than a thread caches, so batches go through the depot
+                Request* held[40];
+                for (int round = 0; round < 1000; ++round) {
+                    for (auto& r : held) {
+                        r = pool.Get();
+                        SSASSERT(r->body.empty() && r->body.capacity() >= 64);
+                        r->body.push_back('x');
+                        ++r->uses;
+                    }
+                    for (auto* r : held) {
+                        pool.Put(r);
+                    }
+                }
+            });
+        }
+        for (auto& thread : threads) {
+            thread.join();
+        }
+        auto stats = pool.GetStats();
+        SSASSERT(stats.hits + stats.misses == 4 * 1000 * 40 && stats.misses == created);
+        SSASSERT(stats.spills > 0 && stats.hits > 100 * stats.misses);
+
+        // Put back by another thread, the caches of the exited threads are in the depot
+        Request* r = pool.Get();
+        SSASSERT(r->uses > 1);
+        std::thread([&pool, r] { pool.Put(r); }).join();
+        SSASSERT(pool.GetStats().misses == stats.misses);
+    }
+    {
+        // The depot keeps `capacity` objects, not whole batches, and the objects dropped are not reset
+        std::atomic<int> resets(0);
+        hooks.onReset = [&resets](Request*) { ++resets; };
+        {
+            ObjectPool<Request, MultiThreadPolicy> pool(20, hooks);
+            std::thread([&pool] {
+                std::vector<Request*> held;
+                for (int i = 0; i < 100; ++i) {
+                    held.push_back(pool.Get());
+                }
+                for (auto* r : held) {
+                    pool.Put(r);
+                }
+            }).join();
+            std::vector<Request*> held;
+            for (int i = 0; i < 40; ++i) {
+                held.push_back(pool.Get());
+            }
+            auto stats = pool.GetStats();
+            SSASSERT(stats.hits == 20 && stats.misses == 120 && stats.drops == 80);
+            for (auto* r : held) {
+                pool.Put(r);
+            }
+        }
+        resets = 0;
+        ObjectPool<Request> pool(1, { nullptr, hooks.onReset });
+        Request* a = pool.Get();
+        Request* b = pool.Get();
+        pool.Put(a);
+        pool.Put(b);
+        SSASSERT(resets == 1 && pool.GetStats().drops == 1);
+        pool.Put(pool.Get());
+    }
+    return true;
+}
+
+} // namespace TestObjectPool
@@ -0,0 +1,45 @@
+//
+// Copyright (c) 2020 Carl Chen. All rights reserved.
+//
+
+#pragma once
+
+#include <SSBase/Assert.h>
+#include <SSBase/Buffer.h>
+#include <cstring>
+
+namespace TestRingBuffer {
+
+bool test()
+{
+    using namespace ss;
+    RingBuffer ring(8);
+    BufferSpan spans[2];
+    char out[64];
+    ring.PushData("abcdef", 6);
+    ring.Skip(4);
+    ring.PushData("ghij", 4); // Wraps around without moving "ef"
+    SSASSERT(ring.Capacity() == 8 && ring.Size() == 6 && ring[0] == 'e' && ring[5] == 'j');
+    SSASSERT(ring.GetReadableSpans(spans) == 2 && spans[0].size == 4 && spans[1].size == 2);
+    SSASSERT(ring.GetWritableSpans(spans) == 1 && spans[0].size == 2 && spans[0].data[-1] == 'j');
+    memcpy(spans[0].data, "kl", 2);
+    ring.Commit(2);
+    SSASSERT(ring.Full() && ring.ReadData(out, 64) == 8 && memcmp(out, "efghijkl", 8) == 0);
+
+    // Growing copies the shorter span only, the order is kept
+    ring.PushData("0123456789", 10);
+    SSASSERT(ring.Capacity() == 32 && ring.ReadData(out, 64) == 18 && memcmp(out, "efghijkl0123456789", 18) == 0);
+    ring.Skip(15);
+    ring.PushData("abcdefghijklmnopqrstuvwxyz", 26);
+    SSASSERT(ring.Capacity() == 32 && ring.Size() == 29 && ring.GetReadableSpans(spans) == 2);
+    uint8_t* data = ring.Linearize();
+    SSASSERT(memcmp(data, "789abcdefghijklmnopqrstuvwxyz", 29) == 0 && ring.GetReadableSpans(spans) == 1);
+
+    RingBuffer moved(std::move(ring));
+    SSASSERT(ring.Empty() && ring.Capacity() == 0 && moved.Size() == 29 && moved[3] == 'a');
+    moved.Skip(29);
+    SSASSERT(moved.Empty() && moved.GetReadableSpans(spans) == 0 && moved.GetWritableSpans(spans) == 1);
+    return true;
+}
+
+} // namespace TestRingBuffer
@@ -0,0 +1,67 @@
+//
+// Copyright (c) 2020 Carl Chen. All rights reserved.
+//
+
+#pragma once
+
+#include <SSBase/Assert.h>
+#include <SSBase/ChainBuffer.h>
+#include <SSBase/Format.h>
+#include <SSBase/SharedBuffer.h>
+#include <cstring>
+#include <functional>
+#include <thread>
+#include <vector>
+
+namespace TestSharedBuffer {
+
+bool test()
+{
+    using namespace ss;
+    DynamicBuffer body;
+    FormatTo(body, "event: {}\ndata: {}\n\n", "tick", 42);
+    SharedBuffer payload(std::move(body)); // Taken over without copying
+    SSASSERT(body.Empty() && payload.Size() == 22 && payload.UseCount() == 1);
+
+    // Pending sends on many connections, each holds a reference until its callback is gone
+    std::vector<std::function<void()>> pending;
+    for (int i = 0; i < 1000; ++i) {
+        BufferSlice slice = payload;
+        pending.emplace_back([slice] { SSASSERT(slice.Size() == 22); });
+    }
+    SSASSERT(payload.UseCount() == 1001);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; ++t) {
+        threads.emplace_back([&pending, t] {
+            for (size_t i = t; i < pending.size(); i += 4) {
+                pending[i]();
+                pending[i] = nullptr;
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    SSASSERT(payload.UseCount() == 1);
+
+    BufferSlice data = payload.Slice(12, 8);
+    SSASSERT(memcmp(data.Data(), "data: 42", 8) == 0 && data.SubSlice(6).Size() == 2 && data.Buffer().Data() == payload.Data());
+    ChainBuffer chain;
+    chain.PushData("id: 1\n", 6);
+    chain.Append(payload);
+    chain.Append(data.SubSlice(6));
+    SSASSERT(chain.Size() == 30 && chain.SegmentsCount() == 3 && payload.UseCount() == 4 && chain.Find("\n\n42", 4) == 26);
+    payload = SharedBuffer();
+    chain.Clear();
+    SSASSERT(data.Size() == 8 && data.Buffer().UseCount() == 1 && data.Data()[7] == '2');
+
+    bool released = false;
+    static const char kBanner[] = "welcome";
+    BufferSlice banner = SharedBuffer(kBanner, 7, [&released] { released = true; }).Slice(0, 4);
+    BufferSlice copied = SharedBuffer(banner.Data(), banner.Size());
+    banner = BufferSlice();
+    SSASSERT(released && copied.Size() == 4 && memcmp(copied.Data(), "welc", 4) == 0);
+    return true;
+}
+
+} // namespace TestSharedBuffer
@@ -4,6 +4,7 @@
 
 #pragma once
 
+#include <SSBase/Format.h>
 #include <SSBase/Ptr.h>
 #include <SSIO/stream/BufferedInputStream.h>
 #include <SSIO/stream/BufferedOutputStream.h>
@@ -12,6 +13,51 @@
 
 namespace TestStream {
 
+/// Takes at most `limit_` bytes per vectored write, like a socket whose send buffer is full
+class ShortOutputStream : public ss::OutputStream {
+public:
+    explicit ShortOutputStream(uint32_t limit)
+        : limit_(limit)
+    {
+    }
+
+    int Write(uint8_t byte) override
+    {
+        data_ += char(byte);
+        return byte;
+    }
+
+    int32_t WriteSpans(const ss::BufferSpan* spans, uint32_t count) override
+    {
+        uint32_t written = 0;
+        for (uint32_t i = 0; i < count && written < limit_; ++i) {
+            uint32_t n = spans[i].size < limit_ - written ? spans[i].size : limit_ - written;
+            data_.append(reinterpret_cast<const char*>(spans[i].data), n);
+            written += n;
+        }
+        return int32_t(written);
+    }
+
+    void Close() override
+    {
+    }
+
+    bool IsValid() const override
+    {
+        return true;
+    }
+
+    int32_t Flush() override
+    {
+        return 0;
+    }
+
+    std::string data_;
+
+private:
+    uint32_t limit_;
+};
+
 bool test(int argc, char** argv)
 {
     using namespace ss;
@@ -28,6 +74,35 @@ bool test(int argc, char** argv)
         }
     }
 
+    {
+        auto formatted = MakeShared<FileOutputStream>(argv[0] + String(".format"));
+        SSASSERT(FormatTo(*formatted, "{} {}={:.3f}\n", String("常数"), "pi", 3.14159) == 16);
+        formatted->Close();
+        SSASSERT(MakeShared<FileInputStream>(argv[0] + String(".format"))->ReadAll() == "常数 pi=3.142\n");
+    }
+
+    {
+        ChainBuffer chain;
+        chain.PushData("body", 4);
+        DynamicBuffer header;
+        FormatTo(header, "length={}\n", 4);
+        chain.Prepend(std::move(header));
+        auto chained = MakeShared<FileOutputStream>(argv[0] + String(".chain"));
+        chained->Write('>');
+        SSASSERT(WriteTo(*chained, chain) == 13 && chain.Size() == 13);
+        chained->Close();
+        SSASSERT(MakeShared<FileInputStream>(argv[0] + String(".chain"))->ReadAll() == ">length=4\nbody");
+
+        // More segments than a vectored write takes, the writing stops at the short write of the first batch
+        ChainBuffer segments;
+        for (int i = 0; i < 100; ++i) {
+            segments.AppendReference("0123456789", 10, [] {});
+        }
+        ShortOutputStream shortStream(25);
+        SSASSERT(segments.SegmentsCount() == 100 && WriteTo(shortStream, segments) == 25);
+        SSASSERT(shortStream.data_ == "0123456789012345678901234");
+    }
+
     SharedPtr<FileInputStream> fis2 = MakeShared<FileInputStream>(__FILE__);
     std::string code = fis2->ReadAll();
     std::cout << code << std::endl;
@@ -5,8 +5,17 @@
 #pragma once
 
 #include <SSBase/Assert.h>
+#include <SSBase/Convert.h>
+#include <SSBase/FlatHashMap.h>
+#include <SSBase/Format.h>
+#include <SSBase/InternedString.h>
 #include <SSBase/Str.h>
+#include <SSBase/Utf8String.h>
+#include <cmath>
+#include <limits>
 #include <set>
+#include <thread>
+#include <unordered_set>
 
 namespace TestString {
 
@@ -156,7 +165,466 @@ bool test()
         result = fmt.Format(3.14159);
         SSASSERT(result == "PI is '3.14'");
     }
+    {
+        // Short strings are stored inline, and become heap strings when they grow
+        String shortStr = "abc";
+        SSASSERT(shortStr.Capacity() >= String::kInlineCapacity);
+        String moved = std::move(shortStr);
+        SSASSERT(moved == "abc" && shortStr.Empty());
+        shortStr = "xyz";
+        StringView sv = shortStr.SubStringView(1);
+        shortStr += "0123456789";
+        SSASSERT(shortStr.Capacity() > String::kInlineCapacity);
+        SSASSERT(sv == "yz");
+        shortStr += shortStr;
+        SSASSERT(shortStr == "xyz0123456789xyz0123456789");
+        moved = std::move(shortStr);
+        SSASSERT(moved == "xyz0123456789xyz0123456789");
+        moved = String("short");
+        SSASSERT(moved == "short");
+    }
+    {
+        // Latin-1, BMP and astral strings are stored at different widths, and compare/search across widths
+        String latin = "caf\xC3\xA9 latin";
+        String bmp = "你好, world";
+        String astral = "\xF0\x9F\x98\x80 smile";
+        SSASSERT(latin.Length() == 10 && latin[3] == 0xE9);
+        SSASSERT(astral.Length() == 7 && astral[0] == 0x1F600);
+        SSASSERT(bmp.Find("world") == 4 && bmp.Find(String("好")) == 1);
+        SSASSERT(String("world") == bmp.SubStringView(4));
+        SSASSERT(latin.Compare(bmp) < 0 && bmp.Compare(astral) < 0);
+        SSASSERT(latin.Hash() == String("caf\xC3\xA9 latin").Hash());
+        StringView sv = latin.SubStringView(0, 4);
+        latin += bmp;
+        latin += astral;
+        SSASSERT(latin == "caf\xC3\xA9 latin你好, world\xF0\x9F\x98\x80 smile");
+        SSASSERT(sv == "caf\xC3\xA9");
+        SSASSERT(latin.ToStdString() == "caf\xC3\xA9 latin你好, world\xF0\x9F\x98\x80 smile");
+        String ascii = "plain";
+        String::CharType* data = ascii.Data();
+        data[0] = 0x4E2D;
+        SSASSERT(ascii == "中lain");
+        String narrow = "narrow";
+        narrow[0] = 'N'; // Stored with the width of the string
+        SSASSERT(narrow == "Narrow" && narrow.Capacity() == String("narrow").Capacity());
+        narrow.At(1) = 0x4E2D;
+        narrow[2] = narrow[0];
+        SSASSERT(narrow == "N中Nrow" && narrow[1] == 0x4E2D && narrow.Capacity() == String("中").Capacity());
+    }
+    {
+        // Long enough to go through the vectorized UTF-8 paths, with sequences crossing the block boundaries
+        std::string utf8;
+        for (int i = 0; i < 50; ++i) {
+            utf8 += "path/to/some/file_" + std::to_string(i) + ".txt;";
+            utf8 += i % 3 == 0 ? "caf\xC3\xA9" : (i % 3 == 1 ? "你好" : "\xF0\x9F\x98\x80");
+        }
+        String s(utf8.c_str());
+        SSASSERT(s.ToStdString() == utf8);
+        SSASSERT(s.GetBytesLength(String::kUtf8) == utf8.length());
+        SSASSERT(String(utf8.c_str(), 40).ToStdString() == utf8.substr(0, 40));
+        String narrow("abcdefghijklmnopqrstuvwxyz0123456789abcdefghijklmnopqrstuvwxyz\xC3\xA9");
+        SSASSERT(narrow.Length() == 63 && narrow[62] == 0xE9 && narrow.ToStdString().length() == 64);
+
+        // Decoding stops at '\0' and invalid lead bytes, and throws on invalid continuation bytes
+        std::string withNul = utf8;
+        withNul[100] = '\0';
+        SSASSERT(String(withNul.c_str(), uint32_t(withNul.length())).ToStdString() == utf8.substr(0, 100));
+        SSASSERT(String("abcdefghijklmnopqrstuvwxyz0123456789\x80tail") == "abcdefghijklmnopqrstuvwxyz0123456789");
+        bool thrown = false;
+        try {
+            String bad("abcdefghijklmnopqrstuvwxyz0123456789\xE4\xBD" "abcdefghijklmnopqrstuvwxyz");
+        } catch (const std::runtime_error&) {
+            thrown = true;
+        }
+        SSASSERT(thrown);
+    }
+    {
+        // Long haystacks go through the vectorized filter, repetitive ones with long needles through Two-Way
+        String text;
+        for (int i = 0; i < 200; ++i) {
+            text += "the quick brown fox jumps over the lazy dog ";
+        }
+        text += "你好, world";
+        SSASSERT(text.Find("你好") == 200 * 44);
+        SSASSERT(text.Find("lazy dog ") == 35);
+        SSASSERT(text.Find("lazy dog ", 36) == 35 + 44);
+        SSASSERT(text.RFind("lazy dog ") == 199 * 44 + 35);
+        SSASSERT(text.Find("over the lazy dog  the quick") == String::kNPos);
+        SSASSERT(text.Find("over the lazy dog 你好") == 199 * 44 + 26);
+        SSASSERT(text.RFind("the quick brown fox jumps over the lazy dog the") == 198 * 44);
+
+        String aaa(std::string(5000, 'a').c_str());
+        String needle = String(std::string(40, 'a').c_str()) + "b" + String(std::string(40, 'a').c_str());
+        SSASSERT(aaa.Find(needle) == String::kNPos && aaa.RFind(needle) == String::kNPos);
+        String withNeedle = aaa + needle + aaa;
+        SSASSERT(withNeedle.Find(needle) == 5000 && withNeedle.RFind(needle) == 5000);
+
+        Searcher searcher(needle);
+        SSASSERT(searcher.Find(withNeedle) == 5000 && searcher.Find(withNeedle, 5001) == String::kNPos);
+        SSASSERT(searcher.RFind(withNeedle) == 5000 && searcher.RFind(withNeedle, 5080) == String::kNPos);
+        Searcher wide(String("你好"));
+        SSASSERT(wide.Find(text) == 200 * 44 && wide.Find(aaa) == String::kNPos);
+        std::vector<String> parts = text.Split("lazy dog ");
+        SSASSERT(parts.size() == 201 && parts[1] == "the quick brown fox jumps over the ");
+    }
+    {
+        // Copies of long strings share the storage until one is modified, views keep the storage alive
+        String original = "copy on write, copy on write, copy on write";
+        String copy = original;
+        String assigned;
+        assigned = copy;
+        copy += "!";
+        assigned.ToUpper();
+        SSASSERT(original == "copy on write, copy on write, copy on write");
+        SSASSERT(copy == "copy on write, copy on write, copy on write!");
+        SSASSERT(assigned == "COPY ON WRITE, COPY ON WRITE, COPY ON WRITE");
+
+        String shared = original;
+        StringView view = original.SubStringView(5, 2);
+        view[0] = 'O';
+        SSASSERT(original.StartsWith("copy On") && shared.StartsWith("copy on"));
+        String withView = original;
+        view[1] = 'N';
+        SSASSERT(original.StartsWith("copy ON") && withView.StartsWith("copy On"));
+        String exposed = shared;
+        String::CharType* chars = exposed.Data();
+        String copyOfExposed = exposed;
+        chars[0] = 'C';
+        SSASSERT(exposed.StartsWith("Copy on") && copyOfExposed.StartsWith("copy on") && shared.StartsWith("copy on"));
+
+        std::vector<StringView> views;
+        {
+            String temp = original + original;
+            temp.Split(String(", "), views);
+            view = temp.SubStringView(0, 4);
+            temp += temp; // Reallocates
+        }
+        SSASSERT(views.size() == 5 && views[4] == "copy on write" && view == "copy");
+        std::vector<StringView> temporaryViews = String("a, temporary, string on the heap, to, split").Split(", ");
+        SSASSERT(temporaryViews.size() == 5 && temporaryViews[1] == "temporary");
+
+        // Views of a const string leave it as it is, and can not write the copies sharing its storage
+        const String constCopy = copy;
+        const String& constShort = shared.SubString(0, 4);
+        StringView readOnly = constCopy.SubStringView(0, 4);
+        StringView borrowed = constShort.SubStringView(1);
+        SSASSERT(readOnly == "copy" && borrowed == "opy" && constShort.Capacity() == String("copy").Capacity());
+        bool thrown = false;
+        try {
+            readOnly[0] = 'C';
+        } catch (const std::runtime_error&) {
+            thrown = true;
+        }
+        SSASSERT(thrown && copy.StartsWith("copy") && constCopy.StartsWith("copy"));
+    }
+    {
+        // Interned strings compare by pointer and keep the hash of the string
+        InternedString a("header-key");
+        InternedString b(String("header-") + "key");
+        InternedString c("other-key");
+        SSASSERT(a == b && a != c && InternedString() == InternedString(""));
+        SSASSERT(a.GetString() == "header-key" && a.Hash() == String("header-key").Hash());
+        std::unordered_set<InternedString> atoms = { a, b, c };
+        SSASSERT(atoms.size() == 2);
+
+        InternTable table(4, false);
+        InternedString local(String("header-key"), table);
+        SSASSERT(local != a && local.GetString() == a.GetString());
+        InternedString found;
+        SSASSERT(table.Lookup(String("header-key"), found) && found == local);
+        SSASSERT(!table.Lookup(String("missing"), found) && table.Size() == 1);
+
+        InternTable shared;
+        std::vector<std::thread> threads;
+        std::vector<std::vector<InternedString>> results(4);
+        for (int t = 0; t < 4; ++t) {
+            threads.emplace_back([&shared, &results, t] {
+                for (int i = 0; i < 1000; ++i) {
+                    results[t].push_back(shared.Intern(String(std::to_string(i).c_str()) + ".txt"));
+                }
+            });
+        }
+        for (auto& thread : threads) {
+            thread.join();
+        }
+        SSASSERT(shared.Size() == 1000);
+        for (int t = 1; t < 4; ++t) {
+            SSASSERT(results[t] == results[0]);
+        }
+    }
+
+    {
+        // The hash does not depend on the width nor on how the string is given
+        String narrow("hash me");
+        String wide("hash me");
+        wide.Data(); // Widened
+        SSASSERT(narrow.Hash() == wide.Hash() && narrow.Hash() != String("hash me!").Hash());
+        String longText;
+        for (int i = 0; i < 300; ++i) {
+            longText += "long 文本 é ";
+        }
+        for (const char* utf8 : { "", "ascii", "Latin-1 é", "中文字符串 with ASCII" }) {
+            SSASSERT(CharSequence::HashUtf8(utf8) == String(utf8).Hash() && String(utf8).Equals(utf8));
+        }
+        std::string longUtf8 = longText.ToStdString();
+        SSASSERT(CharSequence::HashUtf8(longUtf8.c_str()) == longText.Hash() && longText.Equals(longUtf8.c_str()));
+        SSASSERT(!String("abc").Equals("ab") && !String("ab").Equals("abc") && !String("中文").Equals("中"));
+
+        // The cached hash follows modifications
+        String cached = longText;
+        uint64_t hash = cached.Hash();
+        SSASSERT(longText.Hash() == hash);
+        cached[0] = 'L';
+        SSASSERT(cached.Hash() != hash && longText.Hash() == hash);
+        cached[0] = 'l';
+        SSASSERT(cached.Hash() == hash);
+
+        std::unordered_set<String> set = { "a", "b", String("a") };
+        SSASSERT(set.size() == 2);
+
+        // Flat containers are looked up by any kind of string
+        FlatHashMap<String, int> map;
+        for (int i = 0; i < 1000; ++i) {
+            map[String(std::to_string(i).c_str())] = i;
+        }
+        SSASSERT(map.Size() == 1000 && map["999"] == 999 && map.Find("1000") == map.end());
+        String key("key 42 value");
+        SSASSERT(map.Find(key.SubStringView(4, 2))->second == 42 && map.Contains(String("42")));
+        SSASSERT(!map.TryEmplace("42", 0).second && map.TryEmplace("1000", 1000).second);
+        for (int i = 0; i < 1000; i += 2) {
+            SSASSERT(map.Erase(std::to_string(i).c_str()) == 1);
+        }
+        SSASSERT(map.Size() == 501 && !map.Contains("0") && map.Contains("1") && map.Erase("0") == 0);
+        int sum = 0;
+        for (auto& pair : map) {
+            sum += pair.second;
+        }
+        SSASSERT(sum == 250000 + 1000);
+        FlatHashMap<String, int> copy = map;
+        map.Clear();
+        SSASSERT(map.Empty() && copy.Size() == 501 && copy["999"] == 999);
 
+        FlatHashSet<String> words = { "hello", "world", "hello" };
+        SSASSERT(words.Size() == 2 && words.Contains("world") && !words.Insert("world").second);
+        FlatHashSet<int> numbers = { 1, 2, 3 };
+        SSASSERT(numbers.Contains(2) && numbers.Erase(2) == 1 && !numbers.Contains(2));
+    }
+
+    {
+        // Unicode classification and case mapping
+        SSASSERT(String::IsWhiteSpace(0x85) && String::IsWhiteSpace(0x3000) && !String::IsWhiteSpace(0x200B));
+        SSASSERT(String::IsAlpha(L'é') && String::IsAlpha(L'中') && !String::IsAlpha('1'));
+        SSASSERT(String::IsUpper(L'Ω') && String::IsLower(L'ω') && String::ToLower(L'Ω') == L'ω');
+        String mixed("Ünïcödé ÿ straße ΑΒΓ Привет and some ASCII text long enough for the vector path");
+        SSASSERT(mixed.CopyToUpper() == "ÜNÏCÖDÉ Ÿ STRAßE ΑΒΓ ПРИВЕТ AND SOME ASCII TEXT LONG ENOUGH FOR THE VECTOR PATH");
+        SSASSERT(mixed.CopyToLower() == "ünïcödé ÿ straße αβγ привет and some ascii text long enough for the vector path");
+
+        // Case insensitive comparison and hash
+        String upper = mixed.CopyToUpper();
+        SSASSERT(mixed.CompareIgnoreCase(upper) == 0 && mixed.HashIgnoreCase() == upper.HashIgnoreCase());
+        SSASSERT(String("Content-Length").CompareIgnoreCase("content-lengtg") > 0);
+        SSASSERT(String("\u212A").CompareIgnoreCase("k") == 0); // Kelvin sign
+        String wide("content-type: text/html");
+        wide.Data(); // Widened
+        SSASSERT(wide.HashIgnoreCase() == String("Content-Type: TEXT/HTML").HashIgnoreCase());
+        String longText;
+        for (int i = 0; i < 200; ++i) {
+            longText += "Some Text é ";
+        }
+        SSASSERT(longText.CopyToUpper().HashIgnoreCase() == longText.HashIgnoreCase());
+        SSASSERT(longText.HashIgnoreCase() != String(longText + "x").HashIgnoreCase());
+
+        FlatHashMap<String, int, StringHashIgnoreCase, StringEqualIgnoreCase> headers;
+        headers[String("Content-Length")] = 1;
+        headers[String("HOST")] = 2;
+        SSASSERT(headers.Find(String("content-length"))->second == 1 && headers.Contains(String("Host")));
+    }
+
+    {
+        // Concatenations are evaluated at once into a string of the right size
+        String dir("/usr/local/share/applications");
+        String name("a-desktop-entry-with-a-long-name");
+        String path = dir + "/" + name + '.' + L"desktop";
+        SSASSERT(path == "/usr/local/share/applications/a-desktop-entry-with-a-long-name.desktop");
+        SSASSERT(path.Capacity() == path.Length());
+        SSASSERT("[" + dir.SubStringView(1, 3) + "] " + String("中文") == "[usr] 中文");
+        SSASSERT(dir + "/" != dir && dir + "/" > dir && dir < dir + "/");
+
+        // A temporary on the left is appended to in place
+        String reserved;
+        reserved.Reserve(256);
+        reserved += dir;
+        String appended = std::move(reserved) + "/" + name;
+        SSASSERT(appended.Capacity() == 256 && appended == dir + "/" + name);
+
+        StringBuilder builder(64);
+        builder.Append("key", '=', String("value"), L'，');
+        for (int i = 0; i < 3; ++i) {
+            builder << "item" << char('0' + i) << ';';
+        }
+        SSASSERT(builder.Length() == 28 && builder.GetString() == "key=value，item0;item1;item2;");
+        String built = builder.ToString();
+        SSASSERT(built.Length() == 28 && builder.Length() == 0);
+    }
+
+    {
+        // Lazy tokenizing
+        String csv("name,,age,city,");
+        std::vector<String> all = csv.Tokenize(",");
+        SSASSERT(all.size() == 5 && all[1].Empty() && all[4].Empty());
+        std::vector<String> nonEmpty = csv.Tokenize(",", String::kNPos, true);
+        SSASSERT(nonEmpty == std::vector<String>({ "name", "age", "city" }));
+        std::vector<String> limited = csv.Tokenize(",", 2);
+        SSASSERT(limited == std::vector<String>({ "name", "", "age,city," }));
+
+        String words("  split\tby   white\u3000space  ");
+        std::vector<String> tokens = words.Tokenize(StrDelimiter::If(&String::IsWhiteSpace), String::kNPos, true);
+        SSASSERT(tokens == std::vector<String>({ "split", "by", "white", "space" }));
+        std::vector<String> first = words.Tokenize(StrDelimiter::If(&String::IsWhiteSpace), 1, true);
+        SSASSERT(first.size() == 2 && first[0] == "split" && first[1] == "by   white\u3000space  ");
+        std::vector<String> mixed = String("a=1;b=2，c=3").Tokenize(StrDelimiter::AnyOf(String(";，")));
+        SSASSERT(mixed == std::vector<String>({ "a=1", "b=2", "c=3" }));
+        std::vector<String> multi = String("one<->two<->three").Tokenize("<->");
+        SSASSERT(multi.size() == 3 && multi[2] == "three");
+
+        // Stop at the field needed
+        String line("GET /index.html HTTP/1.1");
+        auto fields = line.Tokenize(' ');
+        auto it = fields.begin();
+        ++it;
+        SSASSERT(*it == "/index.html" && it.Offset() == 4 && it.Length() == 11);
+        StringView path = *it; // Borrows the characters of `line`
+        SSASSERT(path.SubStringView(1, 5) == "index" && path.SubStringView(20).Empty());
+        String nothing;
+        StrTokenizer one = nothing.Tokenize(",");
+        StrTokenizer none = nothing.Tokenize(",", String::kNPos, true);
+        SSASSERT(std::distance(one.begin(), one.end()) == 1 && none.begin() == none.end());
+    }
+
+    {
+        int i = -1;
+        SSASSERT(Convert::Parse(String("-2147483648"), i) && i == std::numeric_limits<int>::min());
+        auto r = Convert::Parse(String("12x4"), i);
+        SSASSERT(r.error == Convert::kInvalidChar && r.index == 2 && r.code == 'x' && i == std::numeric_limits<int>::min());
+        SSASSERT(r.Message() == "invalid character 'x' at index 2");
+        SSASSERT(Convert::Parse(String(""), i).error == Convert::kEmpty && Convert::Parse(String("-"), i).error == Convert::kEmpty);
+        uint16_t port = 0;
+        r = Convert::Parse(String("host:65536"), port, 5);
+        SSASSERT(r.error == Convert::kOutOfRange && port == 65535);
+        SSASSERT(Convert::Parse(String("host:8080"), port, 5) && port == 8080);
+        SSASSERT(Convert::Parse(String("-1"), port).error == Convert::kInvalidChar);
+        uint64_t big = 0;
+        SSASSERT(Convert::Parse(String("18446744073709551615"), big) && big == std::numeric_limits<uint64_t>::max());
+        SSASSERT(Convert::Parse(String("18446744073709551616"), big).error == Convert::kOutOfRange);
+        SSASSERT(Convert::Parse(String("000000000000000000000012345678901234567"), big) && big == 12345678901234567ull);
+        // Wide storage is parsed in place
+        SSASSERT(Convert::Parse(String(L"中:42").SubStringView(2), i) && i == 42);
+
+        double d = 0;
+        SSASSERT(Convert::Parse(String("0.1"), d) && d == 0.1);
+        SSASSERT(Convert::Parse(String("-1.5e-3"), d) && d == -1.5e-3);
+        SSASSERT(Convert::Parse(String("2.2250738585072011e-308"), d) && d == 2.2250738585072011e-308);
+        SSASSERT(Convert::Parse(String("123456789012345678901234567890"), d) && d == 123456789012345678901234567890.0);
+        SSASSERT(Convert::Parse(String("-Infinity"), d) && std::isinf(d) && d < 0);
+        SSASSERT(Convert::Parse(String("1e400"), d).error == Convert::kOutOfRange);
+        SSASSERT(Convert::Parse(String("1."), d) && d == 1 && !Convert::Parse(String("1e"), d));
+        float f = 0;
+        SSASSERT(Convert::Parse(String("3.4028235e38"), f) && f == std::numeric_limits<float>::max());
+        double parsed = 0;
+        const char text[] = "6.02214076e23 mol";
+        r = Convert::FromChars(text, text + sizeof(text) - 1, parsed);
+        SSASSERT(r && r.index == 13 && parsed == 6.02214076e23);
+
+        char buffer[32];
+        SSASSERT(Convert::ToChars(buffer, buffer + 3, -123) == 0);
+        uint32_t n = Convert::ToChars(buffer, buffer + sizeof(buffer), std::numeric_limits<int64_t>::min());
+        SSASSERT(std::string(buffer, n) == "-9223372036854775808");
+        n = Convert::ToChars(buffer, buffer + sizeof(buffer), 0.1);
+        SSASSERT(std::string(buffer, n) == "0.1");
+        for (double v : { 1.0 / 3, 5e-324, 1.7976931348623157e308, -0.0001, 100.0 }) {
+            n = Convert::ToChars(buffer, buffer + sizeof(buffer), v);
+            SSASSERT(Convert::FromChars(buffer, buffer + n, parsed) && parsed == v);
+        }
+
+        String s = "port=";
+        Convert::AppendTo(s, 443);
+        SSASSERT(s == "port=443" && Convert::ToString(-7) == "-7" && Convert::ToString(2.5) == "2.5" && Convert::ToString(3.0f) == "3");
+        SSASSERT(Convert::StringTo<int>("  42abc") == 42 && Convert::StringTo<int>("abc") == 0);
+        SSASSERT(Convert::StringTo<double>(std::string("1.25")) == 1.25);
+    }
+
+    {
+        DynamicBuffer received;
+        const char request[] = "GET /文档/索引.html HTTP/1.1\r\nHost: 例子.cn\r\n\r\n";
+        received.PushData(request, sizeof(request) - 1);
+        Utf8View view(received);
+        SSASSERT(view.Data() == received.GetData<char>() && view.Size() == sizeof(request) - 1 && view.IsValid());
+        SSASSERT(view.StartsWith("GET ") && view.EndsWith("\r\n\r\n") && view.Contains("索引"));
+        SSASSERT(view.Find("\r\n") == 32 && view.RFind("\r\n") == view.Size() - 2 && view.Find(U'例') == 40);
+        std::vector<Utf8View> lines = view.Split("\r\n", Utf8View::kNPos, true);
+        SSASSERT(lines.size() == 2 && lines[1] == "Host: 例子.cn");
+        std::vector<Utf8View> parts = lines[0].Split(" ");
+        SSASSERT(parts.size() == 3 && parts[1] == "/文档/索引.html" && parts[1].Length() == 11);
+        std::vector<Utf8View> path = parts[1].Split("/", 1);
+        SSASSERT(path.size() == 2 && path[0].Empty() && path[1] == "文档/索引.html");
+        SSASSERT(Utf8View("a") < Utf8View("é") && Utf8View("é") < Utf8View("中") && Utf8View("中") < Utf8View("😀"));
+        SSASSERT(parts[1].Hash() == String("/文档/索引.html").Hash() && parts[1].ToString() == "/文档/索引.html");
+
+        std::u32string codes;
+        for (uint32_t c : Utf8View("a中😀\xFF").CodePoints()) {
+            codes.push_back(c);
+        }
+        SSASSERT(codes == U"a中😀�");
+        SSASSERT(!Utf8View("\xC0\xAF").IsValid() && !Utf8View("\xED\xA0\x80").IsValid() && !Utf8View("\xE4\xB8").IsValid());
+
+        Utf8String owned(std::move(received));
+        SSASSERT(owned == view && owned.Data() == view.Data() && received.Size() == 0);
+        Utf8String s(String("Ünïcode"));
+        SSASSERT(s == "Ünïcode" && s.Length() == 7 && s.Size() == 9);
+        s.Append(U'✓');
+        s += s.SubView(0, 2);
+        SSASSERT(s == "Ünïcode✓Ü");
+        Utf8String copy = s;
+        s.Clear();
+        SSASSERT(s.Empty() && copy == "Ünïcode✓Ü");
+        DynamicBuffer out = copy.Release();
+        SSASSERT(copy.Empty() && Utf8View(out) == "Ünïcode✓Ü");
+    }
+
+    {
+        String s("id=");
+        s.Reserve(64);
+        FormatTo(s, "{:04d}, name={}, score={:.1f}", 7, String("张三"), 92.25);
+        SSASSERT(s == "id=0007, name=张三, score=92.2");
+        FormatTo(s, fmt::compile<int, StringView>("; {}:{}"), 8, String("李四").SubStringView(1));
+        SSASSERT(s == "id=0007, name=张三, score=92.2; 8:四");
+        FormatTo(s, String("; {}"), Utf8View("王五"));
+        SSASSERT(s.EndsWith(String("; 王五")));
+
+        // Straight into the free space of a buffer, which grows in place
+        DynamicBuffer buffer(8);
+        buffer.PushData("HTTP", 4);
+        FormatTo(buffer, "/1.1 {} {}\r\n", 200, "OK");
+        String longName(L"名字很长的字段");
+        for (int i = 0; i < 100; ++i) {
+            FormatTo(buffer, fmt::compile<String, int>("{}: {}\r\n"), longName, i);
+        }
+        Utf8View text(buffer);
+        SSASSERT(text.StartsWith("HTTP/1.1 200 OK\r\n名字很长的字段: 0\r\n") && text.EndsWith("名字很长的字段: 99\r\n"));
+        SSASSERT(text.Split("\r\n", Utf8View::kNPos, true).operator std::vector<Utf8View>().size() == 101);
+        uint32_t size = buffer.Size();
+        bool thrown = false;
+        try {
+            FormatTo(buffer, "{:d}", "not a number");
+        } catch (const fmt::format_error&) {
+            thrown = true;
+        }
+        SSASSERT(thrown && buffer.Size() == size);
+
+        String name = "Alice";
+        String greeting = String("Hello, {}! {}").Format(name, std::string(300, '!'));
+        SSASSERT(greeting.Length() == 14 + 300 && greeting.StartsWith(String("Hello, Alice! !!!")));
+    }
     return true;
 }
 
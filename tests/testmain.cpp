@@ -2,8 +2,16 @@
 // Copyright (c) 2020 Carl Chen. All rights reserved.
 //
 #include "test_archive.h"
+#include "test_arena.h"
+#include "test_bufferallocator.h"
+#include "test_bytesearch.h"
+#include "test_chainbuffer.h"
 #include "test_filesystem.h"
+#include "test_largebuffer.h"
 #include "test_net.h"
+#include "test_objectpool.h"
+#include "test_ringbuffer.h"
+#include "test_sharedbuffer.h"
 #include "test_stream.h"
 #include "test_string.h"
 #include "testrefcounter.h"
@@ -11,10 +19,39 @@
 
 int main(int argc, char** argv)
 {
+    if (argc > 1 && std::string(argv[1]) == "--bench") {
+        TestRefCount::bench_refcounter();
+        return 0;
+    }
+
     TestString::test();
 
+    TestArena::test();
+
+    TestRingBuffer::test();
+
+    TestChainBuffer::test();
+
+    TestBufferAllocator::test();
+
+    TestSharedBuffer::test();
+
+    TestLargeBuffer::test();
+
+    TestByteSearch::test();
+
+    TestObjectPool::test();
+
     TestRefCount::test_refcounter();
 
+    TestRefCount::test_weak_block();
+
+    TestRefCount::test_refcounter_threads();
+
+    TestRefCount::test_atomic_shared_ptr();
+
+    TestRefCount::test_pooled();
+
     TestFileSystem::test();
 
     TestStream::test(argc, argv);
@@ -4,11 +4,18 @@
 
 #pragma once
 
+#include <SSBase/AtomicSharedPtr.h>
 #include <SSBase/Object.h>
+#include <SSBase/ObjectPool.h>
 #include <SSBase/Ptr.h>
+#include <SSBase/Str.h>
+#include <atomic>
+#include <chrono>
 #include <iostream>
 #include <sstream>
 #include <string>
+#include <thread>
+#include <vector>
 
 namespace TestRefCount {
 
@@ -44,6 +51,242 @@ public:
 class D : public ss::RefCounted {
 };
 
+std::atomic<int> gDestructed(0);
+
+class Shared : public ss::RefCounted {
+public:
+    using RefCountPolicy = ss::MultiThreadPolicy;
+
+    ~Shared() override
+    {
+        value_ = -1;
+        ++gDestructed;
+    }
+
+    int value_ = 1;
+};
+
+class Local : public ss::RefCounted {
+public:
+    int value_ = 1;
+};
+
+void test_weak_block()
+{
+    {
+        ss::SharedPtr<Shared> a = ss::MakeShared<Shared>();
+        ss::SharedPtr<Shared> b = a;
+        // The shared count moves to the weak block in the middle of the life
+        ss::WeakPtr<Shared> weak = b;
+        ss::WeakPtr<Shared> again = a;
+        SSASSERT(weak == again && weak.Lock() == a);
+        a = nullptr;
+        SSASSERT(weak.Lock()->value_ == 1 && gDestructed == 0);
+        b = nullptr;
+        SSASSERT(weak.Lock() == nullptr && gDestructed == 1);
+    }
+    {
+        // A copy is another object
+        ss::SharedPtr<Local> a = ss::MakeShared<Local>();
+        ss::WeakPtr<Local> weak = a;
+        ss::SharedPtr<Local> b = ss::MakeShared<Local>(*a);
+        SSASSERT(a != b && weak.Lock() == a);
+        a = nullptr;
+        SSASSERT(weak.Lock() == nullptr && b->value_ == 1);
+    }
+    gDestructed = 0;
+}
+
+void test_refcounter_threads()
+{
+    {
+        ss::SharedPtr<Shared> shared = ss::MakeShared<Shared>();
+        std::vector<std::thread> threads;
+        for (int t = 0; t < 4; ++t) {
+            threads.emplace_back([shared] {
+                for (int i = 0; i < 100000; ++i) {
+                    ss::SharedPtr<Shared> copy = shared;
+                    ss::WeakPtr<Shared> weak = copy;
+                    SSASSERT(weak.Lock()->value_ == 1);
+                }
+            });
+        }
+        for (auto& thread : threads) {
+            thread.join();
+        }
+        SSASSERT(gDestructed == 0);
+    }
+    SSASSERT(gDestructed == 1);
+
+    // The last reference is released while another thread locks the weak one
+    for (int i = 0; i < 200; ++i) {
+        ss::SharedPtr<Shared> shared = ss::MakeShared<Shared>();
+        ss::WeakPtr<Shared> weak = shared;
+        std::thread locker([weak] {
+            for (;;) {
+                ss::SharedPtr<Shared> locked = weak.Lock();
+                if (locked == nullptr) {
+                    break;
+                }
+                SSASSERT(locked->value_ == 1);
+            }
+        });
+        std::this_thread::yield();
+        shared = nullptr;
+        locker.join();
+    }
+    SSASSERT(gDestructed == 201);
+}
+
+std::atomic<int> gTables(0);
+
+class RoutingTable : public ss::RefCounted {
+public:
+    using RefCountPolicy = ss::MultiThreadPolicy;
+
+    explicit RoutingTable(int version)
+        : version_(version)
+        , check_(version * 7)
+    {
+        ++gTables;
+    }
+
+    ~RoutingTable() override
+    {
+        version_ = -1;
+        --gTables;
+    }
+
+    bool Valid() const
+    {
+        return version_ >= 0 && check_ == version_ * 7;
+    }
+
+    int version_;
+    int check_;
+};
+
+void test_atomic_shared_ptr()
+{
+    {
+        ss::AtomicSharedPtr<RoutingTable> table(ss::MakeShared<RoutingTable>(0));
+        std::atomic<bool> done(false);
+        std::vector<std::thread> readers;
+        for (int t = 0; t < 3; ++t) {
+            readers.emplace_back([&table, &done, t] {
+                int last = 0;
+                while (!done.load()) {
+                    if (t == 0) {
+                        // Keeps a reference beyond the guard
+                        ss::SharedPtr<RoutingTable> held = table.Load();
+                        SSASSERT(held->Valid() && held->version_ >= last);
+                        last = held->version_;
+                    } else {
+                        auto guard = table.Read();
+                        SSASSERT(guard->Valid() && guard->version_ >= last);
+                        last = guard->version_;
+                    }
+                }
+            });
+        }
+        for (int version = 1; version <= 2000; ++version) {
+            if (version % 2 == 0) {
+                table.Store(ss::MakeShared<RoutingTable>(version));
+            } else {
+                ss::SharedPtr<RoutingTable> expected = table.Load();
+                SSASSERT(table.CompareExchange(expected, ss::MakeShared<RoutingTable>(version)));
+            }
+        }
+        done = true;
+        for (auto& reader : readers) {
+            reader.join();
+        }
+
+        ss::SharedPtr<RoutingTable> stale = ss::MakeShared<RoutingTable>(-1);
+        SSASSERT(!table.CompareExchange(stale, ss::MakeShared<RoutingTable>(0)) && stale->version_ == 2000);
+        ss::SharedPtr<RoutingTable> old = table.Exchange(ss::MakeShared<RoutingTable>(2001));
+        SSASSERT(old->version_ == 2000 && table.Read()->version_ == 2001);
+
+        // More guards than the slots of a cache line, nested reads of several tables
+        ss::AtomicSharedPtr<RoutingTable> other(ss::MakeShared<RoutingTable>(7));
+        std::thread([&table, &other] {
+            std::vector<ss::AtomicSharedPtr<RoutingTable>::Guard> guards;
+            for (int i = 0; i < 10; ++i) {
+                guards.push_back(i % 2 == 0 ? table.Read() : other.Read());
+            }
+            other.Store(ss::MakeShared<RoutingTable>(8));
+            SSASSERT(table.Load()->version_ == 2001 && guards[9]->version_ == 7 && other.Read()->version_ == 8);
+        }).join();
+    }
+    // The replaced tables are released once the readers are done
+    SSASSERT(gTables == 0);
+}
+
+class Job : public ss::RefCounted {
+public:
+    explicit Job(int id)
+        : id_(id)
+    {
+    }
+
+    int id_;
+    ss::String name_;
+};
+
+void test_pooled()
+{
+    ss::RefCountedPool<Job> pool(4);
+    auto job = ss::MakePooled(pool, 1);
+    job->name_ = "first";
+    Job* memory = job.Get();
+    ss::WeakPtr<Job> weak = job;
+    job = nullptr; // Back to the pool, the weak reference only keeps the counter
+    SSASSERT(weak.Lock() == nullptr);
+    auto next = ss::MakePooled(pool, 2);
+    SSASSERT(next.Get() == memory && next->id_ == 2 && next->name_.Empty() && weak.Lock() == nullptr);
+    ss::SharedPtr<Job> copy = next;
+    next = nullptr;
+    SSASSERT(copy->id_ == 2);
+    copy = nullptr;
+    auto stats = pool.GetStats();
+    SSASSERT(stats.hits == 1 && stats.misses == 1);
+}
+
+/// Copies of SharedPtr by 4 threads, each on its own object or all on the same one
+template <class T>
+double bench_copies(bool sameObject)
+{
+    const int kCopies = 5000000;
+    ss::SharedPtr<T> same = ss::MakeShared<T>();
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; ++t) {
+        threads.emplace_back([&same, sameObject] {
+            ss::SharedPtr<T> object = sameObject ? same : ss::MakeShared<T>();
+            int sum = 0;
+            for (int i = 0; i < kCopies; ++i) {
+                ss::SharedPtr<T> copy = object;
+                sum += copy->value_;
+            }
+            SSASSERT(sum == kCopies);
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count() / (4.0 * kCopies);
+}
+
+/// Run with --bench
+void bench_refcounter()
+{
+    std::cout << "SharedPtr copy, 4 threads, ns per copy" << std::endl;
+    std::cout << "  non-atomic, own objects: " << bench_copies<Local>(false) << std::endl;
+    std::cout << "  atomic, own objects:     " << bench_copies<Shared>(false) << std::endl;
+    std::cout << "  atomic, same object:     " << bench_copies<Shared>(true) << std::endl;
+}
+
 void test_refcounter()
 {
     {